@@ -0,0 +1,937 @@
+#include <chrono>
+#include <cstring>
+#include <cxxabi.h>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <libsdb/bit.hpp>
+#include <libsdb/breakpoint_condition.hpp>
+#include <libsdb/disassembler.hpp>
+#include <libsdb/elf.hpp>
+#include <libsdb/error.hpp>
+#include <libsdb/index_cache.hpp>
+#include <libsdb/instruction_trace.hpp>
+#include <libsdb/memory_snapshot.hpp>
+#include <libsdb/pipe.hpp>
+#include <libsdb/process.hpp>
+#include <libsdb/profiler.hpp>
+#include <libsdb/target.hpp>
+#include <map>
+#include <memory>
+#include <string_view>
+#include <libsdb/syscalls.hpp>
+#include <sys/ptrace.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// NOTE: when running the benchmarks, the executable expects `targets` in cwd
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  // run `f` once and return how long it took in seconds
+  template <class F>
+  double TimeSeconds(F f) {
+    const auto start = Clock::now();
+    f();
+    const std::chrono::duration<double> elapsed = Clock::now() - start;
+    return elapsed.count();
+  }
+
+  double ToMegabytesPerSecond(const std::size_t bytes, const double seconds) {
+    return static_cast<double>(bytes) / (1024 * 1024) / seconds;
+  }
+
+  // the write path used before bulk writes were introduced: one
+  // PTRACE_POKEDATA per 8-byte word
+  void WriteMemoryWithPokedata(const sdb::Process              &process,
+                               const sdb::VirtualAddress        address,
+                               const sdb::Span<const std::byte> data) {
+    for (std::size_t written = 0; written < data.Size(); written += 8) {
+      const auto word = sdb::FromBytes<std::uint64_t>(data.begin() + written);
+      if (ptrace(PTRACE_POKEDATA, process.GetPid(),
+                 (address + written).GetAddress(), word) == -1) {
+        sdb::Error::SendErrno("Failed to write memory");
+      }
+    }
+  }
+
+  // the symbol address index used before the flat one: a std::map of
+  // address ranges ordered by their start, with a node per symbol
+  class MapSymbolIndex {
+public:
+    explicit MapSymbolIndex(const sdb::Elf &elf) : elf_(elf) {
+      for (const auto &symbol : elf.GetSymbols()) {
+        if (symbol.st_value != 0 && symbol.st_name != 0 &&
+            ELF64_ST_TYPE(symbol.st_info) != STT_TLS) {
+          this->map_.insert(
+              {{sdb::FileAddress{elf, symbol.st_value},
+                sdb::FileAddress{elf, symbol.st_value + symbol.st_size}},
+               &symbol});
+        }
+      }
+    }
+
+    const Elf64_Sym *FindContaining(const std::uint64_t address) const {
+      const sdb::FileAddress file_addr{this->elf_, address};
+      auto it = this->map_.lower_bound({file_addr, sdb::FileAddress{}});
+      if (it != this->map_.end() && it->first.first == file_addr) {
+        return it->second;
+      }
+      if (it == this->map_.begin()) {
+        return nullptr;
+      }
+      --it;
+      return it->first.second > file_addr ? it->second : nullptr;
+    }
+
+private:
+    struct RangeComparator {
+      bool operator()(
+          const std::pair<sdb::FileAddress, sdb::FileAddress> &lhs,
+          const std::pair<sdb::FileAddress, sdb::FileAddress> &rhs) const {
+        return lhs.first < rhs.first;
+      }
+    };
+
+    const sdb::Elf &elf_;
+    std::map<std::pair<sdb::FileAddress, sdb::FileAddress>, const Elf64_Sym *,
+             RangeComparator>
+        map_;
+  };
+
+  // Writes an ELF file with `n_symbols` C++ functions, as far as its symbol
+  // table is concerned: just the tables, a .text with nothing in it, and a
+  // build ID note (empty by default, which nothing caches by)
+  void WriteSyntheticElf(const std::filesystem::path &path,
+                         const std::size_t            n_symbols,
+                         const std::string           &build_id = "") {
+    constexpr std::uint64_t text_address = 0x1000;
+
+    std::vector<Elf64_Sym> symbols(1);  // the null symbol
+    std::string            strings(1, '\0');
+    for (std::size_t i = 0; i < n_symbols; ++i) {
+      // bench::C<i / 64>::m<i % 64>(int)
+      const auto class_name  = fmt::format("C{}", i / 64);
+      const auto method_name = fmt::format("m{}", i % 64);
+      Elf64_Sym  symbol{};
+      symbol.st_name  = strings.size();
+      symbol.st_info  = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+      symbol.st_shndx = 1;
+      symbol.st_value = text_address + i * 16;
+      symbol.st_size  = 16;
+      symbols.push_back(symbol);
+      strings += fmt::format("_ZN5bench{}{}{}{}Ei", class_name.size(),
+                             class_name, method_name.size(), method_name);
+      strings += '\0';
+    }
+    const std::string section_names(
+        "\0.text\0.symtab\0.strtab\0.shstrtab\0.note.gnu.build-id\0", 52);
+    const Elf64_Nhdr note_header{4, static_cast<Elf64_Word>(build_id.size()),
+                                 NT_GNU_BUILD_ID};
+    const auto       note =
+        std::string(reinterpret_cast<const char *>(&note_header),
+                    sizeof(note_header)) +
+        std::string("GNU", 4) + build_id;
+
+    // the header, the symbols, the strings, the section names, the note,
+    // then the section headers
+    const auto symbols_size = symbols.size() * sizeof(Elf64_Sym);
+    const auto symbols_at   = sizeof(Elf64_Ehdr);
+    const auto strings_at   = symbols_at + symbols_size;
+    const auto names_at     = strings_at + strings.size();
+    const auto note_at      = (names_at + section_names.size() + 7) & ~7ull;
+    const auto headers_at   = (note_at + note.size() + 7) & ~7ull;
+
+    // name, type, flags, address, offset, size, link, info, alignment,
+    // entry size
+    const Elf64_Shdr null{};
+    const Elf64_Shdr text{1, SHT_NOBITS, SHF_ALLOC | SHF_EXECINSTR,
+                          text_address, 0, n_symbols * 16, 0, 0, 16, 0};
+    const Elf64_Shdr symtab{7, SHT_SYMTAB, 0, 0, symbols_at, symbols_size,
+                            3, 1, 8, sizeof(Elf64_Sym)};
+    const Elf64_Shdr strtab{15, SHT_STRTAB, 0, 0, strings_at, strings.size(),
+                            0, 0, 1, 0};
+    const Elf64_Shdr shstrtab{
+        23, SHT_STRTAB, 0, 0, names_at, section_names.size(), 0, 0, 1, 0};
+    const Elf64_Shdr build_id_note{
+        33, SHT_NOTE, 0, 0, note_at, note.size(), 0, 0, 4, 0};
+
+    Elf64_Ehdr header{};
+    std::copy_n(ELFMAG, SELFMAG, header.e_ident);
+    header.e_ident[EI_CLASS]   = ELFCLASS64;
+    header.e_ident[EI_DATA]    = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_type              = ET_EXEC;
+    header.e_machine           = EM_X86_64;
+    header.e_version           = EV_CURRENT;
+    header.e_shoff             = headers_at;
+    header.e_ehsize            = sizeof(Elf64_Ehdr);
+    header.e_shentsize         = sizeof(Elf64_Shdr);
+    header.e_shnum             = 6;
+    header.e_shstrndx          = 4;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    const auto    write = [&out](const void *data, const std::size_t size)
+    { out.write(static_cast<const char *>(data), size); };
+    write(&header, sizeof(header));
+    write(symbols.data(), symbols_size);
+    write(strings.data(), strings.size());
+    write(section_names.data(), section_names.size());
+    out.seekp(note_at);
+    write(note.data(), note.size());
+    out.seekp(headers_at);
+    for (const auto &section :
+         {null, text, symtab, strtab, shstrtab, build_id_note}) {
+      write(&section, sizeof(section));
+    }
+    if (!out) {
+      sdb::Error::Send("Could not write " + path.string());
+    }
+  }
+
+  void BenchMemoryWrite() {
+    constexpr bool close_on_exec = false;
+    sdb::Pipe      channel(close_on_exec);
+    const auto     proc    = sdb::Process::Launch("targets/large_buffer", true,
+                                                  channel.GetWriteFd());
+    channel.CloseWriteFd();
+
+    proc->Resume();
+    proc->WaitOnSignal();
+
+    // the target sends the address of a writable buffer followed by the
+    // address of a read-only one
+    const auto addresses = channel.Read();
+    const auto writable =
+        sdb::VirtualAddress{sdb::FromBytes<std::uint64_t>(addresses.data())};
+    const auto read_only = sdb::VirtualAddress{
+        sdb::FromBytes<std::uint64_t>(addresses.data() + sizeof(void *))};
+
+    constexpr std::size_t  size = 16 * 1024 * 1024;
+    std::vector<std::byte> data(size, std::byte{0xab});
+    const sdb::Span<const std::byte> span{data.data(), data.size()};
+
+    for (const auto &[name, address] :
+         {std::pair{"writable", writable}, std::pair{"read-only", read_only}}) {
+      const auto bulk =
+          TimeSeconds([&] { proc->WriteMemory(address, span); });
+      const auto poke =
+          TimeSeconds([&] { WriteMemoryWithPokedata(*proc, address, span); });
+
+      fmt::print("memory_write ({}, {} MiB): WriteMemory {:.1f} MB/s, "
+                 "POKEDATA {:.1f} MB/s ({:.1f}x)\n",
+                 name, size / (1024 * 1024), ToMegabytesPerSecond(size, bulk),
+                 ToMegabytesPerSecond(size, poke), poke / bulk);
+    }
+  }
+
+  // hits a breakpoint in a tight loop, returning to the debugger every time.
+  // `n_other_sites` disabled sites are created alongside it, to see how the
+  // number of sites affects every stop. Returns the average seconds per hit
+  double TimeBreakpointRoundTrip(const int         n_other_sites,
+                                 const char *const target = "targets/hot_loop",
+                                 const bool        displaced = true) {
+    constexpr bool close_on_exec = false;
+    sdb::Pipe      channel(close_on_exec);
+    const auto     proc =
+        sdb::Process::Launch(target, true, channel.GetWriteFd());
+    channel.CloseWriteFd();
+    proc->SetDisplacedSteppingEnabled(displaced);
+
+    proc->Resume();
+    proc->WaitOnSignal();
+
+    const auto data = channel.Read();
+    const auto function =
+        sdb::VirtualAddress{sdb::FromBytes<std::uint64_t>(data.data())};
+    const auto n_iterations = sdb::FromBytes<int>(data.data() + sizeof(void *));
+
+    // spread around the hot site, on both sides of it
+    for (int i = 1; i <= n_other_sites; ++i) {
+      const auto offset = static_cast<std::uint64_t>(i) * 16;
+      proc->CreateBreakpointSite(i % 2 == 0 ? function + offset
+                                            : function - offset);
+    }
+    proc->CreateBreakpointSite(function).Enable();
+
+    int        hits    = 0;
+    const auto seconds = TimeSeconds([&] {
+      proc->Resume();
+      while (proc->WaitOnSignal().reason == sdb::ProcessState::Stopped) {
+        ++hits;
+        proc->Resume();
+      }
+    });
+
+    if (hits != n_iterations) {
+      sdb::Error::Send("Unexpected number of breakpoint hits");
+    }
+
+    return seconds / hits;
+  }
+
+  void BenchBreakpointRoundTrip() {
+    const auto seconds = TimeBreakpointRoundTrip(0);
+    fmt::print("breakpoint_round_trip: {:.0f} hits/s, {:.2f} us/hit\n",
+               1 / seconds, seconds * 1e6);
+  }
+
+  // hits a breakpoint whose condition never holds, so every hit is checked
+  // and skipped inside libsdb. Returns the average seconds per hit
+  double TimeRejectedBreakpointHits(
+      const std::string_view condition,
+      const char *const      target    = "targets/hot_loop",
+      const bool             displaced = true) {
+    constexpr bool close_on_exec = false;
+    sdb::Pipe      channel(close_on_exec);
+    const auto     proc =
+        sdb::Process::Launch(target, true, channel.GetWriteFd());
+    channel.CloseWriteFd();
+    proc->SetDisplacedSteppingEnabled(displaced);
+
+    proc->Resume();
+    proc->WaitOnSignal();
+
+    const auto data = channel.Read();
+    const auto function =
+        sdb::VirtualAddress{sdb::FromBytes<std::uint64_t>(data.data())};
+    const auto n_iterations = sdb::FromBytes<int>(data.data() + sizeof(void *));
+
+    auto &site = proc->CreateBreakpointSite(function);
+    site.SetCondition(sdb::BreakpointCondition::Compile(condition));
+    site.Enable();
+
+    const auto seconds = TimeSeconds(
+        [&]
+        {
+          proc->Resume();
+          if (proc->WaitOnSignal().reason != sdb::ProcessState::Exited) {
+            sdb::Error::Send("Unexpected stop");
+          }
+        });
+    return seconds / n_iterations;
+  }
+
+  // a rejected hit should cost about as much as a plain round trip
+  void BenchConditionalBreakpoint() {
+    const auto unconditional = TimeBreakpointRoundTrip(0);
+    fmt::print("conditional_breakpoint: unconditional {:.2f} us/hit",
+               unconditional * 1e6);
+    for (const auto condition : {"rax == 0x123456789", "*(rsp + 8) == 1"}) {
+      fmt::print(", '{}' {:.2f} us/hit", condition,
+                 TimeRejectedBreakpointHits(condition) * 1e6);
+    }
+    fmt::print("\n");
+  }
+
+  // every stop has to stop every other thread, and resume them after
+  void BenchBreakpointRoundTripThreads() {
+    const auto seconds =
+        TimeBreakpointRoundTrip(0, "targets/hot_loop_threads");
+    fmt::print(
+        "breakpoint_round_trip_threads (17 threads): {:.0f} hits/s, "
+        "{:.2f} us/hit\n",
+        1 / seconds, seconds * 1e6);
+  }
+
+  // stepping over the site by running a copy of the instruction, compared with
+  // lifting the site while the thread steps over it. A rejected hit no longer
+  // has to stop the other threads
+  void BenchDisplacedStep() {
+    for (const auto target : {"targets/hot_loop", "targets/hot_loop_threads"}) {
+      const auto round_trip = [&](const bool displaced)
+      { return TimeBreakpointRoundTrip(0, target, displaced) * 1e6; };
+      const auto rejected = [&](const bool displaced)
+      {
+        return TimeRejectedBreakpointHits("rax == 0x123456789", target,
+                                          displaced) *
+               1e6;
+      };
+      fmt::print(
+          "displaced_step ({}): round trip {:.2f} us/hit (lifted {:.2f}), "
+          "rejected hit {:.2f} us/hit (lifted {:.2f})\n",
+          target, round_trip(true), round_trip(false), rejected(true),
+          rejected(false));
+    }
+  }
+
+  // recording steps through hot_loop's loop to a trace file, compared with
+  // what the CLI's `step` does for every instruction (less the readline round
+  // trip): step, then disassemble the next instruction
+  void BenchInstructionTrace() {
+    constexpr std::uint64_t n_steps = 20000;
+    const auto              path =
+        std::filesystem::temp_directory_path() / "sdb_bench.trace";
+
+    const auto launch = []
+    {
+      constexpr bool close_on_exec = false;
+      sdb::Pipe      channel(close_on_exec);
+      auto           target =
+          sdb::Target::Launch("targets/hot_loop", channel.GetWriteFd());
+      channel.CloseWriteFd();
+      target->GetProcess().Resume();
+      target->GetProcess().WaitOnSignal();
+      return target;
+    };
+
+    for (const auto granularity :
+         {sdb::StepMode::Instruction, sdb::StepMode::Block}) {
+      const auto target = launch();
+      const auto writer = sdb::InstructionTraceWriter::Create(
+          path, granularity, target->GetElf().GetPath(),
+          target->GetElf().GetLoadBias());
+
+      std::uint64_t steps   = 0;
+      const auto    seconds = TimeSeconds(
+          [&]
+          {
+            steps = sdb::RecordInstructionTrace(target->GetProcess(), *writer,
+                                                   {granularity, {}, n_steps})
+                        .steps;
+          });
+      const auto bytes = std::filesystem::file_size(path);
+      fmt::print("instruction_trace ({}): {:.2f} us/step, {:.1f} bytes/step\n",
+                 granularity == sdb::StepMode::Block ? "block" : "instruction",
+                 seconds / steps * 1e6, static_cast<double>(bytes) / steps);
+    }
+    std::filesystem::remove(path);
+
+    const auto         target = launch();
+    sdb::Disassembler  disassembler(*target);
+    const auto         seconds = TimeSeconds(
+        [&]
+        {
+          for (std::uint64_t i = 0; i < n_steps; ++i) {
+            target->GetProcess().StepInstruction();
+            disassembler.Disassemble(1);
+          }
+        });
+    fmt::print("instruction_trace (step and disassemble): {:.2f} us/step\n",
+               seconds / n_steps * 1e6);
+  }
+
+  // a tracepoint on the same function as breakpoint_round_trip. Hits are
+  // recorded in the inferior, so the debugger only gets involved to read them
+  // back once it has exited
+  void BenchTracepoint() {
+    constexpr bool close_on_exec = false;
+    sdb::Pipe      channel(close_on_exec);
+    const auto     proc =
+        sdb::Process::Launch("targets/hot_loop", true, channel.GetWriteFd());
+    channel.CloseWriteFd();
+
+    proc->Resume();
+    proc->WaitOnSignal();
+
+    const auto data = channel.Read();
+    const auto function =
+        sdb::VirtualAddress{sdb::FromBytes<std::uint64_t>(data.data())};
+    const auto n_iterations = sdb::FromBytes<int>(data.data() + sizeof(void *));
+
+    proc->CreateTracepoint(function).Enable();
+
+    std::size_t hits    = 0;
+    const auto  seconds = TimeSeconds(
+        [&]
+        {
+          proc->Resume();
+          if (proc->WaitOnSignal().reason != sdb::ProcessState::Exited) {
+            sdb::Error::Send("Unexpected stop");
+          }
+          hits = proc->ReadTracepointHits().size();
+        });
+    if (hits != static_cast<std::size_t>(n_iterations)) {
+      sdb::Error::Send("Unexpected number of tracepoint hits");
+    }
+
+    const auto breakpoint = TimeBreakpointRoundTrip(0);
+    fmt::print("tracepoint: {:.3f} us/hit, breakpoint {:.2f} us/hit "
+               "({:.0f}x)\n",
+               seconds / hits * 1e6, breakpoint * 1e6,
+               breakpoint / (seconds / hits));
+  }
+
+  // the cost of a stop should stay flat as the number of sites grows
+  void BenchStopDispatch() {
+    for (const auto n_sites : {1, 1000, 10000, 50000}) {
+      const auto seconds = TimeBreakpointRoundTrip(n_sites - 1);
+      fmt::print("stop_dispatch ({} sites): {:.2f} us/hit\n", n_sites,
+                 seconds * 1e6);
+    }
+  }
+
+  // arming (and disarming) breakpoints across a large region one site at a
+  // time compared with in bulk
+  void BenchBreakpointBulkEnable() {
+    constexpr bool close_on_exec = false;
+    sdb::Pipe      channel(close_on_exec);
+    const auto     proc    = sdb::Process::Launch("targets/large_buffer", true,
+                                                  channel.GetWriteFd());
+    channel.CloseWriteFd();
+
+    proc->Resume();
+    proc->WaitOnSignal();
+
+    // the sites never get hit, so they go in the read-only buffer
+    const auto addresses = channel.Read();
+    const auto read_only = sdb::VirtualAddress{
+        sdb::FromBytes<std::uint64_t>(addresses.data() + sizeof(void *))};
+
+    constexpr int                      n_sites = 100000;
+    std::vector<sdb::BreakpointSite *> sites;
+    for (int i = 0; i < n_sites; ++i) {
+      sites.push_back(&proc->CreateBreakpointSite(read_only + i * 16));
+    }
+    const sdb::Span<sdb::BreakpointSite *const> span(sites);
+
+    const auto one_by_one = TimeSeconds([&] {
+      for (const auto site : sites) {
+        site->Enable();
+      }
+      for (const auto site : sites) {
+        site->Disable();
+      }
+    });
+    const auto bulk = TimeSeconds([&] {
+      proc->EnableBreakpointSites(span);
+      proc->DisableBreakpointSites(span);
+    });
+
+    fmt::print("breakpoint_bulk_enable ({} sites): one by one {:.3f} s, "
+               "bulk {:.3f} s ({:.1f}x)\n",
+               n_sites, one_by_one, bulk, one_by_one / bulk);
+  }
+
+  // runs a syscall-heavy inferior to completion while catching a syscall it
+  // never makes, with the policy set after launching (every syscall stops
+  // it), or handed to Launch (only the caught syscall would)
+  void BenchSyscallCatch() {
+    const auto time_run = [](const bool catching, const bool with_seccomp)
+    {
+      const auto policy = sdb::SyscallCatchPolicy::CatchSome(
+          {sdb::SyscallNameToId("mkdir")});
+      const auto proc =
+          with_seccomp
+              ? sdb::Process::Launch("targets/syscall_loop", true,
+                                     std::nullopt, policy)
+              : sdb::Process::Launch("targets/syscall_loop");
+      if (catching and !with_seccomp) {
+        proc->SetSyscallCatchPolicy(policy);
+      }
+
+      return TimeSeconds(
+          [&]
+          {
+            proc->Resume();
+            if (proc->WaitOnSignal().reason != sdb::ProcessState::Exited) {
+              sdb::Error::Send("Unexpected stop");
+            }
+          });
+    };
+
+    const auto none    = time_run(false, false);
+    const auto ptrace  = time_run(true, false);
+    const auto seccomp = time_run(true, true);
+    fmt::print("syscall_catch: not catching {:.3f} s, PTRACE_SYSCALL {:.3f} s "
+               "({:.1f}x), seccomp {:.3f} s ({:.1f}x)\n",
+               none, ptrace, ptrace / none, seccomp, seccomp / none);
+  }
+
+  // samples a process of 17 threads, most of them asleep at any time, and
+  // measures how long each sample keeps it stopped
+  void BenchProfile() {
+    const auto target = sdb::Target::Launch("targets/busy_threads");
+    auto      &process = target->GetProcess();
+    process.Resume();
+    // give it time to start its threads, which needs us to be waiting on it
+    sdb::RecordProfile(process, {99, std::chrono::milliseconds(100), 1});
+
+    const auto profile = sdb::RecordProfile(
+        process, {99, std::chrono::seconds(2), /*max_depth=*/128});
+    const std::chrono::duration<double, std::micro> stopped =
+        profile.StoppedTime();
+
+    std::size_t frames = 0;
+    for (std::size_t i = 0; i < profile.SampleCount(); ++i) {
+      frames += profile.GetStack(i).Size();
+    }
+    const auto fold_seconds =
+        TimeSeconds([&] { profile.Fold(target->GetElf()); });
+    fmt::print("profile ({:.1f} stacks/tick): {:.1f} us stopped/tick, {:.1f} "
+               "frames/stack, fold {:.1f} ms for {} stacks\n",
+               static_cast<double>(profile.SampleCount()) / profile.TickCount(),
+               stopped.count() / profile.TickCount(),
+               static_cast<double>(frames) / profile.SampleCount(),
+               fold_seconds * 1e3, profile.SampleCount());
+  }
+
+  // getting back to main by restarting from a checkpoint taken there,
+  // compared with launching the target again (ELF parsing included) and
+  // running to a breakpoint on main
+  void BenchCheckpointRestart() {
+    constexpr int n_runs = 50;
+
+    const auto launch_to_main = []
+    {
+      auto        target = sdb::Target::Launch("targets/hot_loop");
+      const auto &elf    = target->GetElf();
+      auto       &process = target->GetProcess();
+      process
+          .CreateBreakpointSite(elf.GetLoadBias() +
+                                elf.GetSymbolsByName("main").at(0)->st_value)
+          .Enable();
+      process.Resume();
+      process.WaitOnSignal();
+      return target;
+    };
+
+    const auto relaunch = TimeSeconds(
+        [&]
+        {
+          for (int i = 0; i < n_runs; ++i) {
+            launch_to_main();
+          }
+        });
+
+    const auto target  = launch_to_main();
+    auto      &process = target->GetProcess();
+    const auto id      = process.CreateCheckpoint();
+    const auto restart = TimeSeconds(
+        [&]
+        {
+          for (int i = 0; i < n_runs; ++i) {
+            process.RestartFromCheckpoint(id);
+          }
+        });
+    fmt::print("checkpoint_restart: restart {:.1f} us, relaunch {:.1f} us\n",
+               restart / n_runs * 1e6, relaunch / n_runs * 1e6);
+  }
+
+  // what changed in dirty_pages' 64 MiB buffer at each stop (16 pages), by
+  // taking a snapshot, compared with reading the whole buffer again
+  void BenchMemorySnapshot() {
+    constexpr int  n_stops       = 20;
+    constexpr bool close_on_exec = false;
+    sdb::Pipe      channel(close_on_exec);
+    const auto     proc = sdb::Process::Launch("targets/dirty_pages", true,
+                                               channel.GetWriteFd());
+    channel.CloseWriteFd();
+    proc->Resume();
+    proc->WaitOnSignal();
+    const auto buffer = sdb::VirtualAddress{
+        sdb::FromBytes<std::uint64_t>(channel.Read().data())};
+
+    sdb::MemorySnapshots snapshots(*proc);
+    const auto first = TimeSeconds([&] { snapshots.Take(); });
+    const auto first_arena = snapshots.ArenaSize();
+
+    std::vector<std::byte> copy(64 * 1024 * 1024);
+    double                 take = 0, read = 0;
+    std::size_t            n_changed = 0;
+    for (int i = 0; i < n_stops; ++i) {
+      proc->Resume();
+      proc->WaitOnSignal();
+      take += TimeSeconds([&] { snapshots.Take(); });
+      n_changed += snapshots.ChangedPages(snapshots.SnapshotCount() - 1).size();
+      read += TimeSeconds(
+          [&]
+          {
+            const sdb::MemoryRange range{buffer, {copy.data(), copy.size()}};
+            proc->ReadMemoryRanges({&range, 1});
+          });
+    }
+    fmt::print("memory_snapshot ({}): snapshot {:.2f} ms/stop ({:.1f} pages "
+               "changed, {} KiB stored), full read {:.2f} ms/stop, first "
+               "snapshot {:.1f} ms ({} MiB)\n",
+               sdb::MemorySnapshots::SoftDirtySupported() ? "soft-dirty"
+                                                          : "no soft-dirty",
+               take / n_stops * 1e3, static_cast<double>(n_changed) / n_stops,
+               (snapshots.ArenaSize() - first_arena) / 1024 / n_stops,
+               read / n_stops * 1e3, first * 1e3, first_arena >> 20);
+  }
+
+  // page_writes' writes with a page watchpoint on the start of its buffer:
+  // each hit, each write elsewhere on the watched page (which faults, and is
+  // stepped over), and each write to another page
+  void BenchPageWatchpoint() {
+    constexpr bool close_on_exec = false;
+    sdb::Pipe      channel(close_on_exec);
+    const auto     proc = sdb::Process::Launch("targets/page_writes", true,
+                                               channel.GetWriteFd());
+    channel.CloseWriteFd();
+    proc->Resume();
+    proc->WaitOnSignal();
+    const auto data         = channel.Read();
+    const auto buffer       = sdb::FromBytes<std::uint64_t>(data.data());
+    const auto n_iterations = sdb::FromBytes<int>(data.data() + 8);
+
+    proc->CreateWatchpoint(sdb::VirtualAddress{buffer},
+                           sdb::StoppointMode::write, 8, false)
+        .Enable();
+
+    const auto hits = TimeSeconds(
+        [&]
+        {
+          for (int i = 0; i < n_iterations; ++i) {
+            proc->Resume();
+            if (proc->WaitOnSignal().trap_reason !=
+                sdb::TrapType::PageWatchpoint) {
+              sdb::Error::Send("Expected a page watchpoint hit");
+            }
+          }
+          proc->Resume();
+          proc->WaitOnSignal();
+        });
+    const auto run_to_stop = [&]
+    {
+      proc->Resume();
+      proc->WaitOnSignal();
+    };
+    const auto same_page  = TimeSeconds(run_to_stop);
+    const auto other_page = TimeSeconds(run_to_stop);
+    fmt::print("page_watchpoint: hit {:.1f} us, write to the watched page "
+               "{:.1f} us, write to another page {:.3f} us\n",
+               hits / n_iterations * 1e6, same_page / n_iterations * 1e6,
+               other_page / n_iterations * 1e6);
+  }
+
+  // Opening an ELF file with 500k C++ symbols, and the first lookup by name
+  // (which demangles them all), against demangling them all as it's opened
+  // the way it used to be
+  void BenchElfSymbols() {
+    constexpr std::size_t n_symbols = 500000;
+    const auto            path =
+        std::filesystem::temp_directory_path() / "sdb_bench_symbols";
+    WriteSyntheticElf(path, n_symbols);
+
+    std::unique_ptr<sdb::Elf> elf;
+    const auto open =
+        TimeSeconds([&] { elf = std::make_unique<sdb::Elf>(path); });
+    const auto first = TimeSeconds(
+        [&]
+        {
+          if (elf->GetSymbolsByName("bench::C0::m1(int)").size() != 1) {
+            sdb::Error::Send("Expected a demangled symbol");
+          }
+        });
+
+    // the names demangled up front, on a single thread
+    std::unordered_multimap<std::string_view, const Elf64_Sym *> names;
+    std::vector<std::unique_ptr<char, decltype(&free)>>          demangled;
+    const auto eager = TimeSeconds(
+        [&]
+        {
+          for (const auto &symbol : elf->GetSymbols()) {
+            const auto name = elf->GetString(symbol.st_name);
+            int        status;
+            const auto demangled_name =
+                abi::__cxa_demangle(name.data(), nullptr, nullptr, &status);
+            if (status == 0) {
+              demangled.emplace_back(demangled_name, &free);
+              names.insert({demangled_name, &symbol});
+            }
+            names.insert({name, &symbol});
+          }
+        });
+    std::filesystem::remove(path);
+
+    fmt::print("elf_symbols ({} symbols): open {:.1f} ms, first lookup by "
+               "name {:.1f} ms ({} threads), demangling at open {:.1f} ms\n",
+               n_symbols, open * 1e3, first * 1e3,
+               std::max(std::thread::hardware_concurrency(), 1u), eager * 1e3);
+  }
+
+  // Opening a large file and looking a symbol up by name and by address,
+  // first with an empty cache directory, so every index is built and saved,
+  // then again with the cache in place
+  void BenchIndexCache() {
+    constexpr std::size_t n_symbols = 500000;
+    const auto            temporary = std::filesystem::temp_directory_path();
+    const auto            path      = temporary / "sdb_bench_cached_symbols";
+    const auto            directory = temporary / "sdb_bench_index_cache";
+    std::filesystem::remove_all(directory);
+    setenv("XDG_CACHE_HOME", directory.c_str(), 1);
+    WriteSyntheticElf(path, n_symbols, "sdb index cache bench");
+
+    const auto load = [&]
+    {
+      return TimeSeconds(
+          [&]
+          {
+            const sdb::Elf elf(path);
+            if (elf.GetSymbolsByName("bench::C0::m1(int)").size() != 1 ||
+                !elf.GetSymbolContainingAddress(
+                    sdb::FileAddress{elf, 0x1008})) {
+              sdb::Error::Send("Expected to find a symbol");
+            }
+          });
+    };
+    const auto built  = load();
+    const auto cached = load();
+
+    std::uintmax_t cache_size = 0;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(sdb::IndexCache::Directory())) {
+      cache_size += entry.file_size();
+    }
+    std::filesystem::remove(path);
+    std::filesystem::remove_all(directory);
+
+    fmt::print("index_cache ({} symbols): open and look up {:.1f} ms building "
+               "the indexes, {:.1f} ms from the cache ({:.1f} MB)\n",
+               n_symbols, built * 1e3, cached * 1e3, cache_size / 1e6);
+  }
+
+  // GetSectionContainingAddress on runs of nearby addresses (as a stream of
+  // samples has) and on addresses spread over every allocated section,
+  // against scanning the section headers
+  void BenchSectionLookup() {
+    constexpr std::size_t n_lookups = 1 << 20;
+    const sdb::Elf        elf("/proc/self/exe");
+
+    std::vector<const Elf64_Shdr *> sections;
+    for (const auto &section : elf.GetSectionHeaders()) {
+      if ((section.sh_flags & SHF_ALLOC) != 0 && section.sh_size != 0) {
+        sections.push_back(&section);
+      }
+    }
+    std::vector<std::uint64_t> spread(n_lookups), runs(n_lookups);
+    std::uint64_t              state = 1;
+    for (std::size_t i = 0; i < n_lookups; ++i) {
+      state            = state * 6364136223846793005 + 1442695040888963407;
+      const auto &from = *sections[(state >> 33) % sections.size()];
+      spread[i]        = from.sh_addr + (state >> 17) % from.sh_size;
+      // 64 addresses in a row from the same section
+      runs[i] = i % 64 == 0 ? spread[i] : runs[i - 1];
+    }
+
+    std::size_t n_found = 0;
+    const auto  indexed = [&](const std::vector<std::uint64_t> &addresses)
+    {
+      return TimeSeconds(
+          [&]
+          {
+            for (const auto address : addresses) {
+              n_found += elf.GetSectionContainingAddress(
+                             sdb::FileAddress{elf, address}) != nullptr;
+            }
+          });
+    };
+    const auto scanned = [&](const std::vector<std::uint64_t> &addresses)
+    {
+      return TimeSeconds(
+          [&]
+          {
+            for (const auto address : addresses) {
+              for (const auto &section : elf.GetSectionHeaders()) {
+                if (section.sh_addr <= address &&
+                    section.sh_addr + section.sh_size > address) {
+                  ++n_found;
+                  break;
+                }
+              }
+            }
+          });
+    };
+    fmt::print("section_lookup ({} sections): runs {:.1f} ns (scan {:.1f} "
+               "ns), spread {:.1f} ns (scan {:.1f} ns), {} found\n",
+               elf.GetSectionHeaders().Size(),
+               indexed(runs) / n_lookups * 1e9,
+               scanned(runs) / n_lookups * 1e9,
+               indexed(spread) / n_lookups * 1e9,
+               scanned(spread) / n_lookups * 1e9, n_found);
+  }
+
+  // GetSymbolContainingAddress on addresses spread over the code of a large
+  // binary (the benchmarks themselves), against the std::map index
+  void BenchSymbolLookup() {
+    constexpr std::size_t n_lookups = 1 << 20;
+    const sdb::Elf        elf("/proc/self/exe");
+    const auto            text = *elf.GetSection(".text");
+
+    // the same pseudo-random addresses for both
+    std::vector<std::uint64_t> addresses(n_lookups);
+    std::uint64_t              state = 1;
+    for (auto &address : addresses) {
+      state   = state * 6364136223846793005 + 1442695040888963407;
+      address = text->sh_addr + (state >> 33) % text->sh_size;
+    }
+
+    std::size_t n_flat = 0, n_map = 0;
+    const auto  flat   = TimeSeconds(
+        [&]
+        {
+          for (const auto address : addresses) {
+            n_flat += elf.GetSymbolContainingAddress(
+                             sdb::FileAddress{elf, address})
+                          .has_value();
+          }
+        });
+    const MapSymbolIndex map_index(elf);
+    const auto           map = TimeSeconds(
+        [&]
+        {
+          for (const auto address : addresses) {
+            n_map += map_index.FindContaining(address) != nullptr;
+          }
+        });
+    // the map only looks at the symbol starting closest before an address,
+    // so it misses the ones enclosing it
+    fmt::print("symbol_lookup ({} symbols, {} lookups): flat {:.1f} ns ({} "
+               "found), std::map {:.1f} ns ({} found), {:.1f}x\n",
+               elf.GetSymbols().Size(), n_lookups, flat / n_lookups * 1e9,
+               n_flat, map / n_lookups * 1e9, n_map, map / flat);
+  }
+
+  const std::map<std::string_view, std::function<void()>> g_benchmarks = {
+      {"breakpoint_bulk_enable", BenchBreakpointBulkEnable},
+      {"breakpoint_round_trip", BenchBreakpointRoundTrip},
+      {"breakpoint_round_trip_threads", BenchBreakpointRoundTripThreads},
+      {"checkpoint_restart", BenchCheckpointRestart},
+      {"conditional_breakpoint", BenchConditionalBreakpoint},
+      {"displaced_step", BenchDisplacedStep},
+      {"elf_symbols", BenchElfSymbols},
+      {"index_cache", BenchIndexCache},
+      {"instruction_trace", BenchInstructionTrace},
+      {"memory_snapshot", BenchMemorySnapshot},
+      {"memory_write", BenchMemoryWrite},
+      {"page_watchpoint", BenchPageWatchpoint},
+      {"profile", BenchProfile},
+      {"section_lookup", BenchSectionLookup},
+      {"stop_dispatch", BenchStopDispatch},
+      {"symbol_lookup", BenchSymbolLookup},
+      {"syscall_catch", BenchSyscallCatch},
+      {"tracepoint", BenchTracepoint},
+  };
+}  // namespace
+
+// run every benchmark, or only the ones named on the command line
+int main(const int argc, char **argv) {
+  try {
+    if (argc == 1) {
+      for (const auto &[name, benchmark] : g_benchmarks) {
+        benchmark();
+      }
+      return 0;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+      const auto it = g_benchmarks.find(argv[i]);
+      if (it == g_benchmarks.end()) {
+        std::cerr << "No such benchmark: " << argv[i] << '\n';
+        return -1;
+      }
+      it->second();
+    }
+  } catch (const sdb::Error &err) {
+    std::cerr << err.what() << '\n';
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,44 @@
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+  constexpr int n_threads = 16;
+
+  volatile unsigned g_sink = 0;
+
+  __attribute__((noinline)) void Spin(const int n) {
+    for (int i = 0; i < n; ++i) {
+      g_sink = g_sink + i;
+    }
+  }
+
+  // a few frames deep, so samples have stacks to walk
+  __attribute__((noinline)) void Work(const int depth) {
+    if (depth == 0) {
+      Spin(20000);
+      return;
+    }
+    Work(depth - 1);
+  }
+}  // namespace
+
+// a service that runs until it's killed, for sampling. Its threads do a
+// little work at a time and then sleep, so they don't starve the profiler on
+// small machines
+int main() {
+  std::vector<std::thread> threads;
+  for (int i = 0; i <= n_threads; ++i) {
+    const auto body = [i]
+    {
+      while (true) {
+        Work(i % 8);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    };
+    if (i == n_threads) {
+      body();  // the main thread too
+    }
+    threads.emplace_back(body);
+  }
+}
@@ -0,0 +1,29 @@
+#include <csignal>
+#include <cstddef>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+  constexpr std::size_t buffer_size = 64 * 1024 * 1024;
+  constexpr std::size_t page_size   = 4096;
+  // pages written between stops
+  constexpr std::size_t n_dirty_pages = 16;
+}  // namespace
+
+int main() {
+  // every page is touched, so it's all in memory
+  std::vector<char> buffer(buffer_size, 1);
+
+  void *address = buffer.data();
+  write(STDOUT_FILENO, &address, sizeof(void *));
+
+  for (std::size_t stop = 0;; ++stop) {
+    raise(SIGTRAP);
+    for (std::size_t i = 0; i < n_dirty_pages; ++i) {
+      // spread over the buffer, and different at every stop
+      const auto page = (stop * n_dirty_pages + i) * 997 %
+                        (buffer_size / page_size);
+      ++buffer[page * page_size];
+    }
+  }
+}
@@ -0,0 +1,20 @@
+#include <csignal>
+#include <unistd.h>
+
+namespace {
+  constexpr int n_iterations = 20000;
+}  // namespace
+
+// a function that's called in a tight loop, for placing breakpoints on
+__attribute__((noinline)) void HotFunction() { asm volatile(""); }
+
+int main() {
+  const auto ptr = reinterpret_cast<void *>(&HotFunction);
+  write(STDOUT_FILENO, &ptr, sizeof(void *));
+  write(STDOUT_FILENO, &n_iterations, sizeof(n_iterations));
+  raise(SIGTRAP);
+
+  for (int i = 0; i < n_iterations; ++i) {
+    HotFunction();
+  }
+}
@@ -0,0 +1,44 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+  constexpr int n_iterations = 2000;
+  constexpr int n_threads    = 16;
+
+  std::atomic<bool> g_done = false;
+}  // namespace
+
+// as in hot_loop, but with other threads that have to be stopped on every hit.
+// They mostly sleep, so they don't starve the debugger on small machines
+__attribute__((noinline)) void HotFunction() { asm volatile(""); }
+
+int main() {
+  std::vector<std::thread> threads;
+  for (int i = 0; i < n_threads; ++i) {
+    threads.emplace_back(
+        []
+        {
+          while (!g_done) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+          }
+        });
+  }
+
+  const auto ptr = reinterpret_cast<void *>(&HotFunction);
+  write(STDOUT_FILENO, &ptr, sizeof(void *));
+  write(STDOUT_FILENO, &n_iterations, sizeof(n_iterations));
+  raise(SIGTRAP);
+
+  for (int i = 0; i < n_iterations; ++i) {
+    HotFunction();
+  }
+
+  g_done = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
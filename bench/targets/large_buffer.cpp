@@ -0,0 +1,26 @@
+#include <csignal>
+#include <cstddef>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+  constexpr std::size_t buffer_size = 16 * 1024 * 1024;
+
+  // lives in .bss, so the inferior can write to it
+  char writable[buffer_size];
+}  // namespace
+
+int main() {
+  // mapped read-only, so only the debugger can write to it
+  void *read_only = mmap(nullptr, buffer_size, PROT_READ,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  void *writable_address = writable;
+  write(STDOUT_FILENO, &writable_address, sizeof(void *));
+  write(STDOUT_FILENO, &read_only, sizeof(void *));
+  raise(SIGTRAP);
+
+  while (true) {
+    pause();
+  }
+}
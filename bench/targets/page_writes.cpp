@@ -0,0 +1,33 @@
+#include <csignal>
+#include <unistd.h>
+
+namespace {
+  constexpr int n_iterations = 2000;
+
+  alignas(4096) volatile char g_buffer[2 * 4096];
+}  // namespace
+
+int main() {
+  auto address = g_buffer;
+  write(STDOUT_FILENO, &address, sizeof(void *));
+  write(STDOUT_FILENO, &n_iterations, sizeof(n_iterations));
+  raise(SIGTRAP);
+
+  // the start of the first page is what gets watched
+  for (int i = 0; i < n_iterations; ++i) {
+    ++g_buffer[0];
+  }
+  raise(SIGTRAP);
+
+  // elsewhere on the same page
+  for (int i = 0; i < n_iterations; ++i) {
+    ++g_buffer[64];
+  }
+  raise(SIGTRAP);
+
+  // on a page of its own
+  for (int i = 0; i < n_iterations; ++i) {
+    ++g_buffer[4096];
+  }
+  raise(SIGTRAP);
+}
@@ -0,0 +1,14 @@
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+  constexpr int n_iterations = 100000;
+}  // namespace
+
+// makes a cheap syscall over and over, like a busy server would, so the cost
+// of every syscall stopping the inferior shows up
+int main() {
+  for (int i = 0; i < n_iterations; ++i) {
+    syscall(SYS_getppid);
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef SDB_BREAKPOINT_CONDITION_HPP
+#define SDB_BREAKPOINT_CONDITION_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+namespace sdb {
+  class Process;
+
+  // A condition on the registers and memory of the thread that hit a
+  // breakpoint, i.e `rdi == 3 && *(rsp + 8) != 0`. It's parsed once, into a
+  // small stack-machine bytecode, so evaluating it on every hit only reads the
+  // registers and memory it refers to.
+  //
+  // Every value is an unsigned 64-bit integer. Conditions are made of integer
+  // literals (decimal, or hex with a 0x prefix), general purpose registers by
+  // name (rax, eax, al, ...), `*` to read the 8 bytes at an address, unary
+  // `!` and `-`, `*` `+` `-` `&` `|`, comparisons, `&&` and `||` (which
+  // short-circuit) and parentheses, with the same precedence as in C
+  class BreakpointCondition {
+public:
+    enum class Op : std::uint8_t {
+      Push,          // pushes the operand
+      PushRegister,  // pushes the register with the operand as its RegisterID
+      Load,          // replaces an address with the 8 bytes at it
+      Not,
+      Negate,
+      Multiply,
+      Add,
+      Subtract,
+      BitAnd,
+      BitOr,
+      Equal,
+      NotEqual,
+      Less,
+      LessEqual,
+      Greater,
+      GreaterEqual,
+      ToBool,
+      // jumps to the operand (an instruction index) if the top of the stack is
+      // zero (or non-zero), leaving it there. Otherwise it's popped
+      JumpIfZero,
+      JumpIfNonZero,
+    };
+
+    struct Instruction {
+      Op            op;
+      std::uint64_t operand = 0;
+    };
+
+    // throws an sdb::Error if `text` isn't a valid condition
+    static BreakpointCondition Compile(std::string_view text);
+
+    bool Evaluate(const Process &process, pid_t tid) const;
+
+    const std::string              &Text() const { return this->text_; }
+    const std::vector<Instruction> &Code() const { return this->code_; }
+
+private:
+    BreakpointCondition(std::string text, std::vector<Instruction> code,
+                        std::size_t max_depth) :
+        text_(std::move(text)), code_(std::move(code)), max_depth_(max_depth) {}
+
+    std::string              text_;
+    std::vector<Instruction> code_;
+    std::size_t              max_depth_;  // how deep the stack can get
+  };
+}  // namespace sdb
+
+#endif  // SDB_BREAKPOINT_CONDITION_HPP
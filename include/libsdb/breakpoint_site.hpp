@@ -1,7 +1,11 @@
 #ifndef SDB_BREAKPOINT_SITE
 #define SDB_BREAKPOINT_SITE
 
+#include <libsdb/breakpoint_condition.hpp>
 #include <libsdb/types.hpp>
+#include <optional>
+#include <string>
+#include <sys/types.h>
 
 namespace sdb {
   class Process;
@@ -42,12 +46,42 @@ public:
 
     bool IsEnabled() const { return this->is_enabled_; }
 
+    // Conditions and ignore counts are checked by the process as soon as a
+    // thread hits the site. If the hit isn't to be reported, the thread is
+    // resumed without WaitOnSignal ever returning
+
+    // only stop when `condition` holds (or always, without one)
+    void SetCondition(std::optional<BreakpointCondition> condition) {
+      this->condition_ = std::move(condition);
+    }
+    const std::optional<BreakpointCondition> &GetCondition() const {
+      return this->condition_;
+    }
+
+    // Why the condition couldn't be evaluated at the last hit (i.e it read
+    // unmapped memory), if it couldn't. Such a hit is always reported
+    const std::optional<std::string> &GetConditionError() const {
+      return this->condition_error_;
+    }
+
+    // don't stop for the next `count` hits that meet the condition
+    void SetIgnoreCount(const std::uint64_t count) {
+      this->ignore_count_ = count;
+    }
+    std::uint64_t GetIgnoreCount() const { return this->ignore_count_; }
+
+    // hits that met the condition, including the ignored ones
+    std::uint64_t GetHitCount() const { return this->hit_count_; }
+
 private:
     BreakpointSite(Process &process, VirtualAddress address,
                    bool is_hardware = false, bool is_internal = false);
 
     friend Process;  // allow for access to this ctor
 
+    // called when `tid` has hit the site; whether the stop should be reported
+    bool ShouldStop(pid_t tid);
+
     id_type        id_;
     Process       *process_;
     VirtualAddress address_;
@@ -61,6 +95,11 @@ private:
     int  hardware_register_index_ =
         -1;  // tracks the index of the debug register a hardware breakpoint is
              // using
+
+    std::optional<BreakpointCondition> condition_;
+    std::optional<std::string>         condition_error_;
+    std::uint64_t                      ignore_count_ = 0;
+    std::uint64_t                      hit_count_    = 0;
   };
 
 }  // namespace sdb
@@ -1,7 +1,7 @@
 #ifndef SDB_DISASSEMBLER_HPP
 #define SDB_DISASSEMBLER_HPP
 
-#include <libsdb/process.hpp>
+#include <libsdb/target.hpp>
 #include <libsdb/types.hpp>
 #include <string>
 
@@ -15,7 +15,7 @@ namespace sdb {
     };
 
 public:
-    explicit Disassembler(Process &process) : process_(process) {}
+    explicit Disassembler(Target &target) : target_(target) {}
 
     std::vector<Instruction> Disassemble(
         std::size_t                   n_instructions,
@@ -24,7 +24,7 @@ public:
                                   // current program counter's value
 
 private:
-    Process &process_;
+    Target &target_;
   };
 }  // namespace sdb
 
@@ -7,9 +7,11 @@
 #include <optional>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace sdb {
   class Die;
+  class IndexCache;
   class CompileUnit;
 
   class RangeList {
@@ -194,6 +196,7 @@ private:
   class Dwarf {
 public:
     explicit Dwarf(const Elf &parent);
+    ~Dwarf();
     const Elf *ElfFile() const { return elf_; }
 
     const std::unordered_map<std::uint64_t, Abbrev> &GetAbbrevTable(
@@ -207,20 +210,37 @@ public:
 
     std::optional<Die> FunctionContainingAddress(FileAddress address) const;
 
+    // The functions with address ranges that have the given name. The first
+    // call to either of these indexes every function, unless the index is in
+    // the IndexCache
     std::vector<Die> FindFunctions(std::string name) const;
 
 private:
     void Index() const;
-    void IndexDie(const Die &current) const;
+    // `cu` is the index of the compile unit the DIE belongs to
+    void IndexDie(const Die &current, std::uint32_t cu) const;
 
     const Elf *elf_;
 
+    // A function's name and DIE, both by their offsets in the file, and the
+    // index of its compile unit. The index is a flat array of these sorted by
+    // name and then by offset, so it can be used straight from the cache file
     struct IndexEntry {
-      const CompileUnit *cu;
-      const std::byte   *pos;
+      std::uint64_t name_offset;
+      std::uint64_t die_offset;
+      std::uint32_t name_size;
+      std::uint32_t cu;
     };
 
-    mutable std::unordered_multimap<std::string, IndexEntry> function_index_;
+    std::string_view GetIndexedName(const IndexEntry &entry) const;
+    // nullopt if the entry doesn't point into its compile unit
+    std::optional<Die> GetIndexedDie(const IndexEntry &entry) const;
+
+    // a view of the cache file, or of the vector it was built in
+    mutable Span<const IndexEntry>      function_index_;
+    mutable std::vector<IndexEntry>     function_index_built_;
+    mutable std::unique_ptr<IndexCache> function_index_cache_;
+    mutable bool                        indexed_ = false;
 
     std::unordered_map<std::size_t, std::unordered_map<std::uint64_t, Abbrev>>
         abbrev_tables_;
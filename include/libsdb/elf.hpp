@@ -1,16 +1,20 @@
 #ifndef SDB_ELF_HPP
 #define SDB_ELF_HPP
 
+#include <algorithm>
 #include <elf.h>
 #include <filesystem>
 #include <libsdb/types.hpp>
 #include <map>
+#include <memory>
 #include <optional>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
 namespace sdb {
   class Dwarf;
+  class IndexCache;
   class Elf {
 public:
     // path to an elf file on disk
@@ -22,6 +26,15 @@ public:
 
     std::filesystem::path GetPath() const { return this->path_; }
 
+    // the whole file, as it's mapped
+    Span<const std::byte> GetData() const {
+      return {this->data_, this->fle_size_};
+    }
+
+    // the build ID from the .note.gnu.build-id note, or an empty span if the
+    // file has none
+    Span<const std::byte> GetBuildId() const;
+
     const Elf64_Ehdr &GetHeader() const { return this->header_; }
 
     Dwarf       &GetDwarf() { return *this->dwarf_; }
@@ -36,12 +49,21 @@ public:
 
     VirtualAddress GetLoadBias() const { return this->load_bias_; }
 
+    // The section headers and symbol table (.symtab, else .dynsym), viewed
+    // where they are in the mapped file. Only tables the file has misaligned
+    // are copied. Both are checked to lie within the file when it's opened
+    Span<const Elf64_Shdr> GetSectionHeaders() const {
+      return this->section_headers_;
+    }
+    Span<const Elf64_Sym> GetSymbols() const { return this->symbol_table_; }
+
     std::optional<const Elf64_Shdr *> GetSection(std::string_view name) const;
     std::string_view                  GetSectionName(std::size_t index) const;
     Span<const std::byte> GetSectionContents(std::string_view name) const;
 
-    // retrieve the section to which a given file address or virtual address
-    // belongs
+    // Retrieve the allocated (SHF_ALLOC) section to which a given file address
+    // or virtual address belongs. Sections are found by binary search, and
+    // the last one found is tried first
     const Elf64_Shdr *GetSectionContainingAddress(FileAddress file_addr) const;
     const Elf64_Shdr *GetSectionContainingAddress(
         VirtualAddress virtual_addr) const;
@@ -49,7 +71,20 @@ public:
     std::optional<FileAddress> GetSectionStartAddress(
         std::string_view name) const;
 
-    // retrieve the set of symbols that correspond to the given name
+    // retrieve the loadable (PT_LOAD) segment to which a given file address or
+    // virtual address belongs, found the same way as sections
+    const Elf64_Phdr *GetSegmentContainingAddress(FileAddress file_addr) const;
+    const Elf64_Phdr *GetSegmentContainingAddress(
+        VirtualAddress virtual_addr) const;
+
+    // the bytes of the segment that are backed by the file (the remaining
+    // p_memsz - p_filesz bytes are zero-filled when loaded)
+    Span<const std::byte> GetSegmentContents(const Elf64_Phdr &segment) const;
+
+    // Retrieve the set of symbols that correspond to the given name, mangled
+    // or demangled, in table order. The first call indexes the names of every
+    // symbol, with the C++ ones demangled in parallel, unless the index is
+    // in the IndexCache
     std::vector<const Elf64_Sym *> GetSymbolsByName(
         std::string_view name) const;
 
@@ -66,18 +101,108 @@ public:
         VirtualAddress virt_addr) const;
 
 private:
+    // Sorted, non-overlapping [start, end) address ranges of T, found by
+    // binary search. The range found last is tried first, so a run of nearby
+    // addresses doesn't search at all
+    template <class T>
+    class AddressRangeIndex {
+public:
+      void Add(const std::uint64_t start, const std::uint64_t end,
+               const T *value) {
+        this->ranges_.push_back({start, end, value});
+      }
+
+      // call once every range has been added
+      void Sort() {
+        std::sort(this->ranges_.begin(), this->ranges_.end(),
+                  [](const Range &lhs, const Range &rhs)
+                  { return lhs.start < rhs.start; });
+      }
+
+      const T *Find(const std::uint64_t address) const {
+        if (this->last_ < this->ranges_.size() &&
+            this->ranges_[this->last_].Contains(address)) {
+          return this->ranges_[this->last_].value;
+        }
+
+        // the last range starting at or before `address`, without branching
+        // on the comparisons, as random addresses would mispredict them
+        if (this->ranges_.empty()) {
+          return nullptr;
+        }
+        const Range *base = this->ranges_.data();
+        for (auto n = this->ranges_.size(); n > 1;) {
+          const auto half = n / 2;
+          base            = base[half].start <= address ? base + half : base;
+          n -= half;
+        }
+        if (!base->Contains(address)) {
+          return nullptr;
+        }
+        this->last_ = base - this->ranges_.data();
+        return base->value;
+      }
+
+private:
+      struct Range {
+        std::uint64_t start;
+        std::uint64_t end;
+        const T      *value;
+
+        bool Contains(const std::uint64_t address) const {
+          return this->start <= address && address < this->end;
+        }
+      };
+
+      std::vector<Range>  ranges_;
+      mutable std::size_t last_ = 0;
+    };
+
     void ParseSectionHeaders();
+    void ParseProgramHeaders();
     void ParseSymbolTable();
     void BuildSectionMap();
+    void BuildAddressIndexes();
     void BuildSymbolMaps();
+    void IndexSymbolNames() const;
+
+    // A name of a symbol: its own, in the string table, or the demangled one.
+    // The index of names is a flat array of these sorted by name, so it can
+    // be used straight from the IndexCache
+    struct SymbolName {
+      // set in `symbol` for a name in the demangled names
+      static constexpr std::uint32_t demangled = std::uint32_t{1} << 31;
+
+      // in the file, or in the demangled names
+      std::uint64_t offset;
+      std::uint32_t size;
+      std::uint32_t symbol;
+    };
+
+    std::string_view GetSymbolName(const SymbolName &name) const;
+
+    // point the views of the address index at `addresses` (every start, then
+    // every end, then every max_end) and `indices`
+    void SetSymbolAddresses(Span<const std::uint64_t> addresses,
+                            Span<const std::uint32_t> indices);
+
+    // the table index of the first symbol starting at `address`, given how
+    // many indexed symbols start at or before it
+    std::optional<std::uint32_t> FindSymbolStartingAt(
+        std::uint64_t address, std::size_t n_up_to) const;
 
     int                     fd_;
     std::filesystem::path   path_;
     std::size_t             fle_size_;
     std::byte              *data_;
     Elf64_Ehdr              header_;
-    std::vector<Elf64_Shdr> section_headers_;
-    std::vector<Elf64_Sym>  symbol_table_;
+    // views of the tables in the mapped file, or of the copies below
+    Span<const Elf64_Shdr>  section_headers_;
+    Span<const Elf64_Phdr>  program_headers_;
+    Span<const Elf64_Sym>   symbol_table_;
+    std::vector<Elf64_Shdr> section_header_copy_;
+    std::vector<Elf64_Phdr> program_header_copy_;
+    std::vector<Elf64_Sym>  symbol_table_copy_;
     std::unique_ptr<Dwarf>  dwarf_;
 
     // the load bias is used to translate between virtual addresses and file
@@ -85,22 +210,35 @@ private:
     VirtualAddress load_bias_;
 
     // map from section names to section headers
-    std::unordered_map<std::string_view, Elf64_Shdr *> section_map_;
-
-    // map names to potential symbol table entries
-    std::unordered_multimap<std::string_view, Elf64_Sym *> symbol_name_map_;
-
-    struct RangeComparator {
-      bool operator()(const std::pair<FileAddress, FileAddress> &lhs,
-                      const std::pair<FileAddress, FileAddress> &rhs) const {
-        // key comparison for the map, where first is the lower address
-        return lhs.first < rhs.first;
-      }
-    };
-
-    // maps a single address range to a single symbol
-    std::map<std::pair<FileAddress, FileAddress>, Elf64_Sym *, RangeComparator>
-        symbol_addr_map_;
+    std::unordered_map<std::string_view, const Elf64_Shdr *> section_map_;
+
+    // the allocated sections and loadable segments by file address
+    AddressRangeIndex<Elf64_Shdr> section_index_;
+    AddressRangeIndex<Elf64_Phdr> segment_index_;
+
+    // The names of the symbols, sorted by name and then by their order in
+    // the table, indexed on first use. The demangled names are back to back.
+    // Both are views of the cache file, or of the vectors they were built in
+    mutable Span<const SymbolName>      symbol_names_;
+    mutable Span<const char>            demangled_names_;
+    mutable std::vector<SymbolName>     symbol_names_built_;
+    mutable std::string                 demangled_names_built_;
+    mutable std::unique_ptr<IndexCache> symbol_name_cache_;
+    mutable bool                        symbol_names_indexed_ = false;
+
+    // The symbols with addresses as parallel arrays, sorted by start address
+    // (and then by their order in the table), so a lookup is a binary search
+    // over a flat array of starts. Each max_end is the furthest end of any
+    // symbol up to it, so symbols enclosing others can be found by walking
+    // back only as far as one might reach the address. Like the names, they
+    // view the cache file or what they were built in
+    Span<const std::uint64_t>   symbol_starts_;
+    Span<const std::uint64_t>   symbol_ends_;
+    Span<const std::uint64_t>   symbol_max_ends_;
+    Span<const std::uint32_t>   symbol_indices_;
+    std::vector<std::uint64_t>  symbol_addresses_built_;
+    std::vector<std::uint32_t>  symbol_indices_built_;
+    std::unique_ptr<IndexCache> symbol_address_cache_;
   };
 }  // namespace sdb
 
@@ -0,0 +1,84 @@
+#ifndef SDB_EVENT_LOOP_HPP
+#define SDB_EVENT_LOOP_HPP
+
+#include <chrono>
+#include <csignal>
+#include <functional>
+#include <libsdb/process.hpp>
+#include <optional>
+#include <sys/types.h>
+#include <unordered_map>
+
+namespace sdb {
+  // Waits on any number of traced processes and file descriptors (inferior
+  // output pipes, user input, ...) from a single thread, without blocking in
+  // waitpid on any one of them.
+  //
+  // Stops are noticed through a signalfd for SIGCHLD, and exits through a
+  // pidfd per process (where the kernel supports them). Both are watched with
+  // epoll. SIGCHLD is blocked in the constructing thread for the lifetime of
+  // the loop, so the loop should be created before any other threads
+  class EventLoop {
+public:
+    using StopCallback = std::function<void(Process &, const StopReason &)>;
+    using FdCallback   = std::function<void(int fd)>;
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop &)            = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    // `on_stop` is called every time the process changes state. Processes are
+    // removed from the loop once they exit or are terminated
+    void AddProcess(Process &process, StopCallback on_stop);
+    void RemoveProcess(const Process &process);
+
+    // `on_readable` is called whenever `fd` has data to read (or is closed)
+    void AddFd(int fd, FdCallback on_readable);
+    void RemoveFd(int fd);
+
+    // waits for events for up to `timeout` (forever without one) and
+    // dispatches them. Returns the number of callbacks called, 0 meaning we
+    // timed out
+    std::size_t RunOnce(
+        std::optional<std::chrono::milliseconds> timeout = std::nullopt);
+
+    // dispatches events until Stop is called (i.e from a callback) or no
+    // processes or file descriptors are left in the loop
+    void Run();
+    void Stop() { this->stopping_ = true; }
+
+private:
+    struct WatchedProcess {
+      Process     *process;
+      StopCallback on_stop;
+      int          pidfd;  // -1 if pidfd_open isn't supported
+    };
+
+    // polls every process for a state change and calls its callback, until
+    // none has an event left that another reaped for it
+    std::size_t DispatchStops();
+    std::size_t DispatchStopsOnce();
+
+    // reaps a process whose pidfd says it's exited, if it wasn't running
+    std::size_t DispatchExit(pid_t pid);
+
+    // a single epoll_wait, dispatching whatever it returns
+    std::size_t WaitAndDispatch(int timeout_ms);
+
+    void Watch(int fd) const;
+    void Unwatch(int fd) const;
+
+    int      epoll_fd_  = -1;
+    int      signal_fd_ = -1;
+    sigset_t previous_mask_;  // restored on destruction
+    bool     stopping_     = false;
+    bool     poll_pending_ = false;  // check for stops we may have missed
+
+    std::unordered_map<pid_t, WatchedProcess> processes_;
+    std::unordered_map<int, FdCallback>       fds_;
+  };
+}  // namespace sdb
+
+#endif  // SDB_EVENT_LOOP_HPP
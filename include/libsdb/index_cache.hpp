@@ -0,0 +1,80 @@
+#ifndef SDB_INDEX_CACHE_HPP
+#define SDB_INDEX_CACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <libsdb/types.hpp>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace sdb {
+  class Elf;
+
+  // An index built from an ELF file, kept on disk so later loads of the same
+  // file map it rather than build it again. Cache files live in
+  // $XDG_CACHE_HOME/sdb (or ~/.cache/sdb), named by the file's build ID and
+  // the kind of index. Each holds a header, then tables of fixed-size
+  // entries, 8-byte aligned, which are used where they're mapped.
+  //
+  // A cache file is only used if its version, build ID, the size of the ELF
+  // file and its table layout all match. Otherwise it's ignored, and replaced
+  // when the index is next built
+  class IndexCache {
+public:
+    // bumped whenever the layout of the file or of any table changes
+    static constexpr std::uint32_t version = 1;
+
+    // Maps the `kind` index of `elf` if there's a valid cache file with
+    // `n_tables` tables, or else returns nullptr. Files without a build ID
+    // are never cached
+    static std::unique_ptr<IndexCache> Open(const Elf       &elf,
+                                            std::string_view kind,
+                                            std::size_t      n_tables);
+
+    // Saves `tables` as the `kind` index of `elf`. The file is written under
+    // another name then renamed, so it's never seen half written. Failing to
+    // save it isn't an error: the index is just built again next time
+    static void Save(const Elf &elf, std::string_view kind,
+                     const std::vector<Span<const std::byte>> &tables);
+
+    // where cache files are kept, or an empty path if neither XDG_CACHE_HOME
+    // nor HOME is set
+    static std::filesystem::path Directory();
+
+    // a table of `entries` to save
+    template <class T>
+    static Span<const std::byte> AsTable(const std::vector<T> &entries) {
+      return {reinterpret_cast<const std::byte *>(entries.data()),
+              entries.size() * sizeof(T)};
+    }
+
+    ~IndexCache();
+
+    IndexCache(const IndexCache &)            = delete;
+    IndexCache &operator=(const IndexCache &) = delete;
+
+    // table `index` as entries of T, or nullopt if it isn't a whole number
+    // of them
+    template <class T>
+    std::optional<Span<const T>> GetTable(std::size_t index) const {
+      const auto table = this->GetTableBytes(index);
+      if (table.Size() % sizeof(T) != 0) {
+        return std::nullopt;
+      }
+      return Span<const T>(reinterpret_cast<const T *>(table.begin()),
+                           table.Size() / sizeof(T));
+    }
+
+private:
+    IndexCache(std::byte *data, std::size_t size) : data_(data), size_(size) {}
+
+    Span<const std::byte> GetTableBytes(std::size_t index) const;
+
+    std::byte  *data_;
+    std::size_t size_;
+  };
+}  // namespace sdb
+
+#endif  // SDB_INDEX_CACHE_HPP
@@ -0,0 +1,116 @@
+#ifndef SDB_INSTRUCTION_TRACE_HPP
+#define SDB_INSTRUCTION_TRACE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <libsdb/elf.hpp>
+#include <libsdb/process.hpp>
+#include <memory>
+#include <optional>
+#include <string>
+#include <sys/user.h>
+#include <vector>
+
+namespace sdb {
+  // A PC the traced thread reached, with its general purpose registers as
+  // they were there (before it ran the instruction at the PC)
+  struct InstructionTraceStep {
+    VirtualAddress   pc;
+    user_regs_struct regs;
+    // bit `i` is set when the i-th field of `regs` (in user_regs_struct
+    // order) differs from the previous step
+    std::uint32_t changed;
+  };
+
+  // Writes the steps of a thread to a file. Every step is stored as the
+  // difference from the one before: the PC's distance from the previous one,
+  // a bitmask of the registers that changed, and how much each of them
+  // changed by, all as zigzag varints. A step that only moves the PC to the
+  // next instruction takes 2 bytes
+  class InstructionTraceWriter {
+public:
+    InstructionTraceWriter()                                          = delete;
+    InstructionTraceWriter(const InstructionTraceWriter &)            = delete;
+    InstructionTraceWriter &operator=(const InstructionTraceWriter &) = delete;
+
+    // creates (or replaces) the trace at `path`, for a thread of `program`
+    // (loaded at `load_bias`) stepped with `granularity`, which is recorded
+    // along with it for symbolizing the trace later
+    static std::unique_ptr<InstructionTraceWriter> Create(
+        const std::filesystem::path &path, StepMode granularity,
+        const std::filesystem::path &program, VirtualAddress load_bias);
+
+    void Append(const user_regs_struct &regs);
+
+    std::uint64_t StepCount() const { return this->n_steps_; }
+
+private:
+    explicit InstructionTraceWriter(std::ofstream file) :
+        file_(std::move(file)) {}
+
+    std::ofstream    file_;
+    user_regs_struct previous_{};
+    std::uint64_t    n_steps_ = 0;
+  };
+
+  // a trace written by an InstructionTraceWriter, read back
+  class InstructionTrace {
+public:
+    InstructionTrace(const InstructionTrace &)            = delete;
+    InstructionTrace &operator=(const InstructionTrace &) = delete;
+
+    static std::unique_ptr<InstructionTrace> Open(
+        const std::filesystem::path &path);
+
+    StepMode Granularity() const { return this->granularity_; }
+    const std::filesystem::path &Program() const { return this->program_; }
+    VirtualAddress               LoadBias() const { return this->load_bias_; }
+
+    const std::vector<InstructionTraceStep> &Steps() const {
+      return this->steps_;
+    }
+
+private:
+    InstructionTrace() = default;
+
+    StepMode                          granularity_ = StepMode::Instruction;
+    std::filesystem::path             program_;
+    VirtualAddress                    load_bias_;
+    std::vector<InstructionTraceStep> steps_;
+  };
+
+  struct InstructionTraceOptions {
+    // StepMode::Block only records the first instruction after every branch
+    // taken, at a fraction of the cost
+    StepMode granularity = StepMode::Instruction;
+    // stop once the thread gets here. When stepping by block, this is only
+    // seen if it's the target of a branch
+    std::optional<VirtualAddress> until;
+    std::uint64_t                 max_steps = 1 << 20;
+  };
+
+  struct InstructionTraceResult {
+    enum class End { Address, Count, Breakpoint, Stop };
+
+    End           end;
+    std::uint64_t steps;
+    // the last step's; for End::Stop, a signal or the process ending
+    StopReason reason;
+  };
+
+  // Steps the current thread, appending every PC it gets to (the one it's at
+  // first included) to `trace`, until it reaches `options.until`, has taken
+  // `options.max_steps` steps, reaches an enabled breakpoint site, or stops
+  // for any other reason. The other threads stay stopped throughout
+  InstructionTraceResult RecordInstructionTrace(
+      Process &process, InstructionTraceWriter &trace,
+      const InstructionTraceOptions &options);
+
+  // `address` as `function+0x1c`, from the ELF symbols or else the DWARF
+  // functions of `elf`, or nothing if it's in neither
+  std::optional<std::string> SymbolizeAddress(const Elf     &elf,
+                                              VirtualAddress address);
+}  // namespace sdb
+
+#endif  // SDB_INSTRUCTION_TRACE_HPP
@@ -0,0 +1,90 @@
+#ifndef SDB_MEMORY_SNAPSHOT_HPP
+#define SDB_MEMORY_SNAPSHOT_HPP
+
+#include <cstdint>
+#include <libsdb/process.hpp>
+#include <libsdb/types.hpp>
+#include <unordered_map>
+#include <vector>
+
+namespace sdb {
+  // Snapshots of the writable memory of a process, taken at its stops. Only
+  // the pages that changed since the previous snapshot are read and stored:
+  // the kernel's soft-dirty bits (see /proc/<pid>/clear_refs) are cleared
+  // after each snapshot, and /proc/<pid>/pagemap says which pages have been
+  // written to since. Without soft-dirty tracking in the kernel, every page
+  // that's present in memory is read instead, and compared with the copy we
+  // have. The pages are kept back to back in an arena, so memory can be read
+  // as it was at any snapshot.
+  //
+  // Pages are only captured once they're present in memory (or swapped out),
+  // so memory that was never touched before a snapshot can't be read as it
+  // was then
+  class MemorySnapshots {
+public:
+    static constexpr std::size_t page_size = 0x1000;
+
+    explicit MemorySnapshots(Process &process) : process_(process) {}
+
+    MemorySnapshots(const MemorySnapshots &)            = delete;
+    MemorySnapshots &operator=(const MemorySnapshots &) = delete;
+
+    // Takes a snapshot of the stopped process and returns its index, counting
+    // from 0. Clears the soft-dirty bits of the whole process
+    std::size_t Take();
+
+    std::size_t SnapshotCount() const { return this->changes_.size(); }
+
+    // whether the kernel tracks soft-dirty bits for us
+    static bool SoftDirtySupported();
+
+    // The pages that differ between snapshots `from` and `to`, in address
+    // order. A page mapped or unmapped in between counts as changed
+    std::vector<VirtualAddress> ChangedPages(std::size_t from,
+                                             std::size_t to) const;
+
+    // the pages that changed since the snapshot before `index` (every page
+    // captured, for the first)
+    std::vector<VirtualAddress> ChangedPages(std::size_t index) const;
+
+    // memory as it was at snapshot `index`. Fails if any of it wasn't
+    // captured by then
+    std::vector<std::byte> ReadMemory(std::size_t    index,
+                                      VirtualAddress address,
+                                      std::size_t    amount) const;
+
+    // how much page data the snapshots hold altogether
+    std::size_t ArenaSize() const { return this->arena_.size(); }
+
+private:
+    static constexpr std::size_t unmapped = ~std::size_t{0};
+
+    // the contents of a page from snapshot `snapshot` on, at `offset` in the
+    // arena, or unmapped
+    struct PageVersion {
+      std::size_t snapshot;
+      std::size_t offset;
+    };
+
+    struct PageHistory {
+      std::vector<PageVersion> versions;
+      // whether the page was present in memory at the last snapshot
+      bool present = false;
+    };
+
+    // the version of `history` at snapshot `index`, or nullptr if it has none
+    const PageVersion *FindVersion(const PageHistory &history,
+                                   std::size_t        index) const;
+
+    Process                                      &process_;
+    std::unordered_map<std::uint64_t, PageHistory> pages_;
+    std::vector<std::byte>                         arena_;
+    // the pages with a new version in each snapshot, in address order
+    std::vector<std::vector<std::uint64_t>> changes_;
+    // what the pages that may have changed are read into, kept between
+    // snapshots so it's only faulted in once
+    std::vector<std::byte> buffer_;
+  };
+}  // namespace sdb
+
+#endif  // SDB_MEMORY_SNAPSHOT_HPP
@@ -6,9 +6,14 @@
 #include <libsdb/breakpoint_site.hpp>
 #include <libsdb/registers.hpp>
 #include <libsdb/stoppoint_collection.hpp>
+#include <libsdb/tracepoint.hpp>
 #include <libsdb/watchpoint.hpp>
+#include <map>
 #include <memory>
 #include <optional>
+#include <set>
+#include <sys/types.h>
+#include <unordered_map>
 
 namespace sdb {
   class SyscallCatchPolicy {
@@ -67,17 +72,59 @@ private:
     SingleStep,
     SoftwareBreakpoint,
     HardwareBreakpoint,
+    PageWatchpoint,
     Syscall,
     Unknown,
   };
 
+  // how a thread is resumed: running freely, or stepping one instruction or
+  // up to the next branch taken (PTRACE_SINGLEBLOCK)
+  enum class StepMode {
+    None,
+    Instruction,
+    Block,
+  };
+
   struct StopReason {
-    explicit StopReason(int wait_status);
+    explicit StopReason(int wait_status, pid_t tid = 0);
 
+    pid_t                             tid;  // the thread that stopped
     ProcessState                      reason;
     std::uint8_t                      info;
     std::optional<TrapType>           trap_reason;
     std::optional<SyscallInformation> syscall_info;
+    // the page watchpoint that was hit, for TrapType::PageWatchpoint
+    std::optional<Watchpoint::id_type> watchpoint_id;
+  };
+
+  // a range of the inferior's memory and where to read it to (see
+  // Process::ReadMemoryRanges)
+  struct MemoryRange {
+    VirtualAddress  address;
+    Span<std::byte> out;
+  };
+
+  // what we track for every thread of the inferior
+  struct ThreadState {
+    pid_t                      tid;
+    std::unique_ptr<Registers> registers;
+    ProcessState               state = ProcessState::Stopped;
+
+    // PTRACE_SYSCALL stops don't say whether they're an entry or an exit, so
+    // we keep track
+    bool expecting_syscall_exit = false;
+    // whether the thread is being stepped rather than continued
+    StepMode stepping = StepMode::None;
+    // a SIGSTOP we sent the thread (or that the kernel sent a new thread) that
+    // it hasn't reported yet; it's swallowed when it is
+    bool pending_sigstop = false;
+    // whether the thread has been given the process-wide debug registers
+    bool has_debug_registers = false;
+    // a signal to hand the thread when it's next continued
+    int pending_signal = 0;
+    // a stop that happened while we were stopping the other threads, reported
+    // by the next WaitOnSignal
+    std::optional<StopReason> queued_stop;
   };
 
   class Process {
@@ -87,34 +134,91 @@ public:
     Process &operator=(const Process &) = delete;
     ~Process();
 
-    Registers       &GetRegisters() { return *this->registers_; }
-    const Registers &GetRegisters() const { return *this->registers_; }
-
-    void WriteUserArea(std::size_t offset, std::uint64_t data) const;
-    void WriteFprs(const user_fpregs_struct &fprs) const;
-    void WriteGprs(const user_regs_struct &gprs) const;
-
-    // path to the program to launch
+    // the registers of the given thread, or of the current thread
+    Registers &GetRegisters(std::optional<pid_t> tid = std::nullopt);
+    const Registers &GetRegisters(
+        std::optional<pid_t> tid = std::nullopt) const;
+
+    // each of these operates on the given thread, or the current thread
+    void WriteUserArea(std::size_t offset, std::uint64_t data,
+                       std::optional<pid_t> tid = std::nullopt) const;
+    void WriteFprs(const user_fpregs_struct &fprs,
+                   std::optional<pid_t>      tid = std::nullopt) const;
+    void WriteGprs(const user_regs_struct &gprs,
+                   std::optional<pid_t>    tid = std::nullopt) const;
+
+    std::uint64_t ReadUserArea(std::size_t          offset,
+                               std::optional<pid_t> tid = std::nullopt) const;
+    void          ReadFprs(user_fpregs_struct  &fprs,
+                           std::optional<pid_t> tid = std::nullopt) const;
+    void          ReadGprs(user_regs_struct    &gprs,
+                           std::optional<pid_t> tid = std::nullopt) const;
+
+    // Threads are traced as they're created (PTRACE_O_TRACECLONE). The whole
+    // process stops whenever one of its threads does: WaitOnSignal reports
+    // the stop of a single thread, which becomes the current thread, and
+    // stops the others. Resume resumes them all, while StepInstruction only
+    // steps the current thread
+    const std::map<pid_t, ThreadState> &GetThreads() const {
+      return this->threads_;
+    }
+    pid_t GetCurrentThread() const { return this->current_thread_; }
+    void  SetCurrentThread(pid_t tid);
+
+    // path to the program to launch. If `syscall_catch_policy` catches some
+    // syscalls, they're picked out by a seccomp filter installed in the
+    // inferior, so the others never stop it (see SetSyscallCatchPolicy).
+    // The inferior's forks inherit the filter, so they're traced too, and
+    // let run through every stop
     static std::unique_ptr<Process> Launch(
         const std::filesystem::path &program_path, bool debug = true,
-        std::optional<int> stdout_replacement = std::nullopt);
+        std::optional<int> stdout_replacement = std::nullopt,
+        SyscallCatchPolicy syscall_catch_policy =
+            SyscallCatchPolicy::CatchNone());
 
     // takes a PID of an existing process to attach to
     static std::unique_ptr<Process> Attach(pid_t pid);
 
-    // Resume a currently halted process
-    void Resume();
+    // Resume a currently halted process. The thread that reported the last
+    // stop is handed `signal` (i.e the one it stopped with, which is
+    // otherwise dropped)
+    void Resume(int signal = 0);
 
     StopReason StepInstruction();
 
+    // runs the current thread until it takes a branch, stopping just after
+    // it. An enabled breakpoint site at the PC is stepped over on its own, so
+    // that returns after one instruction
+    StopReason StepBlock();
+
+    // Blocks until the process changes state. Events are waited for with
+    // waitpid(-1), so threads are still followed after the inferior moves to
+    // a process group or session of its own (setpgid, setsid). Events for
+    // the threads of other Processes are set aside for those to claim, but
+    // children the debugger waits on by other means may have theirs taken
     StopReason WaitOnSignal();
 
+    // as above, but returns std::nullopt rather than blocking if the process
+    // hasn't changed state (i.e it's still running)
+    std::optional<StopReason> TryWaitOnSignal();
+
+    // whether another Process reaped events of ours while it waited, which
+    // TryWaitOnSignal will pick up though no SIGCHLD will come for them
+    bool HasUnclaimedEvent() const;
+
+    // stops every thread of the running process without a stop to report.
+    // Anything that happens to a thread as it's being stopped (i.e it exits
+    // or hits a breakpoint) is reported by the first WaitOnSignal after the
+    // next Resume
+    void Interrupt();
+
     pid_t        GetPid() const { return pid_; }
     ProcessState state() const { return state_; }
 
-    VirtualAddress GetPc() const {
+    VirtualAddress GetPc(
+        const std::optional<pid_t> tid = std::nullopt) const {
       return VirtualAddress{
-          this->GetRegisters().ReadByIdAs<std::uint64_t>(RegisterID::rip)};
+          this->GetRegisters(tid).ReadByIdAs<std::uint64_t>(RegisterID::rip)};
     }
 
     // The auxiliary vector for a process is a set of identifier/value pairs
@@ -122,11 +226,12 @@ public:
     std::unordered_map<int, std::uint64_t> GetAuxiliaryVector() const;
 
     std::variant<BreakpointSite::id_type, Watchpoint::id_type>
-    GetCurrentHardwareStoppoint() const;
+    GetCurrentHardwareStoppoint(std::optional<pid_t> tid = std::nullopt) const;
 
     // Write the given address to the program counter (RIP)
-    void SetPc(const VirtualAddress address) {
-      this->GetRegisters().WriteById(RegisterID::rip, address.GetAddress());
+    void SetPc(const VirtualAddress      address,
+               const std::optional<pid_t> tid = std::nullopt) {
+      this->GetRegisters(tid).WriteById(RegisterID::rip, address.GetAddress());
     }
 
     // takes a virtual address to read from and the number of bytes to read
@@ -134,6 +239,17 @@ public:
     std::vector<std::byte> ReadMemory(VirtualAddress address,
                                       std::size_t    amount) const;
 
+    // as above, but reads into a caller provided buffer rather than allocating
+    // a new one
+    void ReadMemory(VirtualAddress address, Span<std::byte> out) const;
+
+    // Reads many ranges with a single process_vm_readv, unless some of them
+    // can't be read in full, bypassing the memory cache. Returns how many
+    // bytes of each range were read: a range stops short at the first page
+    // that can't be read, and the ones after it are read regardless
+    std::vector<std::size_t> ReadMemoryRanges(
+        Span<const MemoryRange> ranges) const;
+
     // read the contents of memory with all int3 instructions replaced with the
     // original byte
     std::vector<std::byte> ReadMemoryWithoutTraps(VirtualAddress address,
@@ -141,21 +257,53 @@ public:
 
     template <class T>
     T ReadMemoryAs(const VirtualAddress address) const {
-      auto data = this->ReadMemory(address, sizeof(T));
-      return FromBytes<T>(data);
+      std::array<std::byte, sizeof(T)> data;
+      this->ReadMemory(address, {data.data(), data.size()});
+      return FromBytes<T>(data.data());
     }
 
     // takes a virtual address to write to and a Span<const std::byte>
-    // representing the data to write
+    // representing the data to write.
+    // Writable pages are written in bulk with process_vm_writev, pages the
+    // tracee can't write to (e.g .text) go through /proc/<pid>/mem, and
+    // PTRACE_POKEDATA is used only if both of those fail
     void WriteMemory(VirtualAddress address, Span<const std::byte> data) const;
 
+    // whether the debugger has written to any page in [low, high) that the
+    // inferior can't write to itself (i.e .text), meaning the executable on
+    // disk no longer matches what's in memory there
+    bool HasPatchedMemory(VirtualAddress low, VirtualAddress high) const;
+
+    // whether the process has its own copy of any page in [low, high) rather
+    // than the file's, i.e one it has written to itself (as code that
+    // rewrites itself does). Looked up once per page per stop
+    bool HasPrivateMemory(VirtualAddress low, VirtualAddress high) const;
+
     // create a breakpoint site at the given address
     BreakpointSite &CreateBreakpointSite(VirtualAddress address,
                                          bool           hardware = false,
                                          bool           internal = false);
 
+    // A hardware watchpoint is split into aligned 1, 2, 4 or 8 byte slots
+    // (see PlanWatchSlots), each taking one of the four debug registers, so
+    // it can cover up to 32 bytes, and fewer if the range is misaligned or
+    // other watchpoints hold registers already. Execution can only be
+    // watched a byte at a time. Otherwise, the
+    // pages the range is on are protected (with an injected mprotect), and
+    // the watchpoint is checked whenever the inferior faults on them, so any
+    // number of them can watch ranges of any size for writes or accesses.
+    // Only accesses to the watched pages cost anything: the faulting thread
+    // steps over the access with the pages unprotected, while the other
+    // threads are stopped, and the watchpoint is hit if the access was to
+    // its range or changed it. Like a hardware watchpoint, it's reported
+    // after the access, as a SIGTRAP.
+    //
+    // The kernel doesn't fault on pages, it fails syscalls (with EFAULT)
+    // that access them, and signal handlers can't run on a watched stack, so
+    // page watchpoints are best kept to the heap and globals. Executable
+    // memory can't be watched this way
     Watchpoint &CreateWatchpoint(VirtualAddress address, StoppointMode mode,
-                                 std::size_t size);
+                                 std::size_t size, bool hardware = true);
 
     StoppointCollection<Watchpoint> &GetWatchpoints() {
       return this->watchpoints_;
@@ -181,29 +329,293 @@ public:
 
     void ClearHardwareStoppoint(int index);
 
+    // enable or disable many breakpoint sites at once. Software sites are
+    // grouped by page, so each page is read and written back a single time
+    // instead of every site peeking and poking its own word. Hardware sites
+    // are handled one at a time
+    void EnableBreakpointSites(Span<BreakpointSite *const> sites);
+    void DisableBreakpointSites(Span<BreakpointSite *const> sites);
+
+    // The filter installed by Launch can't be changed afterwards. As long as
+    // the syscalls to catch are among the ones it was built for, only those
+    // stop the inferior. Otherwise every syscall stops it (PTRACE_SYSCALL),
+    // and the ones we aren't catching are filtered out here
     void SetSyscallCatchPolicy(SyscallCatchPolicy info) {
       this->syscall_catch_policy_ = std::move(info);
     }
 
+    // whether syscalls are being caught by the seccomp filter rather than by
+    // stopping on every one of them
+    bool CatchesSyscallsWithSeccomp() const;
+
+    // Runs a syscall in the current thread, as if it had made it itself at
+    // its current instruction, and returns what the syscall returned (a
+    // negative errno on failure). The thread's registers and memory are left
+    // as they were. The process has to be stopped, and not in a syscall
+    std::int64_t InjectSyscall(long                         number,
+                               std::array<std::uint64_t, 6> args = {});
+
+    // Checkpoints are frozen copies of the process, forked from it by an
+    // injected syscall. A checkpoint never runs itself: restarting from it
+    // kills the process and carries on with a fresh fork of the checkpoint
+    // (under a new PID), so it can be restarted from any number of times.
+    // Breakpoints and everything else set up on the process carry over, as
+    // does the Elf of a Target. fork only copies the thread that calls it, so
+    // the process has to be stopped with a single thread. Returns the
+    // checkpoint's id
+    int CreateCheckpoint();
+    // If forking the checkpoint fails, the checkpoint itself becomes the
+    // process
+    void RestartFromCheckpoint(int id);
+    void DeleteCheckpoint(int id);
+
+    // checkpoint ids, and the PIDs of their frozen processes
+    const std::map<int, pid_t> &GetCheckpoints() const {
+      return this->checkpoints_;
+    }
+
+    // Creates a tracepoint at the given address (see Tracepoint). The first
+    // one maps a buffer for hits into the inferior, and trampolines are
+    // mapped near the tracepoints as they're needed
+    Tracepoint &CreateTracepoint(VirtualAddress address);
+
+    StoppointCollection<Tracepoint> &GetTracepoints() {
+      return this->tracepoints_;
+    }
+
+    const StoppointCollection<Tracepoint> &GetTracepoints() const {
+      return this->tracepoints_;
+    }
+
+    // the tracepoints whose jumps overlap [low, high), ordered by address
+    std::vector<Tracepoint *> GetTracepointsCovering(VirtualAddress low,
+                                                     VirtualAddress high) const;
+
+    // the tracepoint hits recorded since the last call, oldest first. This
+    // doesn't stop the inferior, so it can be called while it runs
+    std::vector<TracepointHit> ReadTracepointHits();
+
+    // hits that happened while the buffer was full
+    std::uint64_t DroppedTracepointHits() const;
+
+    // When enabled, memory read while the process is stopped is cached a page
+    // at a time until the process next runs, so repeatedly inspecting the same
+    // pages costs no syscalls. Only enable this if nothing other than the
+    // inferior and the debugger writes to its memory (i.e shared mappings)
+    void SetMemoryCacheEnabled(bool enabled);
+    bool IsMemoryCacheEnabled() const { return this->memory_cache_enabled_; }
+
+    // When enabled (the default), threads are stepped over breakpoint sites
+    // by running a copy of the instruction in a scratch pad near the site, so
+    // the site stays armed and the other threads can keep running. Otherwise,
+    // or when the instruction can't be copied (i.e a syscall), the site is
+    // lifted while the thread steps over it
+    void SetDisplacedSteppingEnabled(bool enabled) {
+      this->displaced_stepping_enabled_ = enabled;
+    }
+    bool IsDisplacedSteppingEnabled() const {
+      return this->displaced_stepping_enabled_;
+    }
+
 private:
+    friend BreakpointSite;  // breakpoint sites keep the memory cache up to
+                            // date when they patch the inferior's memory
+    friend Tracepoint;      // tracepoints write their own trampolines
+    friend Watchpoint;      // page watchpoints protect their pages
+
+    // ptrace only works on stopped threads. When a hit is skipped (see
+    // ReportsBreakpointHit) only the thread that hit the site is stopped, so
+    // it's the one the site has to go through to patch memory
+    pid_t GetStoppedThread() const;
+
     // for static members to construct a
     // Process object
-    Process(const pid_t pid, const bool terminate_on_end,
-            const bool is_attached) :
-        pid_(pid), terminate_on_end_(terminate_on_end),
-        is_attached_(is_attached), registers_(new Registers(*this)) {}
-
-    void ReadAllRegisters();
+    Process(pid_t pid, bool terminate_on_end, bool is_attached);
 
     // used for both hardware breakpoints and watchpoints
     int SetHardwareStoppoint(VirtualAddress address, StoppointMode mode,
                              std::size_t size);
 
-    // called when we know that the process has stopped because of a signal,
+    // called when we know that a thread has stopped because of a signal,
     // rather than because of exit or termination
-    void AugmentStopReason(StopReason &reason);
-
-    StopReason MaybeResumeFromSyscall(const StopReason &reason);
+    void AugmentStopReason(ThreadState &thread, StopReason &reason);
+
+    ThreadState       &GetThread(std::optional<pid_t> tid);
+    const ThreadState &GetThread(std::optional<pid_t> tid) const;
+    ThreadState       &AddThread(pid_t tid);
+    void               RemoveThread(pid_t tid);
+
+    // attaches to the threads of a process we've just attached to
+    void AttachToOtherThreads();
+
+    // flushes the thread's registers and continues (or steps) it
+    void ResumeThread(ThreadState &thread, StepMode mode);
+
+    // steps the current thread, stepping over any breakpoint site at its PC
+    // one instruction at a time
+    StopReason StepThread(StepMode mode);
+    // continues every stopped thread, stepping them over breakpoints first
+    void ResumeAllThreads();
+
+    // if the thread is stopped at an enabled breakpoint site, steps it over
+    // the site
+    void StepOverBreakpoint(ThreadState &thread);
+
+    // steps the thread over the instruction at its PC by single-stepping a
+    // copy of it in a scratch pad, then moves the PC back. Returns the wait
+    // status of the step, or std::nullopt if the instruction can't be
+    // displaced, in which case the thread hasn't moved
+    std::optional<int> DisplacedStep(ThreadState &thread);
+
+    // copies the instruction at `address` to a scratch pad for DisplacedStep
+    bool PrepareDisplacedStep(VirtualAddress address);
+
+    // maps a scratch pad near `address` if there isn't one yet. This needs
+    // the process to be stopped, so it's done as breakpoint sites are enabled.
+    // Failing isn't an error: the site is lifted to step over it instead
+    void EnsureScratchPad(VirtualAddress address);
+
+    // adds a page watchpoint to the index of watched ranges, and protects
+    // the pages it's on, or the other way round
+    void EnablePageWatchpoint(Watchpoint &watchpoint);
+    void DisablePageWatchpoint(Watchpoint &watchpoint);
+
+    // gives the watched pages in [low, high) the protection the page
+    // watchpoints on them need, and any others theirs back, with syscalls
+    // injected into `thread`
+    void ProtectWatchedPages(ThreadState &thread, std::uint64_t low,
+                             std::uint64_t high);
+
+    // the enabled page watchpoints whose ranges overlap [low, high)
+    std::vector<Watchpoint *> FindPageWatchpoints(std::uint64_t low,
+                                                  std::uint64_t high) const;
+
+    // the address the thread, stopped by a SIGSEGV, faulted on, if it was on
+    // a page we've protected
+    std::optional<std::uint64_t> GetWatchedPageFault(
+        const ThreadState &thread) const;
+
+    // Steps a thread that faulted on a watched page over the access, with the
+    // pages it faults on unprotected until it's done. Returns whether `reason`
+    // (updated to the watchpoint hit, or the end of the user's step) is to be
+    // reported. If not, the process carries on
+    bool StepThroughWatchedPages(ThreadState &thread, std::uint64_t address,
+                                 StopReason &reason);
+
+    // checks the condition and ignore count of the site the thread has hit.
+    // A hit that isn't to be reported is stepped over and the process carries
+    // on (or the thread is left stopped if we're `stopping` every thread).
+    // If something else stops the thread while it's stepped over the site
+    // (say the instruction faults), `reason` is updated to that instead
+    bool ReportsBreakpointHit(ThreadState &thread, BreakpointSite &site,
+                              StopReason &reason, bool stopping);
+
+    // blocks until a thread matching `to_await` (a tid, or -1 for any of
+    // ours) stops in a way we should report
+    StopReason WaitForStop(pid_t to_await);
+
+    // Whether `tid` is one of our threads (known or newly cloned),
+    // checkpoints or followed forks
+    bool IsOurs(pid_t tid) const;
+
+    // whether `tid` is a thread of one of forks_ (known or new)
+    bool IsFollowedFork(pid_t tid) const;
+
+    // lets a followed fork carry on from what waitpid reported for it, or
+    // forgets it if it's ended
+    void ResumeFollowedFork(pid_t tid, int wait_status);
+
+    // waitpid(-1) until it reports one of our threads, setting aside events
+    // for anyone else's for their Process to claim. `options` are added to
+    // __WALL (i.e WNOHANG, which may return 0)
+    pid_t WaitOnAnyThread(int &wait_status, int options = 0);
+
+    // updates our state after waitpid reports `wait_status` for `tid`.
+    // Returns the stop to report, or std::nullopt if there's nothing to report
+    // (i.e a thread was created or exited, or a syscall we aren't catching),
+    // in which case the thread has been resumed. When `stopping` (we're
+    // stopping every thread) nothing is resumed and stops are queued instead
+    std::optional<StopReason> HandleThreadEvent(pid_t tid, int wait_status,
+                                                bool stopping = false);
+
+    // makes the stopped thread the current one and stops the others
+    StopReason ReportStop(const StopReason &reason);
+
+    // sends every running thread a SIGSTOP, then waits for all of them to stop
+    void StopAllThreads();
+
+    std::optional<StopReason> TakeQueuedStop();
+
+    // gives a thread that's just been created the hardware breakpoints and
+    // watchpoints set in every other thread
+    void InitializeDebugRegisters(ThreadState &thread);
+
+    // writes a debug register in every thread
+    void WriteDebugRegister(int index, std::uint64_t value);
+
+    // returns std::nullopt if `reason` is a syscall stop that doesn't match
+    // the catch policy
+    std::optional<StopReason> FilterSyscall(const StopReason &reason) const;
+
+    void PatchBreakpointSites(Span<BreakpointSite *const> sites, bool enable);
+
+    // InjectSyscall into a given thread, stopped whatever the process is
+    std::int64_t InjectSyscall(ThreadState &thread, long number,
+                               std::array<std::uint64_t, 6> args);
+
+    // Forks the current thread with an injected clone(CLONE_PARENT |
+    // SIGCHLD), and returns the child: traced, stopped, and put back the way
+    // the thread was before the syscall. CLONE_PARENT gives it our parent,
+    // so the process never gets a SIGCHLD from it or reaps it
+    pid_t ForkCurrentThread();
+
+    // starts tracking `pid`, a stopped fork of the process with a single
+    // thread, in place of the process
+    void TrackFork(pid_t pid);
+
+    // brings a fork of checkpoint `id` up to date with the stoppoints as
+    // they are now: breakpoint sites, tracepoints (and the mappings they
+    // need) and the protection of watched pages
+    void ReapplyStoppoints(int id);
+
+    // space for a trampoline (or a scratch pad) within a jump of `address`
+    VirtualAddress AllocateTrampoline(VirtualAddress address);
+    // maps a region of trampolines at `address`, which has to be unmapped
+    void MapTrampolineRegion(std::uint64_t address);
+
+    // `record_patches` controls whether writes to pages the inferior can't
+    // write to are added to `patched_pages_`. Breakpoint sites aren't
+    // recorded, as the sites themselves keep track of their int3s
+    void WriteMemory(VirtualAddress address, Span<const std::byte> data,
+                     bool record_patches) const;
+
+    // each of these returns the number of bytes written from the start of
+    // `data`, stopping at the first page it fails to write
+    std::size_t WriteMemoryWithVmWritev(VirtualAddress        address,
+                                        Span<const std::byte> data) const;
+    std::size_t WriteMemoryWithProcMem(VirtualAddress        address,
+                                       Span<const std::byte> data) const;
+    void        WriteMemoryWithPtrace(VirtualAddress        address,
+                                      Span<const std::byte> data) const;
+
+    // lazily opened descriptor for /proc/<pid>/mem
+    int GetMemFd() const;
+
+    // read memory straight from the inferior, bypassing the memory cache
+    void ReadMemoryUncached(VirtualAddress address, Span<std::byte> out) const;
+
+    // copy the given range out of the cache, filling in any pages we haven't
+    // read yet. Returns false if any of the pages can't be read
+    bool ReadMemoryCached(VirtualAddress address, Span<std::byte> out) const;
+
+    // update any cached pages overlapping the range with the given data
+    void UpdateMemoryCache(VirtualAddress        address,
+                           Span<const std::byte> data) const;
+
+    void InvalidateMemoryCache() const {
+      this->memory_cache_.clear();
+      this->private_pages_.clear();
+    }
 
     // for the process we're tracking
     pid_t pid_ = 0;
@@ -211,15 +623,86 @@ private:
     bool terminate_on_end_ = true;
     bool is_attached_      = false;
 
-    bool expecting_syscall_exit_ =
-        false;  // used to track if we expect a syscall exit
+    // file descriptor for /proc/<pid>/mem; opened on first use
+    mutable int mem_fd_ = -1;
+
+    // pages written through /proc/<pid>/mem or PTRACE_POKEDATA
+    mutable std::set<std::uint64_t> patched_pages_;
+
+    // pages of the inferior's memory read during the current stop, keyed by
+    // page address
+    bool memory_cache_enabled_ = false;
+    mutable std::unordered_map<std::uint64_t, std::array<std::byte, 0x1000>>
+        memory_cache_;
+    // whether each page HasPrivateMemory has looked up during the current
+    // stop is the process's own copy
+    mutable std::unordered_map<std::uint64_t, bool> private_pages_;
+
+    // checkpoint ids to the frozen forks they stand for
+    std::map<int, pid_t> checkpoints_;
+    int                  next_checkpoint_id_ = 1;
 
     // current state of the process
-    ProcessState                        state_ = ProcessState::Stopped;
-    std::unique_ptr<Registers>          registers_;
+    ProcessState                 state_ = ProcessState::Stopped;
+    std::map<pid_t, ThreadState> threads_;
+    pid_t                        current_thread_ = 0;
+    // dr0-dr7 as the hardware stoppoints would have them, for new threads
+    std::array<std::uint64_t, 8>        debug_registers_{};
     StoppointCollection<BreakpointSite> breakpoint_sites_;
     StoppointCollection<Watchpoint>     watchpoints_;
+    // An interval index over the ranges of the enabled page watchpoints:
+    // sorted by their start, with the furthest end of any range up to each,
+    // so a lookup only walks back over ranges that can reach the address
+    struct WatchedRange {
+      std::uint64_t low;
+      std::uint64_t high;
+      std::uint64_t max_high;
+      Watchpoint   *watchpoint;
+    };
+    std::vector<WatchedRange> watched_ranges_;
+    // the pages we've protected, with the protection the inferior had given
+    // them and the one they have now
+    struct ProtectedPage {
+      int original;
+      int current;
+    };
+    std::map<std::uint64_t, ProtectedPage> protected_pages_;
+    // protected_pages_ as it was when each checkpoint was made, which is how
+    // a fork of it finds its pages
+    std::map<int, std::map<std::uint64_t, ProtectedPage>> checkpoint_pages_;
     SyscallCatchPolicy syscall_catch_policy_ = SyscallCatchPolicy::CatchNone();
+    // the (sorted) syscalls the inferior's seccomp filter traps, if it has one
+    std::vector<int> seccomp_syscalls_;
+    // The inferior's forks (and theirs) inherit its seccomp filter, and with
+    // no tracer the syscalls it traps would fail with ENOSYS. So while it has
+    // one, we trace them too, letting them through every stop. Each is
+    // mapped to whether its ptrace options are set yet
+    std::map<pid_t, bool> forks_;
+
+    StoppointCollection<Tracepoint>   tracepoints_;
+    std::unique_ptr<TracepointBuffer> tracepoint_buffer_;
+    // executable mappings in the inferior that trampolines are handed out
+    // from, in order
+    struct TrampolineRegion {
+      std::uint64_t address;
+      std::size_t   used;
+    };
+    std::vector<TrampolineRegion> trampoline_regions_;
+
+    bool displaced_stepping_enabled_ = true;
+    // scratch pads for displaced stepping, carved out of the trampoline
+    // regions
+    std::vector<std::uint64_t> scratch_pads_;
+    // the instruction last copied to a scratch pad, which a thread hitting
+    // the same site again can reuse. Writing over the original drops it
+    struct DisplacedInstruction {
+      std::uint64_t from;
+      std::uint64_t scratch;
+      std::size_t   length;     // of the original
+      std::size_t   copy_size;  // of the copy, which may have grown
+      bool          is_call;
+    };
+    mutable std::optional<DisplacedInstruction> displaced_;
   };
 }  // namespace sdb
 
@@ -0,0 +1,73 @@
+#ifndef SDB_PROFILER_HPP
+#define SDB_PROFILER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <libsdb/elf.hpp>
+#include <libsdb/process.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace sdb {
+  struct ProfileOptions {
+    // samples per second. The default is off the round numbers, so we don't
+    // keep sampling in step with the inferior's own timers
+    unsigned                  frequency = 99;
+    std::chrono::milliseconds duration{std::chrono::seconds(10)};
+    // frames per stack, the PC included
+    std::size_t max_depth = 128;
+  };
+
+  // a file mapped into the inferior's memory, from /proc/<pid>/maps
+  struct ProfileMapping {
+    std::uint64_t         low;
+    std::uint64_t         high;
+    std::uint64_t         offset;  // of `low` in the file
+    std::filesystem::path path;
+  };
+
+  // The stacks sampled by RecordProfile, kept as raw addresses. Nothing is
+  // symbolized until the profile is folded
+  class Profile {
+public:
+    std::size_t SampleCount() const { return this->sample_ends_.size(); }
+
+    // the stack of the i-th sample: its PC, then the return addresses found
+    // by walking its frame pointers
+    Span<const std::uint64_t> GetStack(std::size_t i) const;
+
+    // how many times the process was stopped to sample its threads, and how
+    // long it was kept stopped for altogether
+    std::size_t              TickCount() const { return this->n_ticks_; }
+    std::chrono::nanoseconds StoppedTime() const { return this->stopped_; }
+
+    // The distinct stacks sampled and how many times each was, in the folded
+    // format flamegraph.pl and the like read: the frames outermost first,
+    // separated by semicolons. Each distinct address is symbolized once, from
+    // `elf` (the executable) or else the symbols of whichever file was mapped
+    // there
+    std::map<std::string, std::uint64_t> Fold(const Elf &elf) const;
+
+private:
+    friend Profile RecordProfile(Process              &process,
+                                 const ProfileOptions &options);
+
+    // every sample's frames back to back, and where each sample ends
+    std::vector<std::uint64_t>  frames_;
+    std::vector<std::size_t>    sample_ends_;
+    std::vector<ProfileMapping> mappings_;
+    std::size_t                 n_ticks_ = 0;
+    std::chrono::nanoseconds    stopped_{0};
+  };
+
+  // Samples every thread of the process `options.frequency` times a second
+  // for `options.duration`, or until it ends, then leaves it stopped. Stops
+  // of its own (i.e signals) are sampled like any other, and the signal is
+  // delivered as the process is resumed for the next sample. It waits on the
+  // process with an EventLoop, so see there about SIGCHLD
+  Profile RecordProfile(Process &process, const ProfileOptions &options);
+}  // namespace sdb
+
+#endif  // SDB_PROFILER_HPP
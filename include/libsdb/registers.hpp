@@ -3,6 +3,7 @@
 
 #include <libsdb/register_info.hpp>
 #include <libsdb/types.hpp>
+#include <sys/types.h>
 #include <sys/user.h>
 #include <variant>
 
@@ -34,15 +35,68 @@ public:
       this->Write(RegisterInfoByID(id), val);
     }
 
+    // every general purpose register at once
+    const user_regs_struct &GetGprs() const;
+
+    // Writes are batched: they only update our copy of the registers until
+    // the inferior is resumed or stepped, at which point each modified class
+    // is written back with as few syscalls as possible (one PTRACE_SETREGS
+    // for the GPRs, one PTRACE_SETFPREGS for the FPRs and one
+    // PTRACE_POKEUSER per modified debug register)
+
+    // writes back the pending batch now instead of on resume
+    void Flush();
+    // drops the pending batch; the affected registers are fetched again from
+    // the inferior on their next access
+    void Discard();
+
+    struct WriteStats {
+      std::uint64_t writes   = 0;  // calls to `Write`
+      std::uint64_t syscalls = 0;  // ptrace requests issued to flush them
+
+      std::uint64_t Saved() const {
+        return this->writes > this->syscalls ? this->writes - this->syscalls
+                                             : 0;
+      }
+    };
+
+    // statistics for the most recent flushed batch, and for every flushed
+    // batch since the process was created
+    const WriteStats &GetLastBatchStats() const { return this->last_batch_; }
+    const WriteStats &GetTotalStats() const { return this->total_; }
+
 private:
     friend Process;  // Process should be able to construct a Registers object
-    explicit Registers(Process &proc) : proc_(&proc) {}
+    Registers(Process &proc, const pid_t tid) : proc_(&proc), tid_(tid) {}
+
+    // Registers are fetched from the inferior one class at a time (GPRs with
+    // PTRACE_GETREGS, FPRs with PTRACE_GETFPREGS and the debug registers with
+    // PTRACE_PEEKUSER) the first time a register of that class is accessed
+    // during a stop
+    void EnsureLoaded(RegisterType type) const;
+
+    // called by Process whenever the inferior stops; forgets all fetched
+    // registers (and any pending writes)
+    void Invalidate();
+
+    mutable user data_;  // this struct is populated lazily, a register class
+                         // at a time (see `EnsureLoaded`)
+    Process     *proc_;  // pointer to our parent process to allow it to read
+                         // mem for us
+    pid_t        tid_;   // the thread these registers belong to
+
+    mutable bool gprs_loaded_ = false;
+    mutable bool fprs_loaded_ = false;
+    mutable bool drs_loaded_  = false;
+
+    bool gprs_dirty_ = false;  // written since the last flush
+    bool fprs_dirty_ = false;
+    // bit `i` is set when u_debugreg[i] was written since the last flush
+    std::uint8_t drs_dirty_ = 0;
 
-    user data_;      // this struct is populated when reading all registers (via
-                     // ptrace for GPR and FPR registers); debug registers are
-                     // populated manually
-    Process *proc_;  // pointer to our parent process to allow it to read mem
-                     // for us
+    WriteStats pending_;  // the batch that hasn't been flushed yet
+    WriteStats last_batch_;
+    WriteStats total_;
   };
 
 }  // namespace sdb
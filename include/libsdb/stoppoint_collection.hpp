@@ -1,34 +1,51 @@
 #ifndef SDB_STOPPOINT_COLLECTION_HPP
 #define SDB_STOPPOINT_COLLECTION_HPP
 
+#include <algorithm>
+#include <libsdb/error.hpp>
 #include <libsdb/types.hpp>
 #include <memory>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace sdb {
   template <class StopPoint>
   class StoppointCollection {
 public:
+    using id_type = typename StopPoint::id_type;
+
     StopPoint &Push(std::unique_ptr<StopPoint> bs) {
+      auto &point = *bs;
       this->stoppoints_.push_back(std::move(bs));
-      return *this->stoppoints_.back();
+      this->by_id_.emplace(point.GetId(), &point);
+      this->by_address_.emplace_back(point.Address().GetAddress(), &point);
+      return point;
     }
 
-    bool ContainsId(typename StopPoint::id_type id) const;
+    bool ContainsId(id_type id) const;
     bool ContainsAddress(VirtualAddress address) const;
     bool EnabledStopPointAtAddress(VirtualAddress address) const;
 
-    StopPoint       &GetById(typename StopPoint::id_type id);
-    const StopPoint &GetById(typename StopPoint::id_type id) const;
+    // return nullptr when there's no such stop point
+    StopPoint       *FindById(id_type id);
+    const StopPoint *FindById(id_type id) const;
+    StopPoint       *FindByAddress(VirtualAddress address);
+    const StopPoint *FindByAddress(VirtualAddress address) const;
+
+    StopPoint       &GetById(id_type id);
+    const StopPoint &GetById(id_type id) const;
 
     StopPoint               &GetByAddress(VirtualAddress address);
     const StopPoint         &GetByAddress(VirtualAddress address) const;
+    // the stop points in [low, high), ordered by address
     std::vector<StopPoint *> GetInRegion(VirtualAddress low,
                                          VirtualAddress high) const;
 
-    void RemoveById(typename StopPoint::id_type id);
+    void RemoveById(id_type id);
     void RemoveByAddress(VirtualAddress address);
 
+    // visits the stop points in the order they were created
     template <class F>
     void ForEach(F f);
 
@@ -41,85 +58,121 @@ public:
 
 private:
     using points_t = std::vector<std::unique_ptr<StopPoint>>;
+    using index_t  = std::vector<std::pair<std::uint64_t, StopPoint *>>;
+
+    // sorts the entries pushed since the last lookup into the address index
+    void SortIndex() const;
+    // the first index entry at or after the given address
+    typename index_t::const_iterator LowerBound(VirtualAddress address) const;
+
+    void Remove(StopPoint &point);
+
+    points_t                                 stoppoints_;  // creation order
+    std::unordered_map<id_type, StopPoint *> by_id_;
+    // (address, stop point) pairs sorted by address. Stop points tend to be
+    // created in bulk, so new entries are appended and only sorted into place
+    // by the next lookup
+    mutable index_t     by_address_;
+    mutable std::size_t n_sorted_ = 0;  // length of the sorted prefix
+  };
+
+  template <class StopPoint>
+  void StoppointCollection<StopPoint>::SortIndex() const {
+    if (this->n_sorted_ == this->by_address_.size()) {
+      return;
+    }
 
-    typename points_t::iterator       FindById(typename StopPoint::id_type id);
-    typename points_t::const_iterator FindById(
-        typename StopPoint::id_type id) const;
-    typename points_t::iterator       FindByAddress(VirtualAddress address);
-    typename points_t::const_iterator FindByAddress(
-        VirtualAddress address) const;
+    // stable, so a lookup finds the earliest created of several stop points
+    // at the same address
+    const auto by_address = [](const auto &lhs, const auto &rhs)
+    { return lhs.first < rhs.first; };
+    const auto middle = this->by_address_.begin() + this->n_sorted_;
+    std::stable_sort(middle, this->by_address_.end(), by_address);
+    std::inplace_merge(this->by_address_.begin(), middle,
+                       this->by_address_.end(), by_address);
+    this->n_sorted_ = this->by_address_.size();
+  }
 
-    points_t stoppoints_;
-  };
+  template <class StopPoint>
+  auto StoppointCollection<StopPoint>::LowerBound(
+      const VirtualAddress address) const ->
+      typename index_t::const_iterator {
+    this->SortIndex();
+    return std::lower_bound(this->by_address_.begin(), this->by_address_.end(),
+                            address.GetAddress(),
+                            [](const auto &entry, const std::uint64_t value)
+                            { return entry.first < value; });
+  }
 
   template <class StopPoint>
-  auto StoppointCollection<StopPoint>::FindById(typename StopPoint::id_type id)
-      -> typename points_t::iterator {
-    return std::find_if(this->stoppoints_.begin(), this->stoppoints_.end(),
-                        [=](auto &point) { return point->GetId() == id; });
+  StopPoint *StoppointCollection<StopPoint>::FindById(const id_type id) {
+    const auto it = this->by_id_.find(id);
+    return it == this->by_id_.end() ? nullptr : it->second;
   }
 
   template <class StopPoint>
-  auto StoppointCollection<StopPoint>::FindById(typename StopPoint::id_type id)
-      const -> typename points_t::const_iterator {
+  const StopPoint *StoppointCollection<StopPoint>::FindById(
+      const id_type id) const {
     return const_cast<StoppointCollection *>(this)->FindById(id);
   }
 
   template <class StopPoint>
-  auto StoppointCollection<StopPoint>::FindByAddress(VirtualAddress address) ->
-      typename points_t::iterator {
-    return std::find_if(this->stoppoints_.begin(), this->stoppoints_.end(),
-                        [=](auto &point) { return point->AtAddress(address); });
+  StopPoint *StoppointCollection<StopPoint>::FindByAddress(
+      const VirtualAddress address) {
+    const auto it = this->LowerBound(address);
+    if (it == this->by_address_.end() or it->first != address.GetAddress()) {
+      return nullptr;
+    }
+    return it->second;
   }
 
   template <class StopPoint>
-  auto StoppointCollection<StopPoint>::FindByAddress(
-      const VirtualAddress address) const -> typename points_t::const_iterator {
+  const StopPoint *StoppointCollection<StopPoint>::FindByAddress(
+      const VirtualAddress address) const {
     return const_cast<StoppointCollection *>(this)->FindByAddress(address);
   }
 
   template <class StopPoint>
-  bool StoppointCollection<StopPoint>::ContainsId(
-      typename StopPoint::id_type id) const {
-    return this->FindById(id) != this->stoppoints_.end();
+  bool StoppointCollection<StopPoint>::ContainsId(const id_type id) const {
+    return this->FindById(id) != nullptr;
   }
 
   template <class StopPoint>
   bool StoppointCollection<StopPoint>::ContainsAddress(
       const VirtualAddress address) const {
-    return this->FindByAddress(address) != this->stoppoints_.end();
+    return this->FindByAddress(address) != nullptr;
   }
 
   template <class StopPoint>
   bool StoppointCollection<StopPoint>::EnabledStopPointAtAddress(
       const VirtualAddress address) const {
-    return ContainsAddress(address) && GetByAddress(address).IsEnabled();
+    const auto point = this->FindByAddress(address);
+    return point != nullptr && point->IsEnabled();
   }
 
   template <class StopPoint>
-  StopPoint &StoppointCollection<StopPoint>::GetById(
-      typename StopPoint::id_type id) {
-    auto it = this->FindById(id);
-    if (it == end(this->stoppoints_)) {
+  StopPoint &StoppointCollection<StopPoint>::GetById(const id_type id) {
+    const auto point = this->FindById(id);
+    if (point == nullptr) {
       Error::Send("Invalid StopPoint id");
     }
-    return **it;
+    return *point;
   }
 
   template <class StopPoint>
   const StopPoint &StoppointCollection<StopPoint>::GetById(
-      typename StopPoint::id_type id) const {
+      const id_type id) const {
     return const_cast<StoppointCollection *>(this)->GetById(id);
   }
 
   template <class StopPoint>
   StopPoint &StoppointCollection<StopPoint>::GetByAddress(
       const VirtualAddress address) {
-    auto it = this->FindByAddress(address);
-    if (it == end(this->stoppoints_)) {
+    const auto point = this->FindByAddress(address);
+    if (point == nullptr) {
       Error::Send("StopPoint with given address not found");
     }
-    return **it;
+    return *point;
   }
 
   template <class StopPoint>
@@ -129,19 +182,34 @@ private:
   }
 
   template <class StopPoint>
-  void StoppointCollection<StopPoint>::RemoveById(
-      typename StopPoint::id_type id) {
-    auto it = this->FindById(id);
-    (**it).Disable();
-    this->stoppoints_.erase(it);
+  void StoppointCollection<StopPoint>::Remove(StopPoint &point) {
+    point.Disable();
+
+    this->by_id_.erase(point.GetId());
+
+    // the index is sorted by now, so removing keeps it sorted
+    auto it = this->by_address_.begin() +
+              (this->LowerBound(point.Address()) - this->by_address_.begin());
+    while (it->second != &point) {
+      ++it;
+    }
+    this->by_address_.erase(it);
+    --this->n_sorted_;
+
+    this->stoppoints_.erase(
+        std::find_if(this->stoppoints_.begin(), this->stoppoints_.end(),
+                     [&](const auto &p) { return p.get() == &point; }));
+  }
+
+  template <class StopPoint>
+  void StoppointCollection<StopPoint>::RemoveById(const id_type id) {
+    this->Remove(this->GetById(id));
   }
 
   template <class StopPoint>
   void StoppointCollection<StopPoint>::RemoveByAddress(
       const VirtualAddress address) {
-    auto it = this->FindByAddress(address);
-    (**it).Disable();
-    this->stoppoints_.erase(it);
+    this->Remove(this->GetByAddress(address));
   }
 
   template <class StopPoint>
@@ -162,13 +230,13 @@ private:
 
   template <class StopPoint>
   std::vector<StopPoint *> StoppointCollection<StopPoint>::GetInRegion(
-      VirtualAddress low, VirtualAddress high) const {
+      const VirtualAddress low, const VirtualAddress high) const {
     std::vector<StopPoint *> ret;
 
-    for (const auto &site : this->stoppoints_) {
-      if (site->IsInRange(low, high)) {
-        ret.push_back(site.get());
-      }
+    for (auto it = this->LowerBound(low);
+         it != this->by_address_.end() and it->first < high.GetAddress();
+         ++it) {
+      ret.push_back(it->second);
     }
 
     return ret;
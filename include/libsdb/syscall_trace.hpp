@@ -0,0 +1,85 @@
+#ifndef SDB_SYSCALL_TRACE_HPP
+#define SDB_SYSCALL_TRACE_HPP
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <libsdb/process.hpp>
+#include <memory>
+#include <vector>
+
+namespace sdb {
+  // A syscall entry or exit, as it's stored in a SyscallTraceLog. Records only
+  // hold raw values, so writing one is a copy; turning them into text is left
+  // until they're read back
+  struct SyscallRecord {
+    std::uint64_t timestamp_ns;  // CLOCK_MONOTONIC
+    std::int32_t  tid;
+    std::uint16_t id;
+    std::uint8_t  entry;
+    std::uint8_t  reserved = 0;
+    // the arguments on entry. On exit, the first one is the return value
+    std::array<std::uint64_t, 6> args;
+  };
+  static_assert(sizeof(SyscallRecord) == 64, "records should be a cache line");
+
+  // A ring buffer of fixed-size SyscallRecords in a memory mapping, backed by a
+  // file or anonymous. Once it's full, the oldest records are overwritten.
+  // The kernel writes a file-backed log back on its own, so it can be read
+  // with Open once the tracer is done (or has crashed)
+  class SyscallTraceLog {
+public:
+    SyscallTraceLog()                                   = delete;
+    SyscallTraceLog(const SyscallTraceLog &)            = delete;
+    SyscallTraceLog &operator=(const SyscallTraceLog &) = delete;
+    ~SyscallTraceLog();
+
+    // creates (or replaces) the log at `path`, with room for `capacity`
+    // records
+    static std::unique_ptr<SyscallTraceLog> Create(
+        const std::filesystem::path &path, std::size_t capacity);
+    // a log that only lives as long as this object does
+    static std::unique_ptr<SyscallTraceLog> CreateAnonymous(
+        std::size_t capacity);
+    // a log written by an earlier trace
+    static std::unique_ptr<SyscallTraceLog> Open(
+        const std::filesystem::path &path);
+
+    void Append(const SyscallRecord &record);
+    // records the syscall stop described by `reason`, timestamped now
+    void Append(const StopReason &reason);
+
+    std::size_t Capacity() const { return this->header_->capacity; }
+    // every record ever appended, including the ones since overwritten
+    std::uint64_t TotalRecords() const { return this->header_->n_records; }
+    std::uint64_t DroppedRecords() const;
+
+    // the records still in the buffer, oldest first
+    std::vector<SyscallRecord> Records() const;
+
+private:
+    // at the start of the mapping, padded so the records are cache-aligned
+    struct alignas(64) Header {
+      std::array<char, 8> magic;
+      std::uint64_t       capacity;
+      std::uint64_t       n_records;
+    };
+
+    SyscallTraceLog(void *mapping, std::size_t size);
+
+    static std::size_t MappingSize(std::size_t capacity);
+
+    Header        *header_;
+    SyscallRecord *records_;
+    std::size_t    mapping_size_;
+  };
+
+  // Resumes the process, appending each syscall stop to `log`, until it stops
+  // for any other reason or ends. Returns that stop. Which syscalls stop it is
+  // up to the process's SyscallCatchPolicy. `signal` is handed to the thread
+  // that reported the last stop (i.e the signal a previous trace ended on)
+  StopReason TraceSyscalls(Process &process, SyscallTraceLog &log,
+                           int signal = 0);
+}  // namespace sdb
+
+#endif  // SDB_SYSCALL_TRACE_HPP
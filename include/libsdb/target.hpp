@@ -2,6 +2,7 @@
 #define SDB_TARGET_HPP
 
 #include <filesystem>
+#include <libsdb/elf.hpp>
 #include <libsdb/process.hpp>
 #include <memory>
 #include <optional>
@@ -25,10 +26,29 @@ public:
     Elf&       GetElf() { return *this->elf_; }
     const Elf& GetElf() const { return *this->elf_; }
 
+    // Read the inferior's memory. Bytes in non-writable, file-backed segments
+    // of the executable are copied from the mapped ELF file rather than from
+    // the live process, unless the debugger has written to them or the
+    // inferior has (i.e code that rewrites itself)
+    std::vector<std::byte> ReadMemory(VirtualAddress address,
+                                      std::size_t    amount) const;
+
+    // as above, with all int3 instructions replaced with the original byte
+    std::vector<std::byte> ReadMemoryWithoutTraps(VirtualAddress address,
+                                                  std::size_t    amount) const;
+
 private:
     Target(std::unique_ptr<Process> process, std::unique_ptr<Elf> elf) :
         process_(std::move(process)), elf_(std::move(elf)) {}
 
+    // the file-backed bytes of a read-only segment starting at `address`
+    // (empty if the address isn't in one)
+    Span<const std::byte> GetReadOnlyFileData(VirtualAddress address) const;
+
+    std::vector<std::byte> ReadMemory(VirtualAddress address,
+                                      std::size_t    amount,
+                                      bool           with_traps) const;
+
     std::unique_ptr<Process> process_;
     std::unique_ptr<Elf>     elf_;
   };
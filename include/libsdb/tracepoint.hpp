@@ -0,0 +1,166 @@
+#ifndef SDB_TRACEPOINT_HPP
+#define SDB_TRACEPOINT_HPP
+
+#include <cstdint>
+#include <libsdb/types.hpp>
+#include <memory>
+#include <vector>
+
+namespace sdb {
+  class Process;
+
+  // A thread reaching a tracepoint, with its general purpose registers as
+  // they were before it ran the instruction at the tracepoint
+  struct TracepointHit {
+    std::uint64_t address;  // the tracepoint's
+    std::uint64_t rax, rbx, rcx, rdx, rsi, rdi, rbp, rsp;
+    std::uint64_t r8, r9, r10, r11, r12, r13, r14, r15;
+    std::uint64_t rflags;
+  };
+
+  // A tracepoint records hits without stopping the inferior. The
+  // instructions at its address are overwritten with a jump to a trampoline
+  // in the inferior, which saves the registers to a TracepointBuffer, runs the
+  // instructions it displaced (relocated with Zydis) and jumps back.
+  //
+  // At least 5 bytes of instructions are displaced, so none of them can be the
+  // target of a jump from elsewhere in the function; function entries are the
+  // safe place for tracepoints. Nor can any but the last of them end the flow
+  // (i.e ret or jmp). They can only be created, enabled and disabled while
+  // the process is stopped
+  class Tracepoint {
+public:
+    Tracepoint()                              = delete;
+    Tracepoint(const Tracepoint &)            = delete;
+    Tracepoint &operator=(const Tracepoint &) = delete;
+
+    using id_type = std::int32_t;
+    id_type GetId() const { return this->id_; }
+
+    // writes (or removes) the jump to the trampoline
+    void Enable();
+    void Disable();
+
+    VirtualAddress Address() const { return this->address_; }
+
+    bool AtAddress(const VirtualAddress address) const {
+      return address == this->address_;
+    }
+
+    bool IsInRange(const VirtualAddress low, const VirtualAddress high) const {
+      return low <= this->address_ && high > this->address_;
+    }
+
+    bool IsEnabled() const { return this->is_enabled_; }
+
+    // the number of bytes of instructions replaced by the jump
+    std::size_t Size() const { return this->original_.size(); }
+
+    // what's written over those bytes while the tracepoint is enabled: the
+    // jump, followed by int3s in place of the rest of the displaced bytes
+    std::vector<std::byte> GetJump() const;
+
+    VirtualAddress TrampolineAddress() const { return this->trampoline_; }
+
+    // hits read back by Process::ReadTracepointHits so far
+    std::uint64_t GetHitCount() const { return this->hit_count_; }
+
+private:
+    friend Process;
+
+    // builds the trampoline at `trampoline` (space the process has mapped
+    // near `address`), recording hits to the buffer at `buffer`
+    Tracepoint(Process &process, VirtualAddress address,
+               VirtualAddress trampoline, VirtualAddress buffer);
+
+    // the number of bytes of instructions a tracepoint at `address` would
+    // displace. Throws if they can't be displaced
+    static std::size_t DisplacedSize(Process &process, VirtualAddress address);
+
+    // writes the trampoline (recording hits to the buffer at `buffer`) and
+    // the jump or the original instructions again, for a fork of the process
+    // made before either was in place
+    void Restore(VirtualAddress buffer);
+
+    // the most a jump can displace: the first 4 bytes of it, then an
+    // instruction as long as they get
+    static constexpr std::size_t max_size = 4 + 15;
+
+    // room for a trampoline: the code saving the registers, up to 19 bytes of
+    // displaced instructions (which can grow when relocated) and the jump back
+    static constexpr std::size_t trampoline_size = 0x140;
+
+    id_type        id_;
+    Process       *process_;
+    VirtualAddress address_;
+    VirtualAddress trampoline_;
+    bool           is_enabled_ = false;
+    // the instructions the jump replaces, as they were
+    std::vector<std::byte> original_;
+    // the trampoline's code
+    std::vector<std::byte> code_;
+    std::uint64_t          hit_count_ = 0;
+  };
+
+  // The ring buffer the trampolines record hits in. It's a memfd mapped into
+  // both the inferior and the debugger, so reading hits back doesn't involve
+  // the inferior at all.
+  //
+  // Trampolines claim a slot by advancing `head` with a compare-and-swap, so
+  // any number of threads can record hits at once, and publish it by writing
+  // its sequence number last. The debugger copies published slots out and
+  // then advances `tail`. When the buffer is full, hits are counted in
+  // `dropped` rather than waiting for room
+  class TracepointBuffer {
+public:
+    TracepointBuffer()                                    = delete;
+    TracepointBuffer(const TracepointBuffer &)            = delete;
+    TracepointBuffer &operator=(const TracepointBuffer &) = delete;
+    ~TracepointBuffer();
+
+    // the layout the trampolines write to, with the slots starting on the
+    // page after the header
+    struct Header {
+      std::uint64_t head;      // slots claimed
+      std::uint64_t tail;      // slots read back
+      std::uint64_t capacity;  // a power of two
+      std::uint64_t mask;      // capacity - 1
+      std::uint64_t dropped;
+    };
+
+    struct Slot {
+      std::uint64_t sequence;  // the slot's index in the stream, plus one
+      TracepointHit hit;
+    };
+
+    static constexpr std::size_t slots_offset = 0x1000;
+
+    // sets up a buffer with room for `capacity` hits (rounded up to a power
+    // of two) shared with the process, which has to be stopped
+    static std::unique_ptr<TracepointBuffer> Create(Process    &process,
+                                                    std::size_t capacity);
+
+    // where the buffer is mapped in the inferior
+    VirtualAddress InferiorAddress() const { return this->inferior_address_; }
+
+    std::size_t   Capacity() const { return this->capacity_; }
+    std::uint64_t DroppedHits() const;
+
+    // copies out the hits recorded since the last call, oldest first, making
+    // room for more. Safe to call while the inferior is running
+    std::vector<TracepointHit> ReadHits();
+
+private:
+    TracepointBuffer(void *mapping, std::size_t size, std::size_t capacity,
+                     VirtualAddress inferior_address);
+
+    Header        *header_;
+    Slot          *slots_;
+    std::size_t    mapping_size_;
+    // kept here as well as in the header, which the inferior can write to
+    std::size_t    capacity_;
+    VirtualAddress inferior_address_;
+  };
+}  // namespace sdb
+
+#endif  // SDB_TRACEPOINT_HPP
@@ -178,10 +178,10 @@ public:
     T          *begin() const { return data_; }
     T          *end() const { return data_ + size_; }
     std::size_t Size() const { return size_; }
-    T          &operator[](std::size_t n) { return *(data_ + n); }
+    T          &operator[](std::size_t n) const { return *(data_ + n); }
 
 private:
-    T          *data_;
+    T          *data_ = nullptr;
     std::size_t size_ = 0;
   };
 }  // namespace sdb
@@ -2,10 +2,23 @@
 #define SDB_WATCHPOINT_HPP
 
 #include <libsdb/types.hpp>
+#include <vector>
 
 namespace sdb {
   class Process;
 
+  // a range one debug register can watch: 1, 2, 4 or 8 bytes, aligned to its
+  // size
+  struct WatchSlot {
+    VirtualAddress address;
+    std::size_t    size;
+  };
+
+  // The fewest slots that cover exactly the `size` bytes at `address`, in
+  // address order. Execution can only be watched a byte at a time
+  std::vector<WatchSlot> PlanWatchSlots(VirtualAddress address,
+                                        std::size_t size, StoppointMode mode);
+
   class Watchpoint {
 public:
     Watchpoint()                              = delete;
@@ -18,14 +31,26 @@ public:
     void Enable();
     void Disable();
 
+    // the value at the watched address. For a watchpoint larger than 8
+    // bytes, that's its first 8 bytes
     std::uint64_t Data() const { return this->data_; }
 
     std::uint64_t PreviousData() const { return this->previous_data_; }
 
+    // everything in the watched range, now and before the last update
+    const std::vector<std::byte> &Contents() const { return this->contents_; }
+    const std::vector<std::byte> &PreviousContents() const {
+      return this->previous_contents_;
+    }
+
     bool           IsEnabled() const { return this->is_enabled_; }
     VirtualAddress GetAddress() const { return this->address_; }
+    VirtualAddress Address() const { return this->address_; }
     StoppointMode  GetMode() const { return this->mode_; }
     std::size_t    GetSize() const { return this->size_; }
+    // whether it's set in a debug register, rather than by protecting the
+    // pages it's on (see Process::CreateWatchpoint)
+    bool IsHardware() const { return this->is_hardware_; }
 
     // is the watchpoint at a given address?
     bool AtAddress(const VirtualAddress address) const {
@@ -43,11 +68,15 @@ private:
     friend Process;
 
     Watchpoint(Process &process, VirtualAddress address, StoppointMode mode,
-               std::size_t size);
+               std::size_t size, bool hardware);
 
     std::uint64_t data_ = 0;  // current value at the watched address
     std::uint64_t previous_data_ =
         0;  // previously read value at the watched address
+    // everything at the watched range, which a page watchpoint is hit by
+    // changing (see Process::StepThroughWatchedPages)
+    std::vector<std::byte> contents_;
+    std::vector<std::byte> previous_contents_;
 
     id_type        id_;
     Process       *process_;
@@ -57,7 +86,10 @@ private:
     // whether the watchpoint is enabled
     bool        is_enabled_;
     std::size_t size_;
-    int         hardware_register_index_ = -1;
+    bool        is_hardware_;
+    // the debug register each slot of a hardware watchpoint is in, while
+    // it's enabled
+    std::vector<int> hardware_register_indices_;
   };
 };  // namespace sdb
 
@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <libsdb/breakpoint_condition.hpp>
+#include <libsdb/error.hpp>
+#include <libsdb/parse.hpp>
+#include <libsdb/process.hpp>
+
+namespace {
+  using Op          = sdb::BreakpointCondition::Op;
+  using Instruction = sdb::BreakpointCondition::Instruction;
+
+  struct Token {
+    enum Kind { Number, Identifier, Operator, End };
+
+    Kind             kind;
+    std::string_view text;
+    std::uint64_t    value = 0;  // for numbers
+  };
+
+  [[noreturn]] void Fail(const std::string &message) {
+    sdb::Error::Send("Invalid breakpoint condition: " + message);
+  }
+
+  std::vector<Token> Tokenize(const std::string_view text) {
+    // longest first, so `<=` isn't read as `<` and `=`
+    constexpr std::string_view operators[] = {
+        "==", "!=", "<=", ">=", "&&", "||", "!", "-", "*",
+        "+",  "&",  "|",  "<",  ">",  "(",  ")"};
+
+    std::vector<Token> tokens;
+    for (std::size_t pos = 0; pos < text.size();) {
+      const auto c = static_cast<unsigned char>(text[pos]);
+      if (std::isspace(c)) {
+        ++pos;
+        continue;
+      }
+
+      if (std::isalnum(c) || c == '_') {
+        auto end = pos;
+        while (end < text.size() &&
+               (std::isalnum(static_cast<unsigned char>(text[end])) ||
+                text[end] == '_')) {
+          ++end;
+        }
+        const auto word = text.substr(pos, end - pos);
+        pos             = end;
+
+        if (!std::isdigit(c)) {
+          tokens.push_back({Token::Identifier, word});
+          continue;
+        }
+
+        const auto is_hex = word.size() > 2 && word[1] == 'x';
+        const auto value =
+            is_hex ? sdb::ToIntegral<std::uint64_t>(word, 16)
+                   : sdb::ToIntegral<std::uint64_t>(word);
+        if (!value) {
+          Fail("bad number '" + std::string(word) + "'");
+        }
+        tokens.push_back({Token::Number, word, *value});
+        continue;
+      }
+
+      const auto op = std::find_if(
+          std::begin(operators), std::end(operators),
+          [&](const std::string_view op)
+          { return text.substr(pos, op.size()) == op; });
+      if (op == std::end(operators)) {
+        Fail("unexpected '" + std::string(1, text[pos]) + "'");
+      }
+      tokens.push_back({Token::Operator, *op});
+      pos += op->size();
+    }
+
+    tokens.push_back({Token::End, ""});
+    return tokens;
+  }
+
+  // Recursive descent, one function per precedence level, emitting code for
+  // the stack machine as it goes
+  class Compiler {
+public:
+    explicit Compiler(std::vector<Token> tokens) : tokens_(std::move(tokens)) {}
+
+    void Compile() {
+      this->Or();
+      if (this->Peek().kind != Token::End) {
+        Fail("unexpected '" + std::string(this->Peek().text) + "'");
+      }
+    }
+
+    std::vector<Instruction> code;
+    std::size_t              max_depth = 0;
+
+private:
+    const Token &Peek() const { return this->tokens_[this->next_]; }
+
+    bool Match(const std::string_view op) {
+      if (this->Peek().kind != Token::Operator || this->Peek().text != op) {
+        return false;
+      }
+      ++this->next_;
+      return true;
+    }
+
+    std::size_t Emit(const Op op, const std::uint64_t operand = 0) {
+      // how the instruction changes the depth of the stack. A conditional
+      // jump pops when it isn't taken, and when it is, the value it leaves
+      // stands in for the one the skipped code would have pushed
+      switch (op) {
+        case Op::Push:
+        case Op::PushRegister:
+          ++this->depth_;
+          break;
+        case Op::Load:
+        case Op::Not:
+        case Op::Negate:
+        case Op::ToBool:
+          break;
+        default:
+          --this->depth_;
+      }
+      this->max_depth = std::max(this->max_depth, this->depth_);
+
+      this->code.push_back({op, operand});
+      return this->code.size() - 1;
+    }
+
+    // `a && b` is `a; ToBool; JumpIfZero end; b; ToBool; end:`
+    void ShortCircuit(const Op jump, void (Compiler::*operand)()) {
+      this->Emit(Op::ToBool);
+      const auto at = this->Emit(jump);
+      (this->*operand)();
+      this->Emit(Op::ToBool);
+      this->code[at].operand = this->code.size();
+    }
+
+    void Or() {
+      this->And();
+      while (this->Match("||")) {
+        this->ShortCircuit(Op::JumpIfNonZero, &Compiler::And);
+      }
+    }
+
+    void And() {
+      this->BitOr();
+      while (this->Match("&&")) {
+        this->ShortCircuit(Op::JumpIfZero, &Compiler::BitOr);
+      }
+    }
+
+    void BitOr() {
+      this->BitAnd();
+      while (this->Match("|")) {
+        this->BitAnd();
+        this->Emit(Op::BitOr);
+      }
+    }
+
+    void BitAnd() {
+      this->Equality();
+      while (this->Match("&")) {
+        this->Equality();
+        this->Emit(Op::BitAnd);
+      }
+    }
+
+    void Equality() {
+      this->Relational();
+      while (true) {
+        if (this->Match("==")) {
+          this->Relational();
+          this->Emit(Op::Equal);
+        } else if (this->Match("!=")) {
+          this->Relational();
+          this->Emit(Op::NotEqual);
+        } else {
+          return;
+        }
+      }
+    }
+
+    void Relational() {
+      this->Additive();
+      while (true) {
+        if (this->Match("<=")) {
+          this->Additive();
+          this->Emit(Op::LessEqual);
+        } else if (this->Match(">=")) {
+          this->Additive();
+          this->Emit(Op::GreaterEqual);
+        } else if (this->Match("<")) {
+          this->Additive();
+          this->Emit(Op::Less);
+        } else if (this->Match(">")) {
+          this->Additive();
+          this->Emit(Op::Greater);
+        } else {
+          return;
+        }
+      }
+    }
+
+    void Additive() {
+      this->Multiplicative();
+      while (true) {
+        if (this->Match("+")) {
+          this->Multiplicative();
+          this->Emit(Op::Add);
+        } else if (this->Match("-")) {
+          this->Multiplicative();
+          this->Emit(Op::Subtract);
+        } else {
+          return;
+        }
+      }
+    }
+
+    void Multiplicative() {
+      this->Unary();
+      while (this->Match("*")) {
+        this->Unary();
+        this->Emit(Op::Multiply);
+      }
+    }
+
+    void Unary() {
+      if (this->Match("!")) {
+        this->Unary();
+        this->Emit(Op::Not);
+      } else if (this->Match("-")) {
+        this->Unary();
+        this->Emit(Op::Negate);
+      } else if (this->Match("*")) {
+        this->Unary();
+        this->Emit(Op::Load);
+      } else {
+        this->Primary();
+      }
+    }
+
+    void Primary() {
+      const auto token = this->Peek();
+
+      if (this->Match("(")) {
+        this->Or();
+        if (!this->Match(")")) {
+          Fail("expected ')'");
+        }
+        return;
+      }
+
+      ++this->next_;
+      if (token.kind == Token::Number) {
+        this->Emit(Op::Push, token.value);
+      } else if (token.kind == Token::Identifier) {
+        // registers are referred to by their index in gRegisterInfos, so
+        // they don't have to be looked up again on every evaluation
+        const auto info = std::find_if(
+            std::begin(sdb::gRegisterInfos), std::end(sdb::gRegisterInfos),
+            [&](const auto &info) { return info.name == token.text; });
+        if (info == std::end(sdb::gRegisterInfos)) {
+          Fail("no register named '" + std::string(token.text) + "'");
+        }
+        if (info->type != sdb::RegisterType::GPR &&
+            info->type != sdb::RegisterType::SUB_GPR) {
+          Fail("only general purpose registers can be used");
+        }
+        this->Emit(Op::PushRegister,
+                   std::distance(std::begin(sdb::gRegisterInfos), info));
+      } else if (token.kind == Token::End) {
+        Fail("unexpected end of condition");
+      } else {
+        Fail("unexpected '" + std::string(token.text) + "'");
+      }
+    }
+
+    std::vector<Token> tokens_;
+    std::size_t        next_  = 0;
+    std::size_t        depth_ = 0;
+  };
+
+  std::uint64_t ReadRegister(const sdb::Registers    &registers,
+                             const sdb::RegisterInfo &info) {
+    return std::visit(
+        [](const auto value) -> std::uint64_t
+        {
+          if constexpr (std::is_integral_v<decltype(value)>) {
+            return static_cast<std::uint64_t>(value);
+          } else {
+            return 0;  // general purpose registers are all integers
+          }
+        },
+        registers.Read(info));
+  }
+}  // namespace
+
+sdb::BreakpointCondition sdb::BreakpointCondition::Compile(
+    const std::string_view text) {
+  Compiler compiler(Tokenize(text));
+  compiler.Compile();
+  return BreakpointCondition(std::string(text), std::move(compiler.code),
+                             compiler.max_depth);
+}
+
+bool sdb::BreakpointCondition::Evaluate(const Process &process,
+                                        const pid_t    tid) const {
+  // conditions are small, so the stack normally fits in here
+  std::array<std::uint64_t, 16> small_stack;
+  std::vector<std::uint64_t>    large_stack;
+  auto                          stack = small_stack.data();
+  if (this->max_depth_ > small_stack.size()) {
+    large_stack.resize(this->max_depth_);
+    stack = large_stack.data();
+  }
+
+  // registers are only fetched from the inferior once one of them is read
+  const auto &registers = process.GetRegisters(tid);
+
+  std::size_t top = 0;  // the number of values on the stack
+  const auto  binary = [&](const auto f)
+  {
+    --top;
+    stack[top - 1] = f(stack[top - 1], stack[top]);
+  };
+
+  for (std::size_t pc = 0; pc < this->code_.size(); ++pc) {
+    const auto [op, operand] = this->code_[pc];
+    switch (op) {
+      case Op::Push:
+        stack[top++] = operand;
+        break;
+      case Op::PushRegister:
+        stack[top++] = ReadRegister(registers, gRegisterInfos[operand]);
+        break;
+      case Op::Load:
+        stack[top - 1] =
+            process.ReadMemoryAs<std::uint64_t>(VirtualAddress{stack[top - 1]});
+        break;
+      case Op::Not:
+        stack[top - 1] = stack[top - 1] == 0;
+        break;
+      case Op::Negate:
+        stack[top - 1] = -stack[top - 1];
+        break;
+      case Op::ToBool:
+        stack[top - 1] = stack[top - 1] != 0;
+        break;
+      case Op::Multiply:
+        binary(std::multiplies<>{});
+        break;
+      case Op::Add:
+        binary(std::plus<>{});
+        break;
+      case Op::Subtract:
+        binary(std::minus<>{});
+        break;
+      case Op::BitAnd:
+        binary(std::bit_and<>{});
+        break;
+      case Op::BitOr:
+        binary(std::bit_or<>{});
+        break;
+      case Op::Equal:
+        binary(std::equal_to<>{});
+        break;
+      case Op::NotEqual:
+        binary(std::not_equal_to<>{});
+        break;
+      case Op::Less:
+        binary(std::less<>{});
+        break;
+      case Op::LessEqual:
+        binary(std::less_equal<>{});
+        break;
+      case Op::Greater:
+        binary(std::greater<>{});
+        break;
+      case Op::GreaterEqual:
+        binary(std::greater_equal<>{});
+        break;
+      case Op::JumpIfZero:
+      case Op::JumpIfNonZero:
+        if ((stack[top - 1] == 0) == (op == Op::JumpIfZero)) {
+          pc = operand - 1;  // the loop moves it on by one
+        } else {
+          --top;
+        }
+        break;
+    }
+  }
+  return stack[0] != 0;
+}
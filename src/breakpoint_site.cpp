@@ -1,4 +1,6 @@
+#include <libsdb/bit.hpp>
 #include <libsdb/breakpoint_site.hpp>
+#include <libsdb/error.hpp>
 #include <libsdb/process.hpp>
 #include <sys/ptrace.h>
 
@@ -28,9 +30,11 @@ void sdb::BreakpointSite::Enable() {
     this->hardware_register_index_ =
         this->process_->SetHardwareBreakpoint(this->id_, this->address_);
   } else {
+    const auto tid = this->process_->GetStoppedThread();
+
     errno = 0;
     // Read a word at the address in the tracee's memory
-    const std::uint64_t data = ptrace(PTRACE_PEEKDATA, this->process_->GetPid(),
+    const std::uint64_t data = ptrace(PTRACE_PEEKDATA, tid,
                                       this->address_, nullptr);
     if (errno != 0) {
       Error::SendErrno("Enabling breakpoint site failed");
@@ -56,12 +60,18 @@ void sdb::BreakpointSite::Enable() {
     const std::uint64_t data_with_int3 = ((data & ~0xff) | int3);
 
     // Copy the word data to offset addr in the tracee's memory
-    if (ptrace(PTRACE_POKEDATA, this->process_->GetPid(), this->address_,
+    if (ptrace(PTRACE_POKEDATA, tid, this->address_,
                data_with_int3) == -1) {
       Error::SendErrno("Enabling breakpoint site failed");
     }
+
+    // the low byte of the word is the first one in memory
+    this->process_->UpdateMemoryCache(this->address_,
+                                      {AsBytes(data_with_int3), 1});
   }
 
+  // for stepping over the site without lifting it
+  this->process_->EnsureScratchPad(this->address_);
   this->is_enabled_ = true;
 }
 
@@ -74,8 +84,10 @@ void sdb::BreakpointSite::Disable() {
     this->process_->ClearHardwareStoppoint(this->hardware_register_index_);
     this->hardware_register_index_ = -1;
   } else {
+    const auto tid = this->process_->GetStoppedThread();
+
     errno                    = 0;
-    const std::uint64_t data = ptrace(PTRACE_PEEKDATA, this->process_->GetPid(),
+    const std::uint64_t data = ptrace(PTRACE_PEEKDATA, tid,
                                       this->address_.GetAddress(), nullptr);
     if (errno != 0) {
       Error::SendErrno("Disabling breakpoint site failed");
@@ -88,10 +100,35 @@ void sdb::BreakpointSite::Disable() {
 
     // We restore the data masking the first byte with -0xff
     // and then bitwise ORing with the saved data
-    if (ptrace(PTRACE_POKEDATA, this->process_->GetPid(), this->address_,
+    if (ptrace(PTRACE_POKEDATA, tid, this->address_,
                restored_data) == -1) {
       Error::SendErrno("Disabling breakpoint site failed");
     }
+
+    this->process_->UpdateMemoryCache(this->address_, {&this->saved_data_, 1});
   }
   this->is_enabled_ = false;
 }
+
+bool sdb::BreakpointSite::ShouldStop(const pid_t tid) {
+  this->condition_error_.reset();
+  try {
+    if (this->condition_ &&
+        !this->condition_->Evaluate(*this->process_, tid)) {
+      return false;
+    }
+  } catch (const Error &error) {
+    // this is called while waiting on the process, so rather than throw out
+    // of the wait, the hit is reported for the user to see what went wrong
+    this->condition_error_ = error.what();
+    ++this->hit_count_;
+    return true;
+  }
+
+  ++this->hit_count_;
+  if (this->ignore_count_ > 0) {
+    --this->ignore_count_;
+    return false;
+  }
+  return true;
+}
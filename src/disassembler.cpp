@@ -7,13 +7,14 @@ std::vector<sdb::Disassembler::Instruction> sdb::Disassembler::Disassemble(
   ret.reserve(n_instructions);
 
   if (!address) {
-    address.emplace(this->process_.GetPc());
+    address.emplace(this->target_.GetProcess().GetPc());
   }
 
   // we're guaranteeing there's enough memory here to disassemble
   // n_instructions, as the largest x86 instruction is 15 bytes.
+  // (code in the executable's .text is read from the mapped ELF file)
   const auto code =
-      process_.ReadMemoryWithoutTraps(*address, n_instructions * 15);
+      target_.ReadMemoryWithoutTraps(*address, n_instructions * 15);
 
   ZyanUSize                    offset = 0;
   ZydisDisassembledInstruction instruction;
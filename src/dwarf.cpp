@@ -3,6 +3,7 @@
 #include <libsdb/dwarf.hpp>
 #include <libsdb/elf.hpp>
 #include <libsdb/error.hpp>
+#include <libsdb/index_cache.hpp>
 #include <libsdb/types.hpp>
 
 namespace {
@@ -617,12 +618,10 @@ std::optional<sdb::Die> sdb::Dwarf::FunctionContainingAddress(
   // Index the dwarf information to ensure that `function_index_` is populated
   this->Index();
 
-  for (auto &[name, entry] : this->function_index_) {
-    const Cursor cursor({entry.pos, entry.cu->Data().end()});
-
-    if (auto d = ParseDie(*entry.cu, cursor);
-        d.ContainsAddress(address) &&
-        d.GetAbbrevEntry()->tag == DW_TAG_subprogram) {
+  for (const auto &entry : this->function_index_) {
+    if (auto d = this->GetIndexedDie(entry);
+        d && d->ContainsAddress(address) &&
+        d->GetAbbrevEntry()->tag == DW_TAG_subprogram) {
       return d;
     }
   }
@@ -636,32 +635,84 @@ std::vector<sdb::Die> sdb::Dwarf::FindFunctions(std::string name) const {
 
   std::vector<Die> found;
 
-  // get a pair of iterators to the range of entries matching the key
-  auto [begin, end] = this->function_index_.equal_range(name);
+  // the entries with the name are next to each other, in DIE order
+  auto it = std::lower_bound(
+      this->function_index_.begin(), this->function_index_.end(), name,
+      [this](const IndexEntry &entry, const std::string_view name)
+      { return this->GetIndexedName(entry) < name; });
 
   // push the results into the found vector
-  std::transform(begin, end, std::back_inserter(found),
-                 [](auto &pair)
-                 {
-                   auto [name, entry] = pair;
-                   Cursor cursor({entry.pos, entry.cu->Data().end()});
-                   return ParseDie(*entry.cu, cursor);
-                 });
+  for (; it != this->function_index_.end() &&
+         this->GetIndexedName(*it) == name;
+       ++it) {
+    if (auto die = this->GetIndexedDie(*it)) {
+      found.push_back(std::move(*die));
+    }
+  }
 
   return found;
 }
 
 void sdb::Dwarf::Index() const {
   // check that the dwarf information is only indexed once
-  if (!this->function_index_.empty()) {
+  if (this->indexed_) {
     return;
   }
-  for (auto &cu : this->compile_units_) {
-    this->IndexDie(cu->GetRoot());
+  this->indexed_ = true;
+
+  if (auto cache = IndexCache::Open(*this->elf_, "functions", 1)) {
+    if (const auto entries = cache->GetTable<IndexEntry>(0)) {
+      this->function_index_cache_ = std::move(cache);
+      this->function_index_       = *entries;
+      return;
+    }
+  }
+
+  for (std::size_t cu = 0; cu < this->compile_units_.size(); ++cu) {
+    this->IndexDie(this->compile_units_[cu]->GetRoot(), cu);
   }
+  auto &entries = this->function_index_built_;
+  std::sort(entries.begin(), entries.end(),
+            [this](const IndexEntry &lhs, const IndexEntry &rhs)
+            {
+              const auto lhs_name = this->GetIndexedName(lhs);
+              const auto rhs_name = this->GetIndexedName(rhs);
+              if (lhs_name != rhs_name) {
+                return lhs_name < rhs_name;
+              }
+              return lhs.die_offset < rhs.die_offset;
+            });
+  this->function_index_ = Span<const IndexEntry>(entries);
+  IndexCache::Save(*this->elf_, "functions", {IndexCache::AsTable(entries)});
 }
 
-void sdb::Dwarf::IndexDie(const Die &current) const {
+std::string_view sdb::Dwarf::GetIndexedName(const IndexEntry &entry) const {
+  // entries from the cache file are checked as they're used
+  const auto file = ToStringView(this->elf_->GetData().begin(),
+                                 this->elf_->GetData().Size());
+  if (entry.name_offset > file.size() ||
+      entry.name_size > file.size() - entry.name_offset) {
+    return {};
+  }
+  return file.substr(entry.name_offset, entry.name_size);
+}
+
+std::optional<sdb::Die> sdb::Dwarf::GetIndexedDie(
+    const IndexEntry &entry) const {
+  if (entry.cu >= this->compile_units_.size()) {
+    return std::nullopt;
+  }
+  const auto &cu  = *this->compile_units_[entry.cu];
+  const auto  pos = this->elf_->GetData().begin() + entry.die_offset;
+  if (entry.die_offset >= this->elf_->GetData().Size() ||
+      pos < cu.Data().begin() || pos >= cu.Data().end()) {
+    return std::nullopt;
+  }
+  const Cursor cursor({pos, cu.Data().end()});
+  return ParseDie(cu, cursor);
+}
+
+void sdb::Dwarf::IndexDie(const Die &current, const std::uint32_t cu) const {
   /*
    * This function should add the given DIE to the function index so long as it
    * has address range data, then recursively index all of that DIE’s children.
@@ -681,14 +732,19 @@ void sdb::Dwarf::IndexDie(const Die &current) const {
 
   if (has_range and is_function) {
     if (const auto name = current.Name(); name) {
-      IndexEntry entry{current.GetCompileUnit(), current.GetPosition()};
-      this->function_index_.emplace(*name, entry);
+      // names and DIEs are all in the mapped file
+      const auto file = this->elf_->GetData().begin();
+      this->function_index_built_.push_back(
+          {static_cast<std::uint64_t>(
+               reinterpret_cast<const std::byte *>(name->data()) - file),
+           static_cast<std::uint64_t>(current.GetPosition() - file),
+           static_cast<std::uint32_t>(name->size()), cu});
     }
   }
 
   // recursively index children
   for (auto &child : current.Children()) {
-    this->IndexDie(child);
+    this->IndexDie(child, cu);
   }
 }
 
@@ -863,3 +919,6 @@ bool sdb::Die::ContainsAddress(FileAddress address) const {
 sdb::Dwarf::Dwarf(const Elf &parent) : elf_(&parent) {
   this->compile_units_ = ParseCompileUnits(*this, parent);
 }
+
+// here, where IndexCache is complete
+sdb::Dwarf::~Dwarf() = default;
@@ -5,10 +5,105 @@
 #include <libsdb/dwarf.hpp>
 #include <libsdb/elf.hpp>
 #include <libsdb/error.hpp>
+#include <libsdb/index_cache.hpp>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 
+namespace {
+  // A view of the `count` entries of T at `offset` in the mapped file. The
+  // mapping is page aligned, so a table at an offset aligned for T is used
+  // where it is; only a misaligned one is copied, into `copy`
+  template <class T>
+  sdb::Span<const T> ViewTable(const std::byte *data, const std::size_t size,
+                               const std::uint64_t offset,
+                               const std::size_t count, std::vector<T> &copy,
+                               const std::string_view what) {
+    if (offset > size || count > (size - offset) / sizeof(T)) {
+      sdb::Error::Send("ELF " + std::string(what) +
+                       " extend past the end of the file");
+    }
+
+    const auto start = data + offset;
+    if (reinterpret_cast<std::uintptr_t>(start) % alignof(T) == 0) {
+      return {reinterpret_cast<const T *>(start), count};
+    }
+    copy.resize(count);
+    std::copy(start, start + sizeof(T) * count,
+              reinterpret_cast<std::byte *>(copy.data()));
+    return {copy.data(), count};
+  }
+
+  // fewer symbols than this aren't worth a thread of their own to demangle
+  constexpr std::size_t g_symbols_per_thread = 16384;
+
+  // The C++ names (those starting with _Z) of symbols [begin, end) of `elf`,
+  // demangled back to back into `arena`. Returns the index of each symbol
+  // demangled and where its name ends
+  std::vector<std::pair<std::uint32_t, std::size_t>> DemangleSymbols(
+      const sdb::Elf& elf, const std::uint32_t begin, const std::uint32_t end,
+      std::string& arena) {
+    const auto symbols = elf.GetSymbols();
+
+    std::vector<std::pair<std::uint32_t, std::size_t>> ends;
+    // reused for every name, growing as needed
+    char*       buffer      = nullptr;
+    std::size_t buffer_size = 0;
+    for (auto i = begin; i < end; ++i) {
+      const auto name = elf.GetString(symbols[i].st_name);
+      if (name.substr(0, 2) != "_Z") {
+        continue;
+      }
+
+      int        status;
+      const auto demangled =
+          abi::__cxa_demangle(name.data(), buffer, &buffer_size, &status);
+      if (status == 0) {
+        buffer = demangled;
+        arena += demangled;
+        ends.emplace_back(i, arena.size());
+      }
+    }
+    free(buffer);
+    return ends;
+  }
+
+  // How many of the sorted `starts` are at most `address`. The loop has no
+  // branch on the comparison (it's a conditional move), so it doesn't
+  // mispredict on addresses spread all over
+  std::size_t CountStartsUpTo(const sdb::Span<const std::uint64_t> starts,
+                              const std::uint64_t                   address) {
+    if (starts.Size() == 0) {
+      return 0;
+    }
+    const std::uint64_t *base = starts.begin();
+    std::size_t          n    = starts.Size();
+    while (n > 1) {
+      const auto half = n / 2;
+      base            = base[half] <= address ? base + half : base;
+      n -= half;
+    }
+    return base - starts.begin() + (*base <= address);
+  }
+
+  // Whether the symbol address tables from the cache file can be looked up
+  // in: the starts must be sorted, and every index must be in the symbol
+  // table, as nothing checks them afterwards
+  bool AreSymbolAddressesValid(const sdb::Span<const std::uint64_t> addresses,
+                               const sdb::Span<const std::uint32_t> indices,
+                               const std::size_t                    n_symbols) {
+    if (addresses.Size() != 3 * indices.Size()) {
+      return false;
+    }
+    const auto starts_end = addresses.begin() + indices.Size();
+    return std::is_sorted(addresses.begin(), starts_end) &&
+           std::all_of(indices.begin(), indices.end(),
+                       [n_symbols](const std::uint32_t index)
+                       { return index < n_symbols; });
+  }
+}  // namespace
+
 sdb::Elf::Elf(const std::filesystem::path& path) : path_(path) {
   this->path_ = path;
 
@@ -39,12 +134,17 @@ sdb::Elf::Elf(const std::filesystem::path& path) : path_(path) {
   }
 
   this->data_ = reinterpret_cast<std::byte*>(ret);
+  if (this->fle_size_ < sizeof(this->header_)) {
+    Error::Send("ELF file is too small for its header");
+  }
 
   // copy the header from the mapped memory to the header_ member
   std::copy(this->data_, this->data_ + sizeof(header_), AsBytes(this->header_));
 
   this->ParseSectionHeaders();
+  this->ParseProgramHeaders();
   this->BuildSectionMap();
+  this->BuildAddressIndexes();
   this->ParseSymbolTable();
   this->BuildSymbolMaps();
 
@@ -104,26 +204,16 @@ const Elf64_Shdr* sdb::Elf::GetSectionContainingAddress(
   if (file_addr.ElfFile() != this) {
     return nullptr;  // address not in this ELF file
   }
-
-  for (auto& section : section_headers_) {
-    if (section.sh_addr <= file_addr.GetAddress() &&
-        section.sh_addr + section.sh_size > file_addr.GetAddress()) {
-      return &section;  // found the section containing the address
-    }
-  }
-  // otherwise
-  return nullptr;
+  return this->section_index_.Find(file_addr.GetAddress());
 }
 
 const Elf64_Shdr* sdb::Elf::GetSectionContainingAddress(
     const VirtualAddress virtual_addr) const {
-  for (auto& section : section_headers_) {
-    if (load_bias_ + section.sh_addr <= virtual_addr &&
-        load_bias_ + section.sh_addr + section.sh_size > virtual_addr) {
-      return &section;  // found the section containing the address
-    }
+  if (virtual_addr < this->load_bias_) {
+    return nullptr;
   }
-  return nullptr;
+  return this->section_index_.Find(virtual_addr.GetAddress() -
+                                   this->load_bias_.GetAddress());
 }
 
 std::optional<sdb::FileAddress> sdb::Elf::GetSectionStartAddress(
@@ -135,16 +225,79 @@ std::optional<sdb::FileAddress> sdb::Elf::GetSectionStartAddress(
   return std::nullopt;
 }
 
+const Elf64_Phdr* sdb::Elf::GetSegmentContainingAddress(
+    const FileAddress file_addr) const {
+  if (file_addr.ElfFile() != this) {
+    return nullptr;  // address not in this ELF file
+  }
+
+  return this->segment_index_.Find(file_addr.GetAddress());
+}
+
+const Elf64_Phdr* sdb::Elf::GetSegmentContainingAddress(
+    const VirtualAddress virtual_addr) const {
+  // translate through the load bias rather than with `ToFileAddress`, which
+  // requires the address to fall within a section
+  return this->GetSegmentContainingAddress(
+      FileAddress{*this, virtual_addr.GetAddress() - load_bias_.GetAddress()});
+}
+
+sdb::Span<const std::byte> sdb::Elf::GetSegmentContents(
+    const Elf64_Phdr& segment) const {
+  if (segment.p_offset + segment.p_filesz > this->fle_size_) {
+    Error::Send("ELF segment extends past the end of the file");
+  }
+  return {this->data_ + segment.p_offset, segment.p_filesz};
+}
+
+sdb::Span<const std::byte> sdb::Elf::GetBuildId() const {
+  const auto note = this->GetSectionContents(".note.gnu.build-id");
+  if (note.Size() < sizeof(Elf64_Nhdr)) {
+    return {};
+  }
+
+  // the name ("GNU" and its null) and the ID that follows are both padded
+  // to 4 bytes
+  const auto header    = FromBytes<Elf64_Nhdr>(note.begin());
+  const auto desc      = sizeof(Elf64_Nhdr) + (header.n_namesz + 3) / 4 * 4;
+  if (header.n_type != NT_GNU_BUILD_ID || desc > note.Size() ||
+      header.n_descsz > note.Size() - desc) {
+    return {};
+  }
+  return {note.begin() + desc, header.n_descsz};
+}
+
 std::vector<const Elf64_Sym*> sdb::Elf::GetSymbolsByName(
     std::string_view name) const {
-  auto [begin, end] = symbol_name_map_.equal_range(name);
+  this->IndexSymbolNames();
+  auto it = std::lower_bound(
+      this->symbol_names_.begin(), this->symbol_names_.end(), name,
+      [this](const SymbolName& entry, const std::string_view name)
+      { return this->GetSymbolName(entry) < name; });
 
   std::vector<const Elf64_Sym*> ret;
-  std::transform(begin, end, std::back_inserter(ret),
-                 [](const auto& pair) { return pair.second; });
+  for (; it != this->symbol_names_.end() && this->GetSymbolName(*it) == name;
+       ++it) {
+    const auto index = it->symbol & ~SymbolName::demangled;
+    if (index < this->symbol_table_.Size()) {
+      ret.push_back(&this->symbol_table_[index]);
+    }
+  }
   return ret;
 }
 
+std::string_view sdb::Elf::GetSymbolName(const SymbolName& name) const {
+  const auto names = (name.symbol & SymbolName::demangled) != 0
+                         ? std::string_view(this->demangled_names_.begin(),
+                                            this->demangled_names_.Size())
+                         : ToStringView(this->data_, this->fle_size_);
+  // names from the cache file are checked here rather than all up front
+  if (name.offset > names.size() || name.size > names.size() - name.offset) {
+    return {};
+  }
+  return names.substr(name.offset, name.size);
+}
+
 std::optional<const Elf64_Sym*> sdb::Elf::GetSymbolAtAddress(
     FileAddress file_addr) const {
   if (file_addr.ElfFile() != this) {
@@ -152,15 +305,13 @@ std::optional<const Elf64_Sym*> sdb::Elf::GetSymbolAtAddress(
     return std::nullopt;
   }
 
-  FileAddress null_addr;
-  // find the element in the map whose start address matches the given address
-  const auto it = this->symbol_addr_map_.find({file_addr, null_addr});
-  if (it == end(this->symbol_addr_map_)) {
-    // if we don't find one, return empty optional
+  const auto address = file_addr.GetAddress();
+  const auto n_up_to = CountStartsUpTo(this->symbol_starts_, address);
+  const auto index   = this->FindSymbolStartingAt(address, n_up_to);
+  if (!index) {
     return std::nullopt;
   }
-  // otherwise, return the pointer to the symbol
-  return it->second;
+  return &this->symbol_table_[*index];
 }
 
 std::optional<const Elf64_Sym*> sdb::Elf::GetSymbolAtAddress(
@@ -171,33 +322,24 @@ std::optional<const Elf64_Sym*> sdb::Elf::GetSymbolAtAddress(
 
 std::optional<const Elf64_Sym*> sdb::Elf::GetSymbolContainingAddress(
     FileAddress file_addr) const {
-  if (file_addr.ElfFile() != this || this->symbol_addr_map_.empty()) {
+  if (file_addr.ElfFile() != this) {
     return std::nullopt;
   }
 
-  FileAddress null_addr;
-
-  // find the first address with a starting address greater than or equal to the
-  // given one with `lower_bound`
-  auto it = this->symbol_addr_map_.lower_bound({file_addr, null_addr});
-
-  if (it != end(this->symbol_addr_map_)) {
-    if (auto [key, value] = *it; key.first == file_addr) {
-      return value;
-    }
+  // a symbol starting at the address wins, even if it has no size
+  const auto address = file_addr.GetAddress();
+  const auto n_up_to = CountStartsUpTo(this->symbol_starts_, address);
+  if (const auto index = this->FindSymbolStartingAt(address, n_up_to)) {
+    return &this->symbol_table_[*index];
   }
 
-  //  If the current iterator is the begin iterator, there is no entry preceding
-  //  it.
-  if (it == begin(this->symbol_addr_map_)) {
-    return std::nullopt;
-  }
-
-  --it;
-  // otherwise, check if the preceding entry falls within the range
-  if (auto [key, value] = *it;
-      key.first < file_addr && key.second > file_addr) {
-    return value;
+  // Otherwise it's the innermost symbol around the address: the one starting
+  // closest before it. Zero-size symbols contain nothing
+  for (auto i = n_up_to; i > 0 && this->symbol_max_ends_[i - 1] > address;
+       --i) {
+    if (this->symbol_ends_[i - 1] > address) {
+      return &this->symbol_table_[this->symbol_indices_[i - 1]];
+    }
   }
   return std::nullopt;
 }
@@ -207,6 +349,18 @@ std::optional<const Elf64_Sym*> sdb::Elf::GetSymbolContainingAddress(
   return this->GetSymbolContainingAddress(virt_addr.ToFileAddress(*this));
 }
 
+std::optional<std::uint32_t> sdb::Elf::FindSymbolStartingAt(
+    const std::uint64_t address, std::size_t n_up_to) const {
+  if (n_up_to == 0 || this->symbol_starts_[n_up_to - 1] != address) {
+    return std::nullopt;
+  }
+  // the first of them in the table
+  while (n_up_to > 1 && this->symbol_starts_[n_up_to - 2] == address) {
+    --n_up_to;
+  }
+  return this->symbol_indices_[n_up_to - 1];
+}
+
 // Find the section name string table with the index given and in the ELF header
 // and get the string at the given offset in that section
 std::string_view sdb::Elf::GetSectionName(const std::size_t index) const {
@@ -228,7 +382,7 @@ void sdb::Elf::ParseSectionHeaders() {
    * of the first section header
    */
 
-  auto n_headers = this->header_.e_shnum;
+  std::uint64_t n_headers = this->header_.e_shnum;
   if (n_headers == 0 && this->header_.e_shentsize != 0) {
     // If the file specifies the number of headers as 0, but also specifies the
     // section header size element, we've reached this limit (therefore, there
@@ -236,18 +390,36 @@ void sdb::Elf::ParseSectionHeaders() {
 
     // So, we read the sh_size field of the first section
     // header to get the real number of headers
+    if (this->header_.e_shoff + sizeof(Elf64_Shdr) > this->fle_size_) {
+      Error::Send("ELF section headers extend past the end of the file");
+    }
     n_headers =
         FromBytes<Elf64_Shdr>(this->data_ + this->header_.e_shoff).sh_size;
   }
+  if (n_headers != 0 && this->header_.e_shentsize != sizeof(Elf64_Shdr)) {
+    Error::Send("Invalid ELF section header size");
+  }
 
-  // resize based on the number of section headers
-  this->section_headers_.resize(n_headers);
+  this->section_headers_ =
+      ViewTable(this->data_, this->fle_size_, this->header_.e_shoff, n_headers,
+                this->section_header_copy_, "section headers");
+  if (n_headers != 0 && this->header_.e_shstrndx >= n_headers) {
+    Error::Send("Invalid ELF section name string table index");
+  }
+}
+
+void sdb::Elf::ParseProgramHeaders() {
+  std::size_t n_headers = this->header_.e_phnum;
+  if (n_headers == PN_XNUM && this->section_headers_.Size() != 0) {
+    // similar to the section header special case; if there are too many
+    // program headers to fit in e_phnum, the real number is in the sh_info
+    // field of the first section header
+    n_headers = this->section_headers_[0].sh_info;
+  }
 
-  // copy the section headers from the mapped memory to the vector
-  std::copy(
-      this->data_ + this->header_.e_shoff,
-      this->data_ + this->header_.e_shoff + sizeof(Elf64_Shdr) * n_headers,
-      reinterpret_cast<std::byte*>(this->section_headers_.data()));
+  this->program_headers_ =
+      ViewTable(this->data_, this->fle_size_, this->header_.e_phoff, n_headers,
+                this->program_header_copy_, "program headers");
 }
 
 void sdb::Elf::ParseSymbolTable() {
@@ -263,51 +435,189 @@ void sdb::Elf::ParseSymbolTable() {
 
   const auto symtab = *opt_symtab;
 
+  if (symtab->sh_entsize != sizeof(Elf64_Sym)) {
+    Error::Send("Invalid ELF symbol size");
+  }
+
   // overall size of the symbol table (overall size / size of a single entry)
   const auto n_entries = symtab->sh_size / symtab->sh_entsize;
-  this->symbol_table_.resize(n_entries);
-
-  std::copy(this->data_ + symtab->sh_offset,
-            this->data_ + symtab->sh_offset + symtab->sh_size,
-            reinterpret_cast<std::byte*>(this->symbol_table_.data()));
+  this->symbol_table_ =
+      ViewTable(this->data_, this->fle_size_, symtab->sh_offset, n_entries,
+                this->symbol_table_copy_, "symbols");
 }
 
 // get the section name for each section from the string table and update the
 // private mapping
 void sdb::Elf::BuildSectionMap() {
-  for (auto& section : this->section_headers_) {
+  for (const auto& section : this->section_headers_) {
     auto name                = GetSectionName(section.sh_name);
     this->section_map_[name] = &section;
   }
 }
 
-void sdb::Elf::BuildSymbolMaps() {
-  // get every symbol from the symbol table and attempt to demangle its name
-  for (auto& symbol : this->symbol_table_) {
-    const auto mangled_name = GetString(symbol.st_name);
-    int        demangle_status;
-
-    const auto demangled_name = abi::__cxa_demangle(
-        mangled_name.data(), nullptr, nullptr, &demangle_status);
-
-    // if demangling was successful, add an entry for the demangled name
-    if (demangle_status == 0) {
-      this->symbol_name_map_.insert({demangled_name, &symbol});
-      // and free the demangled name string
-      free(demangled_name);
+void sdb::Elf::BuildAddressIndexes() {
+  // .tbss takes up no addresses of its own: they're the next section's
+  for (const auto& section : this->section_headers_) {
+    const auto tbss = (section.sh_flags & SHF_TLS) != 0 &&
+                      section.sh_type == SHT_NOBITS;
+    if ((section.sh_flags & SHF_ALLOC) != 0 && section.sh_size != 0 &&
+        !tbss) {
+      this->section_index_.Add(section.sh_addr,
+                               section.sh_addr + section.sh_size, &section);
     }
+  }
+  this->section_index_.Sort();
+
+  for (const auto& segment : this->program_headers_) {
+    if (segment.p_type == PT_LOAD && segment.p_memsz != 0) {
+      this->segment_index_.Add(segment.p_vaddr,
+                               segment.p_vaddr + segment.p_memsz, &segment);
+    }
+  }
+  this->segment_index_.Sort();
+}
 
-    // add an entry regardless for the mangled name
-    this->symbol_name_map_.insert({mangled_name, &symbol});
+void sdb::Elf::BuildSymbolMaps() {
+  if (auto cache = IndexCache::Open(*this, "symbol-addresses", 2)) {
+    const auto addresses = cache->GetTable<std::uint64_t>(0);
+    const auto indices   = cache->GetTable<std::uint32_t>(1);
+    if (addresses && indices &&
+        AreSymbolAddressesValid(*addresses, *indices,
+                                this->symbol_table_.Size())) {
+      this->symbol_address_cache_ = std::move(cache);
+      this->SetSymbolAddresses(*addresses, *indices);
+      return;
+    }
+  }
 
-    // has and address and a name
+  // index the symbols that have an address and a name, and aren't
+  // thread-local storage
+  auto& indices = this->symbol_indices_built_;
+  for (std::uint32_t i = 0; i < this->symbol_table_.Size(); ++i) {
+    const auto& symbol = this->symbol_table_[i];
     if (symbol.st_value != 0 && symbol.st_name != 0 &&
-        ELF64_ST_TYPE(symbol.st_info) !=
-            STT_TLS) {  // and is not thread-local storage
-      const auto address_range =
-          std::pair(FileAddress{*this, symbol.st_value},
-                    FileAddress{*this, symbol.st_value + symbol.st_size});
-      this->symbol_addr_map_.insert({address_range, &symbol});
+        ELF64_ST_TYPE(symbol.st_info) != STT_TLS) {
+      indices.push_back(i);
     }
   }
+  std::stable_sort(indices.begin(), indices.end(),
+                   [this](const std::uint32_t lhs, const std::uint32_t rhs)
+                   {
+                     return this->symbol_table_[lhs].st_value <
+                            this->symbol_table_[rhs].st_value;
+                   });
+
+  const auto n_indexed = indices.size();
+  auto&      addresses = this->symbol_addresses_built_;
+  addresses.resize(3 * n_indexed);
+  std::uint64_t max_end = 0;
+  for (std::size_t i = 0; i < n_indexed; ++i) {
+    const auto& symbol = this->symbol_table_[indices[i]];
+    const auto  end    = symbol.st_value + symbol.st_size;
+    max_end            = std::max(max_end, end);
+    addresses[i]                 = symbol.st_value;
+    addresses[n_indexed + i]     = end;
+    addresses[2 * n_indexed + i] = max_end;
+  }
+  this->SetSymbolAddresses(Span<const std::uint64_t>(addresses),
+                           Span<const std::uint32_t>(indices));
+  IndexCache::Save(
+      *this, "symbol-addresses",
+      {IndexCache::AsTable(addresses), IndexCache::AsTable(indices)});
+}
+
+void sdb::Elf::SetSymbolAddresses(const Span<const std::uint64_t> addresses,
+                                  const Span<const std::uint32_t> indices) {
+  const auto n_indexed   = indices.Size();
+  this->symbol_starts_   = {addresses.begin(), n_indexed};
+  this->symbol_ends_     = {addresses.begin() + n_indexed, n_indexed};
+  this->symbol_max_ends_ = {addresses.begin() + 2 * n_indexed, n_indexed};
+  this->symbol_indices_  = indices;
+}
+
+void sdb::Elf::IndexSymbolNames() const {
+  if (this->symbol_names_indexed_) {
+    return;
+  }
+  this->symbol_names_indexed_ = true;
+
+  if (auto cache = IndexCache::Open(*this, "symbol-names", 2)) {
+    const auto names     = cache->GetTable<SymbolName>(0);
+    const auto demangled = cache->GetTable<char>(1);
+    if (names && demangled) {
+      this->symbol_name_cache_ = std::move(cache);
+      this->symbol_names_      = *names;
+      this->demangled_names_   = *demangled;
+      return;
+    }
+  }
+
+  // Demangling is what takes the time, so the symbols are split between
+  // threads, each with an arena of its own. The index is built afterwards
+  const auto n_symbols = static_cast<std::uint32_t>(this->symbol_table_.Size());
+  const auto n_threads = std::clamp<std::size_t>(
+      std::thread::hardware_concurrency(), 1,
+      n_symbols / g_symbols_per_thread + 1);
+  const auto per_thread = (n_symbols + n_threads - 1) / n_threads;
+
+  std::vector<std::string> arenas(n_threads);
+  std::vector<std::vector<std::pair<std::uint32_t, std::size_t>>> ends(
+      n_threads);
+  const auto demangle = [&](const std::size_t thread)
+  {
+    const auto begin = std::min<std::size_t>(thread * per_thread, n_symbols);
+    const auto end   = std::min<std::size_t>(begin + per_thread, n_symbols);
+    ends[thread]     = DemangleSymbols(*this, begin, end, arenas[thread]);
+  };
+  std::vector<std::thread> threads;
+  for (std::size_t thread = 1; thread < n_threads; ++thread) {
+    threads.emplace_back(demangle, thread);
+  }
+  demangle(0);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // the arenas are joined into one, so each name is an offset into it
+  auto& names     = this->symbol_names_built_;
+  auto& demangled = this->demangled_names_built_;
+  for (std::size_t thread = 0; thread < n_threads; ++thread) {
+    std::size_t begin = 0;
+    for (const auto [index, end] : ends[thread]) {
+      names.push_back({demangled.size() + begin,
+                       static_cast<std::uint32_t>(end - begin),
+                       index | SymbolName::demangled});
+      begin = end;
+    }
+    demangled += arenas[thread];
+  }
+  this->demangled_names_ = {demangled.data(), demangled.size()};
+
+  // the symbols' own names are in the file already
+  for (std::uint32_t i = 0; i < n_symbols; ++i) {
+    const auto name = this->GetString(this->symbol_table_[i].st_name);
+    if (!name.empty()) {
+      names.push_back({static_cast<std::uint64_t>(
+                           reinterpret_cast<const std::byte*>(name.data()) -
+                           this->data_),
+                       static_cast<std::uint32_t>(name.size()), i});
+    }
+  }
+
+  std::sort(names.begin(), names.end(),
+            [this](const SymbolName& lhs, const SymbolName& rhs)
+            {
+              const auto lhs_name = this->GetSymbolName(lhs);
+              const auto rhs_name = this->GetSymbolName(rhs);
+              if (lhs_name != rhs_name) {
+                return lhs_name < rhs_name;
+              }
+              return (lhs.symbol & ~SymbolName::demangled) <
+                     (rhs.symbol & ~SymbolName::demangled);
+            });
+  this->symbol_names_ = Span<const SymbolName>(names);
+  IndexCache::Save(*this, "symbol-names",
+                   {IndexCache::AsTable(names),
+                    {reinterpret_cast<const std::byte*>(demangled.data()),
+                     demangled.size()}});
 }
@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <csignal>
+#include <libsdb/error.hpp>
+#include <libsdb/event_loop.hpp>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+  // returns -1 when pidfds aren't supported, in which case exits are picked up
+  // through SIGCHLD like any other state change
+  int OpenPidfd(const pid_t pid) {
+#ifdef SYS_pidfd_open
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#else
+    return -1;
+#endif
+  }
+}  // namespace
+
+sdb::EventLoop::EventLoop() {
+  // SIGCHLD has to be blocked to be read from a signalfd rather than delivered
+  sigset_t sigchld;
+  sigemptyset(&sigchld);
+  sigaddset(&sigchld, SIGCHLD);
+  if (pthread_sigmask(SIG_BLOCK, &sigchld, &this->previous_mask_) != 0) {
+    Error::Send("Could not block SIGCHLD");
+  }
+
+  this->signal_fd_ = signalfd(-1, &sigchld, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (this->signal_fd_ == -1) {
+    pthread_sigmask(SIG_SETMASK, &this->previous_mask_, nullptr);
+    Error::SendErrno("Could not create signalfd");
+  }
+
+  this->epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (this->epoll_fd_ == -1) {
+    close(this->signal_fd_);
+    pthread_sigmask(SIG_SETMASK, &this->previous_mask_, nullptr);
+    Error::SendErrno("Could not create epoll instance");
+  }
+
+  this->Watch(this->signal_fd_);
+}
+
+sdb::EventLoop::~EventLoop() {
+  for (const auto &[pid, watched] : this->processes_) {
+    if (watched.pidfd != -1) {
+      close(watched.pidfd);
+    }
+  }
+
+  if (this->signal_fd_ != -1) {
+    close(this->signal_fd_);
+  }
+  if (this->epoll_fd_ != -1) {
+    close(this->epoll_fd_);
+  }
+  pthread_sigmask(SIG_SETMASK, &this->previous_mask_, nullptr);
+}
+
+void sdb::EventLoop::Watch(const int fd) const {
+  epoll_event event{};
+  event.events  = EPOLLIN;
+  event.data.fd = fd;
+  if (epoll_ctl(this->epoll_fd_, EPOLL_CTL_ADD, fd, &event) == -1) {
+    Error::SendErrno("Could not watch file descriptor");
+  }
+}
+
+void sdb::EventLoop::Unwatch(const int fd) const {
+  epoll_ctl(this->epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void sdb::EventLoop::AddProcess(Process &process, StopCallback on_stop) {
+  const auto pidfd = OpenPidfd(process.GetPid());
+  if (pidfd != -1) {
+    this->Watch(pidfd);
+  }
+
+  this->processes_[process.GetPid()] = {&process, std::move(on_stop), pidfd};
+  // the process may have stopped before we started listening for SIGCHLD
+  this->poll_pending_ = true;
+}
+
+void sdb::EventLoop::RemoveProcess(const Process &process) {
+  const auto it = this->processes_.find(process.GetPid());
+  if (it == this->processes_.end()) {
+    return;
+  }
+
+  if (it->second.pidfd != -1) {
+    this->Unwatch(it->second.pidfd);
+    close(it->second.pidfd);
+  }
+  this->processes_.erase(it);
+}
+
+void sdb::EventLoop::AddFd(const int fd, FdCallback on_readable) {
+  this->Watch(fd);
+  this->fds_[fd] = std::move(on_readable);
+}
+
+void sdb::EventLoop::RemoveFd(const int fd) {
+  if (this->fds_.erase(fd) != 0) {
+    this->Unwatch(fd);
+  }
+}
+
+std::size_t sdb::EventLoop::DispatchStops() {
+  std::size_t dispatched = this->DispatchStopsOnce();
+  // a process may have reaped another's event while polling for its own, and
+  // no SIGCHLD is coming for that one
+  while (std::any_of(this->processes_.begin(), this->processes_.end(),
+                     [](const auto &entry)
+                     {
+                       const auto &process = *entry.second.process;
+                       return process.state() == ProcessState::Running &&
+                              process.HasUnclaimedEvent();
+                     })) {
+    dispatched += this->DispatchStopsOnce();
+  }
+  return dispatched;
+}
+
+std::size_t sdb::EventLoop::DispatchStopsOnce() {
+  // SIGCHLDs coalesce, so one signal may stand for several state changes; ask
+  // every process. Callbacks may add or remove processes, hence the copy
+  std::vector<pid_t> pids;
+  for (const auto &[pid, watched] : this->processes_) {
+    pids.push_back(pid);
+  }
+
+  std::size_t dispatched = 0;
+  for (const auto pid : pids) {
+    const auto it = this->processes_.find(pid);
+    if (it == this->processes_.end()) {
+      continue;
+    }
+
+    auto &process = *it->second.process;
+    if (process.state() != ProcessState::Running) {
+      continue;  // nothing to wait for
+    }
+
+    const auto reason = process.TryWaitOnSignal();
+    if (!reason) {
+      continue;
+    }
+
+    const auto on_stop = it->second.on_stop;
+    if (reason->reason == ProcessState::Exited ||
+        reason->reason == ProcessState::Terminated) {
+      this->RemoveProcess(process);
+    }
+
+    on_stop(process, *reason);
+    ++dispatched;
+  }
+
+  return dispatched;
+}
+
+std::size_t sdb::EventLoop::RunOnce(
+    const std::optional<std::chrono::milliseconds> timeout) {
+  if (this->poll_pending_) {
+    this->poll_pending_ = false;
+    if (const auto dispatched = this->DispatchStops(); dispatched != 0) {
+      return dispatched;
+    }
+  }
+
+  using Clock         = std::chrono::steady_clock;
+  const auto deadline =
+      Clock::now() + timeout.value_or(std::chrono::milliseconds{0});
+
+  // a wakeup doesn't always lead to a callback (i.e SIGCHLD for a state change
+  // we've already seen), so keep waiting until one does or we time out
+  while (true) {
+    int wait_ms = -1;
+    if (timeout) {
+      const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+          deadline - Clock::now());
+      wait_ms = static_cast<int>(std::max<std::int64_t>(remaining.count(), 0));
+    }
+
+    if (const auto dispatched = this->WaitAndDispatch(wait_ms);
+        dispatched != 0 || wait_ms == 0) {
+      return dispatched;
+    }
+  }
+}
+
+std::size_t sdb::EventLoop::WaitAndDispatch(const int timeout_ms) {
+  constexpr int max_events = 16;
+  epoll_event   events[max_events];
+
+  const auto n_events =
+      epoll_wait(this->epoll_fd_, events, max_events, timeout_ms);
+  if (n_events == -1) {
+    if (errno == EINTR) {
+      return 0;
+    }
+    Error::SendErrno("Could not wait for events");
+  }
+
+  bool               check_processes = false;
+  std::size_t        dispatched      = 0;
+  std::vector<pid_t> exited;
+
+  for (int i = 0; i < n_events; ++i) {
+    const auto fd = events[i].data.fd;
+
+    if (fd == this->signal_fd_) {
+      // drain the signalfd; we only care that something changed
+      signalfd_siginfo info[8];
+      while (read(this->signal_fd_, info, sizeof(info)) > 0) {
+      }
+      check_processes = true;
+    } else if (const auto it = this->fds_.find(fd); it != this->fds_.end()) {
+      const auto on_readable = it->second;
+      on_readable(fd);
+      ++dispatched;
+    } else {
+      // a pidfd, so a process has exited
+      check_processes = true;
+      for (const auto &[pid, watched] : this->processes_) {
+        if (watched.pidfd == fd) {
+          exited.push_back(pid);
+        }
+      }
+    }
+  }
+
+  if (check_processes) {
+    dispatched += this->DispatchStops();
+  }
+  for (const auto pid : exited) {
+    dispatched += this->DispatchExit(pid);
+  }
+  return dispatched;
+}
+
+std::size_t sdb::EventLoop::DispatchExit(const pid_t pid) {
+  const auto it = this->processes_.find(pid);
+  if (it == this->processes_.end()) {
+    return 0;  // already reported
+  }
+
+  // A running process has had its exit dispatched already, or will when its
+  // SIGCHLD comes. One that died while stopped (i.e killed from outside) is
+  // never polled, and its pidfd stays readable, so it's reaped here
+  auto &process = *it->second.process;
+  if (process.state() == ProcessState::Running) {
+    return 0;
+  }
+  std::optional<StopReason> reason;
+  while (const auto next = process.TryWaitOnSignal()) {
+    reason = next;
+    if (reason->reason == ProcessState::Exited ||
+        reason->reason == ProcessState::Terminated) {
+      const auto on_stop = it->second.on_stop;
+      this->RemoveProcess(process);
+      on_stop(process, *reason);
+      return 1;
+    }
+  }
+
+  // nothing to reap yet, so stop listening rather than wake up for it again
+  this->Unwatch(it->second.pidfd);
+  close(it->second.pidfd);
+  it->second.pidfd = -1;
+  return 0;
+}
+
+void sdb::EventLoop::Run() {
+  this->stopping_ = false;
+  while (!this->stopping_ &&
+         !(this->processes_.empty() && this->fds_.empty())) {
+    this->RunOnce();
+  }
+}
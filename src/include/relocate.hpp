@@ -0,0 +1,34 @@
+#ifndef SDB_RELOCATE_HPP
+#define SDB_RELOCATE_HPP
+
+#include <Zydis/Zydis.h>
+#include <cstdint>
+#include <libsdb/types.hpp>
+#include <optional>
+#include <vector>
+
+// Moving machine code somewhere else in the inferior, for tracepoint
+// trampolines and displaced stepping
+namespace sdb {
+  // decodes the first instruction in `code`
+  std::optional<ZydisDecodedInstruction> DecodeInstruction(
+      Span<const std::byte> code);
+
+  // appends a rel32 to `code`, which is to be placed at `code_address`, that
+  // reaches `target` from the end of it. Returns false if it can't
+  bool AppendRel32(std::vector<std::byte> &code, VirtualAddress code_address,
+                   std::uint64_t target);
+
+  // Appends `instruction` (decoded from `bytes`, which are at `from`) to
+  // `code`, which is to be placed at `code_address`, so that it does the
+  // same thing from there. RIP-relative operands are adjusted, and relative
+  // branches are re-encoded with 32-bit displacements so they can reach
+  // back. Returns false if it can't be moved (i.e loop and jrcxz, which only
+  // have 8-bit displacements, or a target that's out of reach)
+  bool RelocateInstruction(Span<const std::byte>          bytes,
+                           const ZydisDecodedInstruction &instruction,
+                           VirtualAddress from, VirtualAddress code_address,
+                           std::vector<std::byte> &code);
+}  // namespace sdb
+
+#endif  // SDB_RELOCATE_HPP
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <libsdb/bit.hpp>
+#include <libsdb/elf.hpp>
+#include <libsdb/index_cache.hpp>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+  constexpr char g_magic[8] = {'s', 'd', 'b', 'i', 'n', 'd', 'e', 'x'};
+
+  // longer build IDs than this (they're 20 bytes from ld's default SHA-1)
+  // aren't cached
+  constexpr std::size_t g_max_build_id_size = 64;
+
+  struct Header {
+    char          magic[8];
+    std::uint32_t version;
+    std::uint32_t n_tables;
+    std::uint64_t elf_size;
+    std::uint64_t build_id_size;
+    std::byte     build_id[g_max_build_id_size];
+  };
+
+  // follows the header, one per table
+  struct TableEntry {
+    std::uint64_t offset;
+    std::uint64_t size;
+  };
+
+  constexpr std::uint64_t g_table_alignment = 8;
+
+  std::uint64_t AlignTable(const std::uint64_t offset) {
+    return (offset + g_table_alignment - 1) & ~(g_table_alignment - 1);
+  }
+
+  // the header `elf`'s cache files must have, or nullopt if it can't have
+  // any
+  std::optional<Header> ExpectedHeader(const sdb::Elf   &elf,
+                                       const std::size_t n_tables) {
+    const auto build_id = elf.GetBuildId();
+    if (build_id.Size() == 0 || build_id.Size() > g_max_build_id_size) {
+      return std::nullopt;
+    }
+
+    Header header{};
+    std::memcpy(header.magic, g_magic, sizeof(g_magic));
+    header.version       = sdb::IndexCache::version;
+    header.n_tables      = n_tables;
+    header.elf_size      = elf.GetData().Size();
+    header.build_id_size = build_id.Size();
+    std::copy(build_id.begin(), build_id.end(), header.build_id);
+    return header;
+  }
+
+  // where the `kind` index of `elf` is cached, or an empty path if nowhere
+  std::filesystem::path CachePath(const sdb::Elf        &elf,
+                                  const std::string_view kind) {
+    const auto directory = sdb::IndexCache::Directory();
+    const auto build_id  = elf.GetBuildId();
+    if (directory.empty() || build_id.Size() == 0) {
+      return {};
+    }
+
+    constexpr char digits[] = "0123456789abcdef";
+    std::string    name;
+    for (const auto byte : build_id) {
+      name += digits[std::to_integer<unsigned>(byte) >> 4];
+      name += digits[std::to_integer<unsigned>(byte) & 0xf];
+    }
+    name += '.';
+    name += kind;
+    return directory / name;
+  }
+
+  bool WriteAll(const int fd, const void *data, std::size_t size) {
+    auto next = static_cast<const char *>(data);
+    while (size > 0) {
+      const auto n_written = write(fd, next, size);
+      if (n_written <= 0) {
+        return false;
+      }
+      next += n_written;
+      size -= n_written;
+    }
+    return true;
+  }
+}  // namespace
+
+std::filesystem::path sdb::IndexCache::Directory() {
+  if (const auto cache_home = std::getenv("XDG_CACHE_HOME");
+      cache_home && cache_home[0] != '\0') {
+    return std::filesystem::path(cache_home) / "sdb";
+  }
+  if (const auto home = std::getenv("HOME"); home && home[0] != '\0') {
+    return std::filesystem::path(home) / ".cache" / "sdb";
+  }
+  return {};
+}
+
+std::unique_ptr<sdb::IndexCache> sdb::IndexCache::Open(
+    const Elf &elf, const std::string_view kind, const std::size_t n_tables) {
+  const auto expected = ExpectedHeader(elf, n_tables);
+  const auto path     = CachePath(elf, kind);
+  if (!expected || path.empty()) {
+    return nullptr;
+  }
+
+  const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat stats;
+  const auto  size = fstat(fd, &stats) == 0
+                         ? static_cast<std::size_t>(stats.st_size)
+                         : std::size_t{0};
+  const auto tables_end = sizeof(Header) + n_tables * sizeof(TableEntry);
+  if (size < tables_end) {
+    close(fd);
+    return nullptr;
+  }
+  const auto data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+  std::unique_ptr<IndexCache> cache(
+      new IndexCache(static_cast<std::byte *>(data), size));
+
+  if (std::memcmp(data, &*expected, sizeof(Header)) != 0) {
+    return nullptr;
+  }
+  // every table must lie within the file, aligned, and in order
+  std::uint64_t end = tables_end;
+  for (std::size_t i = 0; i < n_tables; ++i) {
+    const auto table = FromBytes<TableEntry>(cache->data_ + sizeof(Header) +
+                                             i * sizeof(TableEntry));
+    if (table.offset != AlignTable(end) || table.size > size - table.offset) {
+      return nullptr;
+    }
+    end = table.offset + table.size;
+  }
+  if (end != size) {
+    return nullptr;
+  }
+  return cache;
+}
+
+void sdb::IndexCache::Save(const Elf &elf, const std::string_view kind,
+                           const std::vector<Span<const std::byte>> &tables) {
+  const auto header = ExpectedHeader(elf, tables.size());
+  const auto path   = CachePath(elf, kind);
+  if (!header || path.empty()) {
+    return;
+  }
+
+  std::error_code error;
+  std::filesystem::create_directories(path.parent_path(), error);
+  if (error) {
+    return;
+  }
+
+  std::vector<TableEntry> entries;
+  std::uint64_t end = sizeof(Header) + tables.size() * sizeof(TableEntry);
+  for (const auto &table : tables) {
+    entries.push_back({AlignTable(end), table.Size()});
+    end = entries.back().offset + table.Size();
+  }
+
+  auto temporary = path;
+  temporary     += ".tmp." + std::to_string(getpid());
+  const auto fd  = open(temporary.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return;
+  }
+
+  constexpr std::byte padding[g_table_alignment] = {};
+  const auto          entries_size = entries.size() * sizeof(TableEntry);
+  auto written = WriteAll(fd, &*header, sizeof(Header)) &&
+                 WriteAll(fd, entries.data(), entries_size);
+  std::uint64_t offset = sizeof(Header) + entries_size;
+  for (std::size_t i = 0; written && i < tables.size(); ++i) {
+    written = WriteAll(fd, padding, entries[i].offset - offset) &&
+              WriteAll(fd, tables[i].begin(), tables[i].Size());
+    offset  = entries[i].offset + tables[i].Size();
+  }
+  close(fd);
+
+  if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+    unlink(temporary.c_str());
+  }
+}
+
+sdb::IndexCache::~IndexCache() { munmap(this->data_, this->size_); }
+
+sdb::Span<const std::byte> sdb::IndexCache::GetTableBytes(
+    const std::size_t index) const {
+  const auto table = FromBytes<TableEntry>(this->data_ + sizeof(Header) +
+                                           index * sizeof(TableEntry));
+  return {this->data_ + table.offset, table.size};
+}
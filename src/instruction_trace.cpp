@@ -0,0 +1,250 @@
+#include <csignal>
+#include <cstring>
+#include <cxxabi.h>
+#include <libsdb/bit.hpp>
+#include <libsdb/dwarf.hpp>
+#include <libsdb/error.hpp>
+#include <libsdb/instruction_trace.hpp>
+#include <iterator>
+#include <sstream>
+
+namespace {
+  constexpr std::array<char, 8> g_magic = {'S', 'D', 'B', 'S',
+                                           'T', 'E', 'P', 'S'};
+
+  // the fixed part of the file, followed by the program's path
+  struct Header {
+    std::array<char, 8> magic;
+    std::uint64_t       granularity;
+    std::uint64_t       load_bias;
+    std::uint64_t       program_size;
+  };
+
+  // user_regs_struct, as an array of its fields
+  constexpr std::size_t n_fields =
+      sizeof(user_regs_struct) / sizeof(std::uint64_t);
+  static_assert(sizeof(user_regs_struct) == n_fields * sizeof(std::uint64_t),
+                "user_regs_struct should be all 64-bit fields");
+  static_assert(n_fields <= 32, "changed fields should fit in a uint32_t");
+  using Fields = std::array<std::uint64_t, n_fields>;
+
+  // the PC is stored on its own
+  constexpr std::size_t g_rip_field =
+      offsetof(user_regs_struct, rip) / sizeof(std::uint64_t);
+
+  Fields ToFields(const user_regs_struct &regs) {
+    Fields fields;
+    std::memcpy(fields.data(), &regs, sizeof(regs));
+    return fields;
+  }
+
+  // small differences either way take few bytes
+  std::uint64_t ZigZag(const std::uint64_t delta) {
+    const auto value = static_cast<std::int64_t>(delta);
+    return (static_cast<std::uint64_t>(value) << 1) ^
+           static_cast<std::uint64_t>(value >> 63);
+  }
+
+  std::uint64_t UnZigZag(const std::uint64_t value) {
+    return (value >> 1) ^ -(value & 1);
+  }
+
+  void AppendVarint(std::string &out, std::uint64_t value) {
+    while (value >= 0x80) {
+      out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+  }
+
+  std::uint64_t ReadVarint(const std::string &in, std::size_t &pos) {
+    std::uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (pos == in.size()) {
+        sdb::Error::Send("Instruction trace is truncated");
+      }
+      const auto byte = static_cast<std::uint8_t>(in[pos++]);
+      value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return value;
+      }
+    }
+    sdb::Error::Send("Invalid instruction trace");
+  }
+
+  // "name+0x1c", or just the name at its start
+  std::string WithOffset(const std::string_view name,
+                         const std::uint64_t    offset) {
+    std::ostringstream out;
+    out << name;
+    if (offset != 0) {
+      out << "+0x" << std::hex << offset;
+    }
+    return out.str();
+  }
+}  // namespace
+
+std::unique_ptr<sdb::InstructionTraceWriter>
+sdb::InstructionTraceWriter::Create(const std::filesystem::path &path,
+                                    const StepMode               granularity,
+                                    const std::filesystem::path &program,
+                                    const VirtualAddress         load_bias) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    Error::Send("Could not create instruction trace " + path.string());
+  }
+
+  const auto &name = program.native();
+  Header      header{g_magic, static_cast<std::uint64_t>(granularity),
+                load_bias.GetAddress(), name.size()};
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(name.data(), static_cast<std::streamsize>(name.size()));
+
+  return std::unique_ptr<InstructionTraceWriter>(
+      new InstructionTraceWriter(std::move(file)));
+}
+
+void sdb::InstructionTraceWriter::Append(const user_regs_struct &regs) {
+  const auto current  = ToFields(regs);
+  const auto previous = ToFields(this->previous_);
+
+  std::uint32_t changed = 0;
+  for (std::size_t i = 0; i < n_fields; ++i) {
+    if (i != g_rip_field && current[i] != previous[i]) {
+      changed |= 1u << i;
+    }
+  }
+
+  std::string record;
+  AppendVarint(record, ZigZag(regs.rip - this->previous_.rip));
+  AppendVarint(record, changed);
+  for (std::size_t i = 0; i < n_fields; ++i) {
+    if (changed & (1u << i)) {
+      AppendVarint(record, ZigZag(current[i] - previous[i]));
+    }
+  }
+
+  if (!this->file_.write(record.data(),
+                         static_cast<std::streamsize>(record.size()))) {
+    Error::Send("Could not write instruction trace");
+  }
+  this->previous_ = regs;
+  ++this->n_steps_;
+}
+
+std::unique_ptr<sdb::InstructionTrace> sdb::InstructionTrace::Open(
+    const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    Error::Send("Could not open instruction trace " + path.string());
+  }
+  const std::string contents{std::istreambuf_iterator<char>(file),
+                             std::istreambuf_iterator<char>()};
+
+  Header header;
+  if (contents.size() < sizeof(header)) {
+    Error::Send("Not an instruction trace");
+  }
+  std::memcpy(&header, contents.data(), sizeof(header));
+  if (header.magic != g_magic ||
+      contents.size() - sizeof(header) < header.program_size) {
+    Error::Send("Not an instruction trace");
+  }
+
+  std::unique_ptr<InstructionTrace> trace(new InstructionTrace);
+  trace->granularity_ = static_cast<StepMode>(header.granularity);
+  trace->load_bias_   = VirtualAddress{header.load_bias};
+  trace->program_     = contents.substr(sizeof(header), header.program_size);
+
+  Fields fields{};
+  auto   pos = sizeof(header) + header.program_size;
+  while (pos < contents.size()) {
+    fields[g_rip_field] += UnZigZag(ReadVarint(contents, pos));
+
+    const auto changed = ReadVarint(contents, pos);
+    if (changed >> n_fields) {
+      Error::Send("Invalid instruction trace");
+    }
+    for (std::size_t i = 0; i < n_fields; ++i) {
+      if (changed & (1u << i)) {
+        fields[i] += UnZigZag(ReadVarint(contents, pos));
+      }
+    }
+
+    auto &step   = trace->steps_.emplace_back();
+    step.pc      = VirtualAddress{fields[g_rip_field]};
+    step.changed = static_cast<std::uint32_t>(changed);
+    std::memcpy(&step.regs, fields.data(), sizeof(step.regs));
+  }
+  return trace;
+}
+
+sdb::InstructionTraceResult sdb::RecordInstructionTrace(
+    Process &process, InstructionTraceWriter &trace,
+    const InstructionTraceOptions &options) {
+  using End = InstructionTraceResult::End;
+
+  trace.Append(process.GetRegisters().GetGprs());
+
+  std::uint64_t steps = 0;
+  while (true) {
+    const auto reason = options.granularity == StepMode::Block
+                            ? process.StepBlock()
+                            : process.StepInstruction();
+    ++steps;
+    if (reason.reason != ProcessState::Stopped) {
+      return {End::Stop, steps, reason};
+    }
+
+    const auto &regs = process.GetRegisters().GetGprs();
+    trace.Append(regs);
+
+    // stepping over a syscall reports a SIGTRAP too, just not as a single
+    // step (see AugmentStopReason), so any other signal ends the trace
+    const VirtualAddress pc{regs.rip};
+    if (process.GetBreakpointSites().EnabledStopPointAtAddress(pc)) {
+      return {End::Breakpoint, steps, reason};
+    }
+    if (reason.info != SIGTRAP) {
+      return {End::Stop, steps, reason};
+    }
+    if (options.until && pc == *options.until) {
+      return {End::Address, steps, reason};
+    }
+    if (steps == options.max_steps) {
+      return {End::Count, steps, reason};
+    }
+  }
+}
+
+std::optional<std::string> sdb::SymbolizeAddress(
+    const Elf &elf, const VirtualAddress address) {
+  if (const auto symbol = elf.GetSymbolContainingAddress(address)) {
+    const auto name   = elf.GetString((*symbol)->st_name);
+    const auto offset = address.ToFileAddress(elf).GetAddress() -
+                        (*symbol)->st_value;
+
+    int        status;
+    const auto demangled =
+        abi::__cxa_demangle(name.data(), nullptr, nullptr, &status);
+    if (status == 0) {
+      const auto symbolized = WithOffset(demangled, offset);
+      free(demangled);
+      return symbolized;
+    }
+    return WithOffset(name, offset);
+  }
+
+  // i.e a stripped symbol table
+  const auto file_address = address.ToFileAddress(elf);
+  if (file_address.ElfFile() != nullptr) {
+    if (const auto function =
+            elf.GetDwarf().FunctionContainingAddress(file_address)) {
+      if (const auto name = function->Name()) {
+        return WithOffset(*name, file_address.GetAddress() -
+                                     function->LowPc().GetAddress());
+      }
+    }
+  }
+  return std::nullopt;
+}
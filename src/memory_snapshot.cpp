@@ -0,0 +1,326 @@
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <libsdb/error.hpp>
+#include <libsdb/memory_snapshot.hpp>
+#include <sstream>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+  constexpr std::uint64_t g_page_size = sdb::MemorySnapshots::page_size;
+
+  // pagemap entry bits, see Documentation/admin-guide/mm/pagemap.rst
+  constexpr std::uint64_t g_soft_dirty = std::uint64_t{1} << 55;
+  constexpr std::uint64_t g_swapped    = std::uint64_t{1} << 62;
+  constexpr std::uint64_t g_present    = std::uint64_t{1} << 63;
+
+  struct Mapping {
+    std::uint64_t low;
+    std::uint64_t high;
+  };
+
+  // the readable and writable mappings of the process, in address order
+  std::vector<Mapping> ReadWritableMappings(const pid_t pid) {
+    std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+    if (!maps) {
+      sdb::Error::Send("Could not read the memory map of the process");
+    }
+
+    std::vector<Mapping> mappings;
+    std::string          line;
+    while (std::getline(maps, line)) {
+      std::istringstream fields(line);
+      std::uint64_t      low, high;
+      std::string        permissions;
+      char               dash;
+      fields >> std::hex >> low >> dash >> high >> permissions;
+      if (permissions.size() >= 2 && permissions[0] == 'r' &&
+          permissions[1] == 'w') {
+        mappings.push_back({low, high});
+      }
+    }
+    return mappings;
+  }
+
+  // the pagemap entries of every page of `mappings`, back to back
+  std::vector<std::uint64_t> ReadPagemap(const pid_t                 pid,
+                                         const std::vector<Mapping> &mappings) {
+    const auto path = "/proc/" + std::to_string(pid) + "/pagemap";
+    const auto fd   = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      sdb::Error::SendErrno("Could not open the page map of the process");
+    }
+
+    std::vector<std::uint64_t> entries;
+    for (const auto &mapping : mappings) {
+      const auto n_pages = (mapping.high - mapping.low) / g_page_size;
+      const auto first   = entries.size();
+      entries.resize(first + n_pages);
+      const auto size = n_pages * sizeof(std::uint64_t);
+      if (pread(fd, entries.data() + first, size,
+                mapping.low / g_page_size * sizeof(std::uint64_t)) !=
+          static_cast<ssize_t>(size)) {
+        close(fd);
+        sdb::Error::SendErrno("Could not read the page map of the process");
+      }
+    }
+    close(fd);
+    return entries;
+  }
+
+  void ClearSoftDirtyBits(const std::string &pid) {
+    const auto path = "/proc/" + pid + "/clear_refs";
+    const auto fd   = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    // 4 clears the soft-dirty bits, and nothing else
+    const auto cleared = fd >= 0 && write(fd, "4", 1) == 1;
+    if (fd >= 0) {
+      close(fd);
+    }
+    if (!cleared) {
+      sdb::Error::SendErrno("Could not clear soft-dirty bits");
+    }
+  }
+}  // namespace
+
+bool sdb::MemorySnapshots::SoftDirtySupported() {
+  // Kernels built without CONFIG_MEM_SOFT_DIRTY accept the write to
+  // clear_refs and just never set the bit, so we see whether writing to a
+  // page of our own sets it
+  static const bool supported = []
+  {
+    const auto page = static_cast<volatile char *>(
+        mmap(nullptr, g_page_size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (page == MAP_FAILED) {
+      return false;
+    }
+
+    bool dirty = false;
+    try {
+      page[0] = 1;
+      ClearSoftDirtyBits("self");
+      page[0] = 2;
+      const auto entries = ReadPagemap(
+          getpid(), {{reinterpret_cast<std::uintptr_t>(page),
+                      reinterpret_cast<std::uintptr_t>(page) + g_page_size}});
+      dirty = (entries[0] & g_soft_dirty) != 0;
+    } catch (const Error &) {
+      // as good as unsupported
+    }
+    munmap(const_cast<char *>(page), g_page_size);
+    return dirty;
+  }();
+  return supported;
+}
+
+std::size_t sdb::MemorySnapshots::Take() {
+  if (this->process_.state() != ProcessState::Stopped) {
+    Error::Send("Snapshots can only be taken while the process is stopped");
+  }
+
+  const auto index      = this->changes_.size();
+  const bool soft_dirty = SoftDirtySupported();
+  const auto pid        = this->process_.GetPid();
+  const auto mappings   = ReadWritableMappings(pid);
+  const auto entries    = ReadPagemap(pid, mappings);
+
+  // the pages that may have changed: those written to since the last
+  // snapshot, or all of them if we can't tell
+  std::vector<std::uint64_t> candidates;
+  std::size_t                entry = 0;
+  for (const auto &mapping : mappings) {
+    for (auto page = mapping.low; page < mapping.high;
+         page += g_page_size, ++entry) {
+      const auto in_memory = (entries[entry] & (g_present | g_swapped)) != 0;
+      if (in_memory && (index == 0 || !soft_dirty ||
+                        (entries[entry] & g_soft_dirty) != 0)) {
+        candidates.push_back(page);
+      }
+    }
+  }
+
+  // Pages dropped from memory (i.e by MADV_DONTNEED) have changed without
+  // being written to, and unmapped pages are a change of their own
+  std::vector<std::size_t> first_entries;
+  std::size_t              n_entries = 0;
+  for (const auto &mapping : mappings) {
+    first_entries.push_back(n_entries);
+    n_entries += (mapping.high - mapping.low) / g_page_size;
+  }
+  std::vector<std::uint64_t> unmapped_pages, dropped_pages;
+  for (auto &[page, history] : this->pages_) {
+    if (!history.present) {
+      continue;
+    }
+    const auto mapping = std::upper_bound(
+        mappings.begin(), mappings.end(), page,
+        [](const std::uint64_t page, const Mapping &mapping)
+        { return page < mapping.high; });
+    if (mapping == mappings.end() || page < mapping->low) {
+      unmapped_pages.push_back(page);
+    } else if ((entries[first_entries[mapping - mappings.begin()] +
+                        (page - mapping->low) / g_page_size] &
+                (g_present | g_swapped)) == 0) {
+      candidates.push_back(page);
+      dropped_pages.push_back(page);
+    }
+  }
+  std::sort(dropped_pages.begin(), dropped_pages.end());
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                   candidates.end());
+
+  // read them all at once, each run of adjacent pages as one range
+  if (this->buffer_.size() < candidates.size() * g_page_size) {
+    this->buffer_.resize(candidates.size() * g_page_size);
+  }
+  const auto contents = this->buffer_.data();
+  std::vector<MemoryRange> ranges;
+  std::vector<std::size_t> candidate_ranges;
+  for (std::size_t i = 0; i < candidates.size(); ++i) {
+    if (i > 0 && candidates[i] == candidates[i - 1] + g_page_size) {
+      auto &range = ranges.back();
+      range.out   = {range.out.begin(), range.out.Size() + g_page_size};
+    } else {
+      ranges.push_back({VirtualAddress{candidates[i]},
+                        {contents + i * g_page_size, g_page_size}});
+    }
+    candidate_ranges.push_back(ranges.size() - 1);
+  }
+  const auto n_read =
+      this->process_.ReadMemoryRanges({ranges.data(), ranges.size()});
+
+  auto &changes = this->changes_.emplace_back();
+  for (std::size_t i = 0; i < candidates.size(); ++i) {
+    const auto range = candidate_ranges[i];
+    if (candidates[i] + g_page_size >
+        ranges[range].address.GetAddress() + n_read[range]) {
+      continue;  // couldn't be read, so it's left as it was
+    }
+
+    const auto page    = contents + i * g_page_size;
+    auto      &history = this->pages_[candidates[i]];
+    // a page dropped from memory reads back as it is now (i.e zeroes), but
+    // it's only present again once it's been touched
+    history.present = !std::binary_search(
+        dropped_pages.begin(), dropped_pages.end(), candidates[i]);
+    if (!history.versions.empty()) {
+      const auto &previous = history.versions.back();
+      if (previous.offset != unmapped &&
+          std::memcmp(this->arena_.data() + previous.offset, page,
+                      g_page_size) == 0) {
+        continue;
+      }
+    }
+
+    const auto offset = this->arena_.size();
+    this->arena_.insert(this->arena_.end(), page, page + g_page_size);
+    history.versions.push_back({index, offset});
+    changes.push_back(candidates[i]);
+  }
+
+  for (const auto page : unmapped_pages) {
+    auto &history   = this->pages_[page];
+    history.present = false;
+    history.versions.push_back({index, unmapped});
+    changes.push_back(page);
+  }
+  std::sort(changes.begin(), changes.end());
+
+  if (soft_dirty) {
+    ClearSoftDirtyBits(std::to_string(pid));
+  }
+  return index;
+}
+
+const sdb::MemorySnapshots::PageVersion *sdb::MemorySnapshots::FindVersion(
+    const PageHistory &history, const std::size_t index) const {
+  const auto it = std::upper_bound(
+      history.versions.begin(), history.versions.end(), index,
+      [](const std::size_t index, const PageVersion &version)
+      { return index < version.snapshot; });
+  return it == history.versions.begin() ? nullptr : &*(it - 1);
+}
+
+std::vector<sdb::VirtualAddress> sdb::MemorySnapshots::ChangedPages(
+    const std::size_t from, const std::size_t to) const {
+  if (from > to || to >= this->SnapshotCount()) {
+    Error::Send("Invalid snapshot range");
+  }
+
+  std::vector<std::uint64_t> pages;
+  for (auto index = from + 1; index <= to; ++index) {
+    pages.insert(pages.end(), this->changes_[index].begin(),
+                 this->changes_[index].end());
+  }
+  std::sort(pages.begin(), pages.end());
+  pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+
+  // a page may have changed back since
+  const auto same = [this](const PageVersion *before, const PageVersion *after)
+  {
+    if (!before || before->offset == unmapped || after->offset == unmapped) {
+      return before && before->offset == after->offset;
+    }
+    return std::memcmp(this->arena_.data() + before->offset,
+                       this->arena_.data() + after->offset, g_page_size) == 0;
+  };
+
+  std::vector<VirtualAddress> changed;
+  for (const auto page : pages) {
+    const auto &history = this->pages_.at(page);
+    if (!same(this->FindVersion(history, from),
+              this->FindVersion(history, to))) {
+      changed.push_back(VirtualAddress{page});
+    }
+  }
+  return changed;
+}
+
+std::vector<sdb::VirtualAddress> sdb::MemorySnapshots::ChangedPages(
+    const std::size_t index) const {
+  if (index >= this->SnapshotCount()) {
+    Error::Send("Invalid snapshot index");
+  }
+  if (index == 0) {
+    std::vector<VirtualAddress> pages;
+    for (const auto page : this->changes_[0]) {
+      pages.push_back(VirtualAddress{page});
+    }
+    return pages;
+  }
+  return this->ChangedPages(index - 1, index);
+}
+
+std::vector<std::byte> sdb::MemorySnapshots::ReadMemory(
+    const std::size_t index, const VirtualAddress address,
+    const std::size_t amount) const {
+  if (index >= this->SnapshotCount()) {
+    Error::Send("Invalid snapshot index");
+  }
+
+  std::vector<std::byte> data;
+  data.reserve(amount);
+  auto       next = address.GetAddress();
+  const auto end  = next + amount;
+  while (next < end) {
+    const auto page = next & ~(g_page_size - 1);
+    const auto it   = this->pages_.find(page);
+    const auto version = it == this->pages_.end()
+                             ? nullptr
+                             : this->FindVersion(it->second, index);
+    if (!version || version->offset == unmapped) {
+      Error::Send("Memory wasn't captured by the snapshot");
+    }
+
+    const auto chunk_end = std::min(end, page + g_page_size);
+    const auto contents  = this->arena_.data() + version->offset;
+    data.insert(data.end(), contents + (next - page),
+                contents + (chunk_end - page));
+    next = chunk_end;
+  }
+  return data;
+}
@@ -1,18 +1,79 @@
+#include "include/relocate.hpp"
+
+#include <algorithm>
 #include <bits/types/struct_iovec.h>
+#include <climits>
 #include <csignal>
 #include <elf.h>
+#include <fcntl.h>
 #include <fstream>
 #include <libsdb/bit.hpp>
 #include <libsdb/error.hpp>
 #include <libsdb/pipe.hpp>
 #include <libsdb/process.hpp>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/mman.h>
 #include <sys/personality.h>
+#include <sys/prctl.h>
 #include <sys/ptrace.h>
+#include <sys/syscall.h>
 #include <sys/uio.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 namespace {
+  // Events waitpid(-1) reported for threads the Process waiting didn't know
+  // (i.e another Process's), in the order they came, until they're claimed
+  std::vector<std::pair<pid_t, int>> g_unclaimed_events;
+
+  // takes the first unclaimed event of a thread `is_claimed` accepts
+  template <class Predicate>
+  std::optional<std::pair<pid_t, int>> ClaimEvent(
+      const Predicate &is_claimed) {
+    const auto it = std::find_if(g_unclaimed_events.begin(),
+                                 g_unclaimed_events.end(),
+                                 [&is_claimed](const auto &event)
+                                 { return is_claimed(event.first); });
+    if (it == g_unclaimed_events.end()) {
+      return std::nullopt;
+    }
+    const auto event = *it;
+    g_unclaimed_events.erase(it);
+    return event;
+  }
+
+  // waitpid on a single thread, taking any event reaped for it first
+  pid_t WaitOnThread(const pid_t tid, int *wait_status) {
+    if (const auto event =
+            ClaimEvent([tid](const pid_t claimed) { return claimed == tid; })) {
+      *wait_status = event->second;
+      return tid;
+    }
+    return waitpid(tid, wait_status, __WALL);
+  }
+
+  // the thread group (process) of a thread, or -1 if it can't be read
+  // a field of /proc/<tid>/status holding a pid (i.e "Tgid:"), or -1 if
+  // the thread has gone
+  pid_t ReadStatusPid(const pid_t tid, const std::string &field) {
+    std::ifstream status("/proc/" + std::to_string(tid) + "/status");
+    std::string   line;
+    while (std::getline(status, line)) {
+      if (line.rfind(field, 0) == 0) {
+        return std::stoi(line.substr(field.size()));
+      }
+    }
+    return -1;
+  }
+
+  pid_t ReadThreadGroup(const pid_t tid) {
+    return ReadStatusPid(tid, "Tgid:");
+  }
+
   void ExitWithPerror(const sdb::Pipe &channel, std::string const &prefix) {
     const auto message = prefix + ": " + std::strerror(errno);
     channel.Write(reinterpret_cast<const std::byte *>(message.data()),
@@ -20,35 +81,311 @@ namespace {
     exit(-1);
   }
 
-  void SetPtraceOptions(const pid_t pid) {
-    if (ptrace(PTRACE_SETOPTIONS, pid, nullptr, PTRACE_O_TRACESYSGOOD) == -1) {
-      sdb::Error::SendErrno("Failed to set TRACESYSGOOD option");
+  // start of the (4k) page containing the given address
+  std::uint64_t PageStart(const std::uint64_t address) {
+    return address & ~std::uint64_t{0xfff};
+  }
+
+  // Whether the process has a copy of the page at `page` of its own, going by
+  // its /proc/<pid>/pagemap entry: one that's present or swapped out, but
+  // isn't a page of a file. Pages that can't be looked up count as its own
+  bool IsPrivatePage(const pid_t pid, const std::uint64_t page) {
+    constexpr std::uint64_t present = std::uint64_t{1} << 63;
+    constexpr std::uint64_t swapped = std::uint64_t{1} << 62;
+    constexpr std::uint64_t file    = std::uint64_t{1} << 61;
+
+    const auto path = "/proc/" + std::to_string(pid) + "/pagemap";
+    const auto fd   = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return true;
+    }
+    std::uint64_t entry  = 0;
+    const auto    offset = static_cast<off_t>(page / 0x1000 * sizeof(entry));
+    const auto    read   = pread(fd, &entry, sizeof(entry), offset);
+    close(fd);
+    if (read != sizeof(entry)) {
+      return true;
+    }
+    return (entry & (present | swapped)) != 0 && (entry & file) == 0;
+  }
+
+  // added to the ptrace options of a process with a seccomp filter, whose
+  // forks have to be traced as well
+  constexpr long g_follow_forks = PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK;
+
+  void SetPtraceOptions(const pid_t pid, const long extra_options = 0) {
+    // report syscall stops as SIGTRAP | 0x80, trace new threads, and stop when
+    // a seccomp filter asks us to
+    if (ptrace(PTRACE_SETOPTIONS, pid, nullptr,
+               PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE |
+                   PTRACE_O_TRACESECCOMP | extra_options) == -1) {
+      sdb::Error::SendErrno("Failed to set ptrace options");
+    }
+  }
+
+  // the data argument of a request that resumes a tracee, which takes the
+  // signal to deliver to it
+  void *SignalData(const int signal) {
+    return reinterpret_cast<void *>(static_cast<std::uintptr_t>(signal));
+  }
+
+  bool IsCloneEvent(const int wait_status) {
+    return wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_CLONE << 8));
+  }
+
+  bool IsSeccompEvent(const int wait_status) {
+    return wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_SECCOMP << 8));
+  }
+
+  bool IsForkEvent(const int wait_status) {
+    return wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_FORK << 8));
+  }
+
+  bool IsVforkEvent(const int wait_status) {
+    return wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_VFORK << 8));
+  }
+
+  // the pid of the thread or process the event at a stop created
+  pid_t GetEventPid(const pid_t tid) {
+    unsigned long new_pid;
+    if (ptrace(PTRACE_GETEVENTMSG, tid, nullptr, &new_pid) == -1) {
+      sdb::Error::SendErrno("Could not get new thread id");
+    }
+    return static_cast<pid_t>(new_pid);
+  }
+
+  // writes to the memory of a stopped process we aren't tracking (i.e a
+  // fork of the one we are)
+  void WriteForkMemory(const pid_t pid, const std::uint64_t address,
+                       const sdb::Span<const std::byte> data) {
+    const auto path = "/proc/" + std::to_string(pid) + "/mem";
+    const auto fd   = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+      sdb::Error::SendErrno("Could not open the memory of a fork");
+    }
+    const auto n_written = pwrite(fd, data.begin(), data.Size(), address);
+    close(fd);
+    if (n_written != static_cast<ssize_t>(data.Size())) {
+      sdb::Error::SendErrno("Could not write to the memory of a fork");
+    }
+  }
+
+  // the syscalls the inferior's seccomp filter should trap, or nothing if the
+  // policy can't be implemented with one
+  std::vector<int> SeccompSyscalls(const sdb::SyscallCatchPolicy &policy) {
+    if (policy.GetMode() != sdb::SyscallCatchPolicy::Mode::Some) {
+      return {};
+    }
+
+    auto syscalls = policy.GetToCatch();
+    std::sort(syscalls.begin(), syscalls.end());
+    syscalls.erase(std::unique(syscalls.begin(), syscalls.end()),
+                   syscalls.end());
+
+    // the filter is in place before the inferior execs, and it can't stop
+    // until we've asked for PTRACE_O_TRACESECCOMP, which we only do after
+    // the exec. The filter's jumps can't go any further than 255 instructions
+    const auto traps_exec = [](const int id)
+    { return id == SYS_execve || id == SYS_execveat; };
+    if (syscalls.size() > 255 ||
+        std::any_of(syscalls.begin(), syscalls.end(), traps_exec)) {
+      return {};
+    }
+    return syscalls;
+  }
+
+  // a filter that stops the inferior on entry to each of the given syscalls
+  // and lets every other one through
+  std::vector<sock_filter> BuildSeccompFilter(
+      const std::vector<int> &syscalls) {
+    std::vector<sock_filter> filter = {
+        // anything other than x86-64 syscalls is let through
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, arch)),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, AUDIT_ARCH_X86_64, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(seccomp_data, nr)),
+    };
+
+    // each comparison jumps over the ones after it, and over the ALLOW, to
+    // the TRACE at the end
+    const auto n_syscalls = static_cast<std::uint8_t>(syscalls.size());
+    for (std::uint8_t i = 0; i < n_syscalls; ++i) {
+      filter.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                                static_cast<std::uint32_t>(syscalls[i]),
+                                static_cast<std::uint8_t>(n_syscalls - i), 0));
+    }
+    filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+    filter.push_back(BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_TRACE));
+    return filter;
+  }
+
+  // whether a rel32 at either address can reach the other, with room to
+  // spare for the size of what's at them
+  bool WithinJump(const std::uint64_t from, const std::uint64_t to) {
+    constexpr std::uint64_t reach = 0x7fff0000;
+    return (from > to ? from - to : to - from) < reach;
+  }
+
+  // the most a copied instruction takes up in a scratch pad: 15 bytes, and
+  // a jcc rel8 grows by 4 when it's re-encoded
+  constexpr std::size_t g_max_copy_size = 0x20;
+
+  // a scratch pad that a copy of the instruction at `address` can reach it
+  // from (and the other way around), if there's one
+  std::optional<std::uint64_t> FindScratchPad(
+      const std::vector<std::uint64_t> &pads, const std::uint64_t address) {
+    const auto pad = std::find_if(
+        pads.begin(), pads.end(),
+        [=](const std::uint64_t pad)
+        {
+          return WithinJump(pad, address) and
+                 WithinJump(pad + g_max_copy_size, address);
+        });
+    if (pad == pads.end()) {
+      return std::nullopt;
+    }
+    return *pad;
+  }
+
+  // recomputes the furthest end of any range up to each of `ranges`
+  template <class Ranges>
+  void UpdateMaxHighs(Ranges &ranges) {
+    std::uint64_t max_high = 0;
+    for (auto &range : ranges) {
+      max_high       = std::max(max_high, range.high);
+      range.max_high = max_high;
+    }
+  }
+
+  // the protection /proc/<pid>/maps gives each page in [low, high), or -1
+  // for the pages that aren't mapped
+  std::vector<int> ReadPageProtections(const pid_t         pid,
+                                       const std::uint64_t low,
+                                       const std::uint64_t high) {
+    std::vector<int> protections((high - low) / 0x1000, -1);
+    std::ifstream    maps("/proc/" + std::to_string(pid) + "/maps");
+    std::string      line;
+    while (std::getline(maps, line)) {
+      std::istringstream fields(line);
+      std::uint64_t      start, end;
+      std::string        permissions;
+      char               dash;
+      fields >> std::hex >> start >> dash >> end >> permissions;
+
+      const auto protection = (permissions[0] == 'r' ? PROT_READ : 0) |
+                              (permissions[1] == 'w' ? PROT_WRITE : 0) |
+                              (permissions[2] == 'x' ? PROT_EXEC : 0);
+      for (auto page = std::max(start, low); page < std::min(end, high);
+           page += 0x1000) {
+        protections[(page - low) / 0x1000] = protection;
+      }
+    }
+    return protections;
+  }
+
+  // the size of the regions trampolines are handed out from
+  constexpr std::size_t g_region_size = 0x10000;
+
+  // the start of an unmapped `size` byte range in the process as close to
+  // `near` as there is, if there's one within a jump of it
+  std::optional<std::uint64_t> FindUnmappedNear(const pid_t         pid,
+                                                const std::uint64_t near,
+                                                const std::size_t   size) {
+    std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+
+    // the lowest address mmap_min_addr normally allows, and the top of the
+    // user address space
+    std::uint64_t       previous_end = 0x10000;
+    const std::uint64_t top          = 0x7ffffffff000;
+
+    std::optional<std::uint64_t> best;
+    const auto                   consider = [&](const std::uint64_t start)
+    {
+      if (WithinJump(start, near) and WithinJump(start + size, near) and
+          (!best or (start > near ? start - near : near - start) <
+                        (*best > near ? *best - near : near - *best))) {
+        best = start;
+      }
+    };
+
+    std::string line;
+    while (true) {
+      std::uint64_t start = top;
+      if (std::getline(maps, line)) {
+        start = std::stoull(line, nullptr, 16);
+      }
+      const auto gap_end = std::min(start, top);
+
+      // either end of the gap is the closest it gets to `near`
+      if (gap_end >= previous_end + size) {
+        consider(previous_end);
+        consider(gap_end - size);
+      }
+
+      if (start >= top) {
+        return best;
+      }
+      previous_end = std::stoull(line.substr(line.find('-') + 1), nullptr, 16);
     }
   }
 }  // namespace
 
 
 // Write the given data to the user area at the given offset
-void sdb::Process::WriteUserArea(const std::size_t   offset,
-                                 const std::uint64_t data) const {
-  if (ptrace(PTRACE_POKEUSER, this->pid_, offset, data) == -1) {
+void sdb::Process::WriteUserArea(const std::size_t          offset,
+                                 const std::uint64_t        data,
+                                 const std::optional<pid_t> tid) const {
+  if (ptrace(PTRACE_POKEUSER, tid.value_or(this->current_thread_), offset,
+             data) == -1) {
     Error::SendErrno("Could not write to user area");
   }
 }
 
-void sdb::Process::WriteFprs(const user_fpregs_struct &fprs) const {
-  if (ptrace(PTRACE_SETFPREGS, this->pid_, nullptr, &fprs) == -1) {
+void sdb::Process::WriteFprs(const user_fpregs_struct  &fprs,
+                             const std::optional<pid_t> tid) const {
+  if (ptrace(PTRACE_SETFPREGS, tid.value_or(this->current_thread_), nullptr,
+             &fprs) == -1) {
     Error::SendErrno("Could not write FPRs");
   }
 }
 
-void sdb::Process::WriteGprs(const user_regs_struct &gprs) const {
-  if (ptrace(PTRACE_SETREGS, this->pid_, nullptr, &gprs) == -1) {
+void sdb::Process::WriteGprs(const user_regs_struct    &gprs,
+                             const std::optional<pid_t> tid) const {
+  if (ptrace(PTRACE_SETREGS, tid.value_or(this->current_thread_), nullptr,
+             &gprs) == -1) {
     Error::SendErrno("Could not write GPRs");
   }
 }
 
-sdb::StopReason::StopReason(const int wait_status) {
+std::uint64_t sdb::Process::ReadUserArea(
+    const std::size_t offset, const std::optional<pid_t> tid) const {
+  errno           = 0;
+  const auto data = ptrace(PTRACE_PEEKUSER, tid.value_or(this->current_thread_),
+                           offset, nullptr);
+  if (errno != 0) {
+    Error::SendErrno("Could not read from user area");
+  }
+  return data;
+}
+
+void sdb::Process::ReadFprs(user_fpregs_struct        &fprs,
+                            const std::optional<pid_t> tid) const {
+  if (ptrace(PTRACE_GETFPREGS, tid.value_or(this->current_thread_), nullptr,
+             &fprs) == -1) {
+    Error::SendErrno("Could not read FPR registers");
+  }
+}
+
+void sdb::Process::ReadGprs(user_regs_struct          &gprs,
+                            const std::optional<pid_t> tid) const {
+  if (ptrace(PTRACE_GETREGS, tid.value_or(this->current_thread_), nullptr,
+             &gprs) == -1) {
+    Error::SendErrno("Could not read GPR registers");
+  }
+}
+
+sdb::StopReason::StopReason(const int wait_status, const pid_t tid) :
+    tid(tid) {
   // if a given status represents an exit event
   if (WIFEXITED(wait_status)) {
     this->reason = ProcessState::Exited;
@@ -63,21 +400,53 @@ sdb::StopReason::StopReason(const int wait_status) {
   }
 }
 
+sdb::Process::Process(const pid_t pid, const bool terminate_on_end,
+                      const bool is_attached) :
+    pid_(pid), terminate_on_end_(terminate_on_end),
+    is_attached_(is_attached), current_thread_(pid) {
+  this->AddThread(pid).has_debug_registers = true;
+}
+
 sdb::Process::~Process() {
+  if (this->mem_fd_ >= 0) {
+    close(this->mem_fd_);
+  }
+
   if (this->pid_ != 0) {
     int status;
 
     if (this->is_attached_) {
-      // For DETACH to work, the inferior process must be stopped
-      // if currently running, we send SIGSTOP
-      if (this->state_ == ProcessState::Running) {
-        kill(this->pid_, SIGSTOP);
-        // wait on the status
-        waitpid(this->pid_, &status, 0);
+      try {
+        // For DETACH to work, the inferior's threads must be stopped
+        if (this->state_ == ProcessState::Running) {
+          this->StopAllThreads();
+          this->state_ = ProcessState::Stopped;
+        }
+
+        // the inferior carries on without us, so it mustn't fault on the
+        // pages we've protected
+        if (!this->terminate_on_end_) {
+          this->watchpoints_.ForEach(
+              [](Watchpoint &watchpoint)
+              {
+                if (!watchpoint.IsHardware()) {
+                  watchpoint.Disable();
+                }
+              });
+        }
+
+        // write back any pending register writes
+        for (auto &[tid, thread] : this->threads_) {
+          thread.registers->Flush();
+        }
+      } catch (const Error &) {
+        // nothing we can do about it at this point
       }
 
-      // detach from the process and let it continue
-      ptrace(PTRACE_DETACH, this->pid_, nullptr, nullptr);
+      // then detach from every thread and let the process continue
+      for (const auto &[tid, thread] : this->threads_) {
+        ptrace(PTRACE_DETACH, tid, nullptr, nullptr);
+      }
       kill(this->pid_, SIGCONT);
     }
 
@@ -85,18 +454,34 @@ sdb::Process::~Process() {
     // and wait for it to terminate
     if (this->terminate_on_end_) {
       kill(this->pid_, SIGKILL);
-      waitpid(this->pid_, &status, 0);
+      WaitOnThread(this->pid_, &status);
     }
+
+    // checkpoints only ever exist for our sake
+    for (const auto &[id, pid] : this->checkpoints_) {
+      kill(pid, SIGKILL);
+      WaitOnThread(pid, &status);
+    }
+  }
+
+  // nobody else will claim what was reaped for us
+  while (ClaimEvent([this](const pid_t tid) { return this->IsOurs(tid); })) {
   }
 }
 
 std::unique_ptr<sdb::Process> sdb::Process::Launch(
     const std::filesystem::path &program_path, const bool debug,
-    const std::optional<int> stdout_replacement) {
+    const std::optional<int> stdout_replacement,
+    SyscallCatchPolicy       syscall_catch_policy) {
   // we want the pipe to be closed when we call execlp, so we
   // don't leave stale file descriptors
   Pipe channel(/*close_on_exec=*/true);
 
+  // built before forking, so the child only has to install it
+  const auto seccomp_syscalls =
+      debug ? SeccompSyscalls(syscall_catch_policy) : std::vector<int>{};
+  auto       seccomp_filter = BuildSeccompFilter(seccomp_syscalls);
+
   pid_t pid = 0;
   if ((pid = fork()) == -1) {
   }
@@ -117,6 +502,13 @@ std::unique_ptr<sdb::Process> sdb::Process::Launch(
     personality(ADDR_NO_RANDOMIZE);
     channel.CloseReadFd();  // we're not using the read end of the pipe
 
+    // an EventLoop in the debugger blocks SIGCHLD; the inferior shouldn't
+    // inherit that
+    sigset_t sigchld;
+    sigemptyset(&sigchld);
+    sigaddset(&sigchld, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &sigchld, nullptr);
+
     if (stdout_replacement) {
       // replace stdout with the provided file descriptor
       // closes the 2nd fd arg and duplicates the 1st to the 2nd,
@@ -134,6 +526,18 @@ std::unique_ptr<sdb::Process> sdb::Process::Launch(
       ExitWithPerror(channel, "Tracing failed");
     }
 
+    // with no tracer, the syscalls it traps would fail with ENOSYS, so it's
+    // only installed once we're being traced
+    if (!seccomp_syscalls.empty()) {
+      const sock_fprog program = {
+          static_cast<unsigned short>(seccomp_filter.size()),
+          seccomp_filter.data()};
+      if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1 ||
+          prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == -1) {
+        ExitWithPerror(channel, "Could not install seccomp filter");
+      }
+    }
+
     if (execlp(program_path.c_str(), program_path.c_str(), nullptr) == -1) {
       ExitWithPerror(channel, "exec failed");
     }
@@ -157,8 +561,11 @@ std::unique_ptr<sdb::Process> sdb::Process::Launch(
 
   if (debug) {
     process->WaitOnSignal();
-    SetPtraceOptions(process->pid_);
+    SetPtraceOptions(process->pid_,
+                     seccomp_syscalls.empty() ? 0 : g_follow_forks);
   }
+  process->seccomp_syscalls_     = seccomp_syscalls;
+  process->syscall_catch_policy_ = std::move(syscall_catch_policy);
   return process;
 }
 
@@ -167,189 +574,1491 @@ std::unique_ptr<sdb::Process> sdb::Process::Attach(const pid_t pid) {
     Error::Send("Invalid PID");
   }
 
-  if (ptrace(PTRACE_ATTACH, pid, /*addr=*/nullptr, /*data=*/nullptr) == -1) {
-    Error::SendErrno("Could not attach");
+  if (ptrace(PTRACE_ATTACH, pid, /*addr=*/nullptr, /*data=*/nullptr) == -1) {
+    Error::SendErrno("Could not attach");
+  }
+
+  std::unique_ptr<Process> process(
+      new Process(pid, /*terminate_on_end=*/false, /*is_attached=*/true));
+  process->WaitOnSignal();
+  SetPtraceOptions(process->GetPid());
+  process->AttachToOtherThreads();
+  return process;
+}
+
+void sdb::Process::AttachToOtherThreads() {
+  const auto tasks =
+      std::filesystem::path("/proc") / std::to_string(this->pid_) / "task";
+
+  // threads may be created while we're attaching, so keep going until we
+  // stop finding new ones. Once we're attached to a thread, the threads it
+  // creates are traced automatically
+  for (bool found_new = true; found_new;) {
+    found_new = false;
+
+    for (const auto &entry : std::filesystem::directory_iterator(tasks)) {
+      const pid_t tid = std::stoi(entry.path().filename());
+      if (this->threads_.count(tid) != 0) {
+        continue;
+      }
+
+      if (ptrace(PTRACE_ATTACH, tid, nullptr, nullptr) == -1) {
+        continue;  // the thread has exited
+      }
+      found_new = true;
+
+      // PTRACE_ATTACH sends a SIGSTOP
+      int wait_status;
+      if (WaitOnThread(tid, &wait_status) == -1) {
+        Error::SendErrno("waitpid failed");
+      }
+
+      auto &thread               = this->AddThread(tid);
+      thread.has_debug_registers = true;
+      SetPtraceOptions(tid);
+    }
+  }
+}
+
+sdb::Registers &sdb::Process::GetRegisters(const std::optional<pid_t> tid) {
+  return *this->GetThread(tid).registers;
+}
+
+const sdb::Registers &sdb::Process::GetRegisters(
+    const std::optional<pid_t> tid) const {
+  return *this->GetThread(tid).registers;
+}
+
+void sdb::Process::SetCurrentThread(const pid_t tid) {
+  this->GetThread(tid);  // throws for unknown threads
+  this->current_thread_ = tid;
+}
+
+sdb::ThreadState &sdb::Process::GetThread(const std::optional<pid_t> tid) {
+  const auto it = this->threads_.find(tid.value_or(this->current_thread_));
+  if (it == this->threads_.end()) {
+    Error::Send("No such thread");
+  }
+  return it->second;
+}
+
+const sdb::ThreadState &sdb::Process::GetThread(
+    const std::optional<pid_t> tid) const {
+  return const_cast<Process *>(this)->GetThread(tid);
+}
+
+pid_t sdb::Process::GetStoppedThread() const {
+  if (this->GetThread(std::nullopt).state == ProcessState::Stopped) {
+    return this->current_thread_;
+  }
+
+  const auto it = std::find_if(
+      this->threads_.begin(), this->threads_.end(), [](const auto &entry)
+      { return entry.second.state == ProcessState::Stopped; });
+  return it == this->threads_.end() ? this->current_thread_ : it->first;
+}
+
+sdb::ThreadState &sdb::Process::AddThread(const pid_t tid) {
+  auto &thread = this->threads_[tid];
+  thread.tid   = tid;
+  thread.registers.reset(new Registers(*this, tid));
+  return thread;
+}
+
+void sdb::Process::RemoveThread(const pid_t tid) {
+  this->threads_.erase(tid);
+  if (this->current_thread_ == tid) {
+    this->current_thread_ = this->pid_;
+  }
+}
+
+sdb::StopReason sdb::Process::StepInstruction() {
+  return this->StepThread(StepMode::Instruction);
+}
+
+sdb::StopReason sdb::Process::StepBlock() {
+  return this->StepThread(StepMode::Block);
+}
+
+sdb::StopReason sdb::Process::StepThread(const StepMode mode) {
+  // the inferior is about to run, so anything we've cached may go stale
+  this->InvalidateMemoryCache();
+
+  // only the current thread runs; the others stay stopped
+  auto &thread = this->GetThread(std::nullopt);
+
+  std::optional<BreakpointSite *> to_reenable;
+  if (const auto bp = this->breakpoint_sites_.FindByAddress(
+          this->GetPc(thread.tid));
+      bp != nullptr and bp->IsEnabled()) {
+    // the site can stay where it is if the instruction can be run elsewhere
+    if (const auto wait_status = this->DisplacedStep(thread)) {
+      if (const auto reason =
+              this->HandleThreadEvent(thread.tid, *wait_status)) {
+        return this->ReportStop(*reason);
+      }
+      return this->WaitForStop(thread.tid);
+    }
+
+    // disable the breakpoint so we can step over it
+    bp->Disable();
+    // store this breakpoint site so we can re-enable it later
+    to_reenable = bp;
+  }
+
+  // step and wait. The thread mustn't get any further than the lifted site
+  this->ResumeThread(thread, to_reenable ? StepMode::Instruction : mode);
+  const auto reason = this->WaitForStop(thread.tid);
+
+  // re-enable if we disabled
+  if (to_reenable) {
+    to_reenable.value()->Enable();
+  }
+
+  return reason;
+}
+
+// Force the process to resume and update its tracked running state
+void sdb::Process::Resume(const int signal) {
+  if (this->state_ == ProcessState::Exited ||
+      this->state_ == ProcessState::Terminated) {
+    Error::Send("Could not resume: the process has ended");
+  }
+  this->GetThread(std::nullopt).pending_signal = signal;
+
+  // the inferior is about to run, so anything we've cached may go stale
+  this->InvalidateMemoryCache();
+
+  // a thread stopped while we were stopping the others for the last stop;
+  // the next WaitOnSignal reports that without running anything
+  if (std::any_of(this->threads_.begin(), this->threads_.end(),
+                  [](const auto &entry)
+                  { return entry.second.queued_stop.has_value(); })) {
+    this->state_ = ProcessState::Running;
+    return;
+  }
+
+  this->ResumeAllThreads();
+  this->state_ = ProcessState::Running;
+}
+
+void sdb::Process::ResumeAllThreads() {
+  // if any thread is stopped at a breakpoint, we should step it over the
+  // breakpoint before letting the others run
+  for (auto &[tid, thread] : this->threads_) {
+    if (thread.state == ProcessState::Stopped) {
+      this->StepOverBreakpoint(thread);
+    }
+  }
+
+  for (auto &[tid, thread] : this->threads_) {
+    if (thread.state == ProcessState::Stopped) {
+      this->ResumeThread(thread, StepMode::None);
+    }
+  }
+}
+
+void sdb::Process::ResumeThread(ThreadState &thread, const StepMode mode) {
+  // any register writes have to be in place first
+  thread.registers->Flush();
+
+  // if the syscall catch policy is set to
+  // 'None', we just continue the process, otherwise,
+  // we use PTRACE_SYSCALL to catch syscalls (in that
+  // case, the inferior will trap whenever a syscall
+  // is entered or exited). When the seccomp filter stops the thread on entry
+  // to the syscalls we're catching, we only need PTRACE_SYSCALL to see the
+  // exit of the one it has just entered
+  auto request = PTRACE_SYSCALL;
+  if (mode == StepMode::Instruction) {
+    request = PTRACE_SINGLESTEP;
+  } else if (mode == StepMode::Block) {
+    request = PTRACE_SINGLEBLOCK;
+  } else if (this->syscall_catch_policy_.GetMode() ==
+             SyscallCatchPolicy::Mode::None) {
+    request = PTRACE_CONT;
+  } else if (this->CatchesSyscallsWithSeccomp() and
+             !thread.expecting_syscall_exit) {
+    request = PTRACE_CONT;
+  }
+
+  // a signal waits for the thread to be continued rather than stepped over
+  // a breakpoint
+  const auto signal =
+      mode == StepMode::None ? std::exchange(thread.pending_signal, 0) : 0;
+
+  // and continue the thread
+  if (ptrace(request, thread.tid, nullptr, SignalData(signal)) == -1) {
+    // exit if we can't resume the process
+    Error::SendErrno("Could not resume");
+  }
+
+  thread.state    = ProcessState::Running;
+  thread.stepping = mode;
+}
+
+void sdb::Process::StepOverBreakpoint(ThreadState &thread) {
+  const auto bp =
+      this->breakpoint_sites_.FindByAddress(this->GetPc(thread.tid));
+  if (bp == nullptr or !bp->IsEnabled()) {
+    return;
+  }
+
+  if (this->DisplacedStep(thread)) {
+    return;
+  }
+
+  bp->Disable();
+
+  int wait_status;
+  do {
+    // execute a single instruction
+    this->ResumeThread(thread, StepMode::Instruction);
+
+    // wait until the thread has executed the instruction and halted. A
+    // SIGSTOP we sent it may be reported first, in which case we try again
+    if (WaitOnThread(thread.tid, &wait_status) == -1) {
+      Error::SendErrno("waitpid failed");
+    }
+    thread.state = ProcessState::Stopped;
+  } while (WIFSTOPPED(wait_status) && WSTOPSIG(wait_status) == SIGSTOP &&
+           std::exchange(thread.pending_sigstop, false));
+
+  // then re-enable the breakpoint
+  bp->Enable();
+}
+
+bool sdb::Process::ReportsBreakpointHit(ThreadState    &thread,
+                                        BreakpointSite &site,
+                                        StopReason     &reason,
+                                        const bool      stopping) {
+  if (site.ShouldStop(thread.tid)) {
+    return true;
+  }
+
+  if (!stopping) {
+    // the site stays armed while a displaced step takes the thread over it,
+    // so the other threads needn't stop. A thread that was block-stepping
+    // carries on doing so
+    const auto mode = thread.stepping;
+    if (const auto wait_status = this->DisplacedStep(thread)) {
+      if (WIFSTOPPED(*wait_status) && WSTOPSIG(*wait_status) == SIGTRAP) {
+        this->ResumeThread(thread, mode);
+        return false;
+      }
+
+      // anything else (a fault in the instruction, a signal, or the end of
+      // the thread) is handled as if it had happened without the site there
+      if (const auto other =
+              this->HandleThreadEvent(thread.tid, *wait_status)) {
+        reason = *other;
+        return true;
+      }
+      return false;
+    }
+
+    // otherwise the site is lifted while the thread steps over it, and any
+    // other thread running through it then would miss it, so they're stopped
+    // first. Any of them that stops for a reason of its own is reported
+    // instead
+    this->StopAllThreads();
+    if (std::none_of(this->threads_.begin(), this->threads_.end(),
+                     [](const auto &entry)
+                     { return entry.second.queued_stop.has_value(); })) {
+      this->ResumeAllThreads();
+    }
+  }
+  return false;
+}
+
+std::optional<int> sdb::Process::DisplacedStep(ThreadState &thread) {
+  if (!this->displaced_stepping_enabled_) {
+    return std::nullopt;
+  }
+
+  // any register writes have to be in place first
+  thread.registers->Flush();
+  user_regs_struct regs;
+  this->ReadGprs(regs, thread.tid);
+
+  const VirtualAddress pc{regs.rip};
+  if ((!this->displaced_ || this->displaced_->from != pc.GetAddress()) &&
+      !this->PrepareDisplacedStep(pc)) {
+    return std::nullopt;
+  }
+  const auto displaced = *this->displaced_;
+
+  regs.rip = displaced.scratch;
+  this->WriteGprs(regs, thread.tid);
+  thread.registers->Invalidate();
+
+  int wait_status;
+  do {
+    this->ResumeThread(thread, StepMode::Instruction);
+
+    // a SIGSTOP we sent it may be reported first, in which case we try again
+    if (WaitOnThread(thread.tid, &wait_status) == -1) {
+      Error::SendErrno("waitpid failed");
+    }
+    thread.state = ProcessState::Stopped;
+  } while (WIFSTOPPED(wait_status) && WSTOPSIG(wait_status) == SIGSTOP &&
+           std::exchange(thread.pending_sigstop, false));
+
+  // the copy may have written to memory
+  this->InvalidateMemoryCache();
+  if (!WIFSTOPPED(wait_status)) {
+    return wait_status;
+  }
+
+  // a taken branch has left for its target already. Otherwise the thread is
+  // either still at the copy (a signal stopped it first) or just past it
+  this->ReadGprs(regs, thread.tid);
+  const auto end_of_copy = displaced.scratch + displaced.copy_size;
+  if (regs.rip == displaced.scratch) {
+    regs.rip = pc.GetAddress();
+  } else if (regs.rip == end_of_copy) {
+    regs.rip = pc.GetAddress() + displaced.length;
+  }
+
+  // and a call pushed a return address inside the scratch pad
+  if (displaced.is_call && regs.rip != pc.GetAddress()) {
+    const VirtualAddress return_address{regs.rsp};
+    if (this->ReadMemoryAs<std::uint64_t>(return_address) == end_of_copy) {
+      const auto original = pc.GetAddress() + displaced.length;
+      this->WriteMemory(return_address, {AsBytes(original), 8});
+    }
+  }
+
+  this->WriteGprs(regs, thread.tid);
+  thread.registers->Invalidate();
+  return wait_status;
+}
+
+bool sdb::Process::PrepareDisplacedStep(const VirtualAddress address) {
+  const auto scratch =
+      FindScratchPad(this->scratch_pads_, address.GetAddress());
+  if (!scratch) {
+    return false;
+  }
+
+  // the instruction can be cut short by the end of a mapping
+  constexpr std::size_t  max_instruction_size = 15;
+  std::vector<std::byte> code;
+  try {
+    code = this->ReadMemoryWithoutTraps(address, max_instruction_size);
+  } catch (const Error &) {
+    code = this->ReadMemoryWithoutTraps(
+        address, 0x1000 - (address.GetAddress() & 0xfff));
+  }
+
+  const auto instruction = DecodeInstruction({code.data(), code.size()});
+  if (!instruction) {
+    return false;
+  }
+
+  // syscalls are left where they are: the kernel may restart one by moving
+  // the PC back over it, which would be inside the scratch pad
+  const auto map    = instruction->opcode_map;
+  const auto opcode = instruction->opcode;
+  if ((map == ZYDIS_OPCODE_MAP_0F && (opcode == 0x05 || opcode == 0x34)) ||
+      (map == ZYDIS_OPCODE_MAP_DEFAULT && opcode == 0xcd)) {
+    return false;
+  }
+
+  std::vector<std::byte> copy;
+  if (!RelocateInstruction({code.data(), instruction->length}, *instruction,
+                           address, VirtualAddress{*scratch}, copy)) {
+    return false;
+  }
+  this->WriteMemory(VirtualAddress{*scratch}, {copy.data(), copy.size()},
+                    /*record_patches=*/false);
+
+  // call rel32, and call through a register or memory (ff /2)
+  const auto is_call =
+      map == ZYDIS_OPCODE_MAP_DEFAULT &&
+      (opcode == 0xe8 || (opcode == 0xff && instruction->raw.modrm.reg == 2));
+  this->displaced_ = DisplacedInstruction{address.GetAddress(), *scratch,
+                                          instruction->length, copy.size(),
+                                          is_call};
+  return true;
+}
+
+void sdb::Process::EnsureScratchPad(const VirtualAddress address) {
+  if (!this->displaced_stepping_enabled_ or !this->is_attached_ or
+      this->state_ != ProcessState::Stopped or
+      this->GetThread(std::nullopt).expecting_syscall_exit) {
+    return;
+  }
+
+  if (FindScratchPad(this->scratch_pads_, address.GetAddress())) {
+    return;
+  }
+
+  try {
+    this->scratch_pads_.push_back(
+        this->AllocateTrampoline(address).GetAddress());
+  } catch (const Error &) {
+    // sites near `address` are lifted to step over them instead
+  }
+}
+
+sdb::StopReason sdb::Process::WaitOnSignal() {
+  return this->WaitForStop(-1);
+}
+
+bool sdb::Process::IsOurs(const pid_t tid) const {
+  // a new thread can report its initial SIGSTOP before its creator reports
+  // the clone event, so a thread we don't know of yet may still be ours
+  return this->threads_.count(tid) != 0 ||
+         std::any_of(this->checkpoints_.begin(), this->checkpoints_.end(),
+                     [tid](const auto &checkpoint)
+                     { return checkpoint.second == tid; }) ||
+         ReadThreadGroup(tid) == this->pid_ || this->IsFollowedFork(tid);
+}
+
+bool sdb::Process::IsFollowedFork(const pid_t tid) const {
+  if (this->forks_.count(tid) != 0) {
+    return true;
+  }
+  if (this->seccomp_syscalls_.empty()) {
+    return false;  // no fork is traced
+  }
+
+  // like a new thread, a new fork can report its first stop before its
+  // parent reports the fork
+  const auto parent = ReadStatusPid(tid, "PPid:");
+  return parent == this->pid_ || this->forks_.count(parent) != 0 ||
+         this->forks_.count(ReadThreadGroup(tid)) != 0;
+}
+
+void sdb::Process::ResumeFollowedFork(const pid_t tid, const int wait_status) {
+  if (!WIFSTOPPED(wait_status)) {
+    this->forks_.erase(tid);
+    return;
+  }
+
+  // the first stop is the SIGSTOP every new tracee starts with. An exec is
+  // then reported as an event, rather than a SIGTRAP we couldn't tell from
+  // the fork's own
+  if (!std::exchange(this->forks_[tid], true)) {
+    SetPtraceOptions(tid, g_follow_forks | PTRACE_O_TRACEEXEC);
+  }
+  if (IsForkEvent(wait_status) || IsVforkEvent(wait_status) ||
+      IsCloneEvent(wait_status)) {
+    this->forks_.try_emplace(GetEventPid(tid), false);
+  }
+
+  // ptrace events pass no signal on. Nor do stop signals: without
+  // PTRACE_SEIZE the group-stop they'd cause looks just like them, and
+  // passing that on again would never end
+  auto signal = wait_status >> 16 == 0 ? WSTOPSIG(wait_status) : 0;
+  if (signal == SIGSTOP || signal == SIGTSTP || signal == SIGTTIN ||
+      signal == SIGTTOU) {
+    signal = 0;
+  }
+  // the fork may have been killed since
+  ptrace(PTRACE_CONT, tid, nullptr, SignalData(signal));
+}
+
+bool sdb::Process::HasUnclaimedEvent() const {
+  return std::any_of(g_unclaimed_events.begin(), g_unclaimed_events.end(),
+                     [this](const auto &event)
+                     { return this->IsOurs(event.first); });
+}
+
+pid_t sdb::Process::WaitOnAnyThread(int &wait_status, const int options) {
+  if (const auto event = ClaimEvent([this](const pid_t tid)
+                                    { return this->IsOurs(tid); })) {
+    wait_status = event->second;
+    return event->first;
+  }
+
+  while (true) {
+    const auto tid = waitpid(-1, &wait_status, __WALL | options);
+    if (tid <= 0 || this->IsOurs(tid)) {
+      return tid;
+    }
+    g_unclaimed_events.emplace_back(tid, wait_status);
+  }
+}
+
+std::optional<sdb::StopReason> sdb::Process::TryWaitOnSignal() {
+  if (const auto queued = this->TakeQueuedStop()) {
+    return this->ReportStop(*queued);
+  }
+
+  while (true) {
+    int        wait_status = 0;
+    const auto tid = this->WaitOnAnyThread(wait_status, WNOHANG);
+    if (tid == -1) {
+      Error::SendErrno("waitpid failed");
+    }
+
+    if (tid == 0) {
+      return std::nullopt;  // still running
+    }
+
+    if (const auto reason = this->HandleThreadEvent(tid, wait_status)) {
+      return this->ReportStop(*reason);
+    }
+    if (const auto queued = this->TakeQueuedStop()) {
+      return this->ReportStop(*queued);
+    }
+  }
+}
+
+void sdb::Process::Interrupt() {
+  if (this->state_ != ProcessState::Running) {
+    Error::Send("Could not interrupt: the process isn't running");
+  }
+  this->StopAllThreads();
+  this->state_ = ProcessState::Stopped;
+}
+
+sdb::StopReason sdb::Process::WaitForStop(const pid_t to_await) {
+  if (to_await < 0) {
+    if (const auto queued = this->TakeQueuedStop()) {
+      return this->ReportStop(*queued);
+    }
+  }
+
+  while (true) {
+    int        wait_status = 0;
+    const auto tid         = to_await < 0
+                                 ? this->WaitOnAnyThread(wait_status)
+                                 : WaitOnThread(to_await, &wait_status);
+    if (tid == -1) {
+      Error::SendErrno("waitpid failed");
+    }
+
+    if (const auto reason = this->HandleThreadEvent(tid, wait_status)) {
+      return this->ReportStop(*reason);
+    }
+    if (to_await < 0) {
+      if (const auto queued = this->TakeQueuedStop()) {
+        return this->ReportStop(*queued);
+      }
+    }
+  }
+}
+
+std::optional<sdb::StopReason> sdb::Process::HandleThreadEvent(
+    const pid_t tid, const int wait_status, const bool stopping) {
+  StopReason stop_reason(wait_status, tid);
+
+  const auto it = this->threads_.find(tid);
+  if (it == this->threads_.end()) {
+    // checkpoints stay stopped (and aren't ours to reap) until they're used
+    if (std::any_of(this->checkpoints_.begin(), this->checkpoints_.end(),
+                    [tid](const auto &checkpoint)
+                    { return checkpoint.second == tid; })) {
+      return std::nullopt;
+    }
+
+    if (this->IsFollowedFork(tid)) {
+      this->ResumeFollowedFork(tid, wait_status);
+      return std::nullopt;
+    }
+
+    // a new thread can report its initial SIGSTOP before its creator reports
+    // the clone event
+    auto &thread = this->AddThread(tid);
+    this->InitializeDebugRegisters(thread);
+    if (!stopping) {
+      this->ResumeThread(thread, StepMode::None);
+    }
+    return std::nullopt;
+  }
+
+  auto &thread = it->second;
+  thread.state = stop_reason.reason;
+
+  if (stop_reason.reason != ProcessState::Stopped) {
+    // the process has exited once its main thread has
+    if (tid != this->pid_) {
+      this->RemoveThread(tid);
+      return std::nullopt;
+    }
+
+    if (stopping) {
+      thread.queued_stop = stop_reason;
+      return std::nullopt;
+    }
+    return stop_reason;
+  }
+
+  if (this->is_attached_ and IsCloneEvent(wait_status)) {
+    const auto new_tid = GetEventPid(tid);
+
+    // the new thread starts with a SIGSTOP, unless we've already seen it
+    if (this->threads_.count(new_tid) == 0) {
+      auto &new_thread           = this->AddThread(new_tid);
+      new_thread.state           = ProcessState::Running;
+      new_thread.pending_sigstop = true;
+    }
+
+    if (!stopping) {
+      this->ResumeThread(thread, thread.stepping);
+    }
+    return std::nullopt;
+  }
+
+  if (this->is_attached_ and
+      (IsForkEvent(wait_status) or IsVforkEvent(wait_status))) {
+    // a fork to follow (its first stop may have been seen already)
+    this->forks_.try_emplace(GetEventPid(tid), false);
+    if (!stopping) {
+      this->ResumeThread(thread, thread.stepping);
+    }
+    return std::nullopt;
+  }
+
+  if (stop_reason.info == SIGSTOP && thread.pending_sigstop) {
+    // a SIGSTOP we sent, rather than a real stop. The thread may have run
+    // since its registers were read
+    thread.pending_sigstop = false;
+    thread.registers->Invalidate();
+    this->InitializeDebugRegisters(thread);
+    if (!stopping) {
+      this->ResumeThread(thread, thread.stepping);
+    }
+    return std::nullopt;
+  }
+
+  if (this->is_attached_ and IsSeccompEvent(wait_status)) {
+    if (!this->CatchesSyscallsWithSeccomp()) {
+      // PTRACE_SYSCALL (if anything) reports the syscall instead
+      if (!stopping) {
+        this->ResumeThread(thread, thread.stepping);
+      }
+      return std::nullopt;
+    }
+
+    // handled as the syscall-entry stop PTRACE_SYSCALL would have given
+    stop_reason.info = SIGTRAP | 0x80;
+  }
+
+  if (this->is_attached_) {
+    // if we're attached to the process, and it's stopped, any registers we
+    // fetched during the last stop are stale. They're fetched again, a class
+    // at a time, as they're accessed
+    thread.registers->Invalidate();
+    this->AugmentStopReason(thread, stop_reason);
+
+    if (stop_reason.info == SIGSEGV and !this->protected_pages_.empty()) {
+      if (const auto address = this->GetWatchedPageFault(thread)) {
+        // while we're stopping every thread, the access is left to fault
+        // again once the thread is resumed
+        if (stopping or
+            !this->StepThroughWatchedPages(thread, *address, stop_reason)) {
+          return std::nullopt;
+        }
+        return stop_reason;
+      }
+    }
+
+    // if the process stopped due to SIGTRAP and the addr 1 byte below the PC
+    // is an enabled breakpoint, we fix up the PC to point to the breakpoint
+    const auto instruction_begin = this->GetPc(tid) - 1;
+
+    if (stop_reason.info == SIGTRAP) {
+      // if a software breakpoint caused the stop, we walk the pc back 1 byte
+      // to the start of the int3 instruction
+      if (stop_reason.trap_reason == TrapType::SoftwareBreakpoint and
+          this->breakpoint_sites_.EnabledStopPointAtAddress(
+              instruction_begin)) {
+        this->SetPc(instruction_begin, tid);
+        auto &site = *this->breakpoint_sites_.FindByAddress(instruction_begin);
+        if (!this->ReportsBreakpointHit(thread, site, stop_reason, stopping)) {
+          return std::nullopt;
+        }
+        // if a hardware breakpoint caused the stop, and the stop point is a
+        // watchpoint, we update the watchpoint's data
+      } else if (stop_reason.trap_reason == TrapType::HardwareBreakpoint) {
+        if (const auto id = this->GetCurrentHardwareStoppoint(tid);
+            id.index() == 1) {  // check the variant here (1 is watchpoint)
+          // now, update data when a watchppoint triggers a stop
+          this->watchpoints_.GetById(std::get<1>(id)).UpdateData();
+        } else if (!this->ReportsBreakpointHit(
+                       thread, this->breakpoint_sites_.GetById(std::get<0>(id)),
+                       stop_reason, stopping)) {
+          return std::nullopt;
+        }
+      } else if (stop_reason.trap_reason == TrapType::Syscall and
+                 !this->FilterSyscall(stop_reason)) {
+        // not a syscall we're catching, so carry on (we leave the thread
+        // stopped if we're stopping every thread). If the filter stopped it,
+        // we don't need to see the syscall's exit either
+        if (this->CatchesSyscallsWithSeccomp()) {
+          thread.expecting_syscall_exit = false;
+        }
+        if (!stopping) {
+          this->ResumeThread(thread, thread.stepping);
+        }
+        return std::nullopt;
+      }
+    }
+  }
+
+  if (stopping) {
+    thread.queued_stop = stop_reason;
+    return std::nullopt;
+  }
+  return stop_reason;
+}
+
+sdb::StopReason sdb::Process::ReportStop(const StopReason &reason) {
+  this->current_thread_ = reason.tid;
+  this->state_          = reason.reason;
+
+  if (this->state_ == ProcessState::Stopped) {
+    this->StopAllThreads();
+  }
+  return reason;
+}
+
+void sdb::Process::StopAllThreads() {
+  // signal every running thread before waiting on any of them, so they stop
+  // concurrently rather than one after the other
+  for (auto &[tid, thread] : this->threads_) {
+    if (thread.state == ProcessState::Running && !thread.pending_sigstop) {
+      if (tgkill(this->pid_, tid, SIGSTOP) == -1) {
+        Error::SendErrno("Could not stop thread");
+      }
+      thread.pending_sigstop = true;
+    }
+  }
+
+  const auto any_running = [this]
+  {
+    return std::any_of(this->threads_.begin(), this->threads_.end(),
+                       [](const auto &entry)
+                       { return entry.second.state == ProcessState::Running; });
+  };
+
+  while (any_running()) {
+    int        wait_status = 0;
+    const auto tid         = this->WaitOnAnyThread(wait_status);
+    if (tid == -1) {
+      Error::SendErrno("waitpid failed");
+    }
+    this->HandleThreadEvent(tid, wait_status, /*stopping=*/true);
+  }
+}
+
+std::optional<sdb::StopReason> sdb::Process::TakeQueuedStop() {
+  for (auto &[tid, thread] : this->threads_) {
+    if (thread.queued_stop) {
+      return std::exchange(thread.queued_stop, std::nullopt);
+    }
+  }
+  return std::nullopt;
+}
+
+std::int64_t sdb::Process::InjectSyscall(
+    const long number, const std::array<std::uint64_t, 6> args) {
+  if (this->state_ != ProcessState::Stopped) {
+    Error::Send("Syscalls can only be injected while the process is stopped");
+  }
+  return this->InjectSyscall(this->GetThread(std::nullopt), number, args);
+}
+
+std::int64_t sdb::Process::InjectSyscall(
+    ThreadState &thread, const long number,
+    const std::array<std::uint64_t, 6> args) {
+  if (thread.expecting_syscall_exit) {
+    Error::Send("Can't inject a syscall while the thread is in one");
+  }
+
+  // any register writes have to be in place to be saved
+  thread.registers->Flush();
+  user_regs_struct saved;
+  this->ReadGprs(saved, thread.tid);
+
+  // the syscall is made from wherever the thread is, so `syscall` goes there
+  // for the time being
+  const VirtualAddress     pc{saved.rip};
+  std::array<std::byte, 2> original;
+  this->ReadMemory(pc, {original.data(), original.size()});
+  constexpr std::array<std::byte, 2> syscall_instruction = {std::byte{0x0f},
+                                                            std::byte{0x05}};
+  this->WriteMemory(pc, {syscall_instruction.data(), 2},
+                    /*record_patches=*/false);
+
+  auto regs = saved;
+  regs.rax  = number;
+  regs.rdi  = args[0];
+  regs.rsi  = args[1];
+  regs.rdx  = args[2];
+  regs.r10  = args[3];
+  regs.r8   = args[4];
+  regs.r9   = args[5];
+  // if the thread was interrupted in a syscall, the kernel would otherwise
+  // restart that one instead
+  regs.orig_rax = -1;
+  this->WriteGprs(regs, thread.tid);
+
+  // the seccomp filter may stop the thread on the way in, a fork we asked to
+  // trace stops it on the way out, and a SIGSTOP we sent it may be reported
+  // first
+  int wait_status;
+  do {
+    if (ptrace(PTRACE_SINGLESTEP, thread.tid, nullptr, nullptr) == -1) {
+      Error::SendErrno("Could not inject syscall");
+    }
+    if (WaitOnThread(thread.tid, &wait_status) == -1) {
+      Error::SendErrno("waitpid failed");
+    }
+  } while (IsSeccompEvent(wait_status) || IsForkEvent(wait_status) ||
+           (WIFSTOPPED(wait_status) && WSTOPSIG(wait_status) == SIGSTOP &&
+            std::exchange(thread.pending_sigstop, false)));
+
+  if (!WIFSTOPPED(wait_status)) {
+    Error::Send("The process ended during an injected syscall");
+  }
+
+  this->ReadGprs(regs, thread.tid);
+
+  // put everything back. If the thread had been interrupted in a syscall, the
+  // kernel restarts it when the thread is next resumed, as it would have
+  this->WriteMemory(pc, {original.data(), original.size()},
+                    /*record_patches=*/false);
+  this->WriteGprs(saved, thread.tid);
+  thread.registers->Invalidate();
+  // the syscall may have changed the inferior's memory
+  this->InvalidateMemoryCache();
+
+  if (WSTOPSIG(wait_status) != SIGTRAP) {
+    Error::Send("An injected syscall was interrupted by a signal");
+  }
+  return static_cast<std::int64_t>(regs.rax);
+}
+
+int sdb::Process::CreateCheckpoint() {
+  if (this->state_ != ProcessState::Stopped) {
+    Error::Send("Checkpoints can only be created while the process is stopped");
+  }
+  if (this->threads_.size() != 1) {
+    Error::Send("Can't checkpoint a multi-threaded process");
+  }
+
+  const auto pid = this->ForkCurrentThread();
+  const auto id  = this->next_checkpoint_id_++;
+  this->checkpoints_[id]      = pid;
+  this->checkpoint_pages_[id] = this->protected_pages_;
+  return id;
+}
+
+void sdb::Process::RestartFromCheckpoint(const int id) {
+  const auto it = this->checkpoints_.find(id);
+  if (it == this->checkpoints_.end()) {
+    Error::Send("No such checkpoint");
+  }
+
+  // The process goes. Other threads have to be reaped before the main thread
+  // is reported to have exited
+  if (this->state_ != ProcessState::Exited &&
+      this->state_ != ProcessState::Terminated) {
+    kill(this->pid_, SIGKILL);
+    int status;
+    for (const auto &[tid, thread] : this->threads_) {
+      if (tid != this->pid_) {
+        WaitOnThread(tid, &status);
+      }
+    }
+    WaitOnThread(this->pid_, &status);
+  }
+
+  // the checkpoint is forked from as if it were the process, which it stays
+  // if that fails
+  const auto checkpoint = it->second;
+  this->checkpoints_.erase(it);
+  this->TrackFork(checkpoint);
+  const auto pid = this->ForkCurrentThread();
+  this->checkpoints_[id] = checkpoint;
+  this->TrackFork(pid);
+  this->ReapplyStoppoints(id);
+}
+
+void sdb::Process::DeleteCheckpoint(const int id) {
+  const auto it = this->checkpoints_.find(id);
+  if (it == this->checkpoints_.end()) {
+    Error::Send("No such checkpoint");
+  }
+  kill(it->second, SIGKILL);
+  int status;
+  WaitOnThread(it->second, &status);
+  this->checkpoints_.erase(it);
+  this->checkpoint_pages_.erase(id);
+}
+
+pid_t sdb::Process::ForkCurrentThread() {
+  auto &thread = this->GetThread(std::nullopt);
+  thread.registers->Flush();
+  user_regs_struct saved;
+  this->ReadGprs(saved, thread.tid);
+  std::array<std::byte, 2> original;
+  this->ReadMemory(VirtualAddress{saved.rip},
+                   {original.data(), original.size()});
+
+  // without PTRACE_O_TRACEFORK the child wouldn't be traced from its first
+  // instruction, which is where the thread is now
+  const auto options = this->seccomp_syscalls_.empty() ? 0 : g_follow_forks;
+  SetPtraceOptions(thread.tid, PTRACE_O_TRACEFORK | options);
+  std::int64_t pid;
+  try {
+    pid = this->InjectSyscall(SYS_clone, {CLONE_PARENT | SIGCHLD});
+  } catch (const Error &) {
+    SetPtraceOptions(thread.tid, options);
+    throw;
+  }
+  SetPtraceOptions(thread.tid, options);
+  if (pid < 0) {
+    Error::Send(std::string("Could not fork the process: ") +
+                std::strerror(-pid));
+  }
+
+  // the child starts with a SIGSTOP
+  int wait_status;
+  if (WaitOnThread(pid, &wait_status) == -1) {
+    Error::SendErrno("waitpid failed");
+  }
+  if (!WIFSTOPPED(wait_status)) {
+    Error::Send("The fork ended before it started");
+  }
+  SetPtraceOptions(pid, options);
+
+  // it was forked with `syscall` in place and returned from it, so it needs
+  // putting back just like the thread was
+  WriteForkMemory(pid, saved.rip, {original.data(), original.size()});
+  this->WriteGprs(saved, pid);
+  return pid;
+}
+
+void sdb::Process::TrackFork(const pid_t pid) {
+  if (this->mem_fd_ >= 0) {
+    close(this->mem_fd_);
+    this->mem_fd_ = -1;
+  }
+  this->InvalidateMemoryCache();
+
+  // the fork may not have the copy, if it was made since
+  this->displaced_.reset();
+
+  this->threads_.clear();
+  this->pid_            = pid;
+  this->current_thread_ = pid;
+  this->state_          = ProcessState::Stopped;
+  // a fork doesn't inherit debug registers
+  auto &thread = this->AddThread(pid);
+  this->InitializeDebugRegisters(thread);
+}
+
+void sdb::Process::ReapplyStoppoints(const int id) {
+  // A disabled site's int3 is only there if the site was enabled at the
+  // checkpoint, in which case it has the original byte saved
+  constexpr std::byte int3{0xcc};
+  this->breakpoint_sites_.ForEach(
+      [this, int3](const BreakpointSite &site)
+      {
+        if (site.IsHardware()) {
+          return;  // the debug registers are copied to every new thread
+        }
+        std::byte byte;
+        this->ReadMemory(site.Address(), {&byte, 1});
+        const auto wanted = site.IsEnabled() ? int3
+                            : byte == int3   ? site.saved_data_
+                                             : byte;
+        if (byte != wanted) {
+          this->WriteMemory(site.Address(), {&wanted, 1},
+                            /*record_patches=*/false);
+        }
+      });
+
+  // the hit buffer and the trampolines are only there if they were mapped
+  // before the checkpoint. A new buffer loses the hits not yet read from the
+  // old one, as the process that recorded them has gone
+  const auto is_mapped = [this](const std::uint64_t address)
+  {
+    return ReadPageProtections(this->pid_, address, address + 0x1000)[0] >= 0;
+  };
+  if (this->tracepoint_buffer_ and
+      !is_mapped(this->tracepoint_buffer_->InferiorAddress().GetAddress())) {
+    this->tracepoint_buffer_ = TracepointBuffer::Create(
+        *this, this->tracepoint_buffer_->Capacity());
+  }
+  for (const auto &region : this->trampoline_regions_) {
+    if (!is_mapped(region.address)) {
+      this->MapTrampolineRegion(region.address);
+    }
+  }
+  this->tracepoints_.ForEach(
+      [this](Tracepoint &tracepoint)
+      { tracepoint.Restore(this->tracepoint_buffer_->InferiorAddress()); });
+
+  // The fork's pages are protected as they were at the checkpoint. Pages
+  // watched since then get the protection they were found with, and those
+  // no longer watched get the inferior's back
+  const auto &checkpoint_pages = this->checkpoint_pages_.at(id);
+
+  std::map<std::uint64_t, int> changes;
+  for (const auto &[page, protection] : checkpoint_pages) {
+    if (this->protected_pages_.count(page) == 0 and
+        protection.current != protection.original) {
+      changes[page] = protection.original;
+    }
+  }
+  for (const auto &[page, protection] : this->protected_pages_) {
+    const auto it      = checkpoint_pages.find(page);
+    const auto in_fork = it != checkpoint_pages.end() ? it->second.current
+                                                      : protection.original;
+    if (protection.current != in_fork) {
+      changes[page] = protection.current;
+    }
+  }
+
+  // runs of adjacent pages that need the same protection take one mprotect.
+  // Pages mapped since the checkpoint aren't there to protect, so failures
+  // are ignored
+  for (auto it = changes.begin(); it != changes.end();) {
+    auto end = std::next(it);
+    while (end != changes.end() and
+           end->first == std::prev(end)->first + 0x1000 and
+           end->second == it->second) {
+      ++end;
+    }
+    const auto size = std::prev(end)->first + 0x1000 - it->first;
+    this->InjectSyscall(SYS_mprotect, {it->first, size,
+                                       static_cast<std::uint64_t>(it->second)});
+    it = end;
+  }
+}
+
+sdb::BreakpointSite &sdb::Process::CreateBreakpointSite(
+    const VirtualAddress address, const bool hardware, const bool internal) {
+  if (this->breakpoint_sites_.ContainsAddress(address)) {
+    Error::Send("Breakpoint site already created at this address " +
+                std::to_string(address.GetAddress()));
+  }
+  if (!this->GetTracepointsCovering(address, address + 1).empty()) {
+    Error::Send("A tracepoint has replaced the instructions at this address");
+  }
+
+  return this->breakpoint_sites_.Push(std::unique_ptr<BreakpointSite>(
+      new BreakpointSite(*this, address, hardware, internal)));
+}
+
+sdb::Watchpoint &sdb::Process::CreateWatchpoint(const VirtualAddress address,
+                                                const StoppointMode  mode,
+                                                const std::size_t    size,
+                                                const bool hardware) {
+  if (this->watchpoints_.ContainsAddress(address)) {
+    Error::Send("Watchpoint already created at address " +
+                std::to_string(address.GetAddress()));
+  }
+
+  return this->watchpoints_.Push(std::unique_ptr<Watchpoint>(
+      new Watchpoint(*this, address, mode, size, hardware)));
+}
+
+sdb::Tracepoint &sdb::Process::CreateTracepoint(const VirtualAddress address) {
+  if (this->state_ != ProcessState::Stopped) {
+    Error::Send("Tracepoints can only be created while the process is stopped");
+  }
+  if (this->tracepoints_.ContainsAddress(address)) {
+    Error::Send("Tracepoint already created at this address " +
+                std::to_string(address.GetAddress()));
+  }
+
+  // the jump can't share bytes with an int3 or with another jump. That's
+  // checked before anything is set up in the inferior for it
+  const auto end = address + Tracepoint::DisplacedSize(*this, address);
+  if (!this->breakpoint_sites_.GetInRegion(address, end).empty() ||
+      !this->GetTracepointsCovering(address, end).empty()) {
+    Error::Send("The tracepoint's instructions overlap another stoppoint");
+  }
+
+  if (!this->tracepoint_buffer_) {
+    constexpr std::size_t capacity = 1 << 16;
+    this->tracepoint_buffer_ = TracepointBuffer::Create(*this, capacity);
+  }
+
+  std::unique_ptr<Tracepoint> tracepoint(
+      new Tracepoint(*this, address, this->AllocateTrampoline(address),
+                     this->tracepoint_buffer_->InferiorAddress()));
+  return this->tracepoints_.Push(std::move(tracepoint));
+}
+
+std::vector<sdb::TracepointHit> sdb::Process::ReadTracepointHits() {
+  if (!this->tracepoint_buffer_) {
+    return {};
+  }
+
+  auto hits = this->tracepoint_buffer_->ReadHits();
+  for (const auto &hit : hits) {
+    if (const auto tracepoint =
+            this->tracepoints_.FindByAddress(VirtualAddress{hit.address})) {
+      ++tracepoint->hit_count_;
+    }
   }
+  return hits;
+}
 
-  std::unique_ptr<Process> process(
-      new Process(pid, /*terminate_on_end=*/false, /*is_attached=*/true));
-  process->WaitOnSignal();
-  SetPtraceOptions(process->GetPid());
-  return process;
+std::uint64_t sdb::Process::DroppedTracepointHits() const {
+  return this->tracepoint_buffer_ ? this->tracepoint_buffer_->DroppedHits()
+                                  : 0;
 }
 
-sdb::StopReason sdb::Process::StepInstruction() {
-  std::optional<BreakpointSite *> to_reenable;
-  if (auto pc = this->GetPc();
-      this->breakpoint_sites_.EnabledStopPointAtAddress(pc)) {
-    auto &bp = this->breakpoint_sites_.GetByAddress(pc);
-    // disable the breakpoint so we can step over it
-    bp.Disable();
-    // store this breakpoint site so we can re-enable it later
-    to_reenable = &bp;
+sdb::VirtualAddress sdb::Process::AllocateTrampoline(
+    const VirtualAddress address) {
+  for (auto &region : this->trampoline_regions_) {
+    if (region.used + Tracepoint::trampoline_size <= g_region_size and
+        WithinJump(region.address, address.GetAddress()) and
+        WithinJump(region.address + g_region_size, address.GetAddress())) {
+      const auto trampoline = VirtualAddress{region.address + region.used};
+      region.used += Tracepoint::trampoline_size;
+      return trampoline;
+    }
   }
 
-  // step over instruction and wait
-  if (ptrace(PTRACE_SINGLESTEP, this->pid_, nullptr, nullptr) == -1) {
-    Error::SendErrno("Could not single step");
+  const auto unmapped =
+      FindUnmappedNear(this->pid_, address.GetAddress(), g_region_size);
+  if (!unmapped) {
+    Error::Send("No room for a tracepoint trampoline near the tracepoint");
   }
+  this->MapTrampolineRegion(*unmapped);
 
-  const auto reason = this->WaitOnSignal();
-  // re-enable if we disabled
-  if (to_reenable) {
-    to_reenable.value()->Enable();
+  this->trampoline_regions_.push_back(
+      {*unmapped, Tracepoint::trampoline_size});
+  return VirtualAddress{*unmapped};
+}
+
+void sdb::Process::MapTrampolineRegion(const std::uint64_t address) {
+  // trampolines are only ever written through /proc/<pid>/mem, so the
+  // inferior never has writable code
+  const auto mapped = this->InjectSyscall(
+      SYS_mmap, {address, g_region_size, PROT_READ | PROT_EXEC,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+                 static_cast<std::uint64_t>(-1), 0});
+  if (static_cast<std::uint64_t>(mapped) != address) {
+    if (mapped >= 0) {
+      // an older kernel took MAP_FIXED_NOREPLACE as a hint
+      this->InjectSyscall(SYS_munmap,
+                          {static_cast<std::uint64_t>(mapped), g_region_size});
+    }
+    Error::Send("Could not map tracepoint trampolines");
   }
+}
 
-  return reason;
+std::vector<sdb::Tracepoint *> sdb::Process::GetTracepointsCovering(
+    const VirtualAddress low, const VirtualAddress high) const {
+  // a tracepoint's jump can start up to Tracepoint::max_size bytes before
+  const auto from = low.GetAddress() > Tracepoint::max_size
+                        ? low - Tracepoint::max_size
+                        : VirtualAddress{0};
+
+  auto       tracepoints = this->tracepoints_.GetInRegion(from, high);
+  const auto ends_before = [=](const Tracepoint *tracepoint)
+  { return tracepoint->Address() + tracepoint->Size() <= low; };
+  tracepoints.erase(
+      std::remove_if(tracepoints.begin(), tracepoints.end(), ends_before),
+      tracepoints.end());
+  return tracepoints;
 }
 
-// Force the process to resume and update its tracked running state
-void sdb::Process::Resume() {
-  // if the process is currently stopped at a breakpoint, we should step over
-  // the breakpoint
-  if (const auto pc = this->GetPc();
-      this->breakpoint_sites_.EnabledStopPointAtAddress(pc)) {
-    auto &bp = this->breakpoint_sites_.GetByAddress(pc);
-    bp.Disable();
-    // execute a single instruction
-    if (ptrace(PTRACE_SINGLESTEP, this->pid_, nullptr, nullptr) == -1) {
-      Error::SendErrno("Failed to single step");
-    }
+int sdb::Process::SetWatchpoint([[maybe_unused]] Watchpoint::id_type id,
+                                const VirtualAddress                 address,
+                                const StoppointMode                  mode,
+                                const std::size_t                    size) {
+  return this->SetHardwareStoppoint(address, mode, size);
+}
 
-    int wait_status;
-    // wait until the inferior has executed the instruction and halted
-    if (waitpid(this->pid_, &wait_status, 0) == -1) {
-      Error::SendErrno("waitpid failed");
+void sdb::Process::EnablePageWatchpoint(Watchpoint &watchpoint) {
+  if (this->state_ != ProcessState::Stopped) {
+    Error::Send(
+        "Page watchpoints can only be enabled while the process is stopped");
+  }
+
+  const auto address = watchpoint.Address().GetAddress();
+  const auto low     = PageStart(address);
+  const auto high    = PageStart(address + watchpoint.GetSize() - 1) + 0x1000;
+
+  // code can't be watched, as it's where syscalls are injected from
+  const auto protections = ReadPageProtections(this->pid_, low, high);
+  for (std::size_t i = 0; i < protections.size(); ++i) {
+    if (this->protected_pages_.count(low + i * 0x1000) == 0 and
+        (protections[i] < 0 or (protections[i] & PROT_EXEC) != 0)) {
+      Error::Send("Page watchpoints can only watch mapped data");
     }
-    // then re-enable the breakpoint
-    bp.Enable();
   }
-  // if the syscall catch policy is set to
-  // 'None', we just continue the process, otherwise,
-  // we use PTRACE_SYSCALL to catch syscalls (in that
-  // case, the inferior will trap whenever a syscall
-  // is entered or exited)
-  const auto request =
-      this->syscall_catch_policy_.GetMode() == SyscallCatchPolicy::Mode::None
-          ? PTRACE_CONT
-          : PTRACE_SYSCALL;
-
-  // and continue the process
-  if (ptrace(request, this->pid_, nullptr, nullptr) == -1) {
-    // exit if we can't resume the process
-    Error::SendErrno("Could not resume");
+  for (std::size_t i = 0; i < protections.size(); ++i) {
+    this->protected_pages_.try_emplace(low + i * 0x1000,
+                                       ProtectedPage{protections[i],
+                                                     protections[i]});
   }
 
-  this->state_ = ProcessState::Running;
+  const auto it = std::upper_bound(
+      this->watched_ranges_.begin(), this->watched_ranges_.end(), address,
+      [](const std::uint64_t address, const WatchedRange &range)
+      { return address < range.low; });
+  this->watched_ranges_.insert(
+      it, {address, address + watchpoint.GetSize(), 0, &watchpoint});
+  UpdateMaxHighs(this->watched_ranges_);
+
+  try {
+    this->ProtectWatchedPages(this->GetThread(std::nullopt), low, high);
+  } catch (const Error &) {
+    this->DisablePageWatchpoint(watchpoint);
+    throw;
+  }
 }
 
-sdb::StopReason sdb::Process::WaitOnSignal() {
-  int wait_status = 0;
-  if (constexpr int options = 0;
-      waitpid(this->pid_, &wait_status, options) == -1) {
-    Error::SendErrno("waitpid failed");
+void sdb::Process::DisablePageWatchpoint(Watchpoint &watchpoint) {
+  this->watched_ranges_.erase(std::find_if(
+      this->watched_ranges_.begin(), this->watched_ranges_.end(),
+      [&watchpoint](const WatchedRange &range)
+      { return range.watchpoint == &watchpoint; }));
+  UpdateMaxHighs(this->watched_ranges_);
+
+  const auto address = watchpoint.Address().GetAddress();
+  const auto low     = PageStart(address);
+  const auto high    = PageStart(address + watchpoint.GetSize() - 1) + 0x1000;
+  if (this->state_ == ProcessState::Exited or
+      this->state_ == ProcessState::Terminated) {
+    // there's nothing left to unprotect
+    this->protected_pages_.erase(this->protected_pages_.lower_bound(low),
+                                 this->protected_pages_.lower_bound(high));
+    return;
   }
-  StopReason stop_reason(wait_status);
-  this->state_ = stop_reason.reason;
+  this->ProtectWatchedPages(this->GetThread(std::nullopt), low, high);
+}
 
-  if (this->is_attached_ and this->state() == ProcessState::Stopped) {
-    // if we're attached to the process, and it's stopped, we
-    // read the registers setting the internal state of the `data_` member to
-    // reflect the contents of the registers
-    this->ReadAllRegisters();
-    this->AugmentStopReason(stop_reason);
+void sdb::Process::ProtectWatchedPages(ThreadState        &thread,
+                                       const std::uint64_t low,
+                                       const std::uint64_t high) {
+  // a page of write watchpoints only needs to be read-only, while the others
+  // need any access to fault. Pages left unwatched get their protection back
+  const auto needed = [this](const std::uint64_t   page,
+                             const ProtectedPage &protection)
+  {
+    const auto watchpoints = this->FindPageWatchpoints(page, page + 0x1000);
+    if (watchpoints.empty()) {
+      return protection.original;
+    }
+    const auto reads_watched = [](const Watchpoint *watchpoint)
+    { return watchpoint->GetMode() != StoppointMode::write; };
+    if (std::any_of(watchpoints.begin(), watchpoints.end(), reads_watched)) {
+      return PROT_NONE;
+    }
+    return protection.original & ~PROT_WRITE;
+  };
+
+  // runs of adjacent pages that need the same change take one mprotect
+  auto it = this->protected_pages_.lower_bound(low);
+  while (it != this->protected_pages_.end() and it->first < high) {
+    const auto protection = needed(it->first, it->second);
+    if (protection == it->second.current) {
+      ++it;
+      continue;
+    }
 
-    // if the process stopped due to SIGTRAP and the addr 1 byte below the PC
-    // is an enabled breakpoint, we fix up the PC to point to the breakpoint
-    const auto instruction_begin = this->GetPc() - 1;
+    const auto start = it->first;
+    auto       end   = it;
+    while (end != this->protected_pages_.end() and end->first < high and
+           end->first == start + 0x1000 * std::distance(it, end) and
+           needed(end->first, end->second) == protection and
+           end->second.current != protection) {
+      ++end;
+    }
+    const auto size = 0x1000 * std::distance(it, end);
+    if (this->InjectSyscall(thread, SYS_mprotect,
+                            {start, static_cast<std::uint64_t>(size),
+                             static_cast<std::uint64_t>(protection)}) != 0) {
+      Error::Send("Could not change the protection of watched pages");
+    }
 
-    if (stop_reason.info == SIGTRAP) {
-      // if a software breakpoint caused the stop, we walk the pc back 1 byte
-      // to the start of the int3 instruction
-      if (stop_reason.trap_reason == TrapType::SoftwareBreakpoint and
-          this->breakpoint_sites_.ContainsAddress(instruction_begin) and
-          this->breakpoint_sites_.GetByAddress(instruction_begin).IsEnabled()) {
-        this->SetPc(instruction_begin);
-        // if a hardware breakpoint caused the stop, and the stop point is a
-        // watchpoint, we update the watchpoint's data
-      } else if (stop_reason.trap_reason == TrapType::HardwareBreakpoint) {
-        if (const auto id = this->GetCurrentHardwareStoppoint();
-            id.index() == 1) {  // check the variant here (1 is watchpoint)
-          // now, update data when a watchppoint triggers a stop
-          this->watchpoints_.GetById(std::get<1>(id)).UpdateData();
-        }
-      } else if (stop_reason.trap_reason == TrapType::Syscall) {
-        // replace the current stop reason with the one returned by
-        // MaybeResumeFromSyscall
-        stop_reason = this->MaybeResumeFromSyscall(stop_reason);
+    // the protection of a page we no longer watch is the inferior's again
+    for (; it != end;) {
+      it->second.current = protection;
+      if (protection == it->second.original and
+          this->FindPageWatchpoints(it->first, it->first + 0x1000).empty()) {
+        it = this->protected_pages_.erase(it);
+      } else {
+        ++it;
       }
     }
   }
-
-  return stop_reason;
 }
 
-void sdb::Process::ReadAllRegisters() {
-  // get GPR registers
-  if (ptrace(PTRACE_GETREGS, this->pid_, nullptr,
-             &this->GetRegisters().data_.regs) == -1) {
-    Error::SendErrno("Could not read GPR registers");
+std::vector<sdb::Watchpoint *> sdb::Process::FindPageWatchpoints(
+    const std::uint64_t low, const std::uint64_t high) const {
+  // only ranges starting before `high` can overlap, and walking back from
+  // there we can stop once no range so far reaches `low`
+  auto it = std::lower_bound(
+      this->watched_ranges_.begin(), this->watched_ranges_.end(), high,
+      [](const WatchedRange &range, const std::uint64_t high)
+      { return range.low < high; });
+
+  std::vector<Watchpoint *> watchpoints;
+  while (it != this->watched_ranges_.begin()) {
+    --it;
+    if (it->max_high <= low) {
+      break;
+    }
+    if (it->high > low) {
+      watchpoints.push_back(it->watchpoint);
+    }
   }
+  return watchpoints;
+}
 
-  // get FPR registers
-  if (ptrace(PTRACE_GETFPREGS, this->pid_, nullptr,
-             &this->GetRegisters().data_.i387) == -1) {
-    Error::SendErrno("Could not read FPR registers");
+std::optional<std::uint64_t> sdb::Process::GetWatchedPageFault(
+    const ThreadState &thread) const {
+  siginfo_t siginfo;
+  if (ptrace(PTRACE_GETSIGINFO, thread.tid, nullptr, &siginfo) == -1) {
+    Error::SendErrno("Failed to get siginfo");
+  }
+  if (siginfo.si_signo != SIGSEGV or siginfo.si_code != SEGV_ACCERR) {
+    return std::nullopt;
   }
 
-  // read the debug registers
-  for (int i = 0; i < 8; ++i) {
-    const auto id = static_cast<int>(RegisterID::dr0) + i;
-    // get the register info
-    const auto &info = RegisterInfoByID(static_cast<RegisterID>(id));
-
-    errno = 0;
-    const std::int64_t data =
-        ptrace(PTRACE_PEEKUSER, this->pid_, info.offset, nullptr);
+  const auto address = reinterpret_cast<std::uint64_t>(siginfo.si_addr);
+  const auto page    = this->protected_pages_.find(PageStart(address));
+  if (page == this->protected_pages_.end() or
+      page->second.current == page->second.original) {
+    return std::nullopt;
+  }
+  return address;
+}
 
-    if (errno != 0) {
-      Error::SendErrno("Could not read debug register");
+bool sdb::Process::StepThroughWatchedPages(ThreadState  &thread,
+                                           std::uint64_t address,
+                                           StopReason   &reason) {
+  // Nothing else may get past the watched pages while they're unprotected,
+  // so the other threads are stopped. Anything they stop for meanwhile is
+  // reported afterwards
+  const auto mode = thread.stepping;
+  this->StopAllThreads();
+
+  // the access may fault on more than one watched page
+  std::vector<std::uint64_t> faults;
+  int                        wait_status;
+  while (true) {
+    faults.push_back(address);
+    auto &protection = this->protected_pages_.at(PageStart(address));
+    if (this->InjectSyscall(thread, SYS_mprotect,
+                            {PageStart(address), 0x1000,
+                             static_cast<std::uint64_t>(
+                                 protection.original)}) != 0) {
+      Error::Send("Could not change the protection of watched pages");
     }
+    protection.current = protection.original;
+
+    do {
+      this->ResumeThread(thread, StepMode::Instruction);
+      // a SIGSTOP we sent it may be reported first, in which case we try
+      // again
+      if (WaitOnThread(thread.tid, &wait_status) == -1) {
+        Error::SendErrno("waitpid failed");
+      }
+      thread.state = ProcessState::Stopped;
+    } while (WIFSTOPPED(wait_status) && WSTOPSIG(wait_status) == SIGSTOP &&
+             std::exchange(thread.pending_sigstop, false));
 
-    // write the retrieved data to the correct location in the
-    // registers_ member.
-    GetRegisters().data_.u_debugreg[i] = data;
+    if (!WIFSTOPPED(wait_status) or WSTOPSIG(wait_status) != SIGSEGV) {
+      break;
+    }
+    const auto next = this->GetWatchedPageFault(thread);
+    if (!next) {
+      break;
+    }
+    address = *next;
   }
-}
 
-sdb::BreakpointSite &sdb::Process::CreateBreakpointSite(
-    const VirtualAddress address, const bool hardware, const bool internal) {
-  if (this->breakpoint_sites_.ContainsAddress(address)) {
-    Error::Send("Breakpoint site already created at this address " +
-                std::to_string(address.GetAddress()));
+  for (const auto fault : faults) {
+    this->ProtectWatchedPages(thread, PageStart(fault),
+                              PageStart(fault) + 0x1000);
+  }
+  thread.registers->Invalidate();
+  this->InvalidateMemoryCache();
+
+  if (!WIFSTOPPED(wait_status) or WSTOPSIG(wait_status) != SIGTRAP) {
+    // something else happened first, and the access is yet to be made
+    reason       = StopReason(wait_status, thread.tid);
+    thread.state = reason.reason;
+    if (reason.reason == ProcessState::Stopped) {
+      this->AugmentStopReason(thread, reason);
+    }
+    return true;
   }
 
-  return this->breakpoint_sites_.Push(std::unique_ptr<BreakpointSite>(
-      new BreakpointSite(*this, address, hardware, internal)));
-}
-
-sdb::Watchpoint &sdb::Process::CreateWatchpoint(const VirtualAddress address,
-                                                const StoppointMode  mode,
-                                                const std::size_t    size) {
-  if (this->watchpoints_.ContainsAddress(address)) {
-    Error::Send("Watchpoint already created at address " +
-                std::to_string(address.GetAddress()));
+  // A watchpoint is hit when the access changed its range, or was to its
+  // range. A write watchpoint's range can also be read from on a page
+  // another watchpoint took every access away from, and we only know that
+  // the fault was a write if the page could be read
+  std::vector<Watchpoint *> candidates;
+  for (const auto fault : faults) {
+    const auto page = PageStart(fault);
+    for (const auto watchpoint :
+         this->FindPageWatchpoints(page, page + 0x1000)) {
+      if (std::find(candidates.begin(), candidates.end(), watchpoint) ==
+          candidates.end()) {
+        candidates.push_back(watchpoint);
+      }
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [](const Watchpoint *a, const Watchpoint *b)
+            { return a->Address() < b->Address(); });
+
+  std::optional<Watchpoint::id_type> hit;
+  for (const auto watchpoint : candidates) {
+    const auto begin = watchpoint->Address().GetAddress();
+    const auto end   = begin + watchpoint->GetSize();
+    const auto accessed =
+        std::any_of(faults.begin(), faults.end(),
+                    [&](const std::uint64_t fault)
+                    {
+                      const auto readable =
+                          (this->protected_pages_.at(PageStart(fault)).current &
+                           PROT_READ) != 0;
+                      return begin <= fault and fault < end and
+                             (watchpoint->GetMode() != StoppointMode::write or
+                              readable);
+                    });
+    const auto changed = this->ReadMemory(watchpoint->Address(),
+                                          watchpoint->GetSize()) !=
+                         watchpoint->contents_;
+    if (accessed or changed) {
+      watchpoint->UpdateData();
+      if (!hit) {
+        hit = watchpoint->GetId();
+      }
+    }
   }
 
-  return this->watchpoints_.Push(
-      std::unique_ptr<Watchpoint>(new Watchpoint(*this, address, mode, size)));
-}
+  if (hit) {
+    reason.info          = SIGTRAP;
+    reason.trap_reason   = TrapType::PageWatchpoint;
+    reason.watchpoint_id = hit;
+    return true;
+  }
+  if (mode == StepMode::Instruction) {
+    // the step we were asked for is done
+    reason.info        = SIGTRAP;
+    reason.trap_reason = TrapType::SingleStep;
+    return true;
+  }
 
-int sdb::Process::SetWatchpoint([[maybe_unused]] Watchpoint::id_type id,
-                                const VirtualAddress                 address,
-                                const StoppointMode                  mode,
-                                const std::size_t                    size) {
-  return this->SetHardwareStoppoint(address, mode, size);
+  // otherwise carry on as if nothing had happened
+  if (mode != StepMode::None) {
+    this->ResumeThread(thread, mode);
+  } else if (std::none_of(this->threads_.begin(), this->threads_.end(),
+                          [](const auto &entry)
+                          { return entry.second.queued_stop.has_value(); })) {
+    this->ResumeAllThreads();
+  }
+  return false;
 }
 
 int sdb::Process::SetHardwareBreakpoint(
@@ -377,8 +2086,9 @@ std::unordered_map<int, std::uint64_t> sdb::Process::GetAuxiliaryVector()
 }
 
 std::variant<sdb::BreakpointSite::id_type, sdb::Watchpoint::id_type>
-sdb::Process::GetCurrentHardwareStoppoint() const {
-  auto      &regs   = this->GetRegisters();
+sdb::Process::GetCurrentHardwareStoppoint(
+    const std::optional<pid_t> tid) const {
+  auto      &regs   = this->GetRegisters(tid);
   const auto status = regs.ReadByIdAs<std::uint64_t>(RegisterID::dr6);
   // find index of the least significant bit set in the status (count
   // trailing zeroes)
@@ -390,20 +2100,49 @@ sdb::Process::GetCurrentHardwareStoppoint() const {
 
   using ret = std::variant<BreakpointSite::id_type, Watchpoint::id_type>;
 
-  if (this->breakpoint_sites_.ContainsAddress(addr)) {
-    auto site_id = this->breakpoint_sites_.GetByAddress(addr).GetId();
-    return ret{std::in_place_index<0>, site_id};
+  if (const auto site = this->breakpoint_sites_.FindByAddress(addr)) {
+    return ret{std::in_place_index<0>, site->GetId()};
   }
 
-  auto watch_id = this->watchpoints_.GetByAddress(addr).GetId();
-  return ret{std::in_place_index<1>, watch_id};
+  // a watchpoint may be spread over more than one register
+  std::optional<Watchpoint::id_type> watch_id;
+  this->watchpoints_.ForEach(
+      [&watch_id, index](const Watchpoint &watchpoint)
+      {
+        const auto &indices = watchpoint.hardware_register_indices_;
+        if (std::find(indices.begin(), indices.end(), index) != indices.end()) {
+          watch_id = watchpoint.GetId();
+        }
+      });
+  if (!watch_id) {
+    Error::Send("No stoppoint is in the hardware register that was hit");
+  }
+  return ret{std::in_place_index<1>, *watch_id};
 }
 
-std::vector<std::byte> sdb::Process::ReadMemory(VirtualAddress address,
-                                                std::size_t    amount) const {
+std::vector<std::byte> sdb::Process::ReadMemory(
+    const VirtualAddress address, const std::size_t amount) const {
   std::vector<std::byte> ret(amount);
-  const iovec            local_desc{ret.data(), ret.size()};
-  std::vector<iovec>     remote_descs;
+  this->ReadMemory(address, {ret.data(), ret.size()});
+  return ret;
+}
+
+void sdb::Process::ReadMemory(const VirtualAddress  address,
+                              const Span<std::byte> out) const {
+  // the cache is only valid while the process is stopped
+  if (this->memory_cache_enabled_ && this->state_ == ProcessState::Stopped &&
+      this->ReadMemoryCached(address, out)) {
+    return;
+  }
+  this->ReadMemoryUncached(address, out);
+}
+
+void sdb::Process::ReadMemoryUncached(VirtualAddress        address,
+                                      const Span<std::byte> out) const {
+  const auto         start  = address;
+  auto               amount = out.Size();
+  const iovec        local_desc{out.begin(), out.Size()};
+  std::vector<iovec> remote_descs;
 
   while (amount > 0) {
     // 0x1000 is the page size on x86_64 (4k), so we read up to the next page
@@ -420,15 +2159,194 @@ std::vector<std::byte> sdb::Process::ReadMemory(VirtualAddress address,
   if (process_vm_readv(this->pid_, &local_desc, /*liovcnt=*/1,
                        remote_descs.data(), /*riovcnt=*/remote_descs.size(),
                        /*flags=*/0) == -1) {
-    Error::SendErrno("Could not read process memory");
+    // pages the inferior can't read (i.e ones protected for a page
+    // watchpoint) can still be read through /proc/<pid>/mem
+    const auto fd = this->GetMemFd();
+    if (fd < 0 or pread(fd, out.begin(), out.Size(), start.GetAddress()) !=
+                      static_cast<ssize_t>(out.Size())) {
+      Error::SendErrno("Could not read process memory");
+    }
   }
-  return ret;
+}
+
+std::vector<std::size_t> sdb::Process::ReadMemoryRanges(
+    const Span<const MemoryRange> ranges) const {
+  // as with ReadMemory, split every range on page boundaries. A failed
+  // process_vm_readv still copies whole iovecs up to the first it can't, so
+  // the pages tell us exactly how far it got
+  std::vector<iovec>       local_descs;
+  std::vector<iovec>       remote_descs;
+  std::vector<std::size_t> owners;
+  for (std::size_t i = 0; i < ranges.Size(); ++i) {
+    const auto &range  = ranges.begin()[i];
+    std::size_t offset = 0;
+    while (offset < range.out.Size()) {
+      const auto address         = range.address.GetAddress() + offset;
+      const auto up_to_next_page = 0x1000 - (address & 0xfff);
+      const auto chunk_size =
+          std::min(range.out.Size() - offset, up_to_next_page);
+      local_descs.push_back({range.out.begin() + offset, chunk_size});
+      remote_descs.push_back({reinterpret_cast<void *>(address), chunk_size});
+      owners.push_back(i);
+      offset += chunk_size;
+    }
+  }
+
+  std::vector<std::size_t> n_read(ranges.Size());
+  std::size_t              next = 0;
+  while (next < remote_descs.size()) {
+    const auto count =
+        std::min<std::size_t>(remote_descs.size() - next, IOV_MAX);
+    const auto read = process_vm_readv(this->pid_, &local_descs[next], count,
+                                       &remote_descs[next], count, 0);
+    if (read == -1 && errno != EFAULT) {
+      Error::SendErrno("Could not read process memory");
+    }
+
+    // credit the pages that were read to their ranges
+    const auto end  = next + count;
+    auto       left = read == -1 ? 0 : static_cast<std::size_t>(read);
+    for (; next < end && left >= remote_descs[next].iov_len; ++next) {
+      left -= remote_descs[next].iov_len;
+      n_read[owners[next]] += remote_descs[next].iov_len;
+    }
+
+    // then skip the rest of the range with the page that couldn't be read
+    if (next < end) {
+      const auto failed = owners[next];
+      while (next < remote_descs.size() && owners[next] == failed) {
+        ++next;
+      }
+    }
+  }
+  return n_read;
+}
+
+bool sdb::Process::ReadMemoryCached(const VirtualAddress  address,
+                                    const Span<std::byte> out) const {
+  if (out.Size() == 0) {
+    return true;
+  }
+
+  const auto first_page = PageStart(address.GetAddress());
+  const auto last_page  = PageStart(address.GetAddress() + out.Size() - 1);
+
+  // fetch every page we haven't seen yet during this stop with a single
+  // process_vm_readv
+  std::vector<std::uint64_t> missing;
+  for (auto page = first_page; page <= last_page; page += 0x1000) {
+    if (this->memory_cache_.count(page) == 0) {
+      missing.push_back(page);
+    }
+  }
+
+  if (!missing.empty()) {
+    std::vector<std::array<std::byte, 0x1000>> pages(missing.size());
+    std::vector<iovec>                         local_descs;
+    std::vector<iovec>                         remote_descs;
+
+    for (std::size_t i = 0; i < missing.size(); ++i) {
+      local_descs.push_back({pages[i].data(), pages[i].size()});
+      remote_descs.push_back({reinterpret_cast<void *>(missing[i]), 0x1000});
+    }
+
+    const auto read =
+        process_vm_readv(this->pid_, local_descs.data(), local_descs.size(),
+                         remote_descs.data(), remote_descs.size(), 0);
+
+    // cache whatever pages we managed to read, even if some of them failed
+    const auto n_read = read < 0 ? 0 : static_cast<std::size_t>(read) / 0x1000;
+    for (std::size_t i = 0; i < n_read; ++i) {
+      this->memory_cache_.emplace(missing[i], pages[i]);
+    }
+
+    if (n_read != missing.size()) {
+      // let the uncached path produce the error (or the partial page read)
+      return false;
+    }
+  }
+
+  std::size_t copied = 0;
+  for (auto page = first_page; page <= last_page; page += 0x1000) {
+    const auto &cached = this->memory_cache_.at(page);
+    const auto  begin  = std::max(page, address.GetAddress()) - page;
+    const auto  end =
+        std::min(page + 0x1000, address.GetAddress() + out.Size()) - page;
+    std::copy(cached.begin() + begin, cached.begin() + end,
+              out.begin() + copied);
+    copied += end - begin;
+  }
+  return true;
+}
+
+void sdb::Process::UpdateMemoryCache(const VirtualAddress        address,
+                                     const Span<const std::byte> data) const {
+  if (this->memory_cache_.empty()) {
+    return;
+  }
+
+  std::size_t updated = 0;
+  while (updated < data.Size()) {
+    const auto current         = address.GetAddress() + updated;
+    const auto page            = PageStart(current);
+    const auto up_to_next_page = 0x1000 - (current & 0xfff);
+    const auto chunk = std::min(data.Size() - updated, up_to_next_page);
+
+    if (const auto it = this->memory_cache_.find(page);
+        it != this->memory_cache_.end()) {
+      std::copy(data.begin() + updated, data.begin() + updated + chunk,
+                it->second.begin() + (current & 0xfff));
+    }
+    updated += chunk;
+  }
+}
+
+bool sdb::Process::HasPatchedMemory(const VirtualAddress low,
+                                    const VirtualAddress high) const {
+  // find the first patched page that ends after `low`
+  const auto it = this->patched_pages_.lower_bound(PageStart(low.GetAddress()));
+  return it != this->patched_pages_.end() && *it < high.GetAddress();
+}
+
+bool sdb::Process::HasPrivateMemory(const VirtualAddress low,
+                                    const VirtualAddress high) const {
+  for (auto page = PageStart(low.GetAddress()); page < high.GetAddress();
+       page += 0x1000) {
+    const auto [it, inserted] = this->private_pages_.try_emplace(page, false);
+    if (inserted) {
+      it->second = IsPrivatePage(this->pid_, page);
+    }
+    if (it->second) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void sdb::Process::SetMemoryCacheEnabled(const bool enabled) {
+  this->memory_cache_enabled_ = enabled;
+  this->InvalidateMemoryCache();
 }
 
 std::vector<std::byte> sdb::Process::ReadMemoryWithoutTraps(
     const VirtualAddress address, const std::size_t amount) const {
   auto memory = this->ReadMemory(address, amount);
 
+  // put back the instructions tracepoints have replaced with jumps
+  for (const auto tracepoint :
+       this->GetTracepointsCovering(address, address + amount)) {
+    if (!tracepoint->IsEnabled()) {
+      continue;
+    }
+    for (std::size_t i = 0; i < tracepoint->Size(); ++i) {
+      const auto at = tracepoint->Address() + i;
+      if (at >= address && at < address + amount) {
+        memory[(at - address.GetAddress()).GetAddress()] =
+            tracepoint->original_[i];
+      }
+    }
+  }
+
   const auto sites =
       this->breakpoint_sites_.GetInRegion(address, address + amount);
 
@@ -448,8 +2366,136 @@ std::vector<std::byte> sdb::Process::ReadMemoryWithoutTraps(
   return memory;
 }
 
-void sdb::Process::WriteMemory(const VirtualAddress  address,
-                               Span<const std::byte> data) const {
+void sdb::Process::WriteMemory(const VirtualAddress        address,
+                               const Span<const std::byte> data) const {
+  this->WriteMemory(address, data, /*record_patches=*/true);
+}
+
+void sdb::Process::WriteMemory(VirtualAddress address,
+                               Span<const std::byte> data,
+                               const bool record_patches) const {
+  // a copy of an instruction being written over is stale
+  if (const auto &displaced = this->displaced_;
+      displaced && address.GetAddress() < displaced->from + displaced->length &&
+      address.GetAddress() + data.Size() > displaced->from) {
+    this->displaced_.reset();
+  }
+
+  std::size_t written = 0;
+
+  // until we've written all the data provided by the caller
+  while (written < data.Size()) {
+    const Span<const std::byte> remaining{data.begin() + written, data.end()};
+
+    // bulk write as much as we can; this stops at the first page the tracee
+    // can't write to itself
+    auto       chunk = this->WriteMemoryWithVmWritev(address, remaining);
+    const bool bulk  = chunk != 0;
+
+    if (chunk == 0) {
+      // the page at `address` isn't writable by the tracee (i.e it's
+      // read-only text). /proc/<pid>/mem ignores page protections, so we
+      // write the rest of the range through it in one go
+      chunk = this->WriteMemoryWithProcMem(address, remaining);
+    }
+
+    if (chunk == 0) {
+      // last resort: write up to the end of the page word by word
+      const auto up_to_next_page = 0x1000 - (address.GetAddress() & 0xfff);
+      chunk = std::min(remaining.Size(), up_to_next_page);
+      this->WriteMemoryWithPtrace(address, {remaining.begin(), chunk});
+    }
+
+    if (!bulk && record_patches) {
+      // remember which pages no longer match the executable on disk
+      const auto last = PageStart(address.GetAddress() + chunk - 1);
+      for (auto page = PageStart(address.GetAddress()); page <= last;
+           page += 0x1000) {
+        // the inferior can write to the pages we've protected itself
+        if (this->protected_pages_.count(page) != 0) {
+          continue;
+        }
+        this->patched_pages_.insert(page);
+      }
+    }
+
+    // keep any pages we've cached in sync with what we just wrote
+    this->UpdateMemoryCache(address, {remaining.begin(), chunk});
+
+    written += chunk;
+    address += chunk;
+  }
+}
+
+std::size_t sdb::Process::WriteMemoryWithVmWritev(
+    VirtualAddress address, const Span<const std::byte> data) const {
+  std::size_t written = 0;
+
+  while (written < data.Size()) {
+    // as with ReadMemory, split the remote range on page boundaries.
+    // process_vm_writev doesn't split a single iovec on a partial transfer, so
+    // this lets us know exactly which page we stopped at
+    std::vector<iovec> remote_descs;
+    std::size_t        batch_size = 0;
+    auto               remote     = address;
+
+    while (written + batch_size < data.Size() &&
+           remote_descs.size() < IOV_MAX) {
+      const auto up_to_next_page = 0x1000 - (remote.GetAddress() & 0xfff);
+      const auto chunk_size =
+          std::min(data.Size() - written - batch_size, up_to_next_page);
+      remote_descs.push_back(
+          {reinterpret_cast<void *>(remote.GetAddress()), chunk_size});
+      batch_size += chunk_size;
+      remote += chunk_size;
+    }
+
+    const iovec local_desc{const_cast<std::byte *>(data.begin() + written),
+                           batch_size};
+
+    const auto result =
+        process_vm_writev(this->pid_, &local_desc, /*liovcnt=*/1,
+                          remote_descs.data(), remote_descs.size(),
+                          /*flags=*/0);
+    if (result <= 0) {
+      // EFAULT here means the page isn't writable from the tracee's point of
+      // view, let the caller pick a different strategy for it
+      break;
+    }
+
+    written += result;
+    address += result;
+
+    if (static_cast<std::size_t>(result) < batch_size) {
+      break;  // partial write; the next page isn't writable
+    }
+  }
+
+  return written;
+}
+
+std::size_t sdb::Process::WriteMemoryWithProcMem(
+    const VirtualAddress address, const Span<const std::byte> data) const {
+  const auto fd = this->GetMemFd();
+  if (fd < 0) {
+    return 0;
+  }
+
+  std::size_t written = 0;
+  while (written < data.Size()) {
+    const auto result =
+        pwrite(fd, data.begin() + written, data.Size() - written,
+               static_cast<off_t>(address.GetAddress() + written));
+    if (result <= 0) {
+      break;
+    }
+    written += result;
+  }
+  return written;
+}
+
+void sdb::Process::WriteMemoryWithPtrace(const VirtualAddress  address,
+                                         Span<const std::byte> data) const {
   std::size_t written = 0;
 
   // until we've written all the data provided by the caller
@@ -487,6 +2533,15 @@ void sdb::Process::WriteMemory(const VirtualAddress  address,
   }
 }
 
+int sdb::Process::GetMemFd() const {
+  if (this->mem_fd_ < 0) {
+    const auto path = "/proc/" + std::to_string(this->pid_) + "/mem";
+    // may fail (i.e if /proc isn't mounted); callers fall back to ptrace
+    this->mem_fd_ = open(path.c_str(), O_RDWR | O_CLOEXEC);
+  }
+  return this->mem_fd_;
+}
+
 namespace {
   std::uint64_t EncodeHardwareStoppointMode(const sdb::StoppointMode mode) {
     switch (mode) {
@@ -541,9 +2596,8 @@ int sdb::Process::SetHardwareStoppoint(const VirtualAddress address,
   // register number)
   const int free_space = FindFreeStoppointRegister(control);
 
-  auto id = static_cast<int>(RegisterID::dr0) + free_space;
   // write the given address to the dr register corresponding to the free space
-  registers.WriteById(static_cast<RegisterID>(id), address.GetAddress());
+  this->WriteDebugRegister(free_space, address.GetAddress());
 
   const auto mode_flag = EncodeHardwareStoppointMode(mode);
   const auto size_flag = EncodeHardwareStoppointSize(size);
@@ -560,29 +2614,57 @@ int sdb::Process::SetHardwareStoppoint(const VirtualAddress address,
   masked |= enable_bit | mode_bits | size_bits;
 
   // write to the control register
-  registers.WriteById(RegisterID::dr7, masked);
+  this->WriteDebugRegister(7, masked);
 
   return free_space;
 }
 
-void sdb::Process::AugmentStopReason(StopReason &reason) {
+void sdb::Process::WriteDebugRegister(const int           index,
+                                      const std::uint64_t value) {
+  // debug registers are per thread, but stoppoints apply to the whole process
+  this->debug_registers_[index] = value;
+
+  const auto id = static_cast<RegisterID>(static_cast<int>(RegisterID::dr0) +
+                                          index);
+  for (auto &[tid, thread] : this->threads_) {
+    if (thread.has_debug_registers) {
+      thread.registers->WriteById(id, value);
+    }
+  }
+}
+
+void sdb::Process::InitializeDebugRegisters(ThreadState &thread) {
+  if (std::exchange(thread.has_debug_registers, true) or
+      this->debug_registers_[7] == 0) {
+    return;  // already done, or there's nothing to copy
+  }
+
+  for (const auto index : {0, 1, 2, 3, 7}) {
+    const auto id = static_cast<RegisterID>(
+        static_cast<int>(RegisterID::dr0) + index);
+    thread.registers->WriteById(id, this->debug_registers_[index]);
+  }
+}
+
+void sdb::Process::AugmentStopReason(ThreadState &thread,
+                                     StopReason  &reason) {
   siginfo_t siginfo;
-  if (ptrace(PTRACE_GETSIGINFO, this->pid_, nullptr, &siginfo) == -1) {
+  if (ptrace(PTRACE_GETSIGINFO, thread.tid, nullptr, &siginfo) == -1) {
     Error::SendErrno("Failed to get siginfo");
   }
 
   // check if syscall
   if (reason.info == (SIGTRAP | 0x80)) {
     auto       &sys_info = reason.syscall_info.emplace();
-    const auto &regs     = this->GetRegisters();
+    const auto &regs     = *thread.registers;
 
-    if (this->expecting_syscall_exit_) {  // syscall exit caused the stop
+    if (thread.expecting_syscall_exit) {  // syscall exit caused the stop
       sys_info.entry = false;
       sys_info.id    = regs.ReadByIdAs<std::uint64_t>(
           RegisterID::orig_rax);  // location of the syscall number
       sys_info.return_value = regs.ReadByIdAs<std::uint64_t>(
           RegisterID::rax);                   // location of the return value
-      this->expecting_syscall_exit_ = false;  // the next syscall event will be
+      thread.expecting_syscall_exit = false;  // the next syscall event will be
                                               // interpreted as an entry event
     } else {
       // handle entry
@@ -602,7 +2684,7 @@ void sdb::Process::AugmentStopReason(StopReason &reason) {
       }
 
       // inverse of the above, we next expect a syscall exit
-      this->expecting_syscall_exit_ = true;
+      thread.expecting_syscall_exit = true;
     }
 
     reason.info        = SIGTRAP;
@@ -610,7 +2692,7 @@ void sdb::Process::AugmentStopReason(StopReason &reason) {
     return;
   }
 
-  this->expecting_syscall_exit_ = false;
+  thread.expecting_syscall_exit = false;
 
   reason.trap_reason = TrapType::Unknown;
   if (reason.info == SIGTRAP) {
@@ -636,7 +2718,24 @@ void sdb::Process::AugmentStopReason(StopReason &reason) {
   }
 }
 
-sdb::StopReason sdb::Process::MaybeResumeFromSyscall(const StopReason &reason) {
+bool sdb::Process::CatchesSyscallsWithSeccomp() const {
+  if (this->seccomp_syscalls_.empty() ||
+      this->syscall_catch_policy_.GetMode() != SyscallCatchPolicy::Mode::Some) {
+    return false;
+  }
+
+  const auto &to_catch = this->syscall_catch_policy_.GetToCatch();
+  return std::all_of(to_catch.begin(), to_catch.end(),
+                     [this](const int id)
+                     {
+                       return std::binary_search(
+                           this->seccomp_syscalls_.begin(),
+                           this->seccomp_syscalls_.end(), id);
+                     });
+}
+
+std::optional<sdb::StopReason> sdb::Process::FilterSyscall(
+    const StopReason &reason) const {
   // we don't bother checking for Mode::None, as we don't trigger a stop in the
   // first place
   if (syscall_catch_policy_.GetMode() == SyscallCatchPolicy::Mode::Some) {
@@ -644,25 +2743,92 @@ sdb::StopReason sdb::Process::MaybeResumeFromSyscall(const StopReason &reason) {
     const auto  found =
         std::find(begin(to_catch), end(to_catch), reason.syscall_info->id);
 
-    // not in the list, we resume the process and wait for the next signal
+    // not in the list, so the caller carries on
     if (found == to_catch.end()) {
-      this->Resume();
-      return this->WaitOnSignal();
+      return std::nullopt;
     }
   }
   return reason;
 }
 
+void sdb::Process::EnableBreakpointSites(
+    const Span<BreakpointSite *const> sites) {
+  this->PatchBreakpointSites(sites, /*enable=*/true);
+}
+
+void sdb::Process::DisableBreakpointSites(
+    const Span<BreakpointSite *const> sites) {
+  this->PatchBreakpointSites(sites, /*enable=*/false);
+}
+
+void sdb::Process::PatchBreakpointSites(
+    const Span<BreakpointSite *const> sites, const bool enable) {
+  std::vector<BreakpointSite *> software;
+  for (const auto site : sites) {
+    if (site->IsEnabled() == enable) {
+      continue;
+    }
+
+    if (site->IsHardware()) {
+      enable ? site->Enable() : site->Disable();
+    } else {
+      software.push_back(site);
+    }
+  }
+
+  const auto by_address = [](const auto lhs, const auto rhs)
+  { return lhs->Address() < rhs->Address(); };
+  std::sort(software.begin(), software.end(), by_address);
+  software.erase(std::unique(software.begin(), software.end()),
+                 software.end());
+
+  constexpr std::byte    int3{0xcc};
+  std::vector<std::byte> buffer;
+
+  for (auto first = software.begin(); first != software.end();) {
+    const auto page = PageStart((*first)->Address().GetAddress());
+    const auto last = std::find_if(
+        first, software.end(), [=](const auto site)
+        { return PageStart(site->Address().GetAddress()) != page; });
+
+    // only the bytes from the first site on the page to the last one
+    const auto low  = (*first)->Address();
+    const auto size = (*(last - 1))->Address().GetAddress() -
+                      low.GetAddress() + 1;
+    buffer.resize(size);
+    this->ReadMemory(low, {buffer.data(), size});
+
+    for (auto it = first; it != last; ++it) {
+      auto &byte = buffer[(*it)->Address().GetAddress() - low.GetAddress()];
+      if (enable) {
+        (*it)->saved_data_ = byte;
+        byte               = int3;
+      } else {
+        byte = (*it)->saved_data_;
+      }
+    }
+
+    this->WriteMemory(low, {buffer.data(), size}, /*record_patches=*/false);
+    if (enable) {
+      this->EnsureScratchPad(low);
+    }
+
+    for (auto it = first; it != last; ++it) {
+      (*it)->is_enabled_ = enable;
+    }
+    first = last;
+  }
+}
+
 void sdb::Process::ClearHardwareStoppoint(const int index) {
-  const auto id = static_cast<int>(RegisterID::dr0) + index;
-  this->GetRegisters().WriteById(static_cast<RegisterID>(id), 0);
+  this->WriteDebugRegister(index, 0);
 
   const auto control =
       this->GetRegisters().ReadByIdAs<std::uint64_t>(RegisterID::dr7);
 
-  const auto clear_mask = (0b11 << (index * 2)) | (0b1111 << (index + 16));
+  const auto clear_mask =
+      (0b11 << (index * 2)) | (0b1111 << (index * 4 + 16));
   auto       masked     = control & ~clear_mask;
 
-  this->GetRegisters().WriteById(
-      RegisterID::dr7, masked);  // write the modified control register
+  this->WriteDebugRegister(7, masked);  // write the modified control register
 }
@@ -0,0 +1,329 @@
+#include <algorithm>
+#include <csignal>
+#include <cxxabi.h>
+#include <fstream>
+#include <libsdb/bit.hpp>
+#include <libsdb/error.hpp>
+#include <libsdb/event_loop.hpp>
+#include <libsdb/profiler.hpp>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  // how much of a thread's stack is read at a time. Most stacks fit, so their
+  // frame pointers can be followed without going back to the inferior
+  constexpr std::size_t g_stack_window = 0x2000;
+
+  // a thread whose frame pointers are being followed
+  struct StackWalk {
+    std::vector<std::uint64_t> frames;
+    std::uint64_t              fp;
+    // where the next window of its stack is read from
+    std::uint64_t base;
+  };
+
+  // Follows the frame pointers of `walk` through the `size` bytes of stack
+  // read from walk.base. Returns true if the chain carries on past them
+  bool FollowFramePointers(StackWalk &walk, const std::byte *stack,
+                           const std::size_t size,
+                           const std::size_t max_depth) {
+    while (walk.frames.size() < max_depth) {
+      // a caller's frame is always further up the stack than its callee's
+      if (walk.fp < walk.base || walk.fp % 8 != 0) {
+        return false;
+      }
+      if (walk.fp - walk.base + 16 > size) {
+        // a short read means the stack ends before the frame would
+        if (size != g_stack_window) {
+          return false;
+        }
+        walk.base = walk.fp;
+        return true;
+      }
+
+      const auto frame          = stack + (walk.fp - walk.base);
+      const auto next           = sdb::FromBytes<std::uint64_t>(frame);
+      const auto return_address = sdb::FromBytes<std::uint64_t>(frame + 8);
+      if (return_address == 0) {
+        return false;
+      }
+      walk.frames.push_back(return_address);
+
+      if (next <= walk.fp) {
+        return false;
+      }
+      walk.fp = next;
+    }
+    return false;
+  }
+
+  // Appends the stack of every stopped thread to `frames`. Every unfinished
+  // stack has a window read at once, starting from its stack pointer, so a
+  // sample usually takes a single read however many threads there are
+  void SampleStacks(sdb::Process &process, const std::size_t max_depth,
+                    std::vector<std::uint64_t> &frames,
+                    std::vector<std::size_t>   &sample_ends) {
+    std::vector<StackWalk> walks;
+    for (const auto &[tid, thread] : process.GetThreads()) {
+      if (thread.state == sdb::ProcessState::Stopped) {
+        const auto &regs = process.GetRegisters(tid).GetGprs();
+        walks.push_back({{regs.rip}, regs.rbp, regs.rsp});
+      }
+    }
+
+    std::vector<StackWalk *> unfinished;
+    for (auto &walk : walks) {
+      unfinished.push_back(&walk);
+    }
+
+    std::vector<std::byte>        stacks(walks.size() * g_stack_window);
+    std::vector<sdb::MemoryRange> ranges;
+    while (!unfinished.empty()) {
+      ranges.clear();
+      for (std::size_t i = 0; i < unfinished.size(); ++i) {
+        const auto window = stacks.data() + i * g_stack_window;
+        ranges.push_back({sdb::VirtualAddress{unfinished[i]->base},
+                          {window, g_stack_window}});
+      }
+      const auto n_read =
+          process.ReadMemoryRanges({ranges.data(), ranges.size()});
+
+      std::size_t n_unfinished = 0;
+      for (std::size_t i = 0; i < unfinished.size(); ++i) {
+        if (FollowFramePointers(*unfinished[i],
+                                stacks.data() + i * g_stack_window, n_read[i],
+                                max_depth)) {
+          unfinished[n_unfinished++] = unfinished[i];
+        }
+      }
+      unfinished.resize(n_unfinished);
+    }
+
+    for (const auto &walk : walks) {
+      frames.insert(frames.end(), walk.frames.begin(), walk.frames.end());
+      sample_ends.push_back(frames.size());
+    }
+  }
+
+  // the executable file mappings of the process
+  std::vector<sdb::ProfileMapping> ReadMappings(const pid_t pid) {
+    std::ifstream maps("/proc/" + std::to_string(pid) + "/maps");
+
+    std::vector<sdb::ProfileMapping> mappings;
+    std::string                      line;
+    while (std::getline(maps, line)) {
+      std::istringstream fields(line);
+      std::uint64_t      low, high, offset;
+      std::string        permissions, device, inode, path;
+      char               dash;
+      fields >> std::hex >> low >> dash >> high >> permissions >> offset >>
+          device >> inode >> path;
+      if (permissions.find('x') != std::string::npos && !path.empty() &&
+          path[0] == '/') {
+        mappings.push_back({low, high, offset, path});
+      }
+    }
+    return mappings;
+  }
+
+  std::string Demangle(const std::string_view name) {
+    int        status;
+    const auto demangled =
+        abi::__cxa_demangle(name.data(), nullptr, nullptr, &status);
+    if (status != 0) {
+      return std::string(name);
+    }
+    std::string ret = demangled;
+    free(demangled);
+    return ret;
+  }
+
+  // Names addresses by the symbols of the executable, or of the file mapped
+  // at them. The other files are opened as addresses in them turn up
+  class Symbolizer {
+public:
+    Symbolizer(const sdb::Elf                         &elf,
+               const std::vector<sdb::ProfileMapping> &mappings) :
+        elf_(elf), mappings_(mappings) {}
+
+    std::string Symbolize(const std::uint64_t address) {
+      const sdb::VirtualAddress virtual_address{address};
+      if (const auto symbol =
+              this->elf_.GetSymbolContainingAddress(virtual_address)) {
+        return Demangle(this->elf_.GetString((*symbol)->st_name));
+      }
+
+      const auto mapping = std::find_if(
+          this->mappings_.begin(), this->mappings_.end(),
+          [address](const auto &mapping)
+          { return mapping.low <= address && address < mapping.high; });
+      if (mapping == this->mappings_.end()) {
+        return "[unknown]";
+      }
+
+      if (const auto elf = this->GetElf(*mapping)) {
+        if (const auto symbol =
+                elf->GetSymbolContainingAddress(virtual_address)) {
+          return Demangle(elf->GetString((*symbol)->st_name));
+        }
+      }
+      return "[" + mapping->path.filename().string() + "]";
+    }
+
+private:
+    // the file mapped by `mapping`, or nullptr if it can't be read
+    const sdb::Elf *GetElf(const sdb::ProfileMapping &mapping) {
+      auto [it, inserted] = this->elfs_.try_emplace(mapping.path);
+      if (inserted) {
+        try {
+          it->second = std::make_unique<sdb::Elf>(mapping.path);
+          // shared objects are linked at 0, with their segments at the same
+          // offsets in memory as in the file
+          if (it->second->GetHeader().e_type == ET_DYN) {
+            it->second->NotifyLoaded(
+                sdb::VirtualAddress{mapping.low - mapping.offset});
+          }
+        } catch (const sdb::Error &) {
+          // left unsymbolized
+        }
+      }
+      return it->second.get();
+    }
+
+    const sdb::Elf                                             &elf_;
+    const std::vector<sdb::ProfileMapping>                     &mappings_;
+    std::map<std::filesystem::path, std::unique_ptr<sdb::Elf>> elfs_;
+  };
+}  // namespace
+
+sdb::Span<const std::uint64_t> sdb::Profile::GetStack(
+    const std::size_t i) const {
+  const auto begin = i == 0 ? 0 : this->sample_ends_[i - 1];
+  return {this->frames_.data() + begin,
+          this->frames_.data() + this->sample_ends_[i]};
+}
+
+std::map<std::string, std::uint64_t> sdb::Profile::Fold(const Elf &elf) const {
+  // a return address is the instruction after the call, which may belong to
+  // the next function if the call was the last thing in this one, so it's
+  // the byte before it that's symbolized
+  const auto lookup_address = [](const Span<const std::uint64_t> stack,
+                                 const std::size_t               frame)
+  { return frame == 0 ? stack.begin()[frame] : stack.begin()[frame] - 1; };
+
+  // count each distinct stack before symbolizing anything, so every distinct
+  // address is only symbolized once
+  std::map<std::vector<std::uint64_t>, std::uint64_t> stacks;
+  for (std::size_t i = 0; i < this->SampleCount(); ++i) {
+    const auto stack = this->GetStack(i);
+    std::vector<std::uint64_t> addresses;
+    for (std::size_t frame = stack.Size(); frame-- > 0;) {
+      addresses.push_back(lookup_address(stack, frame));
+    }
+    ++stacks[addresses];
+  }
+
+  Symbolizer symbolizer(elf, this->mappings_);
+  std::unordered_map<std::uint64_t, std::string> names;
+  std::map<std::string, std::uint64_t>             folded;
+  for (const auto &[addresses, count] : stacks) {
+    std::string line;
+    for (const auto address : addresses) {
+      auto [it, inserted] = names.try_emplace(address);
+      if (inserted) {
+        it->second = symbolizer.Symbolize(address);
+      }
+      if (!line.empty()) {
+        line += ';';
+      }
+      line += it->second;
+    }
+    folded[line] += count;
+  }
+  return folded;
+}
+
+sdb::Profile sdb::RecordProfile(Process              &process,
+                                const ProfileOptions &options) {
+  if (options.frequency == 0 || options.max_depth == 0) {
+    Error::Send("Invalid profile options");
+  }
+
+  auto stopped = Clock::now();
+  if (process.state() == ProcessState::Running) {
+    process.Interrupt();
+  }
+
+  // Rather than sleeping between samples, we wait on the process, so events
+  // that aren't reported (i.e a thread being created) are handled as they
+  // happen instead of holding the thread up until the next sample
+  std::optional<StopReason> own_stop;
+  EventLoop                 loop;
+  loop.AddProcess(process, [&own_stop](Process &, const StopReason &reason)
+                  { own_stop = reason; });
+
+  Profile profile;
+  profile.mappings_ = ReadMappings(process.GetPid());
+
+  const auto period = std::chrono::duration_cast<Clock::duration>(
+                          std::chrono::seconds(1)) /
+                      options.frequency;
+  const auto end  = Clock::now() + options.duration;
+  auto       next = Clock::now();
+  // the signal the process last stopped with of its own, if any
+  int signal = 0;
+
+  while (true) {
+    SampleStacks(process, options.max_depth, profile.frames_,
+                 profile.sample_ends_);
+    ++profile.n_ticks_;
+
+    // ticks we're too late for are skipped rather than caught up on, so a
+    // slow sample never keeps the process stopped for longer
+    const auto now = Clock::now();
+    while (next <= now) {
+      next += period;
+    }
+    if (next >= end) {
+      break;
+    }
+
+    process.Resume(std::exchange(signal, 0));
+    profile.stopped_ += Clock::now() - stopped;
+
+    own_stop.reset();
+    while (!own_stop && Clock::now() < next) {
+      loop.RunOnce(
+          std::chrono::ceil<std::chrono::milliseconds>(next - Clock::now()));
+    }
+
+    stopped = Clock::now();
+    if (!own_stop) {
+      process.Interrupt();
+    } else if (own_stop->reason != ProcessState::Stopped) {
+      return profile;
+    } else if (own_stop->info != SIGTRAP) {
+      // a signal of the program's own is delivered when it goes on
+      signal = own_stop->info;
+    }
+    // otherwise it's already stopped for this sample
+  }
+  profile.stopped_ += Clock::now() - stopped;
+
+  // pick up anything mapped since we started (i.e dlopen)
+  for (auto &mapping : ReadMappings(process.GetPid())) {
+    if (std::none_of(profile.mappings_.begin(), profile.mappings_.end(),
+                     [&mapping](const auto &known)
+                     {
+                       return known.low == mapping.low &&
+                              known.path == mapping.path;
+                     })) {
+      profile.mappings_.push_back(std::move(mapping));
+    }
+  }
+  return profile;
+}
@@ -37,7 +37,13 @@ namespace {
   }
 }  // namespace
 
+const user_regs_struct& sdb::Registers::GetGprs() const {
+  this->EnsureLoaded(RegisterType::GPR);
+  return this->data_.regs;
+}
+
 sdb::Registers::value sdb::Registers::Read(const RegisterInfo& info) const {
+  this->EnsureLoaded(info.type);
   const auto bytes = AsBytes(data_);
 
   if (info.format == RegisterFormat::UINT) {
@@ -67,6 +73,8 @@ sdb::Registers::value sdb::Registers::Read(const RegisterInfo& info) const {
 }
 
 void sdb::Registers::Write(const RegisterInfo& info, value value) {
+  // writes back a whole class at a time, so we need the rest of it first
+  this->EnsureLoaded(info.type);
   auto bytes = AsBytes(data_);
 
   std::visit(
@@ -85,17 +93,103 @@ void sdb::Registers::Write(const RegisterInfo& info, value value) {
       },
       value);
 
-  if (info.type == RegisterType::FPR) {
+  // defer the write until the inferior is about to run, so multiple writes
+  // to the same class cost a single syscall
+  ++this->pending_.writes;
+  switch (info.type) {
+    case RegisterType::GPR:
+    case RegisterType::SUB_GPR:
+      this->gprs_dirty_ = true;
+      break;
+    case RegisterType::FPR:
+      this->fprs_dirty_ = true;
+      break;
+    case RegisterType::DR:
+      this->drs_dirty_ |=
+          1 << ((info.offset - offsetof(user, u_debugreg)) / sizeof(long));
+      break;
+  }
+}
+
+void sdb::Registers::EnsureLoaded(const RegisterType type) const {
+  switch (type) {
+    case RegisterType::GPR:
+    case RegisterType::SUB_GPR:
+      if (!this->gprs_loaded_) {
+        this->proc_->ReadGprs(this->data_.regs, this->tid_);
+        this->gprs_loaded_ = true;
+      }
+      break;
+    case RegisterType::FPR:
+      if (!this->fprs_loaded_) {
+        this->proc_->ReadFprs(this->data_.i387, this->tid_);
+        this->fprs_loaded_ = true;
+      }
+      break;
+    case RegisterType::DR:
+      if (!this->drs_loaded_) {
+        for (int i = 0; i < 8; ++i) {
+          this->data_.u_debugreg[i] = this->proc_->ReadUserArea(
+              offsetof(user, u_debugreg) + i * sizeof(long), this->tid_);
+        }
+        this->drs_loaded_ = true;
+      }
+      break;
+  }
+}
+
+void sdb::Registers::Invalidate() {
+  this->gprs_loaded_ = this->fprs_loaded_ = this->drs_loaded_ = false;
+  this->gprs_dirty_ = this->fprs_dirty_ = false;
+  this->drs_dirty_                      = 0;
+  this->pending_                        = {};
+}
+
+void sdb::Registers::Discard() {
+  // only the modified classes need fetching again
+  this->gprs_loaded_ &= !this->gprs_dirty_;
+  this->fprs_loaded_ &= !this->fprs_dirty_;
+  this->drs_loaded_ &= this->drs_dirty_ == 0;
+
+  this->gprs_dirty_ = this->fprs_dirty_ = false;
+  this->drs_dirty_                      = 0;
+  this->pending_                        = {};
+}
+
+void sdb::Registers::Flush() {
+  if (this->pending_.writes == 0) {
+    return;
+  }
+
+  if (this->gprs_dirty_) {
+    this->proc_->WriteGprs(this->data_.regs, this->tid_);
+    this->gprs_dirty_ = false;
+    ++this->pending_.syscalls;
+  }
+
+  if (this->fprs_dirty_) {
     // PTRACE_POKEUSER and PTRACE_PEEKUSER don’t support writing and
     // reading from the x87 area on x64
     // we'll write to all FPRs at once.
-    proc_->WriteFprs(data_.i387);
-  } else {  // otherwise, we're writing to a single GPR or DR
-    // Note: PTRACE_PEEKUSER and PTRACE_POKEUSER require the offset to be
-    // aligned to 8 bytes so, set the lowest 3 bits to 0, forcing 8 byte
-    // alignment
-    const auto aligned_offset = info.offset & ~0b111;
-    proc_->WriteUserArea(info.offset,
-                         FromBytes<std::uint64_t>(bytes + aligned_offset));
+    this->proc_->WriteFprs(this->data_.i387, this->tid_);
+    this->fprs_dirty_ = false;
+    ++this->pending_.syscalls;
+  }
+
+  // debug registers can only be written one at a time with PTRACE_POKEUSER.
+  // Writing them in order means dr7 (the control register) is written last,
+  // once the addresses it enables are in place
+  for (int i = 0; i < 8 && this->drs_dirty_ != 0; ++i) {
+    if (this->drs_dirty_ & (1 << i)) {
+      this->proc_->WriteUserArea(offsetof(user, u_debugreg) + i * sizeof(long),
+                                 this->data_.u_debugreg[i], this->tid_);
+      this->drs_dirty_ &= ~(1 << i);
+      ++this->pending_.syscalls;
+    }
   }
+
+  this->last_batch_ = this->pending_;
+  this->total_.writes += this->pending_.writes;
+  this->total_.syscalls += this->pending_.syscalls;
+  this->pending_ = {};
 }
@@ -0,0 +1,94 @@
+#include "include/relocate.hpp"
+
+#include <climits>
+#include <libsdb/bit.hpp>
+
+std::optional<ZydisDecodedInstruction> sdb::DecodeInstruction(
+    const Span<const std::byte> code) {
+  ZydisDecoder decoder;
+  ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_STACK_WIDTH_64);
+
+  ZydisDecodedInstruction instruction;
+  ZydisDecodedOperand     operands[ZYDIS_MAX_OPERAND_COUNT];
+  if (!ZYAN_SUCCESS(ZydisDecoderDecodeFull(&decoder, code.begin(), code.Size(),
+                                           &instruction, operands))) {
+    return std::nullopt;
+  }
+  return instruction;
+}
+
+bool sdb::AppendRel32(std::vector<std::byte> &code,
+                      const VirtualAddress    code_address,
+                      const std::uint64_t     target) {
+  const auto end = code_address.GetAddress() + code.size() + 4;
+  const auto rel = static_cast<std::int64_t>(target - end);
+  if (rel < INT32_MIN || rel > INT32_MAX) {
+    return false;
+  }
+  const auto rel32 = static_cast<std::int32_t>(rel);
+  code.insert(code.end(), AsBytes(rel32), AsBytes(rel32) + 4);
+  return true;
+}
+
+bool sdb::RelocateInstruction(const Span<const std::byte>    bytes,
+                              const ZydisDecodedInstruction &instruction,
+                              const VirtualAddress           from,
+                              const VirtualAddress           code_address,
+                              std::vector<std::byte>        &code) {
+  if (!(instruction.attributes & ZYDIS_ATTRIB_IS_RELATIVE)) {
+    code.insert(code.end(), bytes.begin(), bytes.end());
+    return true;
+  }
+
+  const auto end_of_original = from.GetAddress() + instruction.length;
+
+  const auto &modrm = instruction.raw.modrm;
+  if ((instruction.attributes & ZYDIS_ATTRIB_HAS_MODRM) && modrm.mod == 0 &&
+      modrm.rm == 5) {
+    // [rip + disp32] keeps its length, so only the displacement changes
+    const auto target = end_of_original + static_cast<std::uint64_t>(
+                                              instruction.raw.disp.value);
+    const auto start = code.size();
+    code.insert(code.end(), bytes.begin(), bytes.end());
+
+    // the displacement is relative to the end of the instruction, which may
+    // have an immediate after it
+    std::vector<std::byte> disp;
+    const auto             end = code_address + start + instruction.length;
+    if (!AppendRel32(disp, end - 4, target)) {
+      return false;
+    }
+    std::copy(disp.begin(), disp.end(),
+              code.begin() + start + instruction.raw.disp.offset);
+    return true;
+  }
+
+  const auto target = end_of_original + static_cast<std::uint64_t>(
+                                            instruction.raw.imm[0].value.s);
+  const auto opcode = instruction.opcode;
+  const auto start  = code.size();
+  if (instruction.opcode_map == ZYDIS_OPCODE_MAP_DEFAULT &&
+      (opcode == 0xe8 || opcode == 0xe9)) {
+    code.push_back(std::byte{opcode});  // call/jmp rel32
+  } else if (instruction.opcode_map == ZYDIS_OPCODE_MAP_DEFAULT &&
+             opcode == 0xeb) {
+    code.push_back(std::byte{0xe9});  // jmp rel8
+  } else if (instruction.opcode_map == ZYDIS_OPCODE_MAP_DEFAULT &&
+             opcode >= 0x70 && opcode <= 0x7f) {
+    // jcc rel8, as the jcc rel32 with the same condition
+    code.push_back(std::byte{0x0f});
+    code.push_back(std::byte(0x80 + (opcode - 0x70)));
+  } else if (instruction.opcode_map == ZYDIS_OPCODE_MAP_0F && opcode >= 0x80 &&
+             opcode <= 0x8f) {
+    code.push_back(std::byte{0x0f});  // jcc rel32
+    code.push_back(std::byte{opcode});
+  } else {
+    return false;
+  }
+
+  if (!AppendRel32(code, code_address, target)) {
+    code.resize(start);
+    return false;
+  }
+  return true;
+}
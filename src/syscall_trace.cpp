@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <ctime>
+#include <fcntl.h>
+#include <libsdb/error.hpp>
+#include <libsdb/syscall_trace.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+  constexpr std::array<char, 8> g_magic = {'S', 'D', 'B', 'T',
+                                           'R', 'A', 'C', 'E'};
+
+  // maps all of `fd`, which is then no longer needed
+  void *MapFile(const int fd, const std::size_t size) {
+    const auto mapping =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+      sdb::Error::SendErrno("Could not map syscall trace log");
+    }
+    return mapping;
+  }
+}  // namespace
+
+sdb::SyscallTraceLog::SyscallTraceLog(void *const mapping,
+                                      const std::size_t size) :
+    header_(static_cast<Header *>(mapping)),
+    records_(reinterpret_cast<SyscallRecord *>(this->header_ + 1)),
+    mapping_size_(size) {}
+
+sdb::SyscallTraceLog::~SyscallTraceLog() {
+  munmap(this->header_, this->mapping_size_);
+}
+
+std::size_t sdb::SyscallTraceLog::MappingSize(const std::size_t capacity) {
+  return sizeof(Header) + capacity * sizeof(SyscallRecord);
+}
+
+std::unique_ptr<sdb::SyscallTraceLog> sdb::SyscallTraceLog::Create(
+    const std::filesystem::path &path, const std::size_t capacity) {
+  if (capacity == 0) {
+    Error::Send("A syscall trace log needs room for at least one record");
+  }
+
+  const auto fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    Error::SendErrno("Could not create syscall trace log");
+  }
+
+  // the file is sparse until records are written
+  const auto size = MappingSize(capacity);
+  if (ftruncate(fd, static_cast<off_t>(size)) == -1) {
+    close(fd);
+    Error::SendErrno("Could not size syscall trace log");
+  }
+
+  std::unique_ptr<SyscallTraceLog> log(
+      new SyscallTraceLog(MapFile(fd, size), size));
+  log->header_->magic     = g_magic;
+  log->header_->capacity  = capacity;
+  log->header_->n_records = 0;
+  return log;
+}
+
+std::unique_ptr<sdb::SyscallTraceLog> sdb::SyscallTraceLog::CreateAnonymous(
+    const std::size_t capacity) {
+  if (capacity == 0) {
+    Error::Send("A syscall trace log needs room for at least one record");
+  }
+
+  const auto size    = MappingSize(capacity);
+  const auto mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED) {
+    Error::SendErrno("Could not map syscall trace log");
+  }
+
+  std::unique_ptr<SyscallTraceLog> log(new SyscallTraceLog(mapping, size));
+  log->header_->magic     = g_magic;
+  log->header_->capacity  = capacity;
+  log->header_->n_records = 0;
+  return log;
+}
+
+std::unique_ptr<sdb::SyscallTraceLog> sdb::SyscallTraceLog::Open(
+    const std::filesystem::path &path) {
+  const auto fd = open(path.c_str(), O_RDWR);
+  if (fd == -1) {
+    Error::SendErrno("Could not open syscall trace log");
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) == -1) {
+    close(fd);
+    Error::SendErrno("Could not read syscall trace log");
+  }
+
+  const auto size = static_cast<std::size_t>(info.st_size);
+  if (size < sizeof(Header)) {
+    close(fd);
+    Error::Send("Not a syscall trace log");
+  }
+
+  std::unique_ptr<SyscallTraceLog> log(
+      new SyscallTraceLog(MapFile(fd, size), size));
+  if (log->header_->magic != g_magic ||
+      MappingSize(log->header_->capacity) != size) {
+    Error::Send("Not a syscall trace log");
+  }
+  return log;
+}
+
+void sdb::SyscallTraceLog::Append(const SyscallRecord &record) {
+  const auto slot = this->header_->n_records % this->header_->capacity;
+  this->records_[slot] = record;
+  ++this->header_->n_records;
+}
+
+void sdb::SyscallTraceLog::Append(const StopReason &reason) {
+  const auto &info = *reason.syscall_info;
+
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  SyscallRecord record;
+  record.timestamp_ns = static_cast<std::uint64_t>(now.tv_sec) * 1000000000 +
+                        static_cast<std::uint64_t>(now.tv_nsec);
+  record.tid   = reason.tid;
+  record.id    = info.id;
+  record.entry = info.entry;
+  if (info.entry) {
+    record.args = info.args;
+  } else {
+    record.args = {info.return_value};
+  }
+  this->Append(record);
+}
+
+std::uint64_t sdb::SyscallTraceLog::DroppedRecords() const {
+  const auto n_records = this->header_->n_records;
+  return n_records > this->header_->capacity
+             ? n_records - this->header_->capacity
+             : 0;
+}
+
+std::vector<sdb::SyscallRecord> sdb::SyscallTraceLog::Records() const {
+  const auto n_kept = static_cast<std::size_t>(
+      std::min<std::uint64_t>(this->header_->n_records, this->Capacity()));
+
+  // once the buffer has wrapped, the oldest record is the one that would be
+  // overwritten next
+  const auto oldest = this->DroppedRecords() == 0
+                          ? 0
+                          : this->header_->n_records % this->Capacity();
+
+  std::vector<SyscallRecord> records;
+  records.reserve(n_kept);
+  records.insert(records.end(), this->records_ + oldest,
+                 this->records_ + n_kept);
+  records.insert(records.end(), this->records_, this->records_ + oldest);
+  return records;
+}
+
+sdb::StopReason sdb::TraceSyscalls(Process &process, SyscallTraceLog &log,
+                                   int signal) {
+  while (true) {
+    process.Resume(std::exchange(signal, 0));
+    const auto reason = process.WaitOnSignal();
+    if (reason.reason != ProcessState::Stopped ||
+        reason.trap_reason != TrapType::Syscall) {
+      return reason;
+    }
+    log.Append(reason);
+  }
+}
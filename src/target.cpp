@@ -33,3 +33,99 @@ std::unique_ptr<sdb::Target> sdb::Target::Attach(const pid_t pid) {
   auto obj      = CreateLoadedElf(*proc, elf_path);
   return std::unique_ptr<Target>(new Target(std::move(proc), std::move(obj)));
 }
+
+sdb::Span<const std::byte> sdb::Target::GetReadOnlyFileData(
+    const VirtualAddress address) const {
+  const auto segment = this->elf_->GetSegmentContainingAddress(address);
+  if (!segment || (segment->p_flags & PF_W) != 0 ||
+      this->process_->HasPatchedMemory(address, address + 1) ||
+      this->process_->HasPrivateMemory(address, address + 1)) {
+    return {};
+  }
+
+  const auto contents = this->elf_->GetSegmentContents(*segment);
+  const auto offset   = address.GetAddress() -
+                      this->elf_->GetLoadBias().GetAddress() - segment->p_vaddr;
+  if (offset >= contents.Size()) {
+    return {};  // in the zero-filled part of the segment
+  }
+
+  // stop at the end of the page, as the next one may have been patched
+  const auto up_to_next_page = 0x1000 - (address.GetAddress() & 0xfff);
+  return {contents.begin() + offset,
+          std::min(contents.Size() - offset, up_to_next_page)};
+}
+
+std::vector<std::byte> sdb::Target::ReadMemory(const VirtualAddress address,
+                                               const std::size_t    amount,
+                                               const bool with_traps) const {
+  std::vector<std::byte> ret(amount);
+  std::size_t            read = 0;
+
+  while (read < amount) {
+    const auto current = address + read;
+
+    if (const auto file = this->GetReadOnlyFileData(current); file.Size()) {
+      // serve the bytes from the mapped file; these are the original bytes,
+      // without any int3 instructions
+      const auto chunk = std::min(amount - read, file.Size());
+      std::copy(file.begin(), file.begin() + chunk, ret.begin() + read);
+      read += chunk;
+      continue;
+    }
+
+    // otherwise, read every page up to the next one we can serve from the file
+    // (or the end of the range) from the live process in one go
+    auto chunk = 0x1000 - (current.GetAddress() & 0xfff);
+    while (read + chunk < amount &&
+           this->GetReadOnlyFileData(current + chunk).Size() == 0) {
+      chunk += 0x1000;
+    }
+    chunk = std::min(chunk, amount - read);
+
+    const auto memory =
+        with_traps ? this->process_->ReadMemory(current, chunk)
+                   : this->process_->ReadMemoryWithoutTraps(current, chunk);
+    std::copy(memory.begin(), memory.end(), ret.begin() + read);
+    read += chunk;
+  }
+
+  if (with_traps) {
+    // put back the jumps of enabled tracepoints and the int3 instructions of
+    // enabled breakpoint sites in the bytes we copied from the file (the live
+    // process already contains them)
+    for (const auto tracepoint :
+         this->process_->GetTracepointsCovering(address, address + amount)) {
+      if (!tracepoint->IsEnabled()) {
+        continue;
+      }
+      const auto jump = tracepoint->GetJump();
+      for (std::size_t i = 0; i < jump.size(); ++i) {
+        const auto at = tracepoint->Address() + i;
+        if (at >= address && at < address + amount) {
+          ret[(at - address.GetAddress()).GetAddress()] = jump[i];
+        }
+      }
+    }
+
+    const auto sites = this->process_->GetBreakpointSites().GetInRegion(
+        address, address + amount);
+    for (const auto site : sites) {
+      if (site->IsEnabled() && !site->IsHardware()) {
+        ret[site->Address().GetAddress() - address.GetAddress()] =
+            std::byte{0xcc};
+      }
+    }
+  }
+  return ret;
+}
+
+std::vector<std::byte> sdb::Target::ReadMemory(const VirtualAddress address,
+                                               const std::size_t amount) const {
+  return this->ReadMemory(address, amount, /*with_traps=*/true);
+}
+
+std::vector<std::byte> sdb::Target::ReadMemoryWithoutTraps(
+    const VirtualAddress address, const std::size_t amount) const {
+  return this->ReadMemory(address, amount, /*with_traps=*/false);
+}
@@ -0,0 +1,360 @@
+#include "include/relocate.hpp"
+
+#include <cstddef>
+#include <fcntl.h>
+#include <libsdb/bit.hpp>
+#include <libsdb/error.hpp>
+#include <libsdb/process.hpp>
+#include <libsdb/tracepoint.hpp>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+  auto GetNextID() {
+    static sdb::Tracepoint::id_type id = 0;
+    return ++id;
+  }
+
+  using Header = sdb::TracepointBuffer::Header;
+  using Slot   = sdb::TracepointBuffer::Slot;
+  using Hit    = sdb::TracepointHit;
+
+  // the offsets hard-coded into the trampolines below
+  static_assert(offsetof(Header, head) == 0x00 &&
+                offsetof(Header, tail) == 0x08 &&
+                offsetof(Header, capacity) == 0x10 &&
+                offsetof(Header, mask) == 0x18 &&
+                offsetof(Header, dropped) == 0x20);
+  static_assert(sizeof(Slot) == 0x98 && offsetof(Slot, hit) == 0x08);
+  static_assert(offsetof(Hit, rax) == 0x08 && offsetof(Hit, rbx) == 0x10 &&
+                offsetof(Hit, rcx) == 0x18 && offsetof(Hit, rdx) == 0x20 &&
+                offsetof(Hit, rsi) == 0x28 && offsetof(Hit, rdi) == 0x30 &&
+                offsetof(Hit, rbp) == 0x38 && offsetof(Hit, rsp) == 0x40 &&
+                offsetof(Hit, r8) == 0x48 && offsetof(Hit, r15) == 0x80 &&
+                offsetof(Hit, rflags) == 0x88);
+
+  // Records a hit in the TracepointBuffer. Everything it touches is saved
+  // on the stack, below the red zone of the code being traced. The two
+  // movabs immediates are filled in for each trampoline
+  constexpr unsigned char g_record_hit[] = {
+      0x48, 0x8d, 0x64, 0x24, 0x80,  // lea rsp, [rsp - 0x80]
+      0x9c,                          // pushfq
+      0x50,                          // push rax
+      0x51,                          // push rcx
+      0x52,                          // push rdx
+      0x48, 0xba, 0, 0, 0, 0, 0, 0, 0, 0,  // movabs rdx, <buffer>
+      // claim a slot, unless the buffer is full
+      0x48, 0x8b, 0x02,                    // 0x13: mov rax, [rdx]
+      0x48, 0x89, 0xc1,                    // mov rcx, rax
+      0x48, 0x2b, 0x4a, 0x08,              // sub rcx, [rdx + 0x08]
+      0x48, 0x3b, 0x4a, 0x10,              // cmp rcx, [rdx + 0x10]
+      0x0f, 0x83, 0x9f, 0x00, 0x00, 0x00,  // jae full
+      0x48, 0x8d, 0x48, 0x01,              // lea rcx, [rax + 1]
+      0xf0, 0x48, 0x0f, 0xb1, 0x0a,        // lock cmpxchg [rdx], rcx
+      0x75, 0xe1,                          // jne 0x13
+      // rcx = the slot
+      0x48, 0x89, 0xc1,                          // mov rcx, rax
+      0x48, 0x23, 0x4a, 0x18,                    // and rcx, [rdx + 0x18]
+      0x48, 0x69, 0xc9, 0x98, 0x00, 0x00, 0x00,  // imul rcx, rcx, 0x98
+      0x48, 0x8d, 0x8c, 0x0a, 0x00, 0x10, 0x00, 0x00,  // lea rcx,
+                                                       // [rdx + rcx + 0x1000]
+      0x48, 0x89, 0x59, 0x18,                    // mov [rcx + 0x18], rbx
+      0x48, 0x89, 0x71, 0x30,                    // mov [rcx + 0x30], rsi
+      0x48, 0x89, 0x79, 0x38,                    // mov [rcx + 0x38], rdi
+      0x48, 0x89, 0x69, 0x40,                    // mov [rcx + 0x40], rbp
+      0x4c, 0x89, 0x41, 0x50,                    // mov [rcx + 0x50], r8
+      0x4c, 0x89, 0x49, 0x58,                    // mov [rcx + 0x58], r9
+      0x4c, 0x89, 0x51, 0x60,                    // mov [rcx + 0x60], r10
+      0x4c, 0x89, 0x59, 0x68,                    // mov [rcx + 0x68], r11
+      0x4c, 0x89, 0x61, 0x70,                    // mov [rcx + 0x70], r12
+      0x4c, 0x89, 0x69, 0x78,                    // mov [rcx + 0x78], r13
+      0x4c, 0x89, 0xb1, 0x80, 0x00, 0x00, 0x00,  // mov [rcx + 0x80], r14
+      0x4c, 0x89, 0xb9, 0x88, 0x00, 0x00, 0x00,  // mov [rcx + 0x88], r15
+      // the registers we saved on the stack
+      0x48, 0x8b, 0x14, 0x24,                    // mov rdx, [rsp]
+      0x48, 0x89, 0x51, 0x28,                    // mov [rcx + 0x28], rdx
+      0x48, 0x8b, 0x54, 0x24, 0x08,              // mov rdx, [rsp + 0x08]
+      0x48, 0x89, 0x51, 0x20,                    // mov [rcx + 0x20], rdx
+      0x48, 0x8b, 0x54, 0x24, 0x10,              // mov rdx, [rsp + 0x10]
+      0x48, 0x89, 0x51, 0x10,                    // mov [rcx + 0x10], rdx
+      0x48, 0x8b, 0x54, 0x24, 0x18,              // mov rdx, [rsp + 0x18]
+      0x48, 0x89, 0x91, 0x90, 0x00, 0x00, 0x00,  // mov [rcx + 0x90], rdx
+      0x48, 0x8d, 0x94, 0x24, 0xa0, 0x00, 0x00, 0x00,  // lea rdx, [rsp + 0xa0]
+      0x48, 0x89, 0x51, 0x48,                          // mov [rcx + 0x48], rdx
+      0x48, 0xba, 0, 0, 0, 0, 0, 0, 0, 0,  // movabs rdx, <tracepoint address>
+      0x48, 0x89, 0x51, 0x08,              // mov [rcx + 0x08], rdx
+      // publish the slot. x86 doesn't reorder stores, so it's complete by the
+      // time the debugger sees the sequence number
+      0x48, 0xff, 0xc0,  // inc rax
+      0x48, 0x89, 0x01,  // mov [rcx], rax
+      0xeb, 0x05,        // jmp done
+      0xf0, 0x48, 0xff, 0x42, 0x20,  // full: lock inc qword [rdx + 0x20]
+      0x5a,                          // done: pop rdx
+      0x59,                          // pop rcx
+      0x58,                          // pop rax
+      0x9d,                          // popfq
+      0x48, 0x8d, 0xa4, 0x24, 0x80, 0x00, 0x00, 0x00,  // lea rsp, [rsp + 0x80]
+  };
+  constexpr std::size_t g_buffer_immediate  = 0x0b;
+  constexpr std::size_t g_address_immediate = 0xb2;
+
+  constexpr std::size_t g_jump_size = 5;  // jmp rel32
+
+  // Decodes the instructions at the start of `code` that a jump displaces.
+  // Only the last may end the flow: the ones after a ret or jmp needn't be
+  // instructions at all, and if they are they'd be run when they shouldn't
+  std::vector<ZydisDecodedInstruction> DecodeDisplaced(
+      const sdb::Span<const std::byte> code) {
+    std::vector<ZydisDecodedInstruction> instructions;
+    std::size_t                          displaced = 0;
+    while (displaced < g_jump_size) {
+      if (!instructions.empty()) {
+        const auto mnemonic = instructions.back().mnemonic;
+        if (mnemonic == ZYDIS_MNEMONIC_RET || mnemonic == ZYDIS_MNEMONIC_JMP ||
+            mnemonic == ZYDIS_MNEMONIC_UD2 || mnemonic == ZYDIS_MNEMONIC_INT3) {
+          sdb::Error::Send("The tracepoint's instructions end too soon");
+        }
+      }
+
+      const auto instruction = sdb::DecodeInstruction(
+          {code.begin() + displaced, code.Size() - displaced});
+      if (!instruction) {
+        sdb::Error::Send("Could not decode the instructions at the tracepoint");
+      }
+      instructions.push_back(*instruction);
+      displaced += instruction->length;
+    }
+    return instructions;
+  }
+
+  // `result` as a raw syscall returns it; a negative errno on failure
+  std::uint64_t CheckSyscall(const std::int64_t result,
+                             const std::string &message) {
+    if (result < 0 && result > -4096) {
+      errno = static_cast<int>(-result);
+      sdb::Error::SendErrno(message);
+    }
+    return static_cast<std::uint64_t>(result);
+  }
+}  // namespace
+
+sdb::Tracepoint::Tracepoint(Process             &process,
+                            const VirtualAddress address,
+                            const VirtualAddress trampoline,
+                            const VirtualAddress buffer) :
+    id_(GetNextID()), process_(&process), address_(address),
+    trampoline_(trampoline) {
+  const auto original =
+      process.ReadMemoryWithoutTraps(address, max_size);
+
+  std::vector<std::byte> code(
+      reinterpret_cast<const std::byte *>(std::begin(g_record_hit)),
+      reinterpret_cast<const std::byte *>(std::end(g_record_hit)));
+  const auto buffer_address = buffer.GetAddress();
+  const auto site_address   = address.GetAddress();
+  std::copy(AsBytes(buffer_address), AsBytes(buffer_address) + 8,
+            code.begin() + g_buffer_immediate);
+  std::copy(AsBytes(site_address), AsBytes(site_address) + 8,
+            code.begin() + g_address_immediate);
+
+  // move whole instructions until there's room for the jump
+  std::size_t displaced = 0;
+  for (const auto &instruction :
+       DecodeDisplaced({original.data(), original.size()})) {
+    if (!RelocateInstruction({original.data() + displaced, instruction.length},
+                             instruction, address + displaced, trampoline,
+                             code)) {
+      Error::Send("Can't relocate the instructions at the tracepoint");
+    }
+    displaced += instruction.length;
+  }
+
+  // and carry on after them
+  code.push_back(std::byte{0xe9});
+  if (!AppendRel32(code, trampoline, site_address + displaced)) {
+    Error::Send("Tracepoint trampoline is out of reach");
+  }
+
+  this->original_.assign(original.begin(), original.begin() + displaced);
+  process.WriteMemory(trampoline, {code.data(), code.size()},
+                      /*record_patches=*/false);
+  this->code_ = std::move(code);
+}
+
+std::size_t sdb::Tracepoint::DisplacedSize(Process             &process,
+                                           const VirtualAddress address) {
+  const auto  original = process.ReadMemoryWithoutTraps(address, max_size);
+  std::size_t size     = 0;
+  for (const auto &instruction :
+       DecodeDisplaced({original.data(), original.size()})) {
+    size += instruction.length;
+  }
+  return size;
+}
+
+void sdb::Tracepoint::Restore(const VirtualAddress buffer) {
+  const auto buffer_address = buffer.GetAddress();
+  std::copy(AsBytes(buffer_address), AsBytes(buffer_address) + 8,
+            this->code_.begin() + g_buffer_immediate);
+  this->process_->WriteMemory(this->trampoline_,
+                              {this->code_.data(), this->code_.size()},
+                              /*record_patches=*/false);
+
+  // a thread stopped part way through the instructions would resume in the
+  // middle of the jump, so the tracepoint can't stay enabled
+  const auto pc = this->process_->GetPc();
+  if (pc > this->address_ && pc < this->address_ + this->Size()) {
+    this->is_enabled_ = false;
+  }
+
+  const auto code = this->is_enabled_ ? this->GetJump() : this->original_;
+  this->process_->WriteMemory(this->address_, {code.data(), code.size()},
+                              /*record_patches=*/false);
+}
+
+std::vector<std::byte> sdb::Tracepoint::GetJump() const {
+  std::vector<std::byte> jump{std::byte{0xe9}};
+  if (!AppendRel32(jump, this->address_, this->trampoline_.GetAddress())) {
+    Error::Send("Tracepoint trampoline is out of reach");
+  }
+  jump.resize(this->Size(), std::byte{0xcc});
+  return jump;
+}
+
+void sdb::Tracepoint::Enable() {
+  if (this->is_enabled_) {
+    return;
+  }
+
+  if (this->process_->state() != ProcessState::Stopped) {
+    Error::Send("Tracepoints can only be enabled while the process is stopped");
+  }
+
+  // a thread that's stopped part way through the instructions would resume in
+  // the middle of the jump
+  for (const auto &[tid, thread] : this->process_->GetThreads()) {
+    const auto pc = this->process_->GetPc(tid);
+    if (pc > this->address_ && pc < this->address_ + this->Size()) {
+      Error::Send("A thread is stopped inside the tracepoint's instructions");
+    }
+  }
+
+  const auto jump = this->GetJump();
+  this->process_->WriteMemory(this->address_, {jump.data(), jump.size()},
+                              /*record_patches=*/false);
+  this->is_enabled_ = true;
+}
+
+void sdb::Tracepoint::Disable() {
+  if (!this->is_enabled_) {
+    return;
+  }
+
+  if (this->process_->state() != ProcessState::Stopped) {
+    Error::Send(
+        "Tracepoints can only be disabled while the process is stopped");
+  }
+
+  // a thread part way through the trampoline still returns to the end of the
+  // original instructions, which are back where they were
+  this->process_->WriteMemory(this->address_,
+                              {this->original_.data(), this->Size()},
+                              /*record_patches=*/false);
+  this->is_enabled_ = false;
+}
+
+sdb::TracepointBuffer::TracepointBuffer(void *const          mapping,
+                                        const std::size_t    size,
+                                        const std::size_t    capacity,
+                                        const VirtualAddress inferior_address) :
+    header_(static_cast<Header *>(mapping)),
+    slots_(reinterpret_cast<Slot *>(static_cast<std::byte *>(mapping) +
+                                    slots_offset)),
+    mapping_size_(size), capacity_(capacity),
+    inferior_address_(inferior_address) {}
+
+sdb::TracepointBuffer::~TracepointBuffer() {
+  munmap(this->header_, this->mapping_size_);
+}
+
+std::unique_ptr<sdb::TracepointBuffer> sdb::TracepointBuffer::Create(
+    Process &process, const std::size_t capacity) {
+  std::size_t slots = 1;
+  while (slots < capacity) {
+    slots *= 2;
+  }
+  const auto size =
+      (slots_offset + slots * sizeof(Slot) + 0xfff) & ~std::size_t{0xfff};
+
+  // memfd_create wants a name in the inferior's memory. Below its stack
+  // pointer, past the red zone, is free
+  constexpr char name[]       = "sdb-tracepoints";
+  const auto     name_address = VirtualAddress{
+      process.GetRegisters().ReadByIdAs<std::uint64_t>(RegisterID::rsp) -
+      0x400};
+  process.WriteMemory(
+      name_address, {reinterpret_cast<const std::byte *>(name), sizeof(name)});
+
+  const auto fd =
+      CheckSyscall(process.InjectSyscall(SYS_memfd_create,
+                                         {name_address.GetAddress(), 0}),
+                   "Could not create tracepoint buffer");
+
+  // once both sides have the memfd mapped, the inferior doesn't need it open
+  void          *mapping = MAP_FAILED;
+  std::uint64_t  inferior_address;
+  try {
+    CheckSyscall(process.InjectSyscall(SYS_ftruncate, {fd, size}),
+                 "Could not size tracepoint buffer");
+    inferior_address = CheckSyscall(
+        process.InjectSyscall(SYS_mmap, {0, size, PROT_READ | PROT_WRITE,
+                                         MAP_SHARED, fd, 0}),
+        "Could not map tracepoint buffer into the inferior");
+
+    const auto path = "/proc/" + std::to_string(process.GetPid()) + "/fd/" +
+                      std::to_string(fd);
+    const auto local_fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (local_fd == -1) {
+      Error::SendErrno("Could not open tracepoint buffer");
+    }
+    mapping =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, local_fd, 0);
+    close(local_fd);
+    if (mapping == MAP_FAILED) {
+      Error::SendErrno("Could not map tracepoint buffer");
+    }
+  } catch (const Error &) {
+    process.InjectSyscall(SYS_close, {fd});
+    throw;
+  }
+  process.InjectSyscall(SYS_close, {fd});
+
+  std::unique_ptr<TracepointBuffer> buffer(new TracepointBuffer(
+      mapping, size, slots, VirtualAddress{inferior_address}));
+  buffer->header_->capacity = slots;
+  buffer->header_->mask     = slots - 1;
+  return buffer;
+}
+
+std::uint64_t sdb::TracepointBuffer::DroppedHits() const {
+  return __atomic_load_n(&this->header_->dropped, __ATOMIC_RELAXED);
+}
+
+std::vector<sdb::TracepointHit> sdb::TracepointBuffer::ReadHits() {
+  const auto head = __atomic_load_n(&this->header_->head, __ATOMIC_ACQUIRE);
+  auto       tail = this->header_->tail;
+  std::vector<TracepointHit> hits;
+  hits.reserve(std::min<std::uint64_t>(head - tail, this->capacity_));
+  for (; tail != head; ++tail) {
+    const auto &slot = this->slots_[tail & (this->capacity_ - 1)];
+    // claimed, but the trampoline is still filling it in
+    if (__atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE) != tail + 1) {
+      break;
+    }
+    hits.push_back(slot.hit);
+  }
+
+  __atomic_store_n(&this->header_->tail, tail, __ATOMIC_RELEASE);
+  return hits;
+}
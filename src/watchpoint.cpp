@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <libsdb/process.hpp>
 #include <libsdb/watchpoint.hpp>
 
@@ -8,25 +9,50 @@ namespace {
   }
 }  // namespace
 
+std::vector<sdb::WatchSlot> sdb::PlanWatchSlots(const VirtualAddress address,
+                                                const std::size_t    size,
+                                                const StoppointMode  mode) {
+  // Taking the largest slot the next address is aligned to, without going
+  // past the end, never leaves more to cover than a smaller slot would
+  std::vector<WatchSlot> slots;
+  auto                   next = address.GetAddress();
+  const auto             end  = next + size;
+  while (next < end) {
+    std::size_t slot_size = mode == StoppointMode::execute ? 1 : 8;
+    while (next % slot_size != 0 || next + slot_size > end) {
+      slot_size /= 2;
+    }
+    slots.push_back({VirtualAddress{next}, slot_size});
+    next += slot_size;
+  }
+  return slots;
+}
+
 sdb::Watchpoint::Watchpoint(Process &process, const VirtualAddress address,
-                            const StoppointMode mode, const std::size_t size) :
+                            const StoppointMode mode, const std::size_t size,
+                            const bool hardware) :
     process_{&process}, address_{address}, mode_{mode}, is_enabled_{false},
-    size_{size} {
-  // watchpoints on x64 must be aligned to their size; 8-byte watchpoints must
-  // fall on 8-byte boundaries, 4-byte watchpoints on 4-byte boundaries, etc.
-
-  /*
-   *Explainer airlifted from the book:
-   *
-   * "If the size of the breakpoint is 8, the least significant 4 bits of the
-   * address must be 0 for the address to be aligned. Because address & (8 - 1)
-   * is address & 0b1111, we ensure that this calculation results in 0.
-   * Similarly, if the size is 4, the least significant 3 bits of the address
-   * should be 0, and address & (4 - 1) will be address & 0b111. The same
-   * approach works for 2-byte and 1-byte watchpoints."
-   */
-  if ((address.GetAddress() & size - 1) != 0) {
-    Error::Send("Watchpoints must be aligned to their size");
+    size_{size}, is_hardware_{hardware} {
+  // page watchpoints can be any size, anywhere
+  if (!hardware) {
+    if (size == 0) {
+      Error::Send("Watchpoints must watch at least a byte");
+    }
+    if (mode == StoppointMode::execute) {
+      Error::Send("Page watchpoints can't watch for execution");
+    }
+    this->id_ = GetNextId();
+    this->UpdateData();
+    return;
+  }
+
+  // Debug registers watch 1, 2, 4 or 8 bytes aligned to their size, so a
+  // range is spread over as many as it takes, up to all four
+  if (size == 0 || size > 32) {
+    Error::Send("Hardware watchpoints can watch 1 to 32 bytes");
+  }
+  if (PlanWatchSlots(address, size, mode).size() > 4) {
+    Error::Send("Watchpoint needs more than the 4 debug registers");
   }
 
   this->id_ = GetNextId();
@@ -34,11 +60,13 @@ sdb::Watchpoint::Watchpoint(Process &process, const VirtualAddress address,
 }
 
 void sdb::Watchpoint::UpdateData() {
+  // the whole range is read at once, however many slots it's spread over
+  this->previous_contents_ = std::exchange(
+      this->contents_, this->process_->ReadMemory(this->address_, this->size_));
+
   std::uint64_t new_data = 0;
-  // read the necessary amount of data from the watched address
-  const auto read = this->process_->ReadMemory(this->address_, this->size_);
-  // store the result
-  memcpy(&new_data, read.data(), this->size_);
+  std::copy_n(this->contents_.begin(), std::min(this->size_, sizeof(new_data)),
+              AsBytes(new_data));
   // copy the previous data
   this->previous_data_ = std::exchange(this->data_, new_data);
 }
@@ -48,8 +76,25 @@ void sdb::Watchpoint::Enable() {
     return;
   }
 
-  this->hardware_register_index_ = this->process_->SetWatchpoint(
-      this->id_, this->address_, this->mode_, this->size_);
+  if (this->is_hardware_) {
+    // if the registers run out, the ones already taken are freed again
+    try {
+      for (const auto &slot :
+           PlanWatchSlots(this->address_, this->size_, this->mode_)) {
+        const auto index = this->process_->SetWatchpoint(
+            this->id_, slot.address, this->mode_, slot.size);
+        this->hardware_register_indices_.push_back(index);
+      }
+    } catch (const Error &) {
+      for (const auto index : this->hardware_register_indices_) {
+        this->process_->ClearHardwareStoppoint(index);
+      }
+      this->hardware_register_indices_.clear();
+      throw;
+    }
+  } else {
+    this->process_->EnablePageWatchpoint(*this);
+  }
   this->is_enabled_ = true;
 }
 
@@ -58,6 +103,13 @@ void sdb::Watchpoint::Disable() {
     return;
   }
 
-  this->process_->ClearHardwareStoppoint(this->hardware_register_index_);
+  if (this->is_hardware_) {
+    for (const auto index : this->hardware_register_indices_) {
+      this->process_->ClearHardwareStoppoint(index);
+    }
+    this->hardware_register_indices_.clear();
+  } else {
+    this->process_->DisablePageWatchpoint(*this);
+  }
   this->is_enabled_ = false;
 }
@@ -0,0 +1,8 @@
+#include <csignal>
+#include <unistd.h>
+
+int main() {
+  // leave the process group the debugger made us, for the debugger's own
+  setpgid(0, getpgid(getppid()));
+  raise(SIGTRAP);
+}
@@ -0,0 +1,14 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+int main() {
+  // the child inherits any seccomp filter the debugger gave us
+  if (fork() == 0) {
+    _exit(write(STDOUT_FILENO, "child\n", 6) == 6 ? 0 : 1);
+  }
+
+  int status;
+  wait(&status);
+  write(STDOUT_FILENO, "parent\n", 7);
+  return WEXITSTATUS(status);
+}
@@ -0,0 +1,24 @@
+#include <csignal>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// every thread calls this once; the debugger puts a breakpoint on it
+__attribute__((noinline)) void SayHi() { asm volatile(""); }
+
+int main() {
+  // send the debugger the address of SayHi, then give it a chance to set the
+  // breakpoint
+  const auto ptr = reinterpret_cast<void *>(&SayHi);
+  write(STDOUT_FILENO, &ptr, sizeof(void *));
+  raise(SIGTRAP);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back(SayHi);
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
@@ -0,0 +1,23 @@
+#include <csignal>
+#include <cstdint>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// never called: its first instruction is rewritten as a ret
+__attribute__((noinline)) void Rewritten() { asm volatile(""); }
+
+int main() {
+  // make the page writable only long enough to rewrite the function, the way
+  // a program patching its own code would
+  const auto address = reinterpret_cast<std::uintptr_t>(&Rewritten);
+  const auto page =
+      reinterpret_cast<void *>(address & ~std::uintptr_t{0xfff});
+  mprotect(page, 0x1000, PROT_READ | PROT_WRITE | PROT_EXEC);
+  *reinterpret_cast<volatile unsigned char *>(address) = 0xc3;
+  mprotect(page, 0x1000, PROT_READ | PROT_EXEC);
+
+  // send the debugger its address
+  const auto ptr = reinterpret_cast<void *>(&Rewritten);
+  write(STDOUT_FILENO, &ptr, sizeof(void *));
+  raise(SIGTRAP);
+}
@@ -0,0 +1,15 @@
+#include <csignal>
+#include <unistd.h>
+
+namespace {
+  void HandleUsr1(int) { write(STDOUT_FILENO, "caught\n", 7); }
+}  // namespace
+
+int main() {
+  std::signal(SIGUSR1, HandleUsr1);
+  std::raise(SIGUSR1);
+
+  // a debugger that drops the signal leaves us faulting forever
+  volatile int *null = nullptr;
+  *null              = 1;
+}
@@ -0,0 +1,27 @@
+#include <csignal>
+#include <cstdio>
+#include <unistd.h>
+
+namespace {
+  // bigger than the debug registers can watch, and page aligned so nothing
+  // else shares its pages
+  alignas(4096) char g_buffer[3 * 4096];
+}  // namespace
+
+int main() {
+  auto address = g_buffer;
+  write(STDOUT_FILENO, &address, sizeof(void *));
+  fflush(stdout);
+  raise(SIGTRAP);
+
+  // a read and a write from each of the three pages
+  volatile char sum = g_buffer[100];
+  g_buffer[200]     = 1;
+  sum               = sum + g_buffer[4200];
+  g_buffer[5000]    = 2;
+  sum               = sum + g_buffer[9000];
+  g_buffer[10000]   = 3;
+  raise(SIGTRAP);
+
+  printf("%d", g_buffer[200] + g_buffer[5000] + g_buffer[10000]);
+}
@@ -1,18 +1,31 @@
 #include <catch2/catch_test_macros.hpp>
 #include <csignal>
+#include <cstdlib>
 #include <elf.h>
 #include <fcntl.h>
 #include <fstream>
 #include <libsdb/bit.hpp>
+#include <libsdb/breakpoint_condition.hpp>
 #include <libsdb/breakpoint_site.hpp>
 #include <libsdb/dwarf.hpp>
 #include <libsdb/elf.hpp>
 #include <libsdb/error.hpp>
+#include <libsdb/event_loop.hpp>
+#include <libsdb/index_cache.hpp>
+#include <libsdb/instruction_trace.hpp>
+#include <libsdb/memory_snapshot.hpp>
 #include <libsdb/pipe.hpp>
 #include <libsdb/process.hpp>
+#include <libsdb/profiler.hpp>
+#include <libsdb/syscall_trace.hpp>
 #include <libsdb/syscalls.hpp>
+#include <libsdb/target.hpp>
 #include <libsdb/types.hpp>
 #include <regex>
+#include <set>
+#include <sys/ptrace.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 
 namespace {
   bool ProcessExists(const pid_t pid) {
@@ -115,6 +128,29 @@ namespace {
     }
     sdb::Error::Send("Could not find load address for the given PID");
   }
+
+  // The indexes the tests build are cached in a directory of their own for
+  // the run, removed at the end, rather than in ~/.cache/sdb
+  class TemporaryCacheHome {
+public:
+    TemporaryCacheHome() {
+      auto path = (std::filesystem::temp_directory_path() / "sdb_tests_XXXXXX")
+                      .string();
+      if (mkdtemp(path.data()) != nullptr) {
+        this->directory_ = path;
+        setenv("XDG_CACHE_HOME", path.c_str(), 1);
+      }
+    }
+
+    ~TemporaryCacheHome() {
+      std::error_code error;
+      std::filesystem::remove_all(this->directory_, error);
+    }
+
+private:
+    std::filesystem::path directory_;
+  };
+  const TemporaryCacheHome g_cache_home;
 }  // namespace
 
 TEST_CASE("Process::Launch success", "[process]") {
@@ -153,6 +189,19 @@ TEST_CASE("Process::Resume success", "[process]") {
   }
 }
 
+TEST_CASE("Processes are followed into another process group", "[process]") {
+  const auto proc = sdb::Process::Launch("targets/change_pgid");
+  proc->Resume();
+  auto reason = proc->WaitOnSignal();
+  REQUIRE(reason.reason == sdb::ProcessState::Stopped);
+  REQUIRE(reason.info == SIGTRAP);
+  REQUIRE(getpgid(proc->GetPid()) != proc->GetPid());
+
+  proc->Resume();
+  reason = proc->WaitOnSignal();
+  REQUIRE(reason.reason == sdb::ProcessState::Exited);
+}
+
 TEST_CASE("Process::Resume already terminated", "[process]") {
   // launch the process
   const auto proc = sdb::Process::Launch("targets/end_immediately");
@@ -267,6 +316,42 @@ TEST_CASE("Read register works", "[register]") {
   REQUIRE(regs.ReadByIdAs<long double>(sdb::RegisterID::st0) == 64.125L);
 }
 
+TEST_CASE("Register writes are batched", "[register]") {
+  const auto proc = sdb::Process::Launch("targets/reg_read");
+  auto      &regs = proc->GetRegisters();
+
+  proc->Resume();
+  proc->WaitOnSignal();
+
+  const auto r13 = regs.ReadByIdAs<std::uint64_t>(sdb::RegisterID::r13);
+
+  // a discarded write is forgotten without touching the inferior
+  regs.WriteById(sdb::RegisterID::r13, std::uint64_t{42});
+  regs.Discard();
+  REQUIRE(regs.ReadByIdAs<std::uint64_t>(sdb::RegisterID::r13) == r13);
+  REQUIRE(regs.GetTotalStats().writes == 0);
+
+  // several GPR writes cost a single PTRACE_SETREGS, FPR writes a single
+  // PTRACE_SETFPREGS and debug registers one PTRACE_POKEUSER each
+  regs.WriteById(sdb::RegisterID::r12, std::uint64_t{1});
+  regs.WriteById(sdb::RegisterID::r13, std::uint64_t{2});
+  regs.WriteById(sdb::RegisterID::r14, std::uint64_t{3});
+  regs.WriteById(sdb::RegisterID::xmm1, 1.0);
+  regs.WriteById(sdb::RegisterID::xmm2, 2.0);
+  regs.WriteById(sdb::RegisterID::dr0, std::uint64_t{0});
+  regs.WriteById(sdb::RegisterID::dr0, std::uint64_t{0});
+  regs.Flush();
+
+  const auto &stats = regs.GetLastBatchStats();
+  REQUIRE(stats.writes == 7);
+  REQUIRE(stats.syscalls == 3);
+  REQUIRE(stats.Saved() == 4);
+
+  // the flushed values are what the inferior sees
+  REQUIRE(ptrace(PTRACE_PEEKUSER, proc->GetPid(),
+                 offsetof(user, regs.r13), nullptr) == 2);
+}
+
 TEST_CASE("Can create breakpoint site", "[breakpoint]") {
   // verify that we can create a breakpoint site at a given address
   // and that the registered address is the same as the one we provided
@@ -338,6 +423,11 @@ TEST_CASE("Cannot find non-existing breakpoint sites", "[breakpoint]") {
       cproc->GetBreakpointSites().GetByAddress(sdb::VirtualAddress{44}),
       sdb::Error);
   REQUIRE_THROWS_AS(cproc->GetBreakpointSites().GetById(44), sdb::Error);
+
+  // the Find* accessors report a missing site instead of throwing
+  REQUIRE(proc->GetBreakpointSites().FindById(44) == nullptr);
+  REQUIRE(cproc->GetBreakpointSites().FindByAddress(sdb::VirtualAddress{44}) ==
+          nullptr);
 }
 
 TEST_CASE("Breakpoint list size and emptiness", "[breakpoint]") {
@@ -380,6 +470,38 @@ TEST_CASE("Can iterate breakpoint sizes", "[breakpoint]") {
       { REQUIRE(site.Address().GetAddress() == addr++); });
 }
 
+TEST_CASE("Breakpoint sites are found by address in any order",
+          "[breakpoint]") {
+  const auto proc  = sdb::Process::Launch("targets/run_endlessly");
+  auto      &sites = proc->GetBreakpointSites();
+
+  for (const auto addr : {45, 42, 47, 43, 46, 44}) {
+    proc->CreateBreakpointSite(sdb::VirtualAddress(addr));
+  }
+
+  for (std::uint64_t addr = 42; addr <= 47; ++addr) {
+    REQUIRE(sites.FindByAddress(sdb::VirtualAddress{addr})->Address() ==
+            sdb::VirtualAddress{addr});
+  }
+
+  // GetInRegion returns [low, high) ordered by address
+  const auto region =
+      sites.GetInRegion(sdb::VirtualAddress{43}, sdb::VirtualAddress{46});
+  REQUIRE(region.size() == 3);
+  REQUIRE(region[0]->Address().GetAddress() == 43);
+  REQUIRE(region[2]->Address().GetAddress() == 45);
+
+  sites.RemoveByAddress(sdb::VirtualAddress{44});
+  REQUIRE(sites.FindByAddress(sdb::VirtualAddress{44}) == nullptr);
+  REQUIRE(sites.GetInRegion(sdb::VirtualAddress{43}, sdb::VirtualAddress{46})
+              .size() == 2);
+
+  // sites created after a removal are still found
+  proc->CreateBreakpointSite(sdb::VirtualAddress{41});
+  REQUIRE(sites.FindByAddress(sdb::VirtualAddress{41}) != nullptr);
+  REQUIRE(sites.FindByAddress(sdb::VirtualAddress{45}) != nullptr);
+}
+
 TEST_CASE("Breakpoint on address works", "[breakpoint]") {
   bool      close_on_exec = false;
   sdb::Pipe channel(close_on_exec);
@@ -412,6 +534,284 @@ TEST_CASE("Breakpoint on address works", "[breakpoint]") {
   REQUIRE(sdb::ToStringView(data) == "Hello, sdb!\n");
 }
 
+TEST_CASE("Breakpoint sites can be enabled in bulk", "[breakpoint]") {
+  bool      close_on_exec = false;
+  sdb::Pipe channel(close_on_exec);
+
+  const std::filesystem::path target_path = "targets/hello_sdb";
+
+  auto proc = sdb::Process::Launch(target_path, true, channel.GetWriteFd());
+  channel.CloseWriteFd();
+
+  const auto offset       = GetEntryPointOffset(target_path);
+  const auto load_address = GetLoadAddress(proc->GetPid(), offset);
+
+  const auto original = proc->ReadMemory(load_address, 8);
+
+  std::vector<sdb::BreakpointSite *> sites;
+  for (const auto i : {5, 0, 2}) {
+    sites.push_back(&proc->CreateBreakpointSite(load_address + i));
+  }
+  proc->EnableBreakpointSites(sdb::Span<sdb::BreakpointSite *const>(sites));
+
+  const auto patched = proc->ReadMemory(load_address, 8);
+  for (std::size_t i = 0; i < patched.size(); ++i) {
+    const bool has_site = i == 0 or i == 2 or i == 5;
+    REQUIRE(patched[i] == (has_site ? std::byte{0xcc} : original[i]));
+  }
+  REQUIRE(proc->ReadMemoryWithoutTraps(load_address, 8) == original);
+
+  proc->DisableBreakpointSites(sdb::Span<sdb::BreakpointSite *const>(sites));
+  REQUIRE(proc->ReadMemory(load_address, 8) == original);
+  for (const auto site : sites) {
+    REQUIRE(!site->IsEnabled());
+  }
+
+  proc->Resume();
+  const auto reason = proc->WaitOnSignal();
+  REQUIRE(reason.reason == sdb::ProcessState::Exited);
+  REQUIRE(sdb::ToStringView(channel.Read()) == "Hello, sdb!\n");
+}
+
+TEST_CASE("Breakpoints are hit by every thread", "[breakpoint][thread]") {
+  // software and hardware breakpoints, as the latter use per-thread registers
+  for (const auto hardware : {false, true}) {
+    constexpr bool close_on_exec = false;
+    sdb::Pipe      channel(close_on_exec);
+    const auto     proc = sdb::Process::Launch("targets/multi_threaded", true,
+                                               channel.GetWriteFd());
+    channel.CloseWriteFd();
+
+    proc->Resume();
+    proc->WaitOnSignal();
+
+    const auto function = sdb::VirtualAddress{
+        sdb::FromBytes<std::uint64_t>(channel.Read().data())};
+    proc->CreateBreakpointSite(function, hardware).Enable();
+
+    std::set<pid_t> threads_hit;
+    proc->Resume();
+    for (auto reason = proc->WaitOnSignal();
+         reason.reason == sdb::ProcessState::Stopped;
+         reason = proc->WaitOnSignal()) {
+      REQUIRE(reason.info == SIGTRAP);
+      REQUIRE(reason.tid != proc->GetPid());
+      REQUIRE(reason.tid == proc->GetCurrentThread());
+      REQUIRE(proc->GetPc() == function);
+      threads_hit.insert(reason.tid);
+
+      // the whole process is stopped
+      for (const auto &[tid, thread] : proc->GetThreads()) {
+        REQUIRE(thread.state == sdb::ProcessState::Stopped);
+      }
+      proc->Resume();
+    }
+
+    REQUIRE(threads_hit.size() == 8);
+    REQUIRE(proc->GetThreads().size() == 1);
+  }
+}
+
+TEST_CASE("Breakpoint conditions are compiled", "[breakpoint]") {
+  const auto proc = sdb::Process::Launch("targets/hello_sdb");
+  const auto eval = [&](const std::string_view text)
+  {
+    return sdb::BreakpointCondition::Compile(text).Evaluate(*proc,
+                                                            proc->GetPid());
+  };
+
+  REQUIRE(eval("1 + 2 * 3 == 7"));
+  REQUIRE(eval("(1 + 2) * 3 == 9"));
+  REQUIRE(eval("0x10 - 1 == 15 && !0"));
+  REQUIRE(eval("-1 > 0"));  // everything is unsigned
+  REQUIRE(eval("0 || 2 & 3"));
+  REQUIRE_FALSE(eval("1 < 1 || 2 <= 1"));
+  REQUIRE(eval("(rax & 0) == 0"));
+  REQUIRE(eval("rip != 0 && *rsp == *rsp"));
+
+  for (const auto invalid :
+       {"", "rax ==", "(1", "1 $ 2", "foo == 1", "xmm0 == 1", "12ab"}) {
+    REQUIRE_THROWS_AS(sdb::BreakpointCondition::Compile(invalid), sdb::Error);
+  }
+}
+
+TEST_CASE("Breakpoint conditions and ignore counts are checked on every hit",
+          "[breakpoint]") {
+  // `rip <compare> <function address> <rest>`
+  const auto count_stops = [](const std::string  &compare,
+                              const std::string  &rest,
+                              const std::uint64_t ignore_count)
+  {
+    constexpr bool close_on_exec = false;
+    sdb::Pipe      channel(close_on_exec);
+    const auto     proc = sdb::Process::Launch("targets/multi_threaded", true,
+                                               channel.GetWriteFd());
+    channel.CloseWriteFd();
+
+    proc->Resume();
+    proc->WaitOnSignal();
+
+    const auto function = sdb::FromBytes<std::uint64_t>(channel.Read().data());
+    auto &site = proc->CreateBreakpointSite(sdb::VirtualAddress{function});
+    site.SetCondition(sdb::BreakpointCondition::Compile(
+        "rip " + compare + " " + std::to_string(function) + rest));
+    site.SetIgnoreCount(ignore_count);
+    site.Enable();
+
+    // hits that aren't reported never make it back here
+    std::uint64_t n_stops = 0;
+    proc->Resume();
+    while (proc->WaitOnSignal().reason == sdb::ProcessState::Stopped) {
+      REQUIRE(proc->GetPc().GetAddress() == function);
+      ++n_stops;
+      proc->Resume();
+    }
+    return std::pair{n_stops, site.GetHitCount()};
+  };
+
+  // every one of the 8 threads calls the function once
+  REQUIRE(count_stops("==", " && *rsp != 0", 0) == std::pair{8ul, 8ul});
+  REQUIRE(count_stops("!=", "", 0) == std::pair{0ul, 0ul});
+  REQUIRE(count_stops("==", "", 5) == std::pair{3ul, 8ul});
+}
+
+TEST_CASE("Breakpoint conditions that can't be evaluated stop",
+          "[breakpoint]") {
+  const auto target_path = "targets/hello_sdb";
+  const auto proc        = sdb::Process::Launch(target_path);
+
+  const auto load_address =
+      GetLoadAddress(proc->GetPid(), GetEntryPointOffset(target_path));
+  auto &site = proc->CreateBreakpointSite(load_address);
+  // nothing is ever mapped at address 0
+  site.SetCondition(sdb::BreakpointCondition::Compile("*0 == 1"));
+  site.SetIgnoreCount(1);
+  site.Enable();
+
+  proc->Resume();
+  const auto reason = proc->WaitOnSignal();
+
+  REQUIRE(reason.reason == sdb::ProcessState::Stopped);
+  REQUIRE(proc->GetPc() == load_address);
+  REQUIRE(site.GetConditionError().has_value());
+  REQUIRE(site.GetHitCount() == 1);
+  REQUIRE(site.GetIgnoreCount() == 1);
+}
+
+TEST_CASE("Faults stepping over unreported breakpoint hits are reported",
+          "[breakpoint]") {
+  const auto target_path = "targets/hello_sdb";
+  const auto proc        = sdb::Process::Launch(target_path);
+
+  // mov eax, [0]
+  const auto load_address =
+      GetLoadAddress(proc->GetPid(), GetEntryPointOffset(target_path));
+  const std::vector<std::byte> fault = {
+      std::byte{0x8b}, std::byte{0x04}, std::byte{0x25}, std::byte{0x00},
+      std::byte{0x00}, std::byte{0x00}, std::byte{0x00}};
+  proc->WriteMemory(load_address, {fault.data(), fault.size()});
+
+  auto &site = proc->CreateBreakpointSite(load_address);
+  site.SetCondition(sdb::BreakpointCondition::Compile("rip == 0"));
+  site.Enable();
+
+  proc->Resume();
+  const auto reason = proc->WaitOnSignal();
+
+  REQUIRE(reason.reason == sdb::ProcessState::Stopped);
+  REQUIRE(reason.info == SIGSEGV);
+  REQUIRE(proc->GetPc() == load_address);
+  REQUIRE(site.GetHitCount() == 0);
+}
+
+TEST_CASE("Stepping over breakpoints leaves them in place", "[breakpoint]") {
+  // the PCs stepped through with a breakpoint on every instruction, stepping
+  // over them either by running a copy of the instruction or by lifting them
+  const auto step = [](const bool displaced)
+  {
+    constexpr bool close_on_exec = false;
+    sdb::Pipe      channel(close_on_exec);
+    const auto     proc = sdb::Process::Launch("targets/multi_threaded", true,
+                                               channel.GetWriteFd());
+    channel.CloseWriteFd();
+    proc->SetDisplacedSteppingEnabled(displaced);
+    proc->Resume();
+    proc->WaitOnSignal();
+
+    std::vector<std::uint64_t> pcs;
+    for (int i = 0; i < 100; ++i) {
+      const auto pc = proc->GetPc();
+      if (!proc->GetBreakpointSites().ContainsAddress(pc)) {
+        proc->CreateBreakpointSite(pc).Enable();
+      }
+      proc->StepInstruction();
+      REQUIRE(proc->ReadMemory(pc, 1)[0] == std::byte{0xcc});
+      pcs.push_back(proc->GetPc().GetAddress());
+    }
+    return pcs;
+  };
+
+  REQUIRE(step(true) == step(false));
+}
+
+TEST_CASE("Syscalls can be injected", "[syscall]") {
+  const auto proc = sdb::Process::Launch("targets/run_endlessly");
+  const auto pc   = proc->GetPc();
+  const auto code = proc->ReadMemory(pc, 2);
+
+  REQUIRE(proc->InjectSyscall(SYS_getpid) == proc->GetPid());
+  REQUIRE(proc->InjectSyscall(SYS_close, {12345}) == -EBADF);
+
+  // the thread carries on where it was, running what it was going to
+  REQUIRE(proc->GetPc() == pc);
+  REQUIRE(proc->ReadMemory(pc, 2) == code);
+}
+
+TEST_CASE("Tracepoints record hits without stopping", "[tracepoint]") {
+  constexpr bool close_on_exec = false;
+  sdb::Pipe      channel(close_on_exec);
+  const auto     proc = sdb::Process::Launch("targets/multi_threaded", true,
+                                             channel.GetWriteFd());
+  channel.CloseWriteFd();
+
+  proc->Resume();
+  proc->WaitOnSignal();
+
+  const auto function = sdb::FromBytes<std::uint64_t>(channel.Read().data());
+  const auto address  = sdb::VirtualAddress{function};
+  const auto original = proc->ReadMemory(address, 8);
+
+  auto &tracepoint = proc->CreateTracepoint(address);
+  tracepoint.Enable();
+  REQUIRE(proc->ReadMemory(address, 1)[0] == std::byte{0xe9});
+  REQUIRE(proc->ReadMemoryWithoutTraps(address, 8) == original);
+  REQUIRE_THROWS_AS(proc->CreateBreakpointSite(address + 1), sdb::Error);
+
+  // SayHi is push rbp; mov rbp, rsp; nop; pop rbp; ret, so a jump on its pop
+  // would displace main's first instruction too
+  REQUIRE_THROWS_AS(proc->CreateTracepoint(address + 1), sdb::Error);
+  REQUIRE_THROWS_AS(proc->CreateTracepoint(address + 5), sdb::Error);
+
+  // neither used up a trampoline (Tracepoint::trampoline_size apart)
+  auto &next = proc->CreateTracepoint(address + 7);
+  REQUIRE(next.TrampolineAddress() == tracepoint.TrampolineAddress() + 0x140);
+
+  // every one of the 8 threads calls the function once, and nothing stops
+  proc->Resume();
+  REQUIRE(proc->WaitOnSignal().reason == sdb::ProcessState::Exited);
+
+  const auto hits = proc->ReadTracepointHits();
+  REQUIRE(hits.size() == 8);
+  for (const auto &hit : hits) {
+    REQUIRE(hit.address == function);
+    // as it is just after a call
+    REQUIRE(hit.rsp % 16 == 8);
+  }
+  REQUIRE(tracepoint.GetHitCount() == 8);
+  REQUIRE(proc->DroppedTracepointHits() == 0);
+  REQUIRE(proc->ReadTracepointHits().empty());
+}
+
 TEST_CASE("Can remove breakpoint sites", "[breakpoint]") {
   const auto  proc = sdb::Process::Launch("targets/run_endlessly");
   const auto &site = proc->CreateBreakpointSite(sdb::VirtualAddress{42});
@@ -460,6 +860,112 @@ TEST_CASE("Reading and writing memory works", "[memory]") {
   REQUIRE(sdb::ToStringView(read) == "Hello, sdb!");
 }
 
+TEST_CASE("Memory cache is coherent", "[memory]") {
+  constexpr bool close_on_exec = false;
+  sdb::Pipe      channel(close_on_exec);
+  const auto     proc =
+      sdb::Process::Launch("targets/memory", true, channel.GetWriteFd());
+  channel.CloseWriteFd();
+  proc->SetMemoryCacheEnabled(true);
+
+  proc->Resume();
+  proc->WaitOnSignal();
+
+  const auto a_pointer =
+      sdb::VirtualAddress{sdb::FromBytes<std::uint64_t>(channel.Read().data())};
+  REQUIRE(proc->ReadMemoryAs<std::uint64_t>(a_pointer) == 0xcafecafe);
+
+  // writes through the debugger are reflected in cached pages
+  proc->WriteMemory(a_pointer, {sdb::AsBytes(std::uint64_t{0xba5eba11}), 8});
+  REQUIRE(proc->ReadMemoryAs<std::uint64_t>(a_pointer) == 0xba5eba11);
+
+  // as are breakpoint sites
+  auto &site = proc->CreateBreakpointSite(a_pointer);
+  site.Enable();
+  REQUIRE(proc->ReadMemoryAs<std::uint8_t>(a_pointer) == 0xcc);
+  REQUIRE(proc->ReadMemoryWithoutTraps(a_pointer, 1)[0] == std::byte{0x11});
+  site.Disable();
+  REQUIRE(proc->ReadMemoryAs<std::uint8_t>(a_pointer) == 0x11);
+
+  // writes behind the cache's back aren't seen until the process runs again
+  ptrace(PTRACE_POKEDATA, proc->GetPid(), a_pointer.GetAddress(), 0x1234);
+  REQUIRE(proc->ReadMemoryAs<std::uint64_t>(a_pointer) == 0xba5eba11);
+
+  proc->Resume();
+  proc->WaitOnSignal();
+  REQUIRE(proc->ReadMemoryAs<std::uint64_t>(a_pointer) == 0x1234);
+}
+
+TEST_CASE("Writing read-only memory works", "[memory]") {
+  const std::filesystem::path target_path = "targets/hello_sdb";
+  const auto                  proc        = sdb::Process::Launch(target_path);
+
+  const auto offset       = GetEntryPointOffset(target_path);
+  const auto load_address = GetLoadAddress(proc->GetPid(), offset);
+
+  // the entry point lives in .text, which the inferior can't write to itself,
+  // so this write can't be served by process_vm_writev
+  std::vector<std::byte> nops(5000, std::byte{0x90});
+  proc->WriteMemory(load_address, {nops.data(), nops.size()});
+
+  const auto read = proc->ReadMemory(load_address, nops.size());
+  REQUIRE(read == nops);
+}
+
+TEST_CASE("Target reads code the process rewrote from the process",
+          "[target]") {
+  constexpr bool close_on_exec = false;
+  sdb::Pipe      channel(close_on_exec);
+  const auto     target =
+      sdb::Target::Launch("targets/self_modifying", channel.GetWriteFd());
+  channel.CloseWriteFd();
+  auto &proc = target->GetProcess();
+
+  proc.Resume();
+  proc.WaitOnSignal();
+
+  // the function's first byte is a ret in memory, though not in the file
+  const auto address = sdb::VirtualAddress{
+      sdb::FromBytes<std::uint64_t>(channel.Read().data())};
+  REQUIRE(target->ReadMemory(address, 1)[0] == std::byte{0xc3});
+  REQUIRE(target->ReadMemory(address, 64) == proc.ReadMemory(address, 64));
+}
+
+TEST_CASE("Target reads read-only memory from the ELF file", "[target]") {
+  const auto target = sdb::Target::Launch("targets/hello_sdb");
+  auto      &proc   = target->GetProcess();
+  auto      &elf    = target->GetElf();
+
+  const auto load_bias = elf.GetLoadBias();
+  const auto entry     = load_bias + elf.GetHeader().e_entry;
+
+  // spans the read-only, executable and writable segments
+  REQUIRE(target->ReadMemory(load_bias, 0x4000) ==
+          proc.ReadMemory(load_bias, 0x4000));
+
+  auto &site = proc.CreateBreakpointSite(entry);
+  site.Enable();
+  REQUIRE(target->ReadMemory(entry, 1)[0] == std::byte{0xcc});
+  REQUIRE(target->ReadMemory(entry, 64) == proc.ReadMemory(entry, 64));
+  REQUIRE(target->ReadMemoryWithoutTraps(entry, 64) ==
+          proc.ReadMemoryWithoutTraps(entry, 64));
+  proc.GetBreakpointSites().RemoveById(site.GetId());
+
+  // as are the jumps of enabled tracepoints, read from part way through
+  auto &tracepoint = proc.CreateTracepoint(entry);
+  tracepoint.Enable();
+  REQUIRE(target->ReadMemory(entry, 1)[0] == std::byte{0xe9});
+  REQUIRE(target->ReadMemory(entry + 2, 64) == proc.ReadMemory(entry + 2, 64));
+  REQUIRE(target->ReadMemoryWithoutTraps(entry, 64) ==
+          proc.ReadMemoryWithoutTraps(entry, 64));
+  tracepoint.Disable();
+
+  // once the debugger writes to .text, it's read from the live process
+  std::vector<std::byte> nops(16, std::byte{0x90});
+  proc.WriteMemory(entry, {nops.data(), nops.size()});
+  REQUIRE(target->ReadMemory(entry, nops.size()) == nops);
+}
+
 TEST_CASE("Hardware breakpoint evades memory checksums", "[breakpoint]") {
   constexpr bool close_on_exec = false;
   sdb::Pipe      channel(close_on_exec);
@@ -540,6 +1046,79 @@ TEST_CASE("Watchpoint detects read", "[watchpoint]") {
           "Putting pineapple on pizza...\n");
 }
 
+TEST_CASE("Watch slots cover ranges exactly", "[watchpoint]") {
+  const auto plan = [](const std::uint64_t address, const std::size_t size,
+                       const sdb::StoppointMode mode)
+  {
+    std::vector<std::pair<std::uint64_t, std::size_t>> slots;
+    for (const auto &slot :
+         sdb::PlanWatchSlots(sdb::VirtualAddress{address}, size, mode)) {
+      slots.emplace_back(slot.address.GetAddress(), slot.size);
+    }
+    return slots;
+  };
+  using Slots = std::vector<std::pair<std::uint64_t, std::size_t>>;
+
+  REQUIRE(plan(0x1000, 8, sdb::StoppointMode::write) == Slots{{0x1000, 8}});
+  REQUIRE(plan(0x1004, 16, sdb::StoppointMode::write) ==
+          Slots{{0x1004, 4}, {0x1008, 8}, {0x1010, 4}});
+  REQUIRE(plan(0x1000, 32, sdb::StoppointMode::read_write).size() == 4);
+  REQUIRE(plan(0x1001, 7, sdb::StoppointMode::write) ==
+          Slots{{0x1001, 1}, {0x1002, 2}, {0x1004, 4}});
+  REQUIRE(plan(0x1000, 3, sdb::StoppointMode::execute) ==
+          Slots{{0x1000, 1}, {0x1001, 1}, {0x1002, 1}});
+}
+
+TEST_CASE("Hardware watchpoints spread over debug registers",
+          "[watchpoint]") {
+  bool      close_on_exec = false;
+  sdb::Pipe channel(close_on_exec);
+  auto      proc = sdb::Process::Launch("targets/watched_buffer", true,
+                                        channel.GetWriteFd());
+  channel.CloseWriteFd();
+
+  proc->Resume();
+  proc->WaitOnSignal();
+  const auto buffer = sdb::FromBytes<std::uint64_t>(channel.Read().data());
+
+  // too big, or too unaligned for four registers
+  REQUIRE_THROWS_AS(proc->CreateWatchpoint(sdb::VirtualAddress{buffer},
+                                           sdb::StoppointMode::write, 40),
+                    sdb::Error);
+  REQUIRE_THROWS_AS(proc->CreateWatchpoint(sdb::VirtualAddress{buffer + 1},
+                                           sdb::StoppointMode::write, 32),
+                    sdb::Error);
+
+  // 16 unaligned bytes take three registers, and the write to the middle
+  // one is the watchpoint's
+  auto &field = proc->CreateWatchpoint(sdb::VirtualAddress{buffer + 196},
+                                       sdb::StoppointMode::write, 16);
+  field.Enable();
+  auto &other = proc->CreateWatchpoint(sdb::VirtualAddress{buffer + 4096},
+                                       sdb::StoppointMode::write, 8);
+  other.Enable();
+
+  proc->Resume();
+  const auto reason = proc->WaitOnSignal();
+  REQUIRE(reason.trap_reason == sdb::TrapType::HardwareBreakpoint);
+  const auto id = proc->GetCurrentHardwareStoppoint();
+  REQUIRE(id.index() == 1);
+  REQUIRE(std::get<1>(id) == field.GetId());
+  REQUIRE(field.PreviousContents() == std::vector<std::byte>(16));
+  REQUIRE(field.Contents()[4] == std::byte{1});
+  REQUIRE(field.Data() == std::uint64_t{1} << 32);
+
+  // the registers can all be freed and taken again
+  field.Disable();
+  auto &wide = proc->CreateWatchpoint(sdb::VirtualAddress{buffer + 4992},
+                                      sdb::StoppointMode::write, 24);
+  wide.Enable();
+  proc->Resume();
+  proc->WaitOnSignal();
+  REQUIRE(std::get<1>(proc->GetCurrentHardwareStoppoint()) == wide.GetId());
+  REQUIRE(wide.Contents()[8] == std::byte{2});
+}
+
 // Verify that the syscall mapping functions for both conversions
 TEST_CASE("Syscall mapping works", "[syscall]") {
   REQUIRE(sdb::SyscallIdToName(0) == "read");
@@ -580,6 +1159,568 @@ TEST_CASE("Syscall catchpoint work", "[syscall]") {
   close(dev_null);
 }
 
+TEST_CASE("Syscall catchpoints work with a seccomp filter", "[syscall]") {
+  auto       dev_null      = open("/dev/null", O_WRONLY);
+  const auto write_syscall = sdb::SyscallNameToId("write");
+  const auto proc          = sdb::Process::Launch(
+      "targets/anti_debugger", true, dev_null,
+      sdb::SyscallCatchPolicy::CatchSome({write_syscall}));
+  REQUIRE(proc->CatchesSyscallsWithSeccomp());
+
+  for (const auto entry : {true, false}) {
+    proc->Resume();
+    const auto reason = proc->WaitOnSignal();
+
+    REQUIRE(reason.reason == sdb::ProcessState::Stopped);
+    REQUIRE(reason.trap_reason == sdb::TrapType::Syscall);
+    REQUIRE(reason.syscall_info->id == write_syscall);
+    REQUIRE(reason.syscall_info->entry == entry);
+  }
+
+  // the filter can't catch anything it wasn't built for
+  proc->SetSyscallCatchPolicy(sdb::SyscallCatchPolicy::CatchSome(
+      {write_syscall, sdb::SyscallNameToId("getpid")}));
+  REQUIRE_FALSE(proc->CatchesSyscallsWithSeccomp());
+  proc->SetSyscallCatchPolicy(sdb::SyscallCatchPolicy::CatchNone());
+  REQUIRE_FALSE(proc->CatchesSyscallsWithSeccomp());
+
+  close(dev_null);
+}
+
+TEST_CASE("Forks of a process with a seccomp filter can make its syscalls",
+          "[syscall]") {
+  constexpr bool close_on_exec = false;
+  sdb::Pipe      channel(close_on_exec);
+  const auto     write_syscall = sdb::SyscallNameToId("write");
+  const auto     proc          = sdb::Process::Launch(
+      "targets/fork_write", true, channel.GetWriteFd(),
+      sdb::SyscallCatchPolicy::CatchSome({write_syscall}));
+  channel.CloseWriteFd();
+  REQUIRE(proc->CatchesSyscallsWithSeccomp());
+
+  // only the parent's write is caught (along with the SIGCHLD from the
+  // child), and the child's isn't failed
+  int n_stops = 0;
+  proc->Resume();
+  auto reason = proc->WaitOnSignal();
+  while (reason.reason == sdb::ProcessState::Stopped) {
+    if (reason.trap_reason == sdb::TrapType::Syscall) {
+      REQUIRE(reason.syscall_info->id == write_syscall);
+      ++n_stops;
+    } else {
+      REQUIRE(reason.info == SIGCHLD);
+    }
+    proc->Resume();
+    reason = proc->WaitOnSignal();
+  }
+  REQUIRE(n_stops == 2);
+  REQUIRE(reason.reason == sdb::ProcessState::Exited);
+  REQUIRE(reason.info == 0);
+  REQUIRE(sdb::ToStringView(channel.Read()) == "child\nparent\n");
+}
+
+TEST_CASE("Syscalls are traced to a log", "[syscall]") {
+  auto       dev_null      = open("/dev/null", O_WRONLY);
+  const auto write_syscall = sdb::SyscallNameToId("write");
+  const auto proc          = sdb::Process::Launch(
+      "targets/anti_debugger", true, dev_null,
+      sdb::SyscallCatchPolicy::CatchSome({write_syscall}));
+
+  // the trace ends at the SIGTRAP the target raises after its write
+  const auto log    = sdb::SyscallTraceLog::CreateAnonymous(16);
+  const auto reason = sdb::TraceSyscalls(*proc, *log);
+  REQUIRE(reason.reason == sdb::ProcessState::Stopped);
+  REQUIRE(reason.info == SIGTRAP);
+
+  const auto records = log->Records();
+  REQUIRE(records.size() == 2);
+  REQUIRE(records[0].id == write_syscall);
+  REQUIRE(records[0].entry);
+  REQUIRE(records[0].args[0] == STDOUT_FILENO);
+  REQUIRE(records[0].args[2] == sizeof(void *));
+  REQUIRE(records[1].id == write_syscall);
+  REQUIRE_FALSE(records[1].entry);
+  REQUIRE(records[1].args[0] == sizeof(void *));
+  REQUIRE(records[1].tid == proc->GetPid());
+  REQUIRE(records[0].timestamp_ns <= records[1].timestamp_ns);
+
+  close(dev_null);
+}
+
+TEST_CASE("Syscall traces hand signals back to the process", "[syscall]") {
+  constexpr bool close_on_exec = false;
+  sdb::Pipe      channel(close_on_exec);
+  const auto     proc = sdb::Process::Launch(
+      "targets/signals", true, channel.GetWriteFd(),
+      sdb::SyscallCatchPolicy::CatchSome({sdb::SyscallNameToId("write")}));
+  channel.CloseWriteFd();
+
+  // SIGUSR1 reaches the handler, then SIGSEGV ends the process
+  const auto log    = sdb::SyscallTraceLog::CreateAnonymous(16);
+  auto       reason = sdb::TraceSyscalls(*proc, *log);
+  while (reason.reason == sdb::ProcessState::Stopped) {
+    const auto signal = reason.info == SIGTRAP ? 0 : reason.info;
+    reason            = sdb::TraceSyscalls(*proc, *log, signal);
+  }
+  REQUIRE(reason.reason == sdb::ProcessState::Terminated);
+  REQUIRE(reason.info == SIGSEGV);
+  REQUIRE(sdb::ToStringView(channel.Read()) == "caught\n");
+}
+
+TEST_CASE("Syscall trace logs keep the newest records", "[syscall]") {
+  const auto path = std::filesystem::temp_directory_path() / "sdb_trace.log";
+
+  {
+    const auto         log = sdb::SyscallTraceLog::Create(path, 3);
+    sdb::SyscallRecord record{};
+    for (std::uint16_t id = 0; id < 5; ++id) {
+      record.id = id;
+      log->Append(record);
+    }
+  }
+
+  // read back from the file
+  const auto log = sdb::SyscallTraceLog::Open(path);
+  REQUIRE(log->Capacity() == 3);
+  REQUIRE(log->TotalRecords() == 5);
+  REQUIRE(log->DroppedRecords() == 2);
+
+  const auto records = log->Records();
+  REQUIRE(records.size() == 3);
+  REQUIRE(records[0].id == 2);
+  REQUIRE(records[1].id == 3);
+  REQUIRE(records[2].id == 4);
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Instruction traces record every step", "[trace]") {
+  const auto path = std::filesystem::temp_directory_path() / "sdb_steps.trace";
+  auto       dev_null = open("/dev/null", O_WRONLY);
+
+  // records hello_sdb from the start of main, with a breakpoint at `stop_at`
+  const auto record = [&](const sdb::InstructionTraceOptions  &options,
+                          const std::optional<sdb::VirtualAddress> stop_at)
+  {
+    const auto target = sdb::Target::Launch("targets/hello_sdb", dev_null);
+    auto      &proc   = target->GetProcess();
+    auto      &elf    = target->GetElf();
+
+    const auto main =
+        elf.GetLoadBias() + elf.GetSymbolsByName("main").at(0)->st_value;
+    proc.CreateBreakpointSite(main).Enable();
+    proc.Resume();
+    proc.WaitOnSignal();
+    REQUIRE(proc.GetPc() == main);
+    if (stop_at) {
+      proc.CreateBreakpointSite(*stop_at).Enable();
+    }
+
+    const auto writer = sdb::InstructionTraceWriter::Create(
+        path, options.granularity, elf.GetPath(), elf.GetLoadBias());
+    const auto result = sdb::RecordInstructionTrace(proc, *writer, options);
+    REQUIRE(writer->StepCount() == result.steps + 1);
+    return std::pair{result, proc.GetRegisters().GetGprs()};
+  };
+
+  const auto [counted, regs] = record({sdb::StepMode::Instruction, {}, 64}, {});
+  REQUIRE(counted.end == sdb::InstructionTraceResult::End::Count);
+  REQUIRE(counted.steps == 64);
+
+  const auto  trace = sdb::InstructionTrace::Open(path);
+  const auto &steps = trace->Steps();
+  REQUIRE(trace->Granularity() == sdb::StepMode::Instruction);
+  REQUIRE(trace->Program().filename() == "hello_sdb");
+  REQUIRE(steps.size() == 65);
+
+  // the deltas add up to where the thread ended up
+  REQUIRE(std::memcmp(&steps.back().regs, &regs, sizeof(regs)) == 0);
+  for (const auto &step : steps) {
+    REQUIRE(step.regs.rip == step.pc.GetAddress());
+  }
+
+  sdb::Elf elf(trace->Program());
+  elf.NotifyLoaded(trace->LoadBias());
+  REQUIRE(sdb::SymbolizeAddress(elf, steps[0].pc) == "main");
+  REQUIRE(sdb::SymbolizeAddress(elf, steps[1].pc)->rfind("main+0x", 0) == 0);
+
+  // the same run, cut short where it first gets to a later PC
+  const auto later = steps[40].pc;
+  const auto first_visit =
+      std::find_if(steps.begin() + 1, steps.end(),
+                   [&](const auto &step) { return step.pc == later; }) -
+      steps.begin();
+
+  const auto until = record({sdb::StepMode::Instruction, later, 64}, {}).first;
+  REQUIRE(until.end == sdb::InstructionTraceResult::End::Address);
+  REQUIRE(until.steps == static_cast<std::uint64_t>(first_visit));
+
+  const auto breakpoint =
+      record({sdb::StepMode::Instruction, {}, 64}, later).first;
+  REQUIRE(breakpoint.end == sdb::InstructionTraceResult::End::Breakpoint);
+  REQUIRE(breakpoint.steps == static_cast<std::uint64_t>(first_visit));
+
+  // stepping by block only records the PCs branches go to
+  const auto blocks = record({sdb::StepMode::Block, {}, 8}, {}).first;
+  REQUIRE(blocks.steps <= 8);
+  REQUIRE(sdb::InstructionTrace::Open(path)->Steps().size() ==
+          blocks.steps + 1);
+
+  std::filesystem::remove(path);
+  close(dev_null);
+}
+
+TEST_CASE("Profiles sample the stacks of a running process", "[profile]") {
+  const auto target  = sdb::Target::Launch("targets/run_endlessly");
+  auto      &process = target->GetProcess();
+  auto      &elf     = target->GetElf();
+
+  // libc and the dynamic loader don't keep frame pointers, so start once
+  // main has set up its frame (push %rbp; mov %rsp,%rbp)
+  const auto main =
+      elf.GetLoadBias() + elf.GetSymbolsByName("main").at(0)->st_value;
+  auto &site = process.CreateBreakpointSite(main);
+  site.Enable();
+  process.Resume();
+  process.WaitOnSignal();
+  site.Disable();
+  process.StepInstruction();
+  process.StepInstruction();
+  process.Resume();
+
+  const auto profile = sdb::RecordProfile(
+      process, {100, std::chrono::milliseconds(300), /*max_depth=*/64});
+  REQUIRE(process.state() == sdb::ProcessState::Stopped);
+  REQUIRE(profile.TickCount() > 1);
+  REQUIRE(profile.SampleCount() == profile.TickCount());  // one thread
+
+  // the program never leaves main, which was called from somewhere in libc
+  for (std::size_t i = 0; i < profile.SampleCount(); ++i) {
+    REQUIRE(profile.GetStack(i).Size() >= 2);
+  }
+  const auto folded = profile.Fold(elf);
+  REQUIRE(!folded.empty());
+  std::uint64_t n_samples = 0;
+  for (const auto &[stack, count] : folded) {
+    REQUIRE(stack.size() > 5);
+    REQUIRE(stack.substr(stack.size() - 5) == ";main");
+    n_samples += count;
+  }
+  REQUIRE(n_samples == profile.SampleCount());
+
+  // a range that can't be read doesn't stop the others being read
+  const auto                    pc = process.GetPc();
+  std::array<std::byte, 16>     first, second;
+  std::array<std::byte, 8>      unmapped;
+  std::vector<sdb::MemoryRange> ranges = {
+      {pc, {first.data(), first.size()}},
+      {sdb::VirtualAddress{0x10}, {unmapped.data(), unmapped.size()}},
+      {pc, {second.data(), second.size()}},
+  };
+  const auto n_read = process.ReadMemoryRanges({ranges.data(), ranges.size()});
+  REQUIRE(n_read == std::vector<std::size_t>{16, 0, 16});
+  REQUIRE(first == second);
+}
+
+TEST_CASE("Profiles hand signals back to the process", "[profile]") {
+  constexpr bool close_on_exec = false;
+  sdb::Pipe      channel(close_on_exec);
+  const auto     proc =
+      sdb::Process::Launch("targets/signals", true, channel.GetWriteFd());
+  channel.CloseWriteFd();
+  proc->Resume();
+
+  // SIGUSR1 reaches the handler, then SIGSEGV ends the process long before
+  // the profile would
+  sdb::RecordProfile(*proc, {100, std::chrono::seconds(3), /*max_depth=*/64});
+  REQUIRE(proc->state() == sdb::ProcessState::Terminated);
+  REQUIRE(sdb::ToStringView(channel.Read()) == "caught\n");
+}
+
+TEST_CASE("Restarting from a checkpoint reruns the process", "[checkpoint]") {
+  bool      close_on_exec = false;
+  sdb::Pipe channel(close_on_exec);
+
+  const std::filesystem::path target_path = "targets/hello_sdb";
+
+  auto proc = sdb::Process::Launch(target_path, true, channel.GetWriteFd());
+  channel.CloseWriteFd();
+
+  const auto offset       = GetEntryPointOffset(target_path);
+  const auto load_address = GetLoadAddress(proc->GetPid(), offset);
+  proc->CreateBreakpointSite(load_address).Enable();
+  proc->Resume();
+  proc->WaitOnSignal();
+
+  const auto original_pid = proc->GetPid();
+  const auto regs         = proc->GetRegisters().GetGprs();
+  const auto code         = proc->ReadMemory(load_address, 16);
+  const auto id           = proc->CreateCheckpoint();
+  REQUIRE(proc->GetCheckpoints().size() == 1);
+  // the process itself is left as it was
+  REQUIRE(proc->GetPid() == original_pid);
+  REQUIRE(proc->GetPc() == load_address);
+  REQUIRE(proc->ReadMemory(load_address, 16) == code);
+
+  // every restart runs on from the same point, with the breakpoint in place
+  for (int run = 0; run < 2; ++run) {
+    proc->Resume();
+    const auto reason = proc->WaitOnSignal();
+    REQUIRE(reason.reason == sdb::ProcessState::Exited);
+    REQUIRE(reason.info == 0);
+    REQUIRE(sdb::ToStringView(channel.Read()) == "Hello, sdb!\n");
+
+    const auto previous_pid = proc->GetPid();
+    proc->RestartFromCheckpoint(id);
+    REQUIRE(proc->GetPid() != previous_pid);
+    REQUIRE(proc->GetPid() != proc->GetCheckpoints().at(id));
+    REQUIRE(proc->state() == sdb::ProcessState::Stopped);
+    REQUIRE(proc->GetPc() == load_address);
+    REQUIRE(proc->ReadMemory(load_address, 16) == code);
+    const auto &restarted = proc->GetRegisters().GetGprs();
+    REQUIRE(restarted.rsp == regs.rsp);
+    REQUIRE(restarted.rax == regs.rax);
+    REQUIRE(restarted.rdx == regs.rdx);
+  }
+
+  // restarting doesn't have to wait for the process to end
+  proc->RestartFromCheckpoint(id);
+  proc->Resume();
+  REQUIRE(proc->WaitOnSignal().reason == sdb::ProcessState::Exited);
+  REQUIRE(sdb::ToStringView(channel.Read()) == "Hello, sdb!\n");
+
+  // sites enabled or disabled since a checkpoint was made are as they are now
+  // once it's restarted from. The last byte of main is its ret
+  sdb::Elf   elf(target_path);
+  const auto main_symbol = elf.GetSymbolsByName("main").at(0);
+  const auto main =
+      load_address + (main_symbol->st_value - elf.GetHeader().e_entry);
+  const auto ret = main + (main_symbol->st_size - 1);
+
+  proc->RestartFromCheckpoint(id);
+  auto &main_site = proc->CreateBreakpointSite(main);
+  auto &ret_site  = proc->CreateBreakpointSite(ret);
+  main_site.Enable();
+  const auto later = proc->CreateCheckpoint();
+  main_site.Disable();
+  ret_site.Enable();
+
+  proc->RestartFromCheckpoint(later);
+  proc->Resume();
+  REQUIRE(proc->WaitOnSignal().reason == sdb::ProcessState::Stopped);
+  REQUIRE(proc->GetPc() == ret);
+  proc->Resume();
+  REQUIRE(proc->WaitOnSignal().reason == sdb::ProcessState::Exited);
+  REQUIRE(sdb::ToStringView(channel.Read()) == "Hello, sdb!\n");
+  proc->DeleteCheckpoint(later);
+
+  proc->DeleteCheckpoint(id);
+  REQUIRE(proc->GetCheckpoints().empty());
+  REQUIRE_THROWS_AS(proc->RestartFromCheckpoint(id), sdb::Error);
+}
+
+TEST_CASE("Page watchpoints catch accesses to any size of range",
+          "[watchpoint]") {
+  bool      close_on_exec = false;
+  sdb::Pipe channel(close_on_exec);
+  auto      proc = sdb::Process::Launch("targets/watched_buffer", true,
+                                        channel.GetWriteFd());
+  channel.CloseWriteFd();
+
+  proc->Resume();
+  proc->WaitOnSignal();
+  const auto buffer = sdb::FromBytes<std::uint64_t>(channel.Read().data());
+  const auto watch  = [&](const std::uint64_t offset, const std::size_t size,
+                         const sdb::StoppointMode mode) -> sdb::Watchpoint &
+  {
+    auto &watchpoint = proc->CreateWatchpoint(
+        sdb::VirtualAddress{buffer + offset}, mode, size, false);
+    watchpoint.Enable();
+    return watchpoint;
+  };
+
+  // more than the 4 debug registers allow for, and as big as we like
+  auto &byte = watch(200, 1, sdb::StoppointMode::write);
+  for (std::uint64_t offset = 300; offset < 700; offset += 100) {
+    watch(offset, 8, sdb::StoppointMode::write);
+  }
+  auto &page = watch(4096, 4096, sdb::StoppointMode::write);
+  auto &read = watch(8990, 16, sdb::StoppointMode::read_write);
+  REQUIRE_THROWS_AS(watch(0x10000000, 8, sdb::StoppointMode::write),
+                    sdb::Error);
+
+  // stopped after the write, and only by watched accesses
+  const auto require_hit = [&](const sdb::Watchpoint &watchpoint)
+  {
+    proc->Resume();
+    const auto reason = proc->WaitOnSignal();
+    REQUIRE(reason.info == SIGTRAP);
+    REQUIRE(reason.trap_reason == sdb::TrapType::PageWatchpoint);
+    REQUIRE(reason.watchpoint_id == watchpoint.GetId());
+  };
+  require_hit(byte);
+  REQUIRE(byte.PreviousData() == 0);
+  REQUIRE(byte.Data() == 1);
+  require_hit(page);
+  REQUIRE(proc->ReadMemory(sdb::VirtualAddress{buffer + 5000}, 1)[0] ==
+          std::byte{2});
+  require_hit(read);
+
+  // pages the inferior can't read can still be read by us
+  REQUIRE(proc->ReadMemory(sdb::VirtualAddress{buffer + 8990}, 16).size() ==
+          16);
+
+  proc->Resume();
+  const auto reason = proc->WaitOnSignal();
+  REQUIRE(reason.info == SIGTRAP);
+  REQUIRE(reason.trap_reason != sdb::TrapType::PageWatchpoint);
+
+  // every page has its protection back once they're gone
+  std::vector<sdb::Watchpoint::id_type> ids;
+  proc->GetWatchpoints().ForEach([&ids](const sdb::Watchpoint &watchpoint)
+                                 { ids.push_back(watchpoint.GetId()); });
+  for (const auto id : ids) {
+    proc->GetWatchpoints().RemoveById(id);
+  }
+  proc->Resume();
+  REQUIRE(proc->WaitOnSignal().reason == sdb::ProcessState::Exited);
+  REQUIRE(sdb::ToStringView(channel.Read()) == "6");
+}
+
+TEST_CASE("Memory snapshots keep what changed between stops", "[snapshot]") {
+  bool      close_on_exec = false;
+  sdb::Pipe channel(close_on_exec);
+  auto      proc =
+      sdb::Process::Launch("targets/memory", true, channel.GetWriteFd());
+  channel.CloseWriteFd();
+
+  proc->Resume();
+  proc->WaitOnSignal();
+  const auto a_pointer =
+      sdb::VirtualAddress{sdb::FromBytes<std::uint64_t>(channel.Read().data())};
+
+  sdb::MemorySnapshots snapshots(*proc);
+  REQUIRE(snapshots.Take() == 0);
+  const auto page = sdb::VirtualAddress{a_pointer.GetAddress() & ~0xfffull};
+  const auto first_pages = snapshots.ChangedPages(0);
+  REQUIRE(std::find(first_pages.begin(), first_pages.end(), page) !=
+          first_pages.end());
+  const auto arena_size = snapshots.ArenaSize();
+
+  // nothing ran, so nothing changed
+  REQUIRE(snapshots.Take() == 1);
+  REQUIRE(snapshots.ChangedPages(1).empty());
+  REQUIRE(snapshots.ArenaSize() == arena_size);
+
+  proc->Resume();
+  proc->WaitOnSignal();
+  channel.Read();
+  proc->WriteMemory(a_pointer, {sdb::AsBytes(std::uint64_t{0xba5eba11}), 8});
+  REQUIRE(snapshots.Take() == 2);
+
+  const auto changed = snapshots.ChangedPages(2);
+  REQUIRE(std::find(changed.begin(), changed.end(), page) != changed.end());
+  REQUIRE(snapshots.ChangedPages(0, 2) == snapshots.ChangedPages(1, 2));
+  REQUIRE(snapshots.ArenaSize() > arena_size);
+
+  // every snapshot can still be read as it was
+  const auto read_a = [&](const std::size_t index)
+  {
+    const auto data = snapshots.ReadMemory(index, a_pointer, 8);
+    return sdb::FromBytes<std::uint64_t>(data.data());
+  };
+  REQUIRE(read_a(0) == 0xcafecafe);
+  REQUIRE(read_a(1) == 0xcafecafe);
+  REQUIRE(read_a(2) == 0xba5eba11);
+
+  // a page changed and then changed back is the same as it was
+  proc->WriteMemory(a_pointer, {sdb::AsBytes(std::uint64_t{0x1234}), 8});
+  REQUIRE(snapshots.Take() == 3);
+  REQUIRE(snapshots.ChangedPages(3) == std::vector<sdb::VirtualAddress>{page});
+  proc->WriteMemory(a_pointer, {sdb::AsBytes(std::uint64_t{0xba5eba11}), 8});
+  REQUIRE(snapshots.Take() == 4);
+  REQUIRE(read_a(3) == 0x1234);
+  REQUIRE(read_a(4) == 0xba5eba11);
+  REQUIRE(snapshots.ChangedPages(2, 4).empty());
+
+  // code isn't writable, so it isn't captured
+  REQUIRE_THROWS_AS(snapshots.ReadMemory(0, proc->GetPc(), 1), sdb::Error);
+}
+
+TEST_CASE("Event loop reports stops of several processes", "[event_loop]") {
+  sdb::EventLoop loop;
+
+  bool      close_on_exec = false;
+  sdb::Pipe channel(close_on_exec);
+
+  const std::filesystem::path target_path = "targets/hello_sdb";
+
+  auto hello = sdb::Process::Launch(target_path, true, channel.GetWriteFd());
+  channel.CloseWriteFd();
+  const auto endless = sdb::Process::Launch("targets/run_endlessly");
+
+  const auto offset       = GetEntryPointOffset(target_path);
+  const auto load_address = GetLoadAddress(hello->GetPid(), offset);
+  hello->CreateBreakpointSite(load_address).Enable();
+
+  std::vector<std::pair<pid_t, sdb::ProcessState>> stops;
+  const auto on_stop = [&](sdb::Process &process, const sdb::StopReason &reason)
+  { stops.emplace_back(process.GetPid(), reason.reason); };
+  loop.AddProcess(*hello, on_stop);
+  loop.AddProcess(*endless, on_stop);
+
+  hello->Resume();
+  endless->Resume();
+
+  // the breakpoint is hit, while the other process keeps running
+  REQUIRE(loop.RunOnce(std::chrono::seconds(5)) == 1);
+  REQUIRE(stops.size() == 1);
+  REQUIRE(stops[0].first == hello->GetPid());
+  REQUIRE(stops[0].second == sdb::ProcessState::Stopped);
+  REQUIRE(hello->GetPc() == load_address);
+  REQUIRE(endless->state() == sdb::ProcessState::Running);
+
+  // nothing else happens until we time out
+  REQUIRE(loop.RunOnce(std::chrono::milliseconds(10)) == 0);
+
+  // the inferior's output is delivered through the same loop
+  std::string output;
+  loop.AddFd(channel.GetReadFd(),
+             [&](const int fd)
+             {
+               const auto data = channel.Read();
+               if (data.empty()) {
+                 loop.RemoveFd(fd);  // the process has closed its end
+               }
+               output += sdb::ToStringView(data);
+             });
+
+  hello->Resume();
+  while (output.empty() || stops.size() < 2) {
+    REQUIRE(loop.RunOnce(std::chrono::seconds(5)) != 0);
+  }
+  REQUIRE(output == "Hello, sdb!\n");
+  REQUIRE(stops[1].first == hello->GetPid());
+  REQUIRE(stops[1].second == sdb::ProcessState::Exited);
+
+  // and interrupting a running process is just another event
+  kill(endless->GetPid(), SIGSTOP);
+  while (stops.size() < 3) {
+    REQUIRE(loop.RunOnce(std::chrono::seconds(5)) != 0);
+  }
+  REQUIRE(stops[2].first == endless->GetPid());
+  REQUIRE(stops[2].second == sdb::ProcessState::Stopped);
+
+  // a process that dies while it's stopped is reported once, and then the
+  // loop sleeps until it times out rather than waking up for it again
+  kill(endless->GetPid(), SIGKILL);
+  REQUIRE(loop.RunOnce(std::chrono::seconds(5)) == 1);
+  REQUIRE(stops.size() == 4);
+  REQUIRE(stops[3].first == endless->GetPid());
+  REQUIRE(stops[3].second == sdb::ProcessState::Terminated);
+  REQUIRE(loop.RunOnce(std::chrono::milliseconds(10)) == 0);
+}
+
 TEST_CASE("ELF parser works", "[elf]") {
   const auto path = "targets/hello_sdb";
   sdb::Elf   elf(path);
@@ -597,6 +1738,229 @@ TEST_CASE("ELF parser works", "[elf]") {
   REQUIRE(name == "_start");
 }
 
+TEST_CASE("ELF symbols are found by mangled or demangled name", "[elf]") {
+  sdb::Elf   elf("targets/multi_cu");
+  const auto mangled = elf.GetSymbolsByName("_Z12do_somethingv");
+  REQUIRE(mangled.size() == 1);
+  REQUIRE(elf.GetSymbolsByName("do_something()") == mangled);
+  REQUIRE(elf.GetSymbolsByName("main").size() == 1);
+  REQUIRE(elf.GetSymbolsByName("do_something").empty());
+}
+
+TEST_CASE("ELF symbols are found by address", "[elf]") {
+  sdb::Elf   elf("targets/multi_threaded");
+  const auto symbols = elf.GetSymbols();
+  const auto indexed = [](const Elf64_Sym &symbol)
+  {
+    return symbol.st_value != 0 && symbol.st_name != 0 &&
+           ELF64_ST_TYPE(symbol.st_info) != STT_TLS;
+  };
+
+  // the first symbol starting at the address, or else the one that starts
+  // closest before it and reaches past it
+  const auto find_slowly = [&](const std::uint64_t address)
+  {
+    const Elf64_Sym *found = nullptr;
+    for (const auto &symbol : symbols) {
+      if (indexed(symbol) && symbol.st_value == address) {
+        return &symbol;
+      }
+      if (indexed(symbol) && symbol.st_value < address &&
+          symbol.st_value + symbol.st_size > address &&
+          (!found || symbol.st_value >= found->st_value)) {
+        found = &symbol;
+      }
+    }
+    return found;
+  };
+
+  // every address around every symbol, zero-size ones included
+  std::size_t n_found = 0, n_wrong = 0;
+  for (const auto &symbol : symbols) {
+    if (!indexed(symbol)) {
+      continue;
+    }
+    for (const auto address :
+         {symbol.st_value - 1, symbol.st_value, symbol.st_value + 1,
+          symbol.st_value + symbol.st_size / 2,
+          symbol.st_value + symbol.st_size}) {
+      const auto found =
+          elf.GetSymbolContainingAddress(sdb::FileAddress{elf, address});
+      n_wrong += found.value_or(nullptr) != find_slowly(address);
+      n_found += found.has_value();
+    }
+  }
+  REQUIRE(n_found > 0);
+  REQUIRE(n_wrong == 0);
+}
+
+TEST_CASE("ELF sections and segments are found by address", "[elf]") {
+  sdb::Elf elf("targets/multi_threaded");
+  elf.NotifyLoaded(sdb::VirtualAddress{0x10000});
+
+  std::size_t n_sections = 0;
+  for (const auto &section : elf.GetSectionHeaders()) {
+    if ((section.sh_flags & SHF_ALLOC) == 0 || section.sh_size == 0 ||
+        section.sh_type == SHT_NOBITS) {
+      continue;
+    }
+    ++n_sections;
+    const auto last = section.sh_addr + section.sh_size - 1;
+    REQUIRE(elf.GetSectionContainingAddress(
+                sdb::FileAddress{elf, section.sh_addr}) == &section);
+    REQUIRE(elf.GetSectionContainingAddress(sdb::FileAddress{elf, last}) ==
+            &section);
+    // the same again, from the last hit
+    REQUIRE(elf.GetSectionContainingAddress(sdb::FileAddress{elf, last}) ==
+            &section);
+    REQUIRE(elf.GetSectionContainingAddress(
+                sdb::VirtualAddress{0x10000 + section.sh_addr}) == &section);
+    REQUIRE(elf.GetSegmentContainingAddress(
+                sdb::FileAddress{elf, section.sh_addr}) != nullptr);
+  }
+  REQUIRE(n_sections > 0);
+
+  // sections that aren't loaded (i.e .comment) have no addresses
+  REQUIRE(elf.GetSectionContainingAddress(sdb::FileAddress{elf, 1}) ==
+          nullptr);
+  REQUIRE(elf.GetSectionContainingAddress(sdb::VirtualAddress{1}) == nullptr);
+}
+
+TEST_CASE("ELF tables are checked and aligned", "[elf]") {
+  std::ifstream          in("targets/hello_sdb", std::ios::binary);
+  std::vector<std::byte> file;
+  for (char c; in.get(c);) {
+    file.push_back(static_cast<std::byte>(c));
+  }
+  auto header = sdb::FromBytes<Elf64_Ehdr>(file.data());
+
+  const auto open_with_header = [&](const std::vector<std::byte> &contents)
+  {
+    const auto path = std::filesystem::temp_directory_path() / "sdb_elf_test";
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(contents.data()),
+              static_cast<std::streamsize>(contents.size()));
+    out.close();
+    return std::make_unique<sdb::Elf>(path);
+  };
+
+  // section headers moved to an odd offset are copied out to be aligned
+  auto moved = file;
+  moved.resize(moved.size() + 1);
+  const auto headers_size = sizeof(Elf64_Shdr) * header.e_shnum;
+  moved.insert(moved.end(), file.begin() + header.e_shoff,
+               file.begin() + header.e_shoff + headers_size);
+  header.e_shoff = moved.size() - headers_size;
+  std::copy_n(sdb::AsBytes(header), sizeof(header), moved.data());
+
+  const auto elf = open_with_header(moved);
+  const auto sections = elf->GetSectionHeaders();
+  REQUIRE(sections.Size() == header.e_shnum);
+  REQUIRE(reinterpret_cast<std::uintptr_t>(sections.begin()) %
+              alignof(Elf64_Shdr) ==
+          0);
+  REQUIRE(elf->GetSection(".text").has_value());
+  REQUIRE(elf->GetSymbols().Size() > 0);
+  REQUIRE(elf->GetSymbolsByName("main").size() == 1);
+
+  // and tables that don't fit in the file are rejected
+  header.e_shoff = moved.size() - headers_size / 2;
+  std::copy_n(sdb::AsBytes(header), sizeof(header), moved.data());
+  REQUIRE_THROWS_AS(open_with_header(moved), sdb::Error);
+}
+
+TEST_CASE("ELF indexes are cached by build ID", "[elf][dwarf]") {
+  // a cache directory of our own, so the first load builds every index
+  const auto directory =
+      std::filesystem::temp_directory_path() / "sdb_index_cache_test";
+  std::filesystem::remove_all(directory);
+  const auto        previous = std::getenv("XDG_CACHE_HOME");
+  const std::string saved    = previous ? previous : "";
+  setenv("XDG_CACHE_HOME", directory.c_str(), 1);
+  REQUIRE(sdb::IndexCache::Directory() == directory / "sdb");
+
+  const auto lookups = [](const sdb::Elf &elf)
+  {
+    std::vector<std::uint64_t> found;
+    for (const auto name : {"_Z12do_somethingv", "do_something()", "main"}) {
+      found.push_back(elf.GetSymbolsByName(name).at(0)->st_value);
+    }
+    const auto main = sdb::FileAddress{elf, found.back() + 1};
+    found.push_back(elf.GetSymbolContainingAddress(main).value()->st_value);
+    const auto functions = elf.GetDwarf().FindFunctions("do_something");
+    found.push_back(functions.size());
+    found.push_back(functions.at(0).LowPc().GetAddress());
+    return found;
+  };
+  // the cache files by name, with their inodes: a file that's rewritten is
+  // renamed into place, so it gets a new one
+  const auto list_files = [&directory]
+  {
+    std::map<std::string, ino_t> files;
+    for (const auto &entry :
+         std::filesystem::directory_iterator(directory / "sdb")) {
+      struct stat stats;
+      REQUIRE(stat(entry.path().c_str(), &stats) == 0);
+      files[entry.path().filename().string()] = stats.st_ino;
+    }
+    return files;
+  };
+
+  const sdb::Elf built("targets/multi_cu");
+  REQUIRE(built.GetBuildId().Size() > 0);
+  const auto expected = lookups(built);
+  const auto files    = list_files();
+  REQUIRE(files.size() == 3);
+  for (const auto kind : {".symbol-addresses", ".symbol-names", ".functions"}) {
+    REQUIRE(std::any_of(files.begin(), files.end(),
+                        [kind](const auto &file)
+                        {
+                          return file.first.size() > std::strlen(kind) &&
+                                 file.first.substr(file.first.size() -
+                                                   std::strlen(kind)) == kind;
+                        }));
+  }
+
+  // later loads map the files as they are
+  const sdb::Elf cached("targets/multi_cu");
+  REQUIRE(lookups(cached) == expected);
+  REQUIRE(list_files() == files);
+
+  // and files that don't match are ignored, and replaced
+  for (const auto &[name, inode] : files) {
+    std::fstream file(directory / "sdb" / name,
+                      std::ios::binary | std::ios::in | std::ios::out);
+    file.put('x');
+  }
+  const sdb::Elf rebuilt("targets/multi_cu");
+  REQUIRE(lookups(rebuilt) == expected);
+  for (const auto &[name, inode] : list_files()) {
+    REQUIRE(inode != files.at(name));
+  }
+
+  // as are tables that are well formed but can't be looked up in: an index
+  // past the symbol table, or starts out of order
+  const std::vector<std::uint64_t> sorted       = {1, 2, 2, 3, 3, 3};
+  const std::vector<std::uint64_t> unsorted     = {2, 1, 3, 2, 3, 3};
+  const std::vector<std::uint32_t> in_range     = {1, 2};
+  const std::vector<std::uint32_t> out_of_range = {1, 0xffffffff};
+  for (const auto &[addresses, indices] : {std::pair{&sorted, &out_of_range},
+                                           std::pair{&unsorted, &in_range}}) {
+    sdb::IndexCache::Save(built, "symbol-addresses",
+                          {sdb::IndexCache::AsTable(*addresses),
+                           sdb::IndexCache::AsTable(*indices)});
+    const sdb::Elf checked("targets/multi_cu");
+    REQUIRE(lookups(checked) == expected);
+  }
+
+  if (previous) {
+    setenv("XDG_CACHE_HOME", saved.c_str(), 1);
+  } else {
+    unsetenv("XDG_CACHE_HOME");
+  }
+  std::filesystem::remove_all(directory);
+}
+
 TEST_CASE("Correct DWARF language", "[dwarf]") {
   const auto path = "targets/hello_sdb";
   sdb::Elf   elf(path);
@@ -2,12 +2,16 @@
 #include <editline/readline.h>
 #include <fmt/format.h>
 #include <fmt/ranges.h>
+#include <fstream>
 #include <iostream>
 #include <libsdb/disassembler.hpp>
 #include <libsdb/elf.hpp>
 #include <libsdb/error.hpp>
+#include <libsdb/instruction_trace.hpp>
 #include <libsdb/parse.hpp>
 #include <libsdb/process.hpp>
+#include <libsdb/profiler.hpp>
+#include <libsdb/syscall_trace.hpp>
 #include <libsdb/syscalls.hpp>
 #include <libsdb/target.hpp>
 #include <sstream>
@@ -35,11 +39,15 @@ namespace {
       std::cerr << R"(Available commands:
         breakpoint - Commands for operating on breakpoints
         catchpoint - Commands for operating on catchpoints
+        checkpoint - Commands for operating on checkpoints
         continue - Resume the process
         disassemble - Disassemble machine code to assembly
         memory - Commands for operating on memory
+        record - Record the current thread's steps to a trace file
         register - Commands for operating on registers
+        restart <checkpoint id> - Rerun the process from a checkpoint
         step - Step over a single instruction
+        tracepoint - Commands for operating on tracepoints
         watchpoint - Commands for operating on watchpoints
 )";
     } else if (IsPrefix(args[1], "memory")) {
@@ -56,6 +64,9 @@ namespace {
         enable <id>
         set <address>
         set <address> -h
+        condition <id> <expression>
+        condition <id>
+        ignore <id> <count>
 )";
     } else if (IsPrefix(args[1], "register")) {
       std::cerr << R"(Available commands:
@@ -76,12 +87,41 @@ namespace {
         disable <id>
         enable <id>
         set <address> <write|rw|execute> <size>
+        set <address> <write|rw> <size> -p
+Without -p, up to 32 bytes can be watched, spread over the 4 debug registers.
+With -p, the pages of any size of range are protected instead of using one
+of the 4 debug registers. The process is stopped after a watched access
+)";
+    } else if (IsPrefix(args[1], "tracepoint")) {
+      std::cerr << R"(Available commands:
+        list
+        hits
+        delete <id>
+        disable <id>
+        enable <id>
+        set <address>
+)";
+    } else if (IsPrefix(args[1], "record")) {
+      std::cerr << R"(Usage: record <trace file> [options]
+        -n <number of steps> (default 1048576)
+        -u <address to stop at>
+        -b step a block (up to the next branch taken) at a time
+Recording also stops at enabled breakpoints. Read the trace back with
+`sdb step-dump <trace file>`
 )";
     } else if (IsPrefix(args[1], "catchpoint")) {
       std::cerr << R"(Available commands:
         syscall
         syscall none
         syscall <list of syscall IDs or names>
+)";
+    } else if (IsPrefix(args[1], "checkpoint")) {
+      std::cerr << R"(Available commands:
+        (none) create a checkpoint of the process as it is now
+        list
+        delete <id>
+Checkpoints are frozen forks of the process; `restart <id>` carries on from
+one with a fresh fork, keeping breakpoints and the loaded symbols
 )";
     } else {
       std::cerr << "No help available for " << args[1] << '\n';
@@ -118,27 +158,51 @@ namespace {
                              const sdb::StopReason &stop_reason) {
     // for software breakpoints, find the breakpoint site corresponding to the
     // current program counter and generate a string containing the site's ID
+    const auto describe_site = [](const sdb::BreakpointSite &site)
+    {
+      auto message = fmt::format(" breakpoint {})", site.GetId());
+      if (const auto &error = site.GetConditionError()) {
+        message += fmt::format("\nCould not evaluate its condition: {}",
+                               *error);
+      }
+      return message;
+    };
     if (stop_reason.trap_reason == sdb::TrapType::SoftwareBreakpoint) {
-      const auto &site =
-          process.GetBreakpointSites().GetByAddress(process.GetPc());
-      return fmt::format(" breakpoint {})", site.GetId());
+      return describe_site(
+          process.GetBreakpointSites().GetByAddress(process.GetPc()));
     }
 
-    if (stop_reason.trap_reason == sdb::TrapType::HardwareBreakpoint) {
-      const auto id = process.GetCurrentHardwareStoppoint();
+    if (stop_reason.trap_reason == sdb::TrapType::HardwareBreakpoint ||
+        stop_reason.trap_reason == sdb::TrapType::PageWatchpoint) {
+      std::variant<sdb::BreakpointSite::id_type, sdb::Watchpoint::id_type> id;
+      if (stop_reason.watchpoint_id) {
+        id.emplace<1>(*stop_reason.watchpoint_id);
+      } else {
+        id = process.GetCurrentHardwareStoppoint();
+      }
 
       // hardware breakpoint site
       if (id.index() == 0) {
-        const auto &site =
-            process.GetBreakpointSites().GetById(std::get<0>(id));
-        return fmt::format(" breakpoint {})", site.GetId());
+        return describe_site(
+            process.GetBreakpointSites().GetById(std::get<0>(id)));
       }
 
       std::string message;
       const auto &point = process.GetWatchpoints().GetById(std::get<1>(id));
       message += fmt::format(" (watchpoint {})", point.GetId());
 
-      if (point.Data() == point.PreviousData()) {
+      // a range too big for one value is shown as its bytes
+      if (point.GetSize() > 8) {
+        const auto &contents = point.Contents();
+        const auto &previous = point.PreviousContents();
+        if (contents == previous) {
+          message += fmt::format("\nValue: {:02x}", fmt::join(contents, " "));
+        } else {
+          message += fmt::format("\nOld value {:02x}\nNew value {:02x}",
+                                 fmt::join(previous, " "),
+                                 fmt::join(contents, " "));
+        }
+      } else if (point.Data() == point.PreviousData()) {
         message += fmt::format("\nValue: {:#x}", point.Data());
       } else {
         message += fmt::format("\nOld value {:#x}\nNew value {:#x}",
@@ -213,9 +277,9 @@ namespace {
   }
 
 
-  void PrintDisassembly(sdb::Process &process, sdb::VirtualAddress address,
+  void PrintDisassembly(sdb::Target &target, sdb::VirtualAddress address,
                         const std::size_t n_instructions) {
-    const sdb::Disassembler disassembler(process);
+    const sdb::Disassembler disassembler(target);
     const auto instructions = disassembler.Disassemble(n_instructions, address);
     for (const auto &[address, text] : instructions) {
       // add padding for vertical alignment
@@ -226,7 +290,7 @@ namespace {
   void HandleStop(sdb::Target &target, const sdb::StopReason &reason) {
     PrintStopReason(target, reason);
     if (reason.reason == sdb::ProcessState::Stopped) {
-      PrintDisassembly(target.GetProcess(), target.GetProcess().GetPc(), 5);
+      PrintDisassembly(target, target.GetProcess().GetPc(), 5);
     }
   }
 
@@ -344,7 +408,7 @@ namespace {
   }
 
 
-  void HandleMemoryReadCommand(const sdb::Process             &process,
+  void HandleMemoryReadCommand(const sdb::Target              &target,
                                const std::vector<std::string> &args) {
     const auto address = sdb::ToIntegral<std::uint64_t>(args[2], 16);
     if (!address) {
@@ -360,7 +424,7 @@ namespace {
       n_bytes = *bytes_arg;
     }
 
-    auto data = process.ReadMemory(sdb::VirtualAddress{*address}, n_bytes);
+    auto data = target.ReadMemory(sdb::VirtualAddress{*address}, n_bytes);
 
     // iterate 16 bytes at a time
     for (std::size_t i = 0; i < data.size(); i += 16) {
@@ -401,7 +465,7 @@ namespace {
                         {data.data(), data.size()});
   }
 
-  void HandleMemoryCommand(sdb::Process                   &process,
+  void HandleMemoryCommand(sdb::Target                    &target,
                            const std::vector<std::string> &args) {
     if (args.size() < 3) {
       PrintHelp({"help", "memory"});
@@ -409,9 +473,9 @@ namespace {
     }
 
     if (IsPrefix(args[1], "read")) {
-      HandleMemoryReadCommand(process, args);
+      HandleMemoryReadCommand(target, args);
     } else if (IsPrefix(args[1], "write")) {
-      HandleMemoryWriteCommand(process, args);
+      HandleMemoryWriteCommand(target.GetProcess(), args);
     } else {
       PrintHelp({"help", "memory"});
     }
@@ -438,9 +502,17 @@ namespace {
               if (site.IsInternal()) {
                 return;
               }
-              fmt::print("{}: address - {:#x}, {}\n", site.GetId(),
+              fmt::print("{}: address - {:#x}, {}, hit {} times", site.GetId(),
                          site.Address().GetAddress(),
-                         site.IsEnabled() ? "enabled" : "disabled");
+                         site.IsEnabled() ? "enabled" : "disabled",
+                         site.GetHitCount());
+              if (const auto &condition = site.GetCondition()) {
+                fmt::print(", if {}", condition->Text());
+              }
+              if (site.GetIgnoreCount() != 0) {
+                fmt::print(", ignoring the next {}", site.GetIgnoreCount());
+              }
+              fmt::print("\n");
             });
       }
     }
@@ -488,6 +560,26 @@ namespace {
       process.GetBreakpointSites().GetById(*id).Disable();
     } else if (IsPrefix(command, "delete")) {
       process.GetBreakpointSites().RemoveById(*id);
+    } else if (IsPrefix(command, "condition")) {
+      // the expression may have had spaces in it; without one, the condition
+      // is removed
+      std::string expression;
+      for (auto it = args.begin() + 3; it != args.end(); ++it) {
+        expression += (expression.empty() ? "" : " ") + *it;
+      }
+      auto &site = process.GetBreakpointSites().GetById(*id);
+      if (expression.empty()) {
+        site.SetCondition(std::nullopt);
+      } else {
+        site.SetCondition(sdb::BreakpointCondition::Compile(expression));
+      }
+    } else if (IsPrefix(command, "ignore") && args.size() == 4) {
+      const auto count = sdb::ToIntegral<std::uint64_t>(args[3]);
+      if (!count) {
+        std::cerr << "Breakpoint ignore count should be in decimal\n";
+        return;
+      }
+      process.GetBreakpointSites().GetById(*id).SetIgnoreCount(*count);
     }
   }
 
@@ -514,10 +606,11 @@ namespace {
       process.GetWatchpoints().ForEach(
           [&](const auto &watchpoint)
           {
-            fmt::print("{}: address = {:#x}, mode = {}, size = {}, {}\n",
+            fmt::print("{}: address = {:#x}, mode = {}, size = {}, {}, {}\n",
                        watchpoint.GetId(), watchpoint.GetAddress().GetAddress(),
                        StoppointModeToStr(watchpoint.GetMode()),
                        watchpoint.GetSize(),
+                       watchpoint.IsHardware() ? "hardware" : "page",
                        watchpoint.IsEnabled() ? "enabled" : "disabled");
           });
     }
@@ -525,7 +618,8 @@ namespace {
 
   void HandleWatchpointSet(sdb::Process                   &process,
                            const std::vector<std::string> &args) {
-    if (args.size() != 5) {
+    const bool page = args.size() == 6 && args[5] == "-p";
+    if (args.size() != 5 && !page) {
       PrintHelp({"help", "watchpoint"});
       return;
     }
@@ -552,7 +646,8 @@ namespace {
       mode = sdb::StoppointMode::read_write;
     }
 
-    process.CreateWatchpoint(sdb::VirtualAddress{*address}, mode, *size)
+    process
+        .CreateWatchpoint(sdb::VirtualAddress{*address}, mode, *size, !page)
         .Enable();
   }
 
@@ -594,6 +689,94 @@ namespace {
     }
   }
 
+  void HandleTracepointCommand(sdb::Process                   &process,
+                               const std::vector<std::string> &args) {
+    if (args.size() < 2) {
+      PrintHelp({"help", "tracepoint"});
+      return;
+    }
+
+    const auto &command = args[1];
+
+    if (IsPrefix(command, "list")) {
+      if (process.GetTracepoints().IsEmpty()) {
+        fmt::print("No tracepoints set\n");
+        return;
+      }
+      fmt::print("Current tracepoints:\n");
+      process.GetTracepoints().ForEach(
+          [](const auto &tracepoint)
+          {
+            fmt::print("{}: address - {:#x}, {}, hit {} times\n",
+                       tracepoint.GetId(), tracepoint.Address().GetAddress(),
+                       tracepoint.IsEnabled() ? "enabled" : "disabled",
+                       tracepoint.GetHitCount());
+          });
+      return;
+    }
+
+    if (IsPrefix(command, "hits")) {
+      // the registers that hold a function's arguments, as tracepoints are
+      // usually on function entries
+      for (const auto &hit : process.ReadTracepointHits()) {
+        fmt::print("{:#x}: rdi={:#x} rsi={:#x} rdx={:#x} rcx={:#x} r8={:#x} "
+                   "r9={:#x} rsp={:#x}\n",
+                   hit.address, hit.rdi, hit.rsi, hit.rdx, hit.rcx, hit.r8,
+                   hit.r9, hit.rsp);
+      }
+      if (const auto dropped = process.DroppedTracepointHits()) {
+        fmt::print("{} hits were dropped while the buffer was full\n",
+                   dropped);
+      }
+      return;
+    }
+
+    if (args.size() < 3) {
+      PrintHelp({"help", "tracepoint"});
+      return;
+    }
+
+    if (IsPrefix(command, "set")) {
+      const auto address = sdb::ToIntegral<std::uint64_t>(args[2], 16);
+      if (!address) {
+        fmt::print(stderr,
+                   "Tracepoint command expects address "
+                   "in hexadecimal, prefixed with '0x'\n");
+        return;
+      }
+      process.CreateTracepoint(sdb::VirtualAddress{*address}).Enable();
+      return;
+    }
+
+    const auto id = sdb::ToIntegral<sdb::Tracepoint::id_type>(args[2]);
+    if (!id) {
+      std::cerr << "Tracepoint command expects tracepoint ID in decimal\n";
+      return;
+    }
+
+    if (IsPrefix(command, "enable")) {
+      process.GetTracepoints().GetById(*id).Enable();
+    } else if (IsPrefix(command, "disable")) {
+      process.GetTracepoints().GetById(*id).Disable();
+    } else if (IsPrefix(command, "delete")) {
+      process.GetTracepoints().RemoveById(*id);
+    }
+  }
+
+  // a comma-separated list of syscall IDs or names
+  std::vector<int> ParseSyscallList(const std::string_view list) {
+    auto             syscalls = Split(list, ',');
+    std::vector<int> ids;
+    std::transform(
+        begin(syscalls), end(syscalls), std::back_inserter(ids),
+        [](auto &syscall)
+        {
+          return isdigit(syscall[0]) ? sdb::ToIntegral<int>(syscall).value()
+                                     : sdb::SyscallNameToId(syscall);
+        });
+    return ids;
+  }
+
   void HandleSyscallCatchpointCommand(sdb::Process                   &process,
                                       const std::vector<std::string> &args) {
     sdb::SyscallCatchPolicy policy = sdb::SyscallCatchPolicy::CatchAll();
@@ -601,17 +784,8 @@ namespace {
     if (args.size() == 3 && args[2] == "none") {
       policy = sdb::SyscallCatchPolicy::CatchNone();
     } else if (args.size() >= 3) {
-      auto             syscalls = Split(args[2], ',');
-      std::vector<int> to_catch;
-      std::transform(
-          begin(syscalls), end(syscalls), std::back_inserter(to_catch),
-          [](auto &syscall)
-          {
-            return isdigit(syscall[0]) ? sdb::ToIntegral<int>(syscall).value()
-                                       : sdb::SyscallNameToId(syscall);
-          });
       // catch the specified syscalls
-      policy = sdb::SyscallCatchPolicy::CatchSome(to_catch);
+      policy = sdb::SyscallCatchPolicy::CatchSome(ParseSyscallList(args[2]));
     }
     process.SetSyscallCatchPolicy(std::move(policy));
   }
@@ -628,9 +802,63 @@ namespace {
     }
   }
 
-  void HandleDisassembleCommand(sdb::Process                   &process,
+  void HandleCheckpointCommand(sdb::Process                   &process,
+                               const std::vector<std::string> &args) {
+    if (args.size() == 1) {
+      const auto id = process.CreateCheckpoint();
+      fmt::print("Checkpoint {} created at {:#x}\n", id,
+                 process.GetPc().GetAddress());
+      return;
+    }
+
+    const auto &command = args[1];
+
+    if (IsPrefix(command, "list")) {
+      if (process.GetCheckpoints().empty()) {
+        fmt::print("No checkpoints created\n");
+      } else {
+        fmt::print("Current checkpoints:\n");
+        for (const auto &[id, pid] : process.GetCheckpoints()) {
+          fmt::print("{}: pid - {}\n", id, pid);
+        }
+      }
+      return;
+    }
+
+    if (IsPrefix(command, "delete") && args.size() == 3) {
+      const auto id = sdb::ToIntegral<int>(args[2]);
+      if (!id) {
+        std::cerr << "Checkpoint command expects checkpoint ID in decimal\n";
+        return;
+      }
+      process.DeleteCheckpoint(*id);
+      return;
+    }
+    PrintHelp({"help", "checkpoint"});
+  }
+
+  void HandleRestartCommand(sdb::Target                    &target,
+                            const std::vector<std::string> &args) {
+    if (args.size() != 2) {
+      PrintHelp({"help"});
+      return;
+    }
+    const auto id = sdb::ToIntegral<int>(args[1]);
+    if (!id) {
+      std::cerr << "Restart command expects checkpoint ID in decimal\n";
+      return;
+    }
+
+    auto &process = target.GetProcess();
+    process.RestartFromCheckpoint(*id);
+    fmt::print("Process {} restarted from checkpoint {}\n", process.GetPid(),
+               *id);
+    PrintDisassembly(target, process.GetPc(), 5);
+  }
+
+  void HandleDisassembleCommand(sdb::Target                    &target,
                                 const std::vector<std::string> &args) {
-    auto        address        = process.GetPc();
+    auto        address        = target.GetProcess().GetPc();
     std::size_t n_instructions = 5;
 
     auto it = args.begin() + 1;
@@ -657,7 +885,46 @@ namespace {
         return;
       }
     }
-    PrintDisassembly(process, address, n_instructions);
+    PrintDisassembly(target, address, n_instructions);
+  }
+
+  void HandleRecordCommand(sdb::Target                    &target,
+                           const std::vector<std::string> &args) {
+    if (args.size() < 2) {
+      PrintHelp({"help", "record"});
+      return;
+    }
+
+    sdb::InstructionTraceOptions options;
+    for (auto it = args.begin() + 2; it != args.end(); ++it) {
+      if (*it == "-b") {
+        options.granularity = sdb::StepMode::Block;
+      } else if (*it == "-n" && it + 1 != args.end()) {
+        const auto n_steps = sdb::ToIntegral<std::uint64_t>(*++it);
+        if (!n_steps || *n_steps == 0) {
+          sdb::Error::Send("Invalid number of steps");
+        }
+        options.max_steps = *n_steps;
+      } else if (*it == "-u" && it + 1 != args.end()) {
+        const auto address = sdb::ToIntegral<std::uint64_t>(*++it, 16);
+        if (!address) {
+          sdb::Error::Send("Invalid address format");
+        }
+        options.until = sdb::VirtualAddress{*address};
+      } else {
+        PrintHelp({"help", "record"});
+        return;
+      }
+    }
+
+    const auto &elf    = target.GetElf();
+    const auto  writer = sdb::InstructionTraceWriter::Create(
+        args[1], options.granularity, std::filesystem::absolute(elf.GetPath()),
+        elf.GetLoadBias());
+    const auto result =
+        sdb::RecordInstructionTrace(target.GetProcess(), *writer, options);
+    fmt::print("Recorded {} steps in {}\n", writer->StepCount(), args[1]);
+    HandleStop(target, result.reason);
   }
 
   void HandleCommand(const std::unique_ptr<sdb::Target> &target,
@@ -671,22 +938,30 @@ namespace {
       const auto reason = process->WaitOnSignal();
       HandleStop(*target, reason);
     } else if (IsPrefix(command, "memory")) {
-      HandleMemoryCommand(*process, args);
+      HandleMemoryCommand(*target, args);
     } else if (IsPrefix(command, "register")) {
       HandleRegisterCommand(*process, args);
     } else if (IsPrefix(command, "breakpoint")) {
       HandleBreakpointCommand(*process, args);
     } else if (IsPrefix(command, "watchpoint")) {
       HandleWatchpointCommand(*process, args);
+    } else if (IsPrefix(command, "tracepoint")) {
+      HandleTracepointCommand(*process, args);
     } else if (IsPrefix(command, "step")) {
       const auto reason = process->StepInstruction();
       HandleStop(*target, reason);
+    } else if (IsPrefix(command, "record")) {
+      HandleRecordCommand(*target, args);
     } else if (IsPrefix(command, "help")) {
       PrintHelp(args);
     } else if (IsPrefix(command, "disassemble")) {
-      HandleDisassembleCommand(*process, args);
+      HandleDisassembleCommand(*target, args);
     } else if (IsPrefix(command, "catchpoint")) {
       HandleCatchpointCommand(*process, args);
+    } else if (IsPrefix(command, "checkpoint")) {
+      HandleCheckpointCommand(*process, args);
+    } else if (IsPrefix(command, "restart")) {
+      HandleRestartCommand(*target, args);
     } else {
       std::cerr << "Unknown command\n";
     }
@@ -721,6 +996,195 @@ namespace {
     }
   }
 
+  // prints a syscall trace log, timed from its first record
+  void PrintSyscallTrace(const sdb::SyscallTraceLog &log) {
+    if (log.DroppedRecords() != 0) {
+      fmt::print("({} earlier records were overwritten)\n",
+                 log.DroppedRecords());
+    }
+
+    const auto records = log.Records();
+    if (records.empty()) {
+      return;
+    }
+
+    const auto start = records.front().timestamp_ns;
+    for (const auto &record : records) {
+      const auto seconds = (record.timestamp_ns - start) / 1e9;
+      const auto name    = sdb::SyscallIdToName(record.id);
+      if (record.entry) {
+        fmt::print("{:12.6f} [{}] {}({:#x})\n", seconds, record.tid, name,
+                   fmt::join(record.args, ","));
+      } else {
+        fmt::print("{:12.6f} [{}] {} returned {:#x}\n", seconds, record.tid,
+                   name, record.args[0]);
+      }
+    }
+  }
+
+  // sdb step-dump <trace file>
+  //
+  // prints a trace recorded with `record`, one step per line, with the
+  // registers that changed on the way to it
+  void PrintInstructionTrace(const sdb::InstructionTrace &trace) {
+    sdb::Elf elf(trace.Program());
+    elf.NotifyLoaded(trace.LoadBias());
+
+    // the GPRs by their index in user_regs_struct; the segment bases aren't
+    // registers sdb knows about
+    std::array<std::string_view, sizeof(user_regs_struct) / 8> names;
+    for (const auto &info : sdb::gRegisterInfos) {
+      if (info.type == sdb::RegisterType::GPR &&
+          info.offset < sizeof(user_regs_struct)) {
+        names[info.offset / 8] = info.name;
+      }
+    }
+    names[offsetof(user_regs_struct, fs_base) / 8] = "fs_base";
+    names[offsetof(user_regs_struct, gs_base) / 8] = "gs_base";
+
+    for (const auto &step : trace.Steps()) {
+      fmt::print("{:#x}", step.pc.GetAddress());
+      if (const auto symbol = sdb::SymbolizeAddress(elf, step.pc)) {
+        fmt::print(" ({})", *symbol);
+      }
+      const auto fields = reinterpret_cast<const std::uint64_t *>(&step.regs);
+      for (std::size_t i = 0; i < names.size(); ++i) {
+        if (step.changed & (1u << i)) {
+          fmt::print(" {}={:#x}", names[i], fields[i]);
+        }
+      }
+      fmt::print("\n");
+    }
+  }
+
+  // sdb trace-syscalls [-o <log file>] [-n <records>] [-s <syscalls>] <program>
+  //
+  // Runs the program to completion without stopping at a prompt, recording
+  // its syscalls in a ring buffer that's printed at the end, or left in the
+  // log file for `sdb trace-dump <log file>`
+  int TraceSyscalls(const int argc, char **argv) {
+    std::optional<std::filesystem::path> log_path;
+    std::size_t                          capacity = 1 << 20;
+    sdb::SyscallCatchPolicy policy = sdb::SyscallCatchPolicy::CatchAll();
+
+    int i = 2;
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+      const std::string_view option = argv[i];
+      if (option == "-o") {
+        log_path = argv[i + 1];
+      } else if (option == "-n") {
+        capacity = sdb::ToIntegral<std::size_t>(argv[i + 1]).value_or(0);
+      } else if (option == "-s") {
+        policy = sdb::SyscallCatchPolicy::CatchSome(
+            ParseSyscallList(argv[i + 1]));
+      } else {
+        break;
+      }
+    }
+
+    if (i + 1 != argc) {
+      std::cerr << "Usage: sdb trace-syscalls [-o <log file>] [-n <records>] "
+                   "[-s <syscalls>] <program>\n";
+      return -1;
+    }
+
+    const auto log =
+        log_path ? sdb::SyscallTraceLog::Create(*log_path, capacity)
+                 : sdb::SyscallTraceLog::CreateAnonymous(capacity);
+
+    // handing the policy to Launch lets a list of syscalls be picked out in
+    // the kernel
+    const auto process =
+        sdb::Process::Launch(argv[i], true, std::nullopt, std::move(policy));
+
+    // other stops (i.e signals) don't end the trace, and the signal is
+    // delivered when the process goes on. SIGTRAP is ours (e.g after exec)
+    auto reason = sdb::TraceSyscalls(*process, *log);
+    while (reason.reason == sdb::ProcessState::Stopped) {
+      const auto signal = reason.info == SIGTRAP ? 0 : reason.info;
+      reason = sdb::TraceSyscalls(*process, *log, signal);
+    }
+
+    if (log_path) {
+      fmt::print("Recorded {} syscall events in {}\n", log->TotalRecords(),
+                 log_path->string());
+    } else {
+      PrintSyscallTrace(*log);
+    }
+
+    if (reason.reason == sdb::ProcessState::Exited) {
+      fmt::print("Process {}: exited with status {}\n", process->GetPid(),
+                 static_cast<int>(reason.info));
+    } else {
+      fmt::print("Process {}: terminated by signal {}\n", process->GetPid(),
+                 sigabbrev_np(reason.info));
+    }
+    return 0;
+  }
+
+  // sdb profile -p <pid> [--hz <N>] [--duration <seconds>] [-o <file>]
+  //
+  // Samples the stacks of every thread of a running process, then prints
+  // them folded (one line per distinct stack, with its count) for
+  // flamegraph.pl and the like. The process carries on once we detach
+  int ProfileProcess(const int argc, char **argv) {
+    std::optional<pid_t>                 pid;
+    std::optional<std::filesystem::path> out_path;
+    sdb::ProfileOptions                  options;
+
+    int i = 2;
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+      const std::string_view option = argv[i];
+      if (option == "-p") {
+        pid = sdb::ToIntegral<pid_t>(argv[i + 1]);
+      } else if (option == "--hz") {
+        options.frequency =
+            sdb::ToIntegral<unsigned>(argv[i + 1]).value_or(0);
+      } else if (option == "--duration") {
+        const auto seconds = sdb::ToFloat<double>(argv[i + 1]).value_or(0);
+        options.duration   = std::chrono::milliseconds(
+            static_cast<std::chrono::milliseconds::rep>(seconds * 1000));
+      } else if (option == "-o") {
+        out_path = argv[i + 1];
+      } else {
+        break;
+      }
+    }
+
+    if (i != argc || !pid || options.frequency == 0 ||
+        options.duration.count() <= 0) {
+      std::cerr << "Usage: sdb profile -p <pid> [--hz <samples per second>] "
+                   "[--duration <seconds>] [-o <file>]\n";
+      return -1;
+    }
+
+    const auto target  = sdb::Target::Attach(*pid);
+    const auto profile = sdb::RecordProfile(target->GetProcess(), options);
+    const auto folded  = profile.Fold(target->GetElf());
+
+    std::ofstream out_file;
+    if (out_path) {
+      out_file.open(*out_path);
+      if (!out_file) {
+        sdb::Error::Send("Could not open " + out_path->string());
+      }
+    }
+    auto &out = out_path ? out_file : std::cout;
+    for (const auto &[stack, count] : folded) {
+      out << stack << ' ' << count << '\n';
+    }
+
+    // how much the samples cost the process
+    const std::chrono::duration<double, std::micro> stopped =
+        profile.StoppedTime();
+    const auto n_ticks = std::max<std::size_t>(profile.TickCount(), 1);
+    fmt::print(stderr,
+               "{} stacks sampled in {} ticks, process stopped for {:.1f} us "
+               "a tick\n",
+               profile.SampleCount(), profile.TickCount(),
+               stopped.count() / n_ticks);
+    return 0;
+  }
 }  // namespace
 
 int main(const int argc, char **argv) {
@@ -729,8 +1193,31 @@ int main(const int argc, char **argv) {
     return -1;
   }
 
+  try {
+    if (argv[1] == std::string_view("trace-syscalls")) {
+      return TraceSyscalls(argc, argv);
+    }
+    if (argv[1] == std::string_view("profile")) {
+      return ProfileProcess(argc, argv);
+    }
+    if (argc == 3 && argv[1] == std::string_view("trace-dump")) {
+      PrintSyscallTrace(*sdb::SyscallTraceLog::Open(argv[2]));
+      return 0;
+    }
+    if (argc == 3 && argv[1] == std::string_view("step-dump")) {
+      PrintInstructionTrace(*sdb::InstructionTrace::Open(argv[2]));
+      return 0;
+    }
+  } catch (const sdb::Error &err) {
+    std::cerr << err.what() << '\n';
+    return -1;
+  }
+
   try {
     const auto target = Attach(argc, argv);
+    // the CLI only inspects memory while the inferior is stopped, so it's safe
+    // to cache what we read until the next resume
+    target->GetProcess().SetMemoryCacheEnabled(true);
     // install the signal handler
     g_sdb_process = &target->GetProcess();
     signal(SIGINT, HandleSigint);